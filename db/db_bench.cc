@@ -6,6 +6,9 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <atomic>
+#include <map>
+#include <memory>
 #include <unordered_set>
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
@@ -18,6 +21,7 @@
 #include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
+#include "util/ycsb.h"
 #include "silkstore/silkstore_impl.h"
 
 // Comma-separated list of operations to run in the specified order
@@ -38,6 +42,8 @@
 //      open          -- cost of opening a DB
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
+//      ycsb_load     -- YCSB load phase: insert the --table_size records
+//      ycsba..ycsbf  -- N operations of the YCSB core workload A to F
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -133,6 +139,9 @@ static bool FLAGS_enable_memtable_bloom = false;
 // Ratio of the capacity of the log and the dataset
 static double FLAGS_log_dataset_ratio = 2.0;
 
+// Zipfian constant of the YCSB key distributions
+static double FLAGS_ycsb_zipf_theta = 0.99;
+
 namespace leveldb {
 
 namespace {
@@ -202,6 +211,8 @@ class Stats {
   int64_t bytes_;
   double last_op_finish_;
   Histogram hist_;
+  // Latencies per operation type, e.g. of the YCSB workloads
+  std::map<std::string, Histogram> op_hists_;
   std::string message_;
   bool report_current = false;
   double last_current_report = 0;
@@ -216,6 +227,7 @@ class Stats {
     next_report_ = 100;
     last_op_finish_ = start_;
     hist_.Clear();
+    op_hists_.clear();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
@@ -226,6 +238,9 @@ class Stats {
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    for (const auto& kv : other.op_hists_) {
+      OpHistogram(kv.first).Merge(kv.second);
+    }
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -288,6 +303,10 @@ class Stats {
 
   void AddBytes(int64_t n) { bytes_ += n; }
 
+  void AddOpLatency(const std::string& op, double micros) {
+    OpHistogram(op).Add(micros);
+  }
+
   void Report(const Slice& name) {
     // Pretend at least one op was done in case we are running a benchmark
     // that does not call FinishedSingleOp().
@@ -310,8 +329,26 @@ class Stats {
     if (FLAGS_histogram) {
       fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
     }
+    for (const auto& kv : op_hists_) {
+      const Histogram& h = kv.second;
+      fprintf(stdout,
+              "  %-18s: %10.0f ops; micros avg %.1f p50 %.1f p99 %.1f "
+              "p99.9 %.1f max %.0f\n",
+              kv.first.c_str(), h.Count(), h.Average(), h.Median(),
+              h.Percentile(99), h.Percentile(99.9), h.Max());
+    }
     fflush(stdout);
   }
+
+ private:
+  Histogram& OpHistogram(const std::string& op) {
+    auto it = op_hists_.find(op);
+    if (it == op_hists_.end()) {
+      it = op_hists_.emplace(op, Histogram()).first;
+      it->second.Clear();
+    }
+    return it->second;
+  }
 };
 
 // State shared by all concurrent executions of the same benchmark.
@@ -576,6 +613,11 @@ class Benchmark {
   int reads_;
   int writes_;
   int heap_counter_;
+  int bench_threads_;  // Threads running the current benchmark
+  ycsb::Workload ycsb_workload_;
+  std::unique_ptr<ycsb::KeyChooser> ycsb_key_chooser_;
+  // Numbers the keys inserted by ycsb_load and the run phases
+  ycsb::InsertCounter ycsb_inserts_;
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -669,7 +711,9 @@ class Benchmark {
         value_size_(FLAGS_value_size),
         entries_per_batch_(1),
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-        heap_counter_(0) {
+        heap_counter_(0),
+        bench_threads_(1),
+        ycsb_inserts_(FLAGS_table_size) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -796,6 +840,16 @@ class Benchmark {
       } else if (name == Slice("mixed_workload_fillrandom")) {
         fresh_db = true;
         method = &Benchmark::MixedWorkloadFillRandom;
+      } else if (name == Slice("ycsb_load")) {
+        fresh_db = true;
+        ycsb_inserts_.Reset(FLAGS_table_size);
+        method = &Benchmark::YCSBLoad;
+      } else if (name.size() == 5 && name.starts_with("ycsb") &&
+                 ycsb::GetWorkload(name[4], &ycsb_workload_)) {
+        ycsb_key_chooser_.reset(new ycsb::KeyChooser(
+            ycsb_workload_.distribution, FLAGS_table_size,
+            FLAGS_ycsb_zipf_theta));
+        method = &Benchmark::YCSBRun;
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -820,6 +874,7 @@ class Benchmark {
       }
 
       if (method != nullptr) {
+        bench_threads_ = num_threads;
         RunBenchmark(num_threads, name, method);
       }
     }
@@ -1223,6 +1278,96 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  // Thread i inserts records i, i + n, i + 2n, ... of the --table_size
+  // records.
+  void YCSBLoad(ThreadState* thread) {
+    RandomGenerator gen;
+    int64_t bytes = 0;
+    for (uint64_t k = thread->tid; k < static_cast<uint64_t>(FLAGS_table_size);
+         k += bench_threads_) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016llu", static_cast<unsigned long long>(k));
+      uint64_t start = g_env->NowMicros();
+      Status s = db_->Put(write_options_, key, gen.Generate(value_size_));
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.AddOpLatency(ycsb::OpTypeName(ycsb::kInsert),
+                                 g_env->NowMicros() - start);
+      bytes += value_size_ + strlen(key);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Run phase of ycsb_workload_; expects the records of ycsb_load.
+  void YCSBRun(ThreadState* thread) {
+    const ycsb::Workload& workload = ycsb_workload_;
+    RandomGenerator gen;
+    ReadOptions options;
+    std::string value;
+    int64_t bytes = 0;
+    int reads = 0;
+    int found = 0;
+    for (int i = 0; i < num_; i++) {
+      ycsb::OpType op = ycsb::NextOp(workload, &thread->rand);
+      uint64_t k = op == ycsb::kInsert
+                       ? ycsb_inserts_.Next()
+                       : ycsb_key_chooser_->Next(&thread->rand,
+                                                 ycsb_inserts_.key_count());
+      char key[100];
+      snprintf(key, sizeof(key), "%016llu", static_cast<unsigned long long>(k));
+      uint64_t start = g_env->NowMicros();
+      Status s;
+      switch (op) {
+        case ycsb::kRead:
+        case ycsb::kReadModifyWrite:
+          reads++;
+          if (db_->Get(options, key, &value).ok()) {
+            found++;
+            bytes += strlen(key) + value.size();
+          }
+          if (op == ycsb::kReadModifyWrite) {
+            s = db_->Put(write_options_, key, gen.Generate(value_size_));
+            bytes += strlen(key) + value_size_;
+          }
+          break;
+        case ycsb::kUpdate:
+        case ycsb::kInsert:
+          s = db_->Put(write_options_, key, gen.Generate(value_size_));
+          bytes += strlen(key) + value_size_;
+          if (s.ok() && op == ycsb::kInsert) ycsb_inserts_.Acknowledge(k);
+          break;
+        case ycsb::kScan: {
+          int len = 1 + thread->rand.Uniform(workload.max_scan_length);
+          Iterator* iter = db_->NewIterator(options);
+          iter->Seek(key);
+          for (int j = 0; j < len && iter->Valid(); j++) {
+            bytes += iter->key().size() + iter->value().size();
+            iter->Next();
+          }
+          delete iter;
+          break;
+        }
+        case ycsb::kNumOpTypes:
+          break;
+      }
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.AddOpLatency(ycsb::OpTypeName(op),
+                                 g_env->NowMicros() - start);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(workload %c, %d of %d reads found)",
+             workload.name, found, reads);
+    thread->stats.AddMessage(msg);
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -1430,6 +1575,8 @@ int main(int argc, char** argv) {
       FLAGS_table_size = std::stoi(argv[i] + 13);
     } else if (strncmp(argv[i], "--log_dataset_ratio=", 20) == 0) {
       FLAGS_log_dataset_ratio = std::stof(argv[i] + 20);
+    } else if (sscanf(argv[i], "--ycsb_zipf_theta=%lf%c", &d, &junk) == 1) {
+      FLAGS_ycsb_zipf_theta = d;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
@@ -51,6 +51,7 @@ int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
   //    increasing user key (according to user-supplied comparator)
   //    decreasing sequence number
   //    decreasing type (though sequence# should be enough to disambiguate)
+  if (bytewise_) return CompareBytewiseInternalKeys(akey, bkey);
   int r = user_comparator_->Compare(ExtractUserKey(akey), ExtractUserKey(bkey));
   if (r == 0) {
     const uint64_t anum = DecodeFixed64(akey.data() + akey.size() - 8);
@@ -64,6 +65,18 @@ int InternalKeyComparator::Compare(const Slice& akey, const Slice& bkey) const {
   return r;
 }
 
+KeyCompareKind GetKeyCompareKind(const Comparator* cmp) {
+  if (cmp == BytewiseComparator()) {
+    return kBytewiseKeyCompare;
+  }
+  const InternalKeyComparator* icmp =
+      dynamic_cast<const InternalKeyComparator*>(cmp);
+  if (icmp != nullptr && icmp->bytewise()) {
+    return kBytewiseInternalKeyCompare;
+  }
+  return kVirtualKeyCompare;
+}
+
 void InternalKeyComparator::FindShortestSeparator(std::string* start,
                                                   const Slice& limit) const {
   // Attempt to shorten the user portion of the key
@@ -99,9 +99,11 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
 class InternalKeyComparator : public Comparator {
  private:
   const Comparator* user_comparator_;
+  const bool bytewise_;  // user_comparator_ == BytewiseComparator()
 
  public:
-  explicit InternalKeyComparator(const Comparator* c) : user_comparator_(c) {}
+  explicit InternalKeyComparator(const Comparator* c)
+      : user_comparator_(c), bytewise_(c == BytewiseComparator()) {}
   virtual const char* Name() const;
   virtual int Compare(const Slice& a, const Slice& b) const;
   virtual void FindShortestSeparator(std::string* start,
@@ -110,9 +112,64 @@ class InternalKeyComparator : public Comparator {
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
+  // True if user keys are ordered by BytewiseComparator().
+  bool bytewise() const { return bytewise_; }
+
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
+// Same order as an InternalKeyComparator over BytewiseComparator(), without
+// any virtual call.
+inline int CompareBytewiseInternalKeys(const Slice& a, const Slice& b) {
+  int r = ExtractUserKey(a).compare(ExtractUserKey(b));
+  if (r == 0) {
+    const uint64_t anum = DecodeFixed64(a.data() + a.size() - 8);
+    const uint64_t bnum = DecodeFixed64(b.data() + b.size() - 8);
+    if (anum > bnum) {
+      r = -1;
+    } else if (anum < bnum) {
+      r = +1;
+    }
+  }
+  return r;
+}
+
+// Function objects comparing keys like Comparator::Compare(), for the inner
+// loops that are templated on them.  Nearly every database orders its keys
+// with BytewiseComparator(), so the loops over such keys, or internal keys
+// thereof, are instantiated with the inlined comparisons below and make no
+// virtual call per comparison.
+class VirtualKeyCompare {
+ public:
+  explicit VirtualKeyCompare(const Comparator* cmp) : cmp_(cmp) {}
+  int operator()(const Slice& a, const Slice& b) const {
+    return cmp_->Compare(a, b);
+  }
+
+ private:
+  const Comparator* cmp_;
+};
+
+struct BytewiseKeyCompare {
+  int operator()(const Slice& a, const Slice& b) const { return a.compare(b); }
+};
+
+struct BytewiseInternalKeyCompare {
+  int operator()(const Slice& a, const Slice& b) const {
+    return CompareBytewiseInternalKeys(a, b);
+  }
+};
+
+enum KeyCompareKind {
+  kVirtualKeyCompare,
+  kBytewiseKeyCompare,
+  kBytewiseInternalKeyCompare
+};
+
+// Return which of the above compares keys like cmp.  Called once when an
+// iterator is created, not per comparison.
+KeyCompareKind GetKeyCompareKind(const Comparator* cmp);
+
 // Filter policy wrapper that converts from internal keys to user keys
 class InternalFilterPolicy : public FilterPolicy {
  private:
@@ -106,6 +106,46 @@ TEST(FormatTest, InternalKeyShortestSuccessor) {
             ShortSuccessor(IKey("\xff\xff", 100, kTypeValue)));
 }
 
+// Orders user keys like BytewiseComparator() without being it.
+class OpaqueBytewiseComparator : public Comparator {
+ public:
+  const char* Name() const { return "leveldb.BytewiseComparator"; }
+  int Compare(const Slice& a, const Slice& b) const {
+    return BytewiseComparator()->Compare(a, b);
+  }
+  void FindShortestSeparator(std::string* start, const Slice& limit) const {}
+  void FindShortSuccessor(std::string* key) const {}
+};
+
+static int Sign(int r) { return (r > 0) - (r < 0); }
+
+TEST(FormatTest, BytewiseInternalKeyCompare) {
+  OpaqueBytewiseComparator opaque;
+  InternalKeyComparator bytewise_icmp(BytewiseComparator());
+  InternalKeyComparator opaque_icmp(&opaque);
+  ASSERT_TRUE(bytewise_icmp.bytewise());
+  ASSERT_TRUE(!opaque_icmp.bytewise());
+  ASSERT_EQ(kBytewiseKeyCompare, GetKeyCompareKind(BytewiseComparator()));
+  ASSERT_EQ(kBytewiseInternalKeyCompare, GetKeyCompareKind(&bytewise_icmp));
+  ASSERT_EQ(kVirtualKeyCompare, GetKeyCompareKind(&opaque_icmp));
+  ASSERT_EQ(kVirtualKeyCompare, GetKeyCompareKind(&opaque));
+
+  const std::string keys[] = {
+      IKey("", 100, kTypeValue),      IKey("a", 200, kTypeValue),
+      IKey("a", 100, kTypeValue),     IKey("a", 100, kTypeDeletion),
+      IKey("ab", 300, kTypeValue),    IKey("b", kMaxSequenceNumber, kTypeValue),
+      IKey("\xff", 1, kTypeDeletion)};
+  const int n = sizeof(keys) / sizeof(keys[0]);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < n; j++) {
+      const int expected = (i < j) ? -1 : (i > j) ? +1 : 0;
+      ASSERT_EQ(expected, Sign(opaque_icmp.Compare(keys[i], keys[j])));
+      ASSERT_EQ(expected, Sign(bytewise_icmp.Compare(keys[i], keys[j])));
+      ASSERT_EQ(expected, Sign(CompareBytewiseInternalKeys(keys[i], keys[j])));
+    }
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -278,6 +278,7 @@ class InMemoryEnv : public EnvWrapper {
     if (file == nullptr) {
       file = new FileState();
       file->Ref();
+      *sptr = file;
     }
     *result = new WritableFileImpl(file);
     return Status::OK();
@@ -154,6 +154,18 @@ TEST(MemEnvTest, Misc) {
   delete writable_file;
 }
 
+TEST(MemEnvTest, AppendableFileCreatesFile) {
+  WritableFile* writable_file;
+  uint64_t file_size;
+  ASSERT_OK(env_->CreateDir("/dir"));
+  ASSERT_OK(env_->NewAppendableFile("/dir/f", &writable_file));
+  ASSERT_OK(writable_file->Append("abc"));
+  delete writable_file;
+  ASSERT_TRUE(env_->FileExists("/dir/f"));
+  ASSERT_OK(env_->GetFileSize("/dir/f", &file_size));
+  ASSERT_EQ(3, file_size);
+}
+
 TEST(MemEnvTest, LargeWrite) {
   const size_t kWriteSize = 300 * 1024;
   char* scratch = new char[kWriteSize * 2];
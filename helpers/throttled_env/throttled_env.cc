@@ -0,0 +1,211 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "helpers/throttled_env/throttled_env.h"
+
+#include <string.h>
+
+#include <algorithm>
+
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+DeviceProfile SSDProfile() {
+  DeviceProfile p = {100, 50, 1000, 500 << 20, 400 << 20};
+  return p;
+}
+
+DeviceProfile NVMeProfile() {
+  DeviceProfile p = {20, 10, 100, 3000ull << 20, 2000ull << 20};
+  return p;
+}
+
+DeviceProfile HDDProfile() {
+  DeviceProfile p = {8000, 8000, 10000, 150 << 20, 150 << 20};
+  return p;
+}
+
+bool GetDeviceProfile(const char* name, DeviceProfile* profile) {
+  if (strcmp(name, "ssd") == 0) {
+    *profile = SSDProfile();
+  } else if (strcmp(name, "nvme") == 0) {
+    *profile = NVMeProfile();
+  } else if (strcmp(name, "hdd") == 0) {
+    *profile = HDDProfile();
+  } else {
+    return false;
+  }
+  return true;
+}
+
+namespace {
+
+// Keeps one timeline per direction: a transfer starts once the previous
+// one in the same direction has left the channel, and completes a fixed
+// latency after its last byte.
+class Device {
+ public:
+  Device(Env* env, const DeviceProfile& profile)
+      : env_(env),
+        profile_(profile),
+        read_busy_until_(0),
+        write_busy_until_(0) {}
+
+  void Read(size_t n) {
+    Wait(&read_busy_until_, n, profile_.read_bytes_per_second,
+         profile_.read_latency_micros);
+  }
+
+  void Write(size_t n) {
+    Wait(&write_busy_until_, n, profile_.write_bytes_per_second,
+         profile_.write_latency_micros);
+  }
+
+  void Sync() {
+    Wait(&write_busy_until_, 0, 0,
+         profile_.write_latency_micros + profile_.sync_latency_micros);
+  }
+
+ private:
+  void Wait(uint64_t* busy_until, size_t n, uint64_t bytes_per_second,
+            uint64_t latency_micros) {
+    uint64_t done;
+    {
+      MutexLock l(&mutex_);
+      uint64_t start = std::max(env_->NowMicros(), *busy_until);
+      if (bytes_per_second != 0) {
+        start += static_cast<uint64_t>(n) * 1000000 / bytes_per_second;
+      }
+      *busy_until = start;
+      done = start + latency_micros;
+    }
+    uint64_t now = env_->NowMicros();
+    if (done > now) {
+      env_->SleepForMicroseconds(static_cast<int>(done - now));
+    }
+  }
+
+  Env* const env_;
+  const DeviceProfile profile_;
+  port::Mutex mutex_;
+  uint64_t read_busy_until_ GUARDED_BY(mutex_);
+  uint64_t write_busy_until_ GUARDED_BY(mutex_);
+};
+
+class ThrottledSequentialFile : public SequentialFile {
+ public:
+  ThrottledSequentialFile(SequentialFile* file, Device* device)
+      : file_(file), device_(device) {}
+  ~ThrottledSequentialFile() override { delete file_; }
+
+  Status Read(size_t n, Slice* result, char* scratch) override {
+    Status s = file_->Read(n, result, scratch);
+    if (s.ok()) device_->Read(result->size());
+    return s;
+  }
+
+  Status Skip(uint64_t n) override { return file_->Skip(n); }
+
+ private:
+  SequentialFile* const file_;
+  Device* const device_;
+};
+
+class ThrottledRandomAccessFile : public RandomAccessFile {
+ public:
+  ThrottledRandomAccessFile(RandomAccessFile* file, Device* device)
+      : file_(file), device_(device) {}
+  ~ThrottledRandomAccessFile() override { delete file_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    Status s = file_->Read(offset, n, result, scratch);
+    if (s.ok()) device_->Read(result->size());
+    return s;
+  }
+
+ private:
+  RandomAccessFile* const file_;
+  Device* const device_;
+};
+
+class ThrottledWritableFile : public WritableFile {
+ public:
+  ThrottledWritableFile(WritableFile* file, Device* device)
+      : file_(file), device_(device) {}
+  ~ThrottledWritableFile() override { delete file_; }
+
+  Status Append(const Slice& data) override {
+    Status s = file_->Append(data);
+    if (s.ok()) device_->Write(data.size());
+    return s;
+  }
+
+  Status Close() override { return file_->Close(); }
+  Status Flush() override { return file_->Flush(); }
+
+  Status Sync() override {
+    Status s = file_->Sync();
+    if (s.ok()) device_->Sync();
+    return s;
+  }
+
+ private:
+  WritableFile* const file_;
+  Device* const device_;
+};
+
+class ThrottledEnv : public EnvWrapper {
+ public:
+  ThrottledEnv(Env* base_env, const DeviceProfile& profile)
+      : EnvWrapper(base_env), device_(base_env, profile) {}
+
+  Status NewSequentialFile(const std::string& fname,
+                           SequentialFile** result) override {
+    SequentialFile* file;
+    Status s = target()->NewSequentialFile(fname, &file);
+    *result = s.ok() ? new ThrottledSequentialFile(file, &device_) : nullptr;
+    return s;
+  }
+
+  Status NewRandomAccessFile(const std::string& fname,
+                             RandomAccessFile** result) override {
+    RandomAccessFile* file;
+    Status s = target()->NewRandomAccessFile(fname, &file);
+    *result = s.ok() ? new ThrottledRandomAccessFile(file, &device_) : nullptr;
+    return s;
+  }
+
+  Status NewWritableFile(const std::string& fname,
+                         WritableFile** result) override {
+    WritableFile* file;
+    Status s = target()->NewWritableFile(fname, &file);
+    *result = s.ok() ? new ThrottledWritableFile(file, &device_) : nullptr;
+    return s;
+  }
+
+  Status NewAppendableFile(const std::string& fname,
+                           WritableFile** result) override {
+    WritableFile* file;
+    Status s = target()->NewAppendableFile(fname, &file);
+    *result = s.ok() ? new ThrottledWritableFile(file, &device_) : nullptr;
+    return s;
+  }
+
+ private:
+  Device device_;
+};
+
+}  // namespace
+
+Env* NewThrottledEnv(Env* base_env, const DeviceProfile& profile) {
+  return new ThrottledEnv(base_env, profile);
+}
+
+}  // namespace leveldb
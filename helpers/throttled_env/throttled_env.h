@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_HELPERS_THROTTLED_ENV_THROTTLED_ENV_H_
+#define STORAGE_LEVELDB_HELPERS_THROTTLED_ENV_THROTTLED_ENV_H_
+
+#include <stdint.h>
+
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+class Env;
+
+// Service model of an emulated storage device. Every read or write request
+// pays the fixed latency, and requests in the same direction share the
+// bandwidth in FIFO order. A zero bandwidth means unlimited.
+struct LEVELDB_EXPORT DeviceProfile {
+  uint64_t read_latency_micros;
+  uint64_t write_latency_micros;
+  // Charged by WritableFile::Sync() on top of the write latency.
+  uint64_t sync_latency_micros;
+  uint64_t read_bytes_per_second;
+  uint64_t write_bytes_per_second;
+};
+
+// Rough figures of a SATA SSD, an NVMe SSD and a 7200rpm hard disk.
+LEVELDB_EXPORT DeviceProfile SSDProfile();
+LEVELDB_EXPORT DeviceProfile NVMeProfile();
+LEVELDB_EXPORT DeviceProfile HDDProfile();
+
+// Store the profile named "ssd", "nvme" or "hdd" in *profile. Returns false
+// if there is no such profile.
+LEVELDB_EXPORT bool GetDeviceProfile(const char* name, DeviceProfile* profile);
+
+// Returns a new environment that stores its data in base_env and delays
+// every file read and write as the device described by profile would. All
+// other calls are passed through to base_env undelayed. The caller must
+// delete the result when it is no longer needed.
+// *base_env must remain live while the result is in use.
+LEVELDB_EXPORT Env* NewThrottledEnv(Env* base_env,
+                                    const DeviceProfile& profile);
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_HELPERS_THROTTLED_ENV_THROTTLED_ENV_H_
@@ -0,0 +1,87 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "helpers/throttled_env/throttled_env.h"
+
+#include <string>
+
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+class ThrottledEnvTest {
+ public:
+  ThrottledEnvTest() : base_env_(NewMemEnv(Env::Default())) {
+    base_env_->CreateDir("/dir");
+  }
+  ~ThrottledEnvTest() { delete base_env_; }
+
+  Env* const base_env_;
+};
+
+TEST(ThrottledEnvTest, ProfileNames) {
+  DeviceProfile profile;
+  ASSERT_TRUE(GetDeviceProfile("ssd", &profile));
+  ASSERT_TRUE(GetDeviceProfile("nvme", &profile));
+  ASSERT_TRUE(GetDeviceProfile("hdd", &profile));
+  ASSERT_EQ(HDDProfile().read_latency_micros, profile.read_latency_micros);
+  ASSERT_TRUE(!GetDeviceProfile("tape", &profile));
+}
+
+TEST(ThrottledEnvTest, WriteBandwidth) {
+  DeviceProfile profile = {0, 0, 0, 0, 10 << 20};
+  Env* env = NewThrottledEnv(base_env_, profile);
+  WritableFile* file;
+  ASSERT_OK(env->NewWritableFile("/dir/f", &file));
+  std::string data(256 << 10, 'x');
+  uint64_t start = env->NowMicros();
+  for (int i = 0; i < 4; i++) {
+    ASSERT_OK(file->Append(data));
+  }
+  // 1MB at 10MB/s.
+  ASSERT_GE(env->NowMicros() - start, 100000);
+  ASSERT_OK(file->Close());
+  delete file;
+
+  uint64_t size;
+  ASSERT_OK(base_env_->GetFileSize("/dir/f", &size));
+  ASSERT_EQ(4 * data.size(), size);
+  delete env;
+}
+
+TEST(ThrottledEnvTest, ReadAndSyncLatency) {
+  DeviceProfile profile = {20000, 0, 30000, 0, 0};
+  Env* env = NewThrottledEnv(base_env_, profile);
+  WritableFile* wfile;
+  ASSERT_OK(env->NewWritableFile("/dir/f", &wfile));
+  ASSERT_OK(wfile->Append("hello world"));
+  uint64_t start = env->NowMicros();
+  ASSERT_OK(wfile->Sync());
+  ASSERT_GE(env->NowMicros() - start, 30000);
+  delete wfile;
+
+  RandomAccessFile* rfile;
+  ASSERT_OK(env->NewRandomAccessFile("/dir/f", &rfile));
+  char scratch[16];
+  Slice result;
+  start = env->NowMicros();
+  ASSERT_OK(rfile->Read(0, 5, &result, scratch));
+  ASSERT_EQ("hello", result.ToString());
+  ASSERT_OK(rfile->Read(6, 5, &result, scratch));
+  ASSERT_EQ("world", result.ToString());
+  ASSERT_GE(env->NowMicros() - start, 40000);
+  delete rfile;
+
+  // Metadata calls are not delayed.
+  ASSERT_TRUE(env->FileExists("/dir/f"));
+  ASSERT_OK(env->DeleteFile("/dir/f"));
+  ASSERT_TRUE(!base_env_->FileExists("/dir/f"));
+  delete env;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
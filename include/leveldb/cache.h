@@ -30,6 +30,13 @@ class LEVELDB_EXPORT Cache;
 // of Cache uses a least-recently-used eviction policy.
 LEVELDB_EXPORT Cache* NewLRUCache(size_t capacity);
 
+// Create a new cache with a fixed size capacity.  This implementation
+// evicts with the CLOCK algorithm, so lookups only take a shared lock, and
+// once full only admits entries whose keys are looked up at least as often
+// as those of the entries they would evict, so that large scans do not
+// flush the frequently used entries.
+LEVELDB_EXPORT Cache* NewClockCache(size_t capacity);
+
 class LEVELDB_EXPORT Cache {
  public:
   Cache() = default;
@@ -48,6 +48,14 @@ class LEVELDB_EXPORT FilterPolicy {
   // This method may return true or false if the key was not on the
   // list, but it should aim to return false with a high probability.
   virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const = 0;
+
+  // Return a new policy creating the same kind of filters as this one, but
+  // sized for approximately bits_per_key bits per key, or nullptr if this
+  // policy has no such parameter.  The filters of both policies must be
+  // readable by either of them.  The caller must delete the result.
+  //
+  // The default implementation returns nullptr.
+  virtual const FilterPolicy* NewWithBitsPerKey(int bits_per_key) const;
 };
 
 // Return a new filter policy that uses a bloom filter with approximately
@@ -66,6 +74,32 @@ class LEVELDB_EXPORT FilterPolicy {
 // trailing spaces in keys.
 LEVELDB_EXPORT const FilterPolicy* NewBloomFilterPolicy(int bits_per_key);
 
+// Return a new filter policy whose bloom filters keep all the probes of a
+// key within one 64-byte cache line, so that KeyMayMatch() costs at most one
+// cache miss per filter.  Probes are checked with AVX2 when the CPU supports
+// it.  For the same bits_per_key the false positive rate is slightly higher
+// than that of NewBloomFilterPolicy().
+//
+// Filters created by NewBloomFilterPolicy() are still read correctly by
+// this policy, so it may be switched on for an existing database.
+//
+// The caveats of NewBloomFilterPolicy() about custom comparators apply.
+LEVELDB_EXPORT const FilterPolicy* NewBlockedBloomFilterPolicy(
+    int bits_per_key);
+
+// Return a new filter policy that builds Ribbon filters, static filters that
+// need 20-25% less memory than a bloom filter with the same false positive
+// rate, at the cost of slower construction.  The false positive
+// rate is about that of NewBloomFilterPolicy(bits_per_key).  Suited to
+// filters that are built once over all their keys, such as those of
+// immutable miniruns.
+//
+// Filters created by NewBloomFilterPolicy() and
+// NewBlockedBloomFilterPolicy() are still read correctly by this policy.
+//
+// The caveats of NewBloomFilterPolicy() about custom comparators apply.
+LEVELDB_EXPORT const FilterPolicy* NewRibbonFilterPolicy(int bits_per_key);
+
 class LEVELDB_EXPORT DynamicFilter {
  public:
   virtual ~DynamicFilter();
@@ -15,6 +15,7 @@ class Comparator;
 class Env;
 class FilterPolicy;
 class Logger;
+class PerfContext;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -198,6 +199,95 @@ struct LEVELDB_EXPORT Options {
   // Only used when use_memtable_dynamic_filter is set.
   // Default: 0.1
   double memtable_dynamic_filter_fp_rate;
+
+  // Number of threads used to load segment metadata (footer and run
+  // handles) when the database is opened.  With 0 no warm-up is done and
+  // every segment is opened lazily on first access.
+  // Default: 4
+  int segment_open_threads;
+
+  // Number of threads decoding each NVM memtable log during recovery.
+  // Default: 4
+  int nvmemtable_recovery_threads;
+
+  // Only one out of every leaf_read_sample_rate reads is counted towards
+  // leaf read hotness, weighted accordingly.  1 counts every read.
+  // Default: 1
+  int leaf_read_sample_rate;
+
+  // If non-null, background jobs and write stalls are recorded as a
+  // timeline in Chrome trace_event JSON format to this file.
+  // Default: nullptr
+  const char* event_trace_file;
+
+  // If non-null, a sample of Get, Put, Delete, Write and iterator seeks is
+  // recorded to this file in a binary format that nvm_db_bench can replay.
+  // Default: nullptr
+  const char* op_trace_file;
+
+  // One out of every op_trace_sample_rate operations is traced, on average.
+  // Default: 1
+  int op_trace_sample_rate;
+
+  // If positive, the filter of every minirun is sized individually so that
+  // runs of read-hot leaves get more bits per key and large runs of cold
+  // leaves fewer, averaging about this many bits per key overall.  Requires
+  // a filter_policy whose NewWithBitsPerKey() is implemented, such as the
+  // builtin ones.  With 0 every run uses filter_policy as is.
+  // Default: 0
+  int adaptive_filter_bits_per_key;
+
+  // If positive, every leaf keeps a blocked bloom filter with about this
+  // many bits per key over the keys of all its miniruns, so that a lookup
+  // of a key absent from the leaf probes one filter instead of one per run.
+  // The filter is sized for the leaf to grow to leaf_datasize_thresh and is
+  // dropped, until the leaf is next compacted or split, if it outgrows that.
+  // Default: 0
+  int leaf_filter_bits_per_key;
+
+  // If positive, the runs written to a leaf whose read hotness (see
+  // LeafStatStore) is below this value store their block index and filter
+  // in their segment, right after their data, instead of in the leaf index.
+  // The leaf index then only holds a handle to them, and they are read
+  // through a cache of metadata_cache_size bytes when the run is looked up.
+  // Leaf index memory thus scales with the read-hot part of the data; runs
+  // move between the two tiers when they are rewritten by merges,
+  // compactions or garbage collection.
+  // Default: 0
+  double cold_leaf_read_hotness;
+
+  // Capacity of the cache of spilled minirun metadata, in bytes.
+  // Only used when cold_leaf_read_hotness is positive.
+  // Default: 8MB
+  size_t metadata_cache_size;
+
+  // Number of keys between restart points for delta encoding of the keys
+  // of the block index of a minirun, which is kept in memory in the leaf
+  // index.  Larger values share more of the prefixes of neighbouring keys,
+  // at the cost of a longer scan on each seek within the block index.
+  // Default: 16
+  int index_block_restart_interval;
+
+  // If positive, the results of point lookups that reach the leaf store,
+  // found values and absent keys alike, are kept in a cache of about this
+  // many bytes, consulted by Get right after the memtables.  Writes
+  // invalidate the cached keys, so lookups at any snapshot stay exact.
+  // Default: 0
+  size_t row_cache_size;
+
+  // If non-null, the run data blocks evicted from block_cache are written
+  // to a cache file of secondary_cache_size bytes created at this path,
+  // on NVM or a local SSD, and read back from it on a later block_cache
+  // miss instead of from their segment.  Only the index of the file is
+  // kept in DRAM.  Requires a block_cache.
+  // Default: nullptr
+  const char* secondary_cache_file;
+
+  // Size of the secondary cache file.
+  // Only used when secondary_cache_file is set.
+  // Default: 1GB
+  size_t secondary_cache_size;
+
   // Create an Options object with default values for all fields.
 
   // Nvm map file
@@ -228,8 +318,16 @@ struct LEVELDB_EXPORT ReadOptions {
   // Default: nullptr
   const Snapshot* snapshot;
 
+  // If non-null, the time spent in each stage of the read is added to
+  // *perf_context.  See leveldb/perf_context.h.
+  // Default: nullptr
+  PerfContext* perf_context;
+
   ReadOptions()
-      : verify_checksums(false), fill_cache(true), snapshot(nullptr) {}
+      : verify_checksums(false),
+        fill_cache(true),
+        snapshot(nullptr),
+        perf_context(nullptr) {}
 };
 
 // Options that control write operations
@@ -252,7 +350,12 @@ struct LEVELDB_EXPORT WriteOptions {
   // Default: false
   bool sync;
 
-  WriteOptions() : sync(false) {}
+  // If non-null, the time spent in each stage of the write is added to
+  // *perf_context.  See leveldb/perf_context.h.
+  // Default: nullptr
+  PerfContext* perf_context;
+
+  WriteOptions() : sync(false), perf_context(nullptr) {}
 };
 
 }  // namespace leveldb
@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+#define STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
+
+#include <stdint.h>
+#include <string>
+#include "leveldb/export.h"
+
+namespace leveldb {
+
+// A PerfContext breaks down where a single request spent its time.  Pass
+// one through ReadOptions::perf_context or WriteOptions::perf_context to
+// have the request add its timings to it.  Values accumulate over all
+// requests that use the same context until Reset() is called; a context
+// must not be shared by concurrent requests.
+//
+// Only SilkStore fills in a PerfContext; other DB implementations ignore
+// it.
+struct LEVELDB_EXPORT PerfContext {
+  // Reads
+  uint64_t memtable_nanos;         // Looking up the memtables.
+  uint64_t leaf_index_seek_nanos;  // Locating the leaf holding the key.
+  uint64_t filter_nanos;           // Probing the filters of the runs.
+  uint64_t block_read_nanos;       // Opening runs and reading their blocks.
+  uint64_t decode_nanos;           // Parsing the entry and copying the value.
+  uint64_t runs_searched;          // Runs visited, including filtered ones.
+  uint64_t filter_rejects;         // Runs skipped thanks to their filter.
+  uint64_t leaf_filter_rejects;    // Leaves skipped thanks to their filter.
+
+  // Writes
+  uint64_t write_wait_nanos;      // Waiting for earlier writers and room.
+  uint64_t write_memtable_nanos;  // Inserting into the memtable.
+
+  PerfContext() { Reset(); }
+
+  void Reset();
+
+  // Human-readable "name = value" listing of the non-zero fields.
+  std::string ToString() const;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_INCLUDE_PERF_CONTEXT_H_
@@ -5,8 +5,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <sys/types.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <map>
+#include <memory>
 #include <unordered_set>
 #include <sstream>
+#include "helpers/throttled_env/throttled_env.h"
 #include "leveldb/cache.h"
 #include "leveldb/db.h"
 #include "leveldb/env.h"
@@ -14,10 +20,12 @@
 #include "leveldb/write_batch.h"
 #include "port/port.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
+#include "util/ycsb.h"
 #include "silkstore/silkstore_impl.h"
 
 // Comma-separated list of operations to run in the specified order
@@ -36,8 +44,12 @@
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
 //      open          -- cost of opening a DB
+//      restart       -- cost of closing and recovering the current DB once
+//      replay        -- re-issue the operations of --replay_file
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
+//      ycsb_load     -- YCSB load phase: insert the --table_size records
+//      ycsba..ycsbf  -- N operations of the YCSB core workload A to F
 //   Meta operations:
 //      compact     -- Compact the entire DB
 //      stats       -- Print DB stats
@@ -131,6 +143,10 @@ static int FLAGS_block_size = 0;
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Kind of cache of FLAGS_cache_size bytes: "lru" (see NewLRUCache()) or
+// "clock" (see NewClockCache()).
+static const char* FLAGS_cache_type = "lru";
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
@@ -138,6 +154,36 @@ static int FLAGS_open_files = 0;
 // Negative means use default settings.
 static int FLAGS_bloom_bits = 10;
 
+// Kind of filter built with FLAGS_bloom_bits: "bloom", "blocked_bloom"
+// (see NewBlockedBloomFilterPolicy()) or "ribbon" (see
+// NewRibbonFilterPolicy()).
+static const char* FLAGS_filter_type = "bloom";
+
+// If positive, size every minirun filter by leaf hotness and run size for
+// this many bits per key on average instead of using FLAGS_bloom_bits.
+static int FLAGS_adaptive_filter_bits = 0;
+
+// If positive, keep a filter with this many bits per key over all the runs
+// of each leaf.
+static int FLAGS_leaf_filter_bits = 0;
+
+// If positive, keep the block index and filter of the runs of leaves read
+// less than this often in their segments instead of in the leaf index.
+static double FLAGS_cold_leaf_read_hotness = 0;
+
+// Size of the cache of the block indexes and filters kept in segments.
+static int FLAGS_metadata_cache_size = 8 << 20;
+
+// If positive, size of the cache of point lookup results.
+static int FLAGS_row_cache_size = 0;
+
+// If non-null, file of the secondary cache of the blocks evicted from the
+// block cache.
+static const char* FLAGS_secondary_cache_file = nullptr;
+
+// Size of the secondary cache file.
+static int64_t FLAGS_secondary_cache_size = 1 << 30;
+
 // If true, do not destroy the existing database.  If you set this
 // flag and also specify a benchmark that wants a fresh database, that
 // benchmark will fail.
@@ -165,6 +211,43 @@ static bool FLAGS_enable_memtable_bloom = false;
 // Ratio of the capacity of the log and the dataset
 static double FLAGS_log_dataset_ratio = 2.0;
 
+// Zipfian constant of the YCSB key distributions
+static double FLAGS_ycsb_zipf_theta = 0.99;
+
+// If positive, the YCSB benchmarks run open-loop: operations are issued at
+// this total rate regardless of how long earlier ones take, and latency is
+// measured from the intended start of each operation.
+static double FLAGS_open_loop_qps = 0;
+
+// Arrival schedule of open-loop runs, "poisson" or "constant".
+static const char* FLAGS_open_loop_schedule = "poisson";
+
+// Open-loop latencies are also reported per window of this many seconds.
+static int FLAGS_latency_window_secs = 10;
+
+// Number of threads loading segment metadata when the db is opened
+static int FLAGS_segment_open_threads = 4;
+
+// Number of threads decoding each NVM memtable log during recovery
+static int FLAGS_nvmemtable_recovery_threads = 4;
+
+// If non-null, trace the operations issued by the benchmarks to this file.
+static const char* FLAGS_op_trace_file = nullptr;
+
+// Trace one out of every op_trace_sample_rate operations.
+static int FLAGS_op_trace_sample_rate = 1;
+
+// Operation trace re-issued by the replay benchmark.
+static const char* FLAGS_replay_file = nullptr;
+
+// Replay at this multiple of the traced speed, e.g. 2 issues operations
+// twice as fast as traced.  0 replays as fast as possible.
+static double FLAGS_replay_speed = 1.0;
+
+// Emulate the storage device named by this profile ("ssd", "nvme" or
+// "hdd") by throttling file reads and writes.  Unthrottled if unset.
+static const char* FLAGS_device_profile = nullptr;
+
 namespace leveldb {
 
 namespace {
@@ -234,6 +317,10 @@ class Stats {
   int64_t bytes_;
   double last_op_finish_;
   Histogram hist_;
+  // Latencies per operation type, e.g. of the YCSB workloads
+  std::map<std::string, Histogram> op_hists_;
+  // Latencies per --latency_window_secs since start_ of open-loop runs
+  std::vector<Histogram> window_hists_;
   std::string message_;
   bool report_current = false;
   double last_current_report = 0;
@@ -248,6 +335,8 @@ class Stats {
     next_report_ = 100;
     last_op_finish_ = start_;
     hist_.Clear();
+    op_hists_.clear();
+    window_hists_.clear();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
@@ -259,6 +348,12 @@ class Stats {
 
   void Merge(const Stats& other) {
     hist_.Merge(other.hist_);
+    for (const auto& kv : other.op_hists_) {
+      OpHistogram(kv.first).Merge(kv.second);
+    }
+    for (size_t i = 0; i < other.window_hists_.size(); i++) {
+      WindowHistogram(i).Merge(other.window_hists_[i]);
+    }
     done_ += other.done_;
     bytes_ += other.bytes_;
     seconds_ += other.seconds_;
@@ -322,6 +417,20 @@ class Stats {
 
   void AddBytes(int64_t n) { bytes_ += n; }
 
+  void AddOpLatency(const std::string& op, double micros) {
+    OpHistogram(op).Add(micros);
+  }
+
+  // Record the latency of an operation intended to start at start_micros
+  // in the window containing start_micros.
+  void AddWindowLatency(uint64_t start_micros, double micros) {
+    if (FLAGS_latency_window_secs <= 0) return;
+    double offset = start_micros > start_ ? start_micros - start_ : 0;
+    WindowHistogram(static_cast<size_t>(offset * 1e-6 /
+                                        FLAGS_latency_window_secs))
+        .Add(micros);
+  }
+
   void Report(const Slice& name) {
     // Pretend at least one op was done in case we are running a benchmark
     // that does not call FinishedSingleOp().
@@ -344,8 +453,44 @@ class Stats {
     if (FLAGS_histogram) {
       fprintf(stdout, "Microseconds per op:\n%s\n", hist_.ToString().c_str());
     }
+    for (const auto& kv : op_hists_) {
+      const Histogram& h = kv.second;
+      fprintf(stdout,
+              "  %-18s: %10.0f ops; micros avg %.1f p50 %.1f p99 %.1f "
+              "p99.9 %.1f max %.0f\n",
+              kv.first.c_str(), h.Count(), h.Average(), h.Median(),
+              h.Percentile(99), h.Percentile(99.9), h.Max());
+    }
+    for (size_t i = 0; i < window_hists_.size(); i++) {
+      const Histogram& h = window_hists_[i];
+      if (h.Count() == 0) continue;
+      fprintf(stdout,
+              "  [%5zus, %5zus): %10.0f ops; micros p50 %.1f p99 %.1f "
+              "p99.9 %.1f max %.0f\n",
+              i * FLAGS_latency_window_secs,
+              (i + 1) * FLAGS_latency_window_secs, h.Count(), h.Median(),
+              h.Percentile(99), h.Percentile(99.9), h.Max());
+    }
     fflush(stdout);
   }
+
+ private:
+  Histogram& OpHistogram(const std::string& op) {
+    auto it = op_hists_.find(op);
+    if (it == op_hists_.end()) {
+      it = op_hists_.emplace(op, Histogram()).first;
+      it->second.Clear();
+    }
+    return it->second;
+  }
+
+  Histogram& WindowHistogram(size_t window) {
+    while (window_hists_.size() <= window) {
+      window_hists_.emplace_back();
+      window_hists_.back().Clear();
+    }
+    return window_hists_[window];
+  }
 };
 
 // State shared by all concurrent executions of the same benchmark.
@@ -368,6 +513,38 @@ struct SharedState {
       : cv(&mu), total(total), num_initialized(0), num_done(0), start(false) {}
 };
 
+// Paces the operations of one thread of an open-loop run. The intended
+// start times follow the schedule even when operations fall behind it, so
+// time spent queued behind a stalled operation counts as latency instead
+// of being omitted.
+class OpenLoopPacer {
+ public:
+  OpenLoopPacer(double ops_per_sec, bool poisson, Random* rnd)
+      : mean_gap_micros_(1e6 / ops_per_sec),
+        poisson_(poisson),
+        rnd_(rnd),
+        next_micros_(g_env->NowMicros()) {}
+
+  // Wait until the intended start of the next operation and return it.
+  uint64_t Wait() {
+    uint64_t intended = static_cast<uint64_t>(next_micros_);
+    double gap = mean_gap_micros_;
+    if (poisson_) gap *= -std::log(1 - ycsb::NextDouble(rnd_));
+    next_micros_ += gap;
+    uint64_t now = g_env->NowMicros();
+    if (intended > now) {
+      g_env->SleepForMicroseconds(static_cast<int>(intended - now));
+    }
+    return intended;
+  }
+
+ private:
+  const double mean_gap_micros_;
+  const bool poisson_;
+  Random* const rnd_;
+  double next_micros_;
+};
+
 // Per-thread state for concurrent executions of the same benchmark.
 struct ThreadState {
   int tid;      // 0..n-1 when running in n threads
@@ -599,6 +776,36 @@ class WorkloadMixture {
   }
 };
 
+static const FilterPolicy* NewFilterPolicy() {
+  if (FLAGS_bloom_bits < 0) {
+    return nullptr;
+  }
+  const std::string type = FLAGS_filter_type;
+  if (type == "blocked_bloom") {
+    return NewBlockedBloomFilterPolicy(FLAGS_bloom_bits);
+  } else if (type == "ribbon") {
+    return NewRibbonFilterPolicy(FLAGS_bloom_bits);
+  } else if (type != "bloom") {
+    fprintf(stderr, "unknown filter type '%s'\n", FLAGS_filter_type);
+    exit(1);
+  }
+  return NewBloomFilterPolicy(FLAGS_bloom_bits);
+}
+
+static Cache* NewBlockCache() {
+  if (FLAGS_cache_size < 0) {
+    return nullptr;
+  }
+  const std::string type = FLAGS_cache_type;
+  if (type == "clock") {
+    return NewClockCache(FLAGS_cache_size);
+  } else if (type != "lru") {
+    fprintf(stderr, "unknown cache type '%s'\n", FLAGS_cache_type);
+    exit(1);
+  }
+  return NewLRUCache(FLAGS_cache_size);
+}
+
 class Benchmark {
  private:
   Cache* cache_;
@@ -611,6 +818,12 @@ class Benchmark {
   int reads_;
   int writes_;
   int heap_counter_;
+  int bench_threads_;  // Threads running the current benchmark
+  ycsb::Workload ycsb_workload_;
+  std::unique_ptr<ycsb::KeyChooser> ycsb_key_chooser_;
+  // Numbers the keys inserted by ycsb_load and the run phases
+  ycsb::InsertCounter ycsb_inserts_;
+  std::vector<leveldb::silkstore::TraceRecord> replay_records_;
 
   void PrintHeader() {
     const int kKeySize = 16;
@@ -699,16 +912,16 @@ class Benchmark {
 
  public:
   Benchmark()
-      : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : nullptr),
-        filter_policy_(FLAGS_bloom_bits >= 0
-                           ? NewBloomFilterPolicy(FLAGS_bloom_bits)
-                           : nullptr),
+      : cache_(NewBlockCache()),
+        filter_policy_(NewFilterPolicy()),
         db_(nullptr),
         num_(FLAGS_num),
         value_size_(FLAGS_value_size),
         entries_per_batch_(1),
         reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-        heap_counter_(0) {
+        heap_counter_(0),
+        bench_threads_(1),
+        ycsb_inserts_(FLAGS_table_size) {
     std::vector<std::string> files;
     g_env->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -765,6 +978,10 @@ class Benchmark {
         method = &Benchmark::OpenBench;
         num_ /= 10000;
         if (num_ < 1) num_ = 1;
+      } else if (name == Slice("restart")) {
+        method = &Benchmark::OpenBench;
+        num_ = 1;
+        num_threads = 1;
       } else if (name == Slice("fillseq")) {
         fresh_db = true;
         method = &Benchmark::WriteSeq;
@@ -837,6 +1054,20 @@ class Benchmark {
       } else if (name == Slice("mixed_workload_fillrandom")) {
         fresh_db = true;
         method = &Benchmark::MixedWorkloadFillRandom;
+      } else if (name == Slice("ycsb_load")) {
+        fresh_db = true;
+        ycsb_inserts_.Reset(FLAGS_table_size);
+        method = &Benchmark::YCSBLoad;
+      } else if (name.size() == 5 && name.starts_with("ycsb") &&
+                 ycsb::GetWorkload(name[4], &ycsb_workload_)) {
+        ycsb_key_chooser_.reset(new ycsb::KeyChooser(
+            ycsb_workload_.distribution, FLAGS_table_size,
+            FLAGS_ycsb_zipf_theta));
+        method = &Benchmark::YCSBRun;
+      } else if (name == Slice("replay")) {
+        if (LoadReplayTrace()) {
+          method = &Benchmark::Replay;
+        }
       } else {
         if (name != Slice()) {  // No error message for empty name
           fprintf(stderr, "unknown benchmark '%s'\n", name.ToString().c_str());
@@ -861,6 +1092,7 @@ class Benchmark {
       }
 
       if (method != nullptr) {
+        bench_threads_ = num_threads;
         RunBenchmark(num_threads, name, method);
       }
     }
@@ -1047,16 +1279,31 @@ class Benchmark {
     fprintf(stderr, "maximum_segments_storage_size %lu bytes\n",
             options.maximum_segments_storage_size);
 
+    options.segment_open_threads = FLAGS_segment_open_threads;
+    options.nvmemtable_recovery_threads = FLAGS_nvmemtable_recovery_threads;
+    options.op_trace_file = FLAGS_op_trace_file;
+    options.op_trace_sample_rate = FLAGS_op_trace_sample_rate;
+    options.adaptive_filter_bits_per_key = FLAGS_adaptive_filter_bits;
+    options.leaf_filter_bits_per_key = FLAGS_leaf_filter_bits;
+    options.cold_leaf_read_hotness = FLAGS_cold_leaf_read_hotness;
+    options.metadata_cache_size = FLAGS_metadata_cache_size;
+    options.row_cache_size = FLAGS_row_cache_size;
+    options.secondary_cache_file = FLAGS_secondary_cache_file;
+    options.secondary_cache_size = FLAGS_secondary_cache_size;
     Status s;
+    uint64_t open_start = g_env->NowMicros();
     if (FLAGS_db_type == std::string("silkstore")) {
-      DB::OpenSilkStore(options, FLAGS_db, &db_);
+      s = DB::OpenSilkStore(options, FLAGS_db, &db_);
     } else {
-      DB::Open(options, FLAGS_db, &db_);
+      s = DB::Open(options, FLAGS_db, &db_);
     }
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
       exit(1);
     }
+    // Time from the open call until the db is able to serve requests.
+    fprintf(stdout, "%-12s : %11.3f ms\n", "open-to-serve",
+            (g_env->NowMicros() - open_start) * 1e-3);
   }
 
   void OpenBench(ThreadState* thread) {
@@ -1309,6 +1556,211 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  bool LoadReplayTrace() {
+    if (FLAGS_replay_file == nullptr) {
+      fprintf(stderr, "replay requires --replay_file\n");
+      return false;
+    }
+    Status s = leveldb::silkstore::ReadOpTrace(g_env, FLAGS_replay_file,
+                                               &replay_records_);
+    if (!s.ok()) {
+      fprintf(stderr, "replay error: %s\n", s.ToString().c_str());
+      return false;
+    }
+    return true;
+  }
+
+  // Thread i re-issues the records of the keys that hash to shard i, so
+  // that the operations on a key keep their traced order, at their traced
+  // offsets scaled by --replay_speed, so the threads together follow the
+  // timeline of the trace.  Records without a key (writes of batches and
+  // SeekToFirst) are dealt round robin.
+  void Replay(ThreadState* thread) {
+    using namespace leveldb::silkstore;
+    if (replay_records_.empty()) return;
+    const uint64_t first_micros = replay_records_[0].micros;
+    const uint64_t start = g_env->NowMicros();
+    ReadOptions options;
+    std::string value;
+    WriteBatch batch;
+    int64_t bytes = 0;
+    int found = 0;
+    int lagging = 0;
+    Status s;
+    for (size_t i = 0; i < replay_records_.size(); i++) {
+      const TraceRecord& r = replay_records_[i];
+      const size_t shard =
+          r.key.empty() ? i : Hash(r.key.data(), r.key.size(), 0x7d4a9e31);
+      if (shard % bench_threads_ != static_cast<size_t>(thread->tid)) {
+        continue;
+      }
+      if (FLAGS_replay_speed > 0) {
+        uint64_t due =
+            start + static_cast<uint64_t>((r.micros - first_micros) /
+                                          FLAGS_replay_speed);
+        uint64_t now = g_env->NowMicros();
+        if (now > due + 1000) ++lagging;
+        // Gaps between records may overflow the int of
+        // SleepForMicroseconds(), so sleep at most a second at a time.
+        while (due > now) {
+          g_env->SleepForMicroseconds(
+              static_cast<int>(std::min<uint64_t>(due - now, 1000000)));
+          now = g_env->NowMicros();
+        }
+      }
+      switch (r.type) {
+        case kTraceGet:
+          if (db_->Get(options, r.key, &value).ok()) {
+            found++;
+            bytes += r.key.size() + value.size();
+          }
+          break;
+        case kTracePut:
+          s = db_->Put(write_options_, r.key, r.value);
+          bytes += r.key.size() + r.value.size();
+          break;
+        case kTraceDelete:
+          s = db_->Delete(write_options_, r.key);
+          break;
+        case kTraceWrite:
+          WriteBatchInternal::SetContents(&batch, r.value);
+          s = db_->Write(write_options_, &batch);
+          bytes += r.value.size();
+          break;
+        case kTraceSeek:
+        case kTraceSeekToFirst: {
+          Iterator* iter = db_->NewIterator(options);
+          if (r.type == kTraceSeek) {
+            iter->Seek(r.key);
+          } else {
+            iter->SeekToFirst();
+          }
+          for (uint64_t n = 0; n < r.nexts && iter->Valid(); ++n) {
+            bytes += iter->key().size() + iter->value().size();
+            iter->Next();
+          }
+          delete iter;
+          break;
+        }
+      }
+      if (!s.ok()) {
+        fprintf(stderr, "replay error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d gets found, %d ops behind schedule)",
+             found, lagging);
+    thread->stats.AddMessage(msg);
+  }
+
+  // Returns null unless --open_loop_qps is set.
+  OpenLoopPacer* NewOpenLoopPacer(ThreadState* thread) {
+    if (FLAGS_open_loop_qps <= 0) return nullptr;
+    return new OpenLoopPacer(
+        FLAGS_open_loop_qps / bench_threads_,
+        strcmp(FLAGS_open_loop_schedule, "constant") != 0, &thread->rand);
+  }
+
+  void RecordYCSBLatency(ThreadState* thread, ycsb::OpType op,
+                         uint64_t start, bool open_loop) {
+    double micros = g_env->NowMicros() - start;
+    thread->stats.AddOpLatency(ycsb::OpTypeName(op), micros);
+    if (open_loop) thread->stats.AddWindowLatency(start, micros);
+  }
+
+  // Thread i inserts records i, i + n, i + 2n, ... of the --table_size
+  // records.
+  void YCSBLoad(ThreadState* thread) {
+    RandomGenerator gen;
+    std::unique_ptr<OpenLoopPacer> pacer(NewOpenLoopPacer(thread));
+    int64_t bytes = 0;
+    for (uint64_t k = thread->tid; k < static_cast<uint64_t>(FLAGS_table_size);
+         k += bench_threads_) {
+      char key[100];
+      snprintf(key, sizeof(key), "%016llu", static_cast<unsigned long long>(k));
+      uint64_t start = pacer ? pacer->Wait() : g_env->NowMicros();
+      Status s = db_->Put(write_options_, key, gen.Generate(value_size_));
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      RecordYCSBLatency(thread, ycsb::kInsert, start, pacer != nullptr);
+      bytes += value_size_ + strlen(key);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+  }
+
+  // Run phase of ycsb_workload_; expects the records of ycsb_load.
+  void YCSBRun(ThreadState* thread) {
+    const ycsb::Workload& workload = ycsb_workload_;
+    RandomGenerator gen;
+    std::unique_ptr<OpenLoopPacer> pacer(NewOpenLoopPacer(thread));
+    ReadOptions options;
+    std::string value;
+    int64_t bytes = 0;
+    int reads = 0;
+    int found = 0;
+    for (int i = 0; i < num_; i++) {
+      ycsb::OpType op = ycsb::NextOp(workload, &thread->rand);
+      uint64_t k = op == ycsb::kInsert
+                       ? ycsb_inserts_.Next()
+                       : ycsb_key_chooser_->Next(&thread->rand,
+                                                 ycsb_inserts_.key_count());
+      char key[100];
+      snprintf(key, sizeof(key), "%016llu", static_cast<unsigned long long>(k));
+      uint64_t start = pacer ? pacer->Wait() : g_env->NowMicros();
+      Status s;
+      switch (op) {
+        case ycsb::kRead:
+        case ycsb::kReadModifyWrite:
+          reads++;
+          if (db_->Get(options, key, &value).ok()) {
+            found++;
+            bytes += strlen(key) + value.size();
+          }
+          if (op == ycsb::kReadModifyWrite) {
+            s = db_->Put(write_options_, key, gen.Generate(value_size_));
+            bytes += strlen(key) + value_size_;
+          }
+          break;
+        case ycsb::kUpdate:
+        case ycsb::kInsert:
+          s = db_->Put(write_options_, key, gen.Generate(value_size_));
+          bytes += strlen(key) + value_size_;
+          if (s.ok() && op == ycsb::kInsert) ycsb_inserts_.Acknowledge(k);
+          break;
+        case ycsb::kScan: {
+          int len = 1 + thread->rand.Uniform(workload.max_scan_length);
+          Iterator* iter = db_->NewIterator(options);
+          iter->Seek(key);
+          for (int j = 0; j < len && iter->Valid(); j++) {
+            bytes += iter->key().size() + iter->value().size();
+            iter->Next();
+          }
+          delete iter;
+          break;
+        }
+        case ycsb::kNumOpTypes:
+          break;
+      }
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      RecordYCSBLatency(thread, op, start, pacer != nullptr);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(workload %c, %d of %d reads found)",
+             workload.name, found, reads);
+    thread->stats.AddMessage(msg);
+  }
+
   void DoDelete(ThreadState* thread, bool seq) {
     RandomGenerator gen;
     WriteBatch batch;
@@ -1495,8 +1947,29 @@ int main(int argc, char** argv) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (strncmp(argv[i], "--cache_type=", 13) == 0) {
+      FLAGS_cache_type = argv[i] + 13;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--filter_type=", 14) == 0) {
+      FLAGS_filter_type = argv[i] + 14;
+    } else if (sscanf(argv[i], "--adaptive_filter_bits=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_adaptive_filter_bits = n;
+    } else if (sscanf(argv[i], "--leaf_filter_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_leaf_filter_bits = n;
+    } else if (sscanf(argv[i], "--cold_leaf_read_hotness=%lf%c", &d,
+                      &junk) == 1) {
+      FLAGS_cold_leaf_read_hotness = d;
+    } else if (sscanf(argv[i], "--metadata_cache_size=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_metadata_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
+    } else if (strncmp(argv[i], "--secondary_cache_file=", 23) == 0) {
+      FLAGS_secondary_cache_file = argv[i] + 23;
+    } else if (strncmp(argv[i], "--secondary_cache_size=", 23) == 0) {
+      FLAGS_secondary_cache_size = std::stoll(argv[i] + 23);
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
       FLAGS_open_files = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
@@ -1515,6 +1988,38 @@ int main(int argc, char** argv) {
       FLAGS_table_size = std::stoi(argv[i] + 13);
     } else if (strncmp(argv[i], "--log_dataset_ratio=", 20) == 0) {
       FLAGS_log_dataset_ratio = std::stof(argv[i] + 20);
+    } else if (sscanf(argv[i], "--ycsb_zipf_theta=%lf%c", &d, &junk) == 1) {
+      FLAGS_ycsb_zipf_theta = d;
+    } else if (sscanf(argv[i], "--open_loop_qps=%lf%c", &d, &junk) == 1) {
+      FLAGS_open_loop_qps = d;
+    } else if (strncmp(argv[i], "--open_loop_schedule=", 21) == 0) {
+      FLAGS_open_loop_schedule = argv[i] + 21;
+      if (strcmp(FLAGS_open_loop_schedule, "poisson") != 0 &&
+          strcmp(FLAGS_open_loop_schedule, "constant") != 0) {
+        fprintf(stderr, "unknown open loop schedule '%s'\n",
+                FLAGS_open_loop_schedule);
+        exit(1);
+      }
+    } else if (sscanf(argv[i], "--latency_window_secs=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_latency_window_secs = n;
+    } else if (sscanf(argv[i], "--segment_open_threads=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_segment_open_threads = n;
+    } else if (strncmp(argv[i], "--op_trace_file=", 16) == 0) {
+      FLAGS_op_trace_file = argv[i] + 16;
+    } else if (sscanf(argv[i], "--op_trace_sample_rate=%d%c", &n, &junk) ==
+               1) {
+      FLAGS_op_trace_sample_rate = n;
+    } else if (strncmp(argv[i], "--replay_file=", 14) == 0) {
+      FLAGS_replay_file = argv[i] + 14;
+    } else if (sscanf(argv[i], "--replay_speed=%lf%c", &d, &junk) == 1) {
+      FLAGS_replay_speed = d;
+    } else if (strncmp(argv[i], "--device_profile=", 17) == 0) {
+      FLAGS_device_profile = argv[i] + 17;
+    } else if (sscanf(argv[i], "--nvmemtable_recovery_threads=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_nvmemtable_recovery_threads = n;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
@@ -1522,6 +2027,14 @@ int main(int argc, char** argv) {
   }
 
   leveldb::g_env = leveldb::Env::Default();
+  if (FLAGS_device_profile != nullptr) {
+    leveldb::DeviceProfile profile;
+    if (!leveldb::GetDeviceProfile(FLAGS_device_profile, &profile)) {
+      fprintf(stderr, "Unknown device profile '%s'\n", FLAGS_device_profile);
+      exit(1);
+    }
+    leveldb::g_env = leveldb::NewThrottledEnv(leveldb::g_env, profile);
+  }
 
   // Choose a location for the test database if none given with --db=<path>
   if (FLAGS_db == nullptr) {
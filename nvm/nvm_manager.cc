@@ -58,23 +58,21 @@ Nvmem* NvmManager::allocate(size_t size) {
   return nvm;
 }
 
-std::string NvmManager::getNvmInfo() {
-  std::string info;
-  info += std::to_string(index_) + ",";
-  for (int i = 0; i < memUsage.size(); i++) {
-    info += std::to_string(memUsage[i].first) + ",";
-    info += std::to_string(memUsage[i].second) + ",";
-  }
-  return info;
+size_t NvmManager::getOffset(Nvmem* nvm) {
+  return (char*)nvm->GetBeginAddress() - data_;
+}
+
+size_t NvmManager::getNextOffset() {
+  std::lock_guard<std::mutex> lk(mtx);
+  return index_;
 }
 
-bool NvmManager::recovery(const std::vector<size_t>& records) {
+bool NvmManager::recovery(
+    size_t next_offset, const std::vector<std::pair<size_t, size_t>>& regions) {
+  std::lock_guard<std::mutex> lk(mtx);
   // recover data
-  index_ = records[0];
-  memUsage.clear();
-  for (int i = 1; i < records.size(); i += 2) {
-    memUsage.emplace_back(records[i], records[i + 1]);
-  }
+  index_ = next_offset;
+  memUsage.assign(regions.begin(), regions.end());
   return true;
 }
 
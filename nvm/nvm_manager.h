@@ -32,8 +32,13 @@ class NvmManager {
   Nvmem* allocate(size_t cap = 30 * MB);
   // using to recovery nvm table
   Nvmem* reallocate(size_t offset, size_t cap);
-  std::string getNvmInfo();
-  bool recovery(const std::vector<size_t>& records);
+  // offset of nvm's memory from the beginning of the pool
+  size_t getOffset(Nvmem* nvm);
+  // offset at which the next allocation is attempted
+  size_t getNextOffset();
+  // restore the allocator from the (offset, size) pairs of live regions
+  bool recovery(size_t next_offset,
+                const std::vector<std::pair<size_t, size_t>>& regions);
   void free(char* address);
 };
 
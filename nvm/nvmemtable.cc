@@ -1,7 +1,11 @@
 // Copyright (c) 2011 The LevelDB Authors. All rights reserved.
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
+#include <algorithm>
 #include <iostream>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "db/dbformat.h"
 #include "leveldb/comparator.h"
@@ -141,40 +145,131 @@ bool NvmemTable::AddIndex(Slice key, uint64_t val) {
   return true;
 }
 
-Status NvmemTable::Recovery(SequenceNumber max_sequence) {
-  // ToDo Get the right counters
-  // Because updatecounter is not called in testcase, counters is set to 20
-  int counters = nvmem->GetCounter();
+namespace {
+
+typedef std::vector<std::pair<std::string, uint64_t>> RecoveredChunk;
+
+// Decode the records in [begin, end) of the log starting at base, sort them
+// by user key and keep only the latest record of every key.
+void DecodeRecoveryChunk(uint64_t base, uint64_t begin, uint64_t end,
+                         size_t num_records, RecoveredChunk* chunk) {
+  chunk->reserve(num_records);
+  uint64_t offset = begin;
+  uint32_t key_length;
+  uint32_t value_length;
+  while (offset < end) {
+    const char* key_ptr = GetVarint32Ptr(
+        (char*)(base + offset), (char*)(base + offset + 5), &key_length);
+    chunk->emplace_back(std::string(key_ptr, key_length - 8), base + offset);
+    const char* value_ptr =
+        GetVarint32Ptr(key_ptr + key_length, key_ptr + key_length + 5,
+                       &value_length);
+    offset = value_ptr + value_length - (char*)base;
+  }
+  // Records of the same key keep their log order, so the last one of every
+  // run of equal keys is the newest.
+  std::stable_sort(chunk->begin(), chunk->end(),
+                   [](const RecoveredChunk::value_type& a,
+                      const RecoveredChunk::value_type& b) {
+                     return a.first < b.first;
+                   });
+  size_t out = 0;
+  for (size_t i = 0; i < chunk->size(); ++i) {
+    if (i + 1 < chunk->size() && (*chunk)[i].first == (*chunk)[i + 1].first) {
+      continue;
+    }
+    if (out != i) (*chunk)[out] = std::move((*chunk)[i]);
+    ++out;
+  }
+  chunk->resize(out);
+}
+
+}  // anonymous namespace
+
+Status NvmemTable::Recovery(SequenceNumber* max_sequence, int num_threads) {
+  size_t counters = nvmem->GetCounter();
   uint64_t offset = 16;
   uint64_t address = nvmem->GetBeginAddress();
   uint32_t key_length;
   uint32_t value_length;
   counters_ = counters;
+  index_.clear();
   if (counters > 0) {
     const char* key_ptr = GetVarint32Ptr(
         (char*)(address + offset), (char*)(address + offset + 5), &key_length);
-    std::string key =  // Slice(key_ptr, key_length - 8).ToString();
-        std::string(key_ptr, key_length - 8);
-    max_sequence = SequenceNumber(DecodeFixed64(key_ptr + key_length - 8));
-    max_sequence = (max_sequence >> 8) + counters;
-    // std::cout << "max_sequence: " << max_sequence << "\n";
+    SequenceNumber seq =
+        SequenceNumber(DecodeFixed64(key_ptr + key_length - 8));
+    *max_sequence = (seq >> 8) + counters;
+  }
+  if (num_threads < 1) num_threads = 1;
+  if (counters < static_cast<size_t>(num_threads)) {
+    num_threads = counters > 0 ? counters : 1;
   }
 
-  while (counters--) {
+  // Records are not self-delimiting, so first hop over the length prefixes
+  // to find chunk boundaries that fall on record starts. This only touches
+  // two varints per record; decoding and key copies happen in parallel.
+  size_t records_per_chunk = (counters + num_threads - 1) / num_threads;
+  std::vector<uint64_t> boundaries;
+  std::vector<size_t> chunk_records;
+  boundaries.push_back(offset);
+  for (size_t i = 0; i < counters; ++i) {
     const char* key_ptr = GetVarint32Ptr(
         (char*)(address + offset), (char*)(address + offset + 5), &key_length);
-    std::string key =  // Slice(key_ptr, key_length - 8).ToString();
-        std::string(key_ptr, key_length - 8);
-    AddIndex(key, address + offset);
-    offset += key_length + VarintLength(key_length);
     const char* value_ptr =
-        GetVarint32Ptr((char*)(key_ptr + key_length),
-                       (char*)(key_ptr + key_length + 5), &value_length);
-    offset += value_length + VarintLength(value_length);
+        GetVarint32Ptr(key_ptr + key_length, key_ptr + key_length + 5,
+                       &value_length);
+    offset = value_ptr + value_length - (char*)address;
+    if ((i + 1) % records_per_chunk == 0 || i + 1 == counters) {
+      boundaries.push_back(offset);
+      chunk_records.push_back((i % records_per_chunk) + 1);
+    }
+  }
+
+  size_t num_chunks = chunk_records.size();
+  std::vector<RecoveredChunk> chunks(num_chunks);
+  std::vector<std::thread> thread_pool;
+  thread_pool.reserve(num_chunks);
+  for (size_t i = 1; i < num_chunks; ++i) {
+    thread_pool.emplace_back(DecodeRecoveryChunk, address, boundaries[i],
+                             boundaries[i + 1], chunk_records[i], &chunks[i]);
+  }
+  if (num_chunks > 0) {
+    DecodeRecoveryChunk(address, boundaries[0], boundaries[1],
+                        chunk_records[0], &chunks[0]);
+  }
+  for (auto& thread : thread_pool) {
+    thread.join();
+  }
+
+  // Merge the sorted chunks into the index in key order so that every
+  // insertion is an O(1) append at the end of the tree. For duplicate keys
+  // the record from the latest chunk wins.
+  std::vector<size_t> pos(num_chunks, 0);
+  while (true) {
+    int min_chunk = -1;
+    for (size_t i = 0; i < num_chunks; ++i) {
+      if (pos[i] == chunks[i].size()) continue;
+      if (min_chunk < 0 ||
+          chunks[i][pos[i]].first <= chunks[min_chunk][pos[min_chunk]].first) {
+        min_chunk = i;
+      }
+    }
+    if (min_chunk < 0) break;
+    auto& winner = chunks[min_chunk][pos[min_chunk]];
+    for (size_t i = 0; i < num_chunks; ++i) {
+      if (static_cast<int>(i) != min_chunk && pos[i] < chunks[i].size() &&
+          chunks[i][pos[i]].first == winner.first) {
+        ++pos[i];
+      }
+    }
+    index_.emplace_hint(index_.end(), std::move(winner.first), winner.second);
+    ++pos[min_chunk];
   }
+
+  num_entries_ = counters;
   nvmem->UpdateIndex(offset);
   memory_usage_ = offset;
-  // printf("Recovery Finished ! \n");
   return Status::OK();
 }
 
@@ -214,11 +309,9 @@ bool NvmemTable::Get(const LookupKey& key, std::string* value, Status* s) {
   if (dynamic_filter != nullptr && !dynamic_filter->KeyMayMatch(key.user_key()))
     return false;
   ++searches_;
-  Slice memkey = key.user_key();
-  uint64_t address = 0;
-  bool suc = index_.count(memkey.ToString());
+  Index::const_iterator it = index_.find(key.user_key().ToString());
 
-  if (suc) {
+  if (it != index_.end()) {
     /*  Slice foundkey = NvmGetLengthPrefixedSlice((char *)(address));
      std::cout << "found ! key: "<< foundkey.ToString() <<"\n"; */
     // entry format is:
@@ -231,14 +324,17 @@ bool NvmemTable::Get(const LookupKey& key, std::string* value, Status* s) {
     // Check that it belongs to same user key.  We do not check the
     // sequence number since the Seek() call above should have skipped
     // all entries with overly large sequence numbers.
-    address = index_[memkey.ToString()];
+    const uint64_t address = it->second;
     uint32_t key_length;
     const char* key_ptr =
         GetVarint32Ptr((char*)(address), (char*)(address + 5),
                        &key_length);  //
                                       //  +5: we assume "p" is not corrupted
-    if (comparator_.comparator.user_comparator()->Compare(
-            Slice(key_ptr, key_length - 8), key.user_key()) == 0) {
+    const Slice user_key(key_ptr, key_length - 8);
+    if (comparator_.comparator.bytewise()
+            ? user_key == key.user_key()
+            : comparator_.comparator.user_comparator()->Compare(
+                  user_key, key.user_key()) == 0) {
       // Correct user key
       const uint64_t tag = DecodeFixed64(key_ptr + key_length - 8);
       switch (static_cast<ValueType>(tag & 0xff)) {
@@ -68,7 +68,10 @@ class NvmemTable {
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
   Status AddBatch(const WriteBatch* b);
-  Status Recovery(SequenceNumber max_sequence);
+  // Rebuild the index from the records persisted in nvmem, decoding the
+  // log with num_threads threads. Stores the largest recovered sequence
+  // number in *max_sequence.
+  Status Recovery(SequenceNumber* max_sequence, int num_threads = 1);
   Status AddCounter(size_t added);
   size_t GetCounter();
   bool AddIndex(Slice, uint64_t);
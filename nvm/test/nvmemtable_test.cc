@@ -430,8 +430,72 @@ void Recovery() {
   // nvm->init(4000);
   leveldb::NvmemTable* nvm = new leveldb::NvmemTable(
       cmp, dynamic_filter, nvmem);  // = new  silkstore::NvmemTable();
-  uint64_t seq_num;
-  nvm->Recovery(seq_num);
+  uint64_t seq_num = 0;
+  nvm->Recovery(&seq_num, 4);
+}
+// Recovers a memtable full of overwrites with one and with several threads.
+// With few keys, every chunk boundary splits the versions of a key between
+// chunks, and the newest one must win regardless of the chunking.
+void ParallelRecovery_TEST() {
+  leveldb::InternalKeyComparator cmp(leveldb::BytewiseComparator());
+  leveldb::silkstore::NvmManager* manager = new leveldb::silkstore::NvmManager(
+      "/mnt/NVMSilkstore/nvmtable_recovery_test", GB);
+  size_t asize = 64 * MB;
+  leveldb::silkstore::Nvmem* nvmem = manager->allocate(asize);
+  size_t offset = manager->getOffset(nvmem);
+  leveldb::NvmemTable* table = new leveldb::NvmemTable(cmp, nullptr, nvmem);
+  table->Ref();
+
+  const int kKeys = 37;
+  const int N = 100000;
+  std::map<std::string, std::string> m;
+  for (int i = 0; i < N; i++) {
+    std::string k = "key" + std::to_string(i % kKeys);
+    std::string v = k + "@" + std::to_string(i);
+    m[k] = v;
+    table->Add(i + 1, leveldb::kTypeValue, k, v);
+  }
+  // Make the records visible to recovery, as the write path does.
+  table->AddCounter(N);
+
+  leveldb::SequenceNumber single_max_seq = 0;
+  const int kThreads[] = {1, 2, 3, 8, 64};
+  for (int num_threads : kThreads) {
+    leveldb::NvmemTable* recovered = new leveldb::NvmemTable(
+        cmp, nullptr, manager->reallocate(offset, asize));
+    leveldb::SequenceNumber max_seq = 0;
+    leveldb::Status status = recovered->Recovery(&max_seq, num_threads);
+    if (!status.ok()) {
+      std::cout << "recovery failed " << status.ToString() << "\n";
+      exit(-1);
+    }
+    if (num_threads == 1) {
+      single_max_seq = max_seq;
+    } else if (max_seq != single_max_seq) {
+      std::cout << "recovery with " << num_threads << " threads got max "
+                << "sequence " << max_seq << " instead of " << single_max_seq
+                << "\n";
+      exit(-1);
+    }
+    for (auto& kv : m) {
+      leveldb::LookupKey lookupkey(kv.first, leveldb::kMaxSequenceNumber);
+      std::string res;
+      leveldb::Status s;
+      if (!recovered->Get(lookupkey, &res, &s) || res != kv.second) {
+        std::cout << "recovery with " << num_threads << " threads found "
+                  << res << " instead of " << kv.second << "\n";
+        exit(-1);
+      }
+    }
+    // recovered is leaked: it shares the region of table, which frees it.
+  }
+  if (single_max_seq < N) {
+    std::cout << "recovered max sequence " << single_max_seq << " < " << N
+              << "\n";
+    exit(-1);
+  }
+  table->Unref();
+  std::cout << "  ## PASS Parallel Recovery TEST ## \n";
 }
 }  // namespace nvmemtable_test
 }  // namespace leveldb
@@ -441,6 +505,7 @@ int main(int argc, char** argv) {
   // leveldb::nvmemtable_test::Iterator_TEST();
   // leveldb::nvmemtable_test::Delete_TEST();
   leveldb::nvmemtable_test::Copy_TEST();
+  leveldb::nvmemtable_test::ParallelRecovery_TEST();
 
   // leveldb::nvmemtable_test::WriteData();
   // leveldb::nvmemtable_test::Recovery();
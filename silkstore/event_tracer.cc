@@ -0,0 +1,98 @@
+//
+// Timeline of background jobs and write stalls in the Chrome trace_event
+// format.
+//
+
+#include "silkstore/event_tracer.h"
+
+#include <stdio.h>
+#include <atomic>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace silkstore {
+
+Status EventTracer::Open(Env* env, const std::string& fname,
+                         EventTracer** tracer) {
+  *tracer = nullptr;
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) return s;
+  s = file->Append("[\n");
+  if (!s.ok()) {
+    delete file;
+    return s;
+  }
+  *tracer = new EventTracer(env, file);
+  return s;
+}
+
+EventTracer::EventTracer(Env* env, WritableFile* file)
+    : env_(env),
+      start_micros_(env->NowMicros()),
+      file_(file),
+      first_event_(true) {}
+
+EventTracer::~EventTracer() {
+  Flush();
+  MutexLock l(&file_mutex_);
+  if (status_.ok()) {
+    file_->Append("\n]\n");
+  }
+  file_->Close();
+  delete file_;
+}
+
+int EventTracer::ThreadId() {
+  static std::atomic<int> next_id(1);
+  thread_local int id = next_id.fetch_add(1);
+  return id;
+}
+
+void EventTracer::AddSpan(
+    const char* name, uint64_t start_micros, uint64_t dur_micros,
+    const std::vector<std::pair<const char*, uint64_t>>& args) {
+  std::string event;
+  char buf[200];
+  snprintf(buf, sizeof(buf),
+           "{\"name\": \"%s\", \"cat\": \"silkstore\", \"ph\": \"X\", "
+           "\"ts\": %llu, \"dur\": %llu, \"pid\": 1, \"tid\": %d, \"args\": {",
+           name,
+           static_cast<unsigned long long>(
+               start_micros >= start_micros_ ? start_micros - start_micros_
+                                             : 0),
+           static_cast<unsigned long long>(dur_micros), ThreadId());
+  event.append(buf);
+  for (size_t i = 0; i < args.size(); ++i) {
+    snprintf(buf, sizeof(buf), "%s\"%s\": %llu", i == 0 ? "" : ", ",
+             args[i].first, static_cast<unsigned long long>(args[i].second));
+    event.append(buf);
+  }
+  event.append("}}");
+
+  MutexLock l(&mutex_);
+  if (!first_event_) {
+    pending_.append(",\n");
+  }
+  first_event_ = false;
+  pending_.append(event);
+}
+
+void EventTracer::Flush() {
+  MutexLock file_lock(&file_mutex_);
+  std::string events;
+  {
+    MutexLock l(&mutex_);
+    events.swap(pending_);
+  }
+  if (!status_.ok() || events.empty()) return;
+  status_ = file_->Append(events);
+  // Keep the file readable while the DB is running.
+  if (status_.ok()) {
+    status_ = file_->Flush();
+  }
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
@@ -0,0 +1,110 @@
+//
+// Timeline of background jobs and write stalls in the Chrome trace_event
+// format (load the file in chrome://tracing or Perfetto).
+//
+
+#ifndef SILKSTORE_EVENT_TRACER_H_
+#define SILKSTORE_EVENT_TRACER_H_
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// EventTracer writes complete ("ph": "X") events to a file. The file is
+// a JSON array that is closed when the tracer is deleted; the trace
+// viewers also accept the unterminated array left behind by a crash.
+//
+// Spans may end with the DB mutex held, so AddSpan() only buffers the
+// event; Flush() writes the buffered events, and is called by background
+// threads once they released the DB mutex.
+class EventTracer {
+ public:
+  // Create a tracer writing to fname, replacing any existing file.
+  static Status Open(Env* env, const std::string& fname, EventTracer** tracer);
+
+  EventTracer(const EventTracer&) = delete;
+  EventTracer& operator=(const EventTracer&) = delete;
+
+  ~EventTracer();
+
+  // Record a span named name that started at start_micros (Env::NowMicros)
+  // and lasted dur_micros on the calling thread. args are shown as the
+  // arguments of the event.
+  void AddSpan(const char* name, uint64_t start_micros, uint64_t dur_micros,
+               const std::vector<std::pair<const char*, uint64_t>>& args);
+
+  // Write the events buffered so far to the file.
+  void Flush();
+
+  Env* env() const { return env_; }
+
+ private:
+  EventTracer(Env* env, WritableFile* file);
+
+  // Small sequential id of the calling thread, used as the trace tid.
+  static int ThreadId();
+
+  Env* const env_;
+  const uint64_t start_micros_;
+  // Held while writing to the file, so that AddSpan() never waits on I/O.
+  port::Mutex file_mutex_;
+  WritableFile* file_ GUARDED_BY(file_mutex_);
+  Status status_ GUARDED_BY(file_mutex_);
+  port::Mutex mutex_;
+  // Events not written yet, each preceded by its separator.
+  std::string pending_ GUARDED_BY(mutex_);
+  bool first_event_ GUARDED_BY(mutex_);
+};
+
+// Records the lifetime of a TraceSpan as one event of a tracer. A null
+// tracer disables the span, so call sites need no checks.
+class TraceSpan {
+ public:
+  TraceSpan(EventTracer* tracer, const char* name)
+      : tracer_(tracer),
+        name_(name),
+        start_micros_(tracer != nullptr ? tracer->env()->NowMicros() : 0) {}
+
+  TraceSpan(const TraceSpan&) = delete;
+  TraceSpan& operator=(const TraceSpan&) = delete;
+
+  ~TraceSpan() {
+    if (tracer_ != nullptr) {
+      tracer_->AddSpan(name_, start_micros_,
+                       tracer_->env()->NowMicros() - start_micros_, args_);
+    }
+  }
+
+  // Attach an argument, e.g. bytes or leaves, to the event. Setting the
+  // same key again overwrites it.
+  void SetArg(const char* key, uint64_t value) {
+    if (tracer_ == nullptr) return;
+    for (auto& arg : args_) {
+      if (arg.first == key) {
+        arg.second = value;
+        return;
+      }
+    }
+    args_.emplace_back(key, value);
+  }
+
+ private:
+  EventTracer* const tracer_;
+  const char* const name_;
+  const uint64_t start_micros_;
+  std::vector<std::pair<const char*, uint64_t>> args_;
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_EVENT_TRACER_H_
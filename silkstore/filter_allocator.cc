@@ -0,0 +1,82 @@
+//
+// Per-minirun filter sizing from leaf read hotness and run size.
+//
+
+#include "silkstore/filter_allocator.h"
+
+#include <math.h>
+#include <algorithm>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace silkstore {
+
+namespace {
+
+// c in exp(-c * b), the false positive rate of a bloom filter with b bits
+// per key.
+const double kFalsePositiveExponent = 0.4805;  // ln(2)^2
+
+// Weight left to the runs built before the last one in the mean estimate.
+const double kScoreDecay = 0.99;
+
+// Added to the read hotness so that never read leaves are comparable.
+const double kHotnessPrior = 1.0;
+
+}  // namespace
+
+const int FilterAllocator::kMinBitsPerKey;
+const int FilterAllocator::kMaxBitsPerKey;
+
+FilterAllocator::FilterAllocator(const FilterPolicy* user_policy, int budget)
+    : budget_(budget),
+      weight_sum_(0),
+      score_sum_(0),
+      keys_allocated_(0),
+      bits_allocated_(0) {
+  if (user_policy == nullptr || budget <= 0) return;
+  for (int b = kMinBitsPerKey; b <= kMaxBitsPerKey; ++b) {
+    const FilterPolicy* p = user_policy->NewWithBitsPerKey(b);
+    if (p == nullptr) {
+      user_policies_.clear();
+      policies_.clear();
+      return;
+    }
+    user_policies_.emplace_back(p);
+    policies_.emplace_back(new InternalFilterPolicy(p));
+  }
+}
+
+int FilterAllocator::BitsPerKeyForRun(double leaf_read_hotness,
+                                      uint64_t num_keys) {
+  const double n = static_cast<double>(std::max<uint64_t>(num_keys, 1));
+  const double score =
+      log((std::max(leaf_read_hotness, 0.0) + kHotnessPrior) / n);
+  MutexLock l(&mutex_);
+  weight_sum_ = weight_sum_ * kScoreDecay + n;
+  score_sum_ = score_sum_ * kScoreDecay + n * score;
+  const double mean = score_sum_ / weight_sum_;
+  int bits = static_cast<int>(
+      lround(budget_ + (score - mean) / kFalsePositiveExponent));
+  bits = std::min(std::max(bits, kMinBitsPerKey), kMaxBitsPerKey);
+  keys_allocated_ += num_keys;
+  bits_allocated_ += num_keys * bits;
+  return bits;
+}
+
+const FilterPolicy* FilterAllocator::PolicyForRun(double leaf_read_hotness,
+                                                  uint64_t num_keys) {
+  if (!enabled()) return nullptr;
+  const int bits = BitsPerKeyForRun(leaf_read_hotness, num_keys);
+  return policies_[bits - kMinBitsPerKey].get();
+}
+
+double FilterAllocator::AverageBitsPerKey() const {
+  MutexLock l(&mutex_);
+  if (keys_allocated_ == 0) return budget_;
+  return static_cast<double>(bits_allocated_) / keys_allocated_;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
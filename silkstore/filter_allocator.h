@@ -0,0 +1,79 @@
+//
+// Per-minirun filter sizing from leaf read hotness and run size.
+//
+
+#ifndef SILKSTORE_FILTER_ALLOCATOR_H_
+#define SILKSTORE_FILTER_ALLOCATOR_H_
+
+#include <stdint.h>
+#include <memory>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/filter_policy.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// FilterAllocator picks the bits per key of each minirun filter so that the
+// expected number of false positive run reads per lookup is minimized for a
+// given average bits per key [Dayan et al., Monkey, SIGMOD 2017].
+//
+// A lookup of an absent key, the case filters exist for, probes every run
+// of its leaf, so run r is probed about as often as its leaf is read (h_r)
+// and holds n_r keys.  With a bloom false positive rate of exp(-c * b) for
+// b bits per key, c = ln(2)^2, the optimal allocation is
+//    b_r = budget + (ln(h_r / n_r) - mean) / c
+// where mean is the n-weighted mean of ln(h / n) over all runs: large runs
+// of cold leaves, which are mostly the old compacted ones, give bits to
+// small runs of hot leaves.  Since runs are immutable, mean is estimated
+// from the recently built runs.
+//
+// Thread-safe.
+class FilterAllocator {
+ public:
+  static const int kMinBitsPerKey = 1;
+  static const int kMaxBitsPerKey = 30;
+
+  // Sizes the filters of user_policy for an average of budget bits per key.
+  // Disabled, with PolicyForRun() always returning nullptr, if budget is not
+  // positive or user_policy does not implement NewWithBitsPerKey().
+  FilterAllocator(const FilterPolicy* user_policy, int budget);
+
+  FilterAllocator(const FilterAllocator&) = delete;
+  FilterAllocator& operator=(const FilterAllocator&) = delete;
+
+  bool enabled() const { return !policies_.empty(); }
+
+  // Bits per key for a run of num_keys keys in a leaf of the given read
+  // hotness (see LeafStatStore::LeafStat), and records the run in the
+  // estimate of the mean.
+  int BitsPerKeyForRun(double leaf_read_hotness, uint64_t num_keys);
+
+  // Filter policy on internal keys for such a run, or nullptr if disabled.
+  const FilterPolicy* PolicyForRun(double leaf_read_hotness,
+                                   uint64_t num_keys);
+
+  // Average bits per key allocated so far.
+  double AverageBitsPerKey() const;
+
+ private:
+  const int budget_;
+  std::vector<std::unique_ptr<const FilterPolicy>> user_policies_;
+  // policies_[b - kMinBitsPerKey] has b bits per key.
+  std::vector<std::unique_ptr<InternalFilterPolicy>> policies_;
+
+  mutable port::Mutex mutex_;
+  // Exponentially decayed sums of n and n * ln(h / n) over built runs.
+  double weight_sum_ GUARDED_BY(mutex_);
+  double score_sum_ GUARDED_BY(mutex_);
+  uint64_t keys_allocated_ GUARDED_BY(mutex_);
+  uint64_t bits_allocated_ GUARDED_BY(mutex_);
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_FILTER_ALLOCATOR_H_
@@ -0,0 +1,116 @@
+//
+// Aggregate filter over the user keys of all the miniruns of a leaf.
+//
+
+#include "silkstore/leaf_filter.h"
+
+#include "util/blocked_bloom.h"
+#include "util/coding.h"
+#include "util/murmur.h"
+
+namespace leveldb {
+namespace silkstore {
+
+namespace {
+
+using blocked_bloom::kLineBytes;
+using blocked_bloom::kMaxProbes;
+
+const size_t kTrailerSize = 9;
+
+void AddHashes(const uint64_t* hashes, size_t n, size_t num_lines, int k,
+               char* array) {
+  for (size_t i = 0; i < n; i++) {
+    char* line =
+        array + blocked_bloom::LineOf(hashes[i], num_lines) * kLineBytes;
+    blocked_bloom::AddToLine(line, static_cast<uint32_t>(hashes[i] >> 32), k);
+  }
+}
+
+// Parses the trailer of filter.  Returns false if filter is malformed.
+bool DecodeTrailer(const Slice& filter, size_t* num_lines, uint32_t* num_keys,
+                   uint32_t* capacity, int* k) {
+  if (filter.size() < kLineBytes + kTrailerSize) return false;
+  const size_t array_size = filter.size() - kTrailerSize;
+  if (array_size % kLineBytes != 0) return false;
+  const char* trailer = filter.data() + array_size;
+  *num_lines = array_size / kLineBytes;
+  *num_keys = DecodeFixed32(trailer);
+  *capacity = DecodeFixed32(trailer + 4);
+  *k = static_cast<unsigned char>(trailer[8]);
+  return *k >= 1 && *k <= kMaxProbes;
+}
+
+}  // namespace
+
+uint64_t LeafFilter::HashKey(const Slice& user_key) {
+  return MurmurHash64A(user_key.data(), static_cast<int>(user_key.size()),
+                       0x6c8e9cf570932bd5ULL);
+}
+
+void LeafFilter::Build(const uint64_t* hashes, size_t n, size_t capacity,
+                       int bits_per_key, std::string* dst) {
+  if (capacity < n) capacity = n;
+  if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+  int k = static_cast<int>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+  if (k < 1) k = 1;
+  if (k > kMaxProbes) k = kMaxProbes;
+  const size_t bits = capacity * static_cast<size_t>(bits_per_key);
+  size_t num_lines = (bits + kLineBytes * 8 - 1) / (kLineBytes * 8);
+  if (num_lines == 0) num_lines = 1;
+
+  const size_t init_size = dst->size();
+  dst->resize(init_size + num_lines * kLineBytes, 0);
+  AddHashes(hashes, n, num_lines, k, &(*dst)[init_size]);
+  PutFixed32(dst, static_cast<uint32_t>(n));
+  PutFixed32(dst, static_cast<uint32_t>(capacity));
+  dst->push_back(static_cast<char>(k));
+}
+
+bool LeafFilter::Extend(const Slice& filter, const uint64_t* hashes, size_t n,
+                        std::string* dst) {
+  size_t num_lines;
+  uint32_t num_keys, capacity;
+  int k;
+  if (!DecodeTrailer(filter, &num_lines, &num_keys, &capacity, &k)) {
+    return false;
+  }
+  if (num_keys + n > capacity) return false;
+
+  const size_t init_size = dst->size();
+  dst->append(filter.data(), filter.size());
+  AddHashes(hashes, n, num_lines, k, &(*dst)[init_size]);
+  EncodeFixed32(&(*dst)[init_size + num_lines * kLineBytes],
+                static_cast<uint32_t>(num_keys + n));
+  return true;
+}
+
+bool LeafFilter::KeyMayMatch(uint64_t hash, const Slice& filter) {
+  size_t num_lines;
+  uint32_t num_keys, capacity;
+  int k;
+  if (!DecodeTrailer(filter, &num_lines, &num_keys, &capacity, &k)) {
+    // Reserved for new encodings. Consider it a match.
+    return true;
+  }
+  const char* line =
+      filter.data() + blocked_bloom::LineOf(hash, num_lines) * kLineBytes;
+#ifdef BLOCKED_BLOOM_HAVE_AVX2
+  if (blocked_bloom::HaveAVX2()) {
+    return blocked_bloom::ProbeLineAVX2(line, static_cast<uint32_t>(hash >> 32),
+                                        k);
+  }
+#endif
+  return blocked_bloom::ProbeLine(line, static_cast<uint32_t>(hash >> 32), k);
+}
+
+uint32_t LeafFilter::NumKeys(const Slice& filter) {
+  size_t num_lines;
+  uint32_t num_keys, capacity;
+  int k;
+  if (!DecodeTrailer(filter, &num_lines, &num_keys, &capacity, &k)) return 0;
+  return num_keys;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
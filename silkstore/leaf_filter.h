@@ -0,0 +1,58 @@
+//
+// Aggregate filter over the user keys of all the miniruns of a leaf.
+//
+
+#ifndef SILKSTORE_LEAF_FILTER_H_
+#define SILKSTORE_LEAF_FILTER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+#include "leveldb/slice.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// A leaf filter lets a lookup of a key absent from a leaf skip the leaf with
+// a single probe instead of probing the filter of each of its runs.
+//
+// It is a blocked bloom filter sized for a fixed capacity of keys when the
+// leaf is created or fully compacted, so that the keys of runs appended
+// later can be added to it without the keys of the earlier runs.  Removing
+// or compacting some runs keeps it a superset of the keys of the leaf, which
+// is still correct.  Once the leaf holds more keys than the capacity, the
+// filter is dropped and lookups fall back to the run filters.
+//
+// The filter is laid out as
+//    lines: 64-byte lines
+//    num_keys: fixed32
+//    capacity: fixed32
+//    k: uint8
+class LeafFilter {
+ public:
+  // Hash of a user key, computed once and used for both adding and probing.
+  static uint64_t HashKey(const Slice& user_key);
+
+  // Append to *dst a filter for capacity keys at bits_per_key bits per key,
+  // holding the keys with hashes[0, n-1].
+  static void Build(const uint64_t* hashes, size_t n, size_t capacity,
+                    int bits_per_key, std::string* dst);
+
+  // Append to *dst a copy of filter with the keys with hashes[0, n-1] added.
+  // Returns false and leaves *dst unchanged if the filter would then hold
+  // more keys than its capacity, or is not a valid filter.
+  static bool Extend(const Slice& filter, const uint64_t* hashes, size_t n,
+                     std::string* dst);
+
+  // Return false only if no key with the given hash was added to filter.
+  static bool KeyMayMatch(uint64_t hash, const Slice& filter);
+
+  // Number of keys added to filter, or 0 if it is not a valid filter.
+  static uint32_t NumKeys(const Slice& filter);
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_LEAF_FILTER_H_
@@ -2,27 +2,331 @@
 // Created by zxjcarrot on 2019-07-15.
 //
 
+#include <atomic>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
 
+#include "leveldb/perf_context.h"
 #include "table/filter_block.h"
 #include "table/format.h"
 #include "table/merger.h"
 #include "util/coding.h"
+#include "util/crc32c.h"
+#include "util/murmur.h"
 
+#include "silkstore/leaf_filter.h"
 #include "silkstore/leaf_store.h"
 #include "silkstore/segment.h"
 #include "silkstore/silkstore_iter.h"
 #include "silkstore/util.h"
 
-extern int runs_searched;
-extern int runs_hit_counts;
-extern int runs_miss_counts;
-extern int bloom_filter_counts;
 namespace leveldb {
+
+// A utility routine: write "data" to the named file and Sync() it.
+Status WriteStringToFileSync(Env* env, const Slice& data,
+                             const std::string& fname);
+
 namespace silkstore {
 
+LeafStatStore::LeafId LeafStatStore::LeafIdOf(const Slice& leaf_key) {
+  return MurmurHash64A(leaf_key.data(), leaf_key.size(), 0x6c656166);
+}
+
+// Every thread sticks to one read counter shard, so concurrent readers
+// only contend when more threads than shards are reading.
+static int ThisThreadReadShard(int num_shards) {
+  static std::atomic<int> next_shard(0);
+  thread_local int shard = next_shard.fetch_add(1) % num_shards;
+  return shard;
+}
+
+void LeafStatStore::NewLeaf(const std::string& key, int num_runs) {
+  StatShard& shard = ShardFor(LeafIdOf(key));
+  MutexLock g(&shard.lock);
+  shard.m[LeafIdOf(key)] = {-1,
+                            0,
+                            0,
+                            (long long)Env::Default()->NowMicros() / 1000000,
+                            0,
+                            num_runs,
+                            key};
+}
+
+void LeafStatStore::IncrementLeafReads(const Slice& leaf_key,
+                                       uint64_t device_bytes) {
+  int weight = 1;
+  if (read_sample_rate_ > 1) {
+    thread_local unsigned int reads_seen = 0;
+    if (++reads_seen % read_sample_rate_ != 0) return;
+    weight = read_sample_rate_;
+  }
+  ReadCounterShard& shard =
+      read_shards_[ThisThreadReadShard(kNumReadShards)];
+  MutexLock g(&shard.lock);
+  ReadCount& count = shard.reads[LeafIdOf(leaf_key)];
+  count.reads += weight;
+  count.device_bytes += device_bytes * weight;
+}
+
+void LeafStatStore::AddLeafWrites(const std::string& leaf_key,
+                                  uint64_t user_bytes, uint64_t device_bytes) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  auto it = shard.m.find(id);
+  if (it == shard.m.end()) return;
+  it->second.user_bytes_written += user_bytes;
+  it->second.device_bytes_written += device_bytes;
+}
+
+double LeafStatStore::GetWriteHotness(const std::string& leaf_key) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  auto it = shard.m.find(id);
+  if (it == shard.m.end()) return -1;
+  return it->second.write_hotness;
+}
+
+double LeafStatStore::GetReadHotness(const std::string& leaf_key) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  auto it = shard.m.find(id);
+  if (it == shard.m.end()) return -1;
+  return it->second.read_hotness;
+}
+
+void LeafStatStore::DeleteLeaf(const std::string& leaf_key) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  shard.m.erase(id);
+}
+
+void LeafStatStore::UpdateLeafNumRuns(const std::string& leaf_key,
+                                      int num_runs) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  auto it = shard.m.find(id);
+  if (it == shard.m.end()) {
+    return;
+  }
+  it->second.num_runs = num_runs;
+}
+
+void LeafStatStore::UpdateWriteHotnessLocked(LeafStat& stat, int writes) {
+  long long cur_time_in_s = Env::Default()->NowMicros() / 1000000;
+  // We weight the writes by the inverse of the amount of time elapsed since
+  // last update. Therefore, the longer the elapsed time is, the less the
+  // writes contribute to the hotness. This reflects not only the amount of
+  // writes but also the frequency of writes.
+  double weighted_writes =
+      (double)writes / std::max(1LL, cur_time_in_s - stat.last_write_time_in_s);
+  stat.write_hotness = ExpSmoothUpdate(stat.write_hotness, weighted_writes,
+                                       write_hotness_exp_smooth_factor);
+  stat.last_write_time_in_s = cur_time_in_s;
+}
+
+void LeafStatStore::UpdateWriteHotness(const std::string& leaf_key,
+                                       int writes) {
+  LeafId id = LeafIdOf(leaf_key);
+  StatShard& shard = ShardFor(id);
+  MutexLock g(&shard.lock);
+  auto it = shard.m.find(id);
+  if (it == shard.m.end()) {
+    it = shard.m
+             .emplace(id, LeafStat{-1, 0, 0,
+                                   (long long)Env::Default()->NowMicros() /
+                                       1000000,
+                                   0, 0, leaf_key})
+             .first;
+  }
+  UpdateWriteHotnessLocked(it->second, writes);
+}
+
+void LeafStatStore::SplitLeaf(const std::string& leaf_key,
+                              std::vector<std::string>& splitted_keys) {
+  // leaf_key is splitted into (first_half_key, leaf_key)
+  LeafStat original_leaf_stat;
+  {
+    LeafId id = LeafIdOf(leaf_key);
+    StatShard& shard = ShardFor(id);
+    MutexLock g(&shard.lock);
+    auto it = shard.m.find(id);
+    if (it == shard.m.end()) return;
+    original_leaf_stat = it->second;
+    shard.m.erase(it);
+  }
+  for (auto& subkey : splitted_keys) {
+    LeafId id = LeafIdOf(subkey);
+    StatShard& shard = ShardFor(id);
+    MutexLock g(&shard.lock);
+    LeafStat& new_leaf_stat = shard.m[id] = {
+        -1, 0, 0, (long long)Env::Default()->NowMicros() / 1000000, 0, 1,
+        subkey};
+    new_leaf_stat.write_hotness =
+        original_leaf_stat.write_hotness / splitted_keys.size();
+    new_leaf_stat.read_hotness =
+        original_leaf_stat.read_hotness / splitted_keys.size();
+    new_leaf_stat.reads_in_last_interval =
+        original_leaf_stat.reads_in_last_interval / splitted_keys.size();
+    new_leaf_stat.user_bytes_written =
+        original_leaf_stat.user_bytes_written / splitted_keys.size();
+    new_leaf_stat.device_bytes_written =
+        original_leaf_stat.device_bytes_written / splitted_keys.size();
+    new_leaf_stat.device_bytes_read =
+        original_leaf_stat.device_bytes_read / splitted_keys.size();
+    new_leaf_stat.reads = original_leaf_stat.reads / splitted_keys.size();
+    new_leaf_stat.group_id = original_leaf_stat.group_id;
+    new_leaf_stat.last_write_time_in_s =
+        original_leaf_stat.last_write_time_in_s;
+  }
+}
+
+void LeafStatStore::UpdateReadHotness() {
+  // Drain the per-thread read counters first so that readers only ever
+  // wait for a map swap.
+  std::unordered_map<LeafId, ReadCount> reads;
+  for (auto& read_shard : read_shards_) {
+    std::unordered_map<LeafId, ReadCount> drained;
+    {
+      MutexLock g(&read_shard.lock);
+      drained.swap(read_shard.reads);
+    }
+    if (reads.empty()) {
+      reads.swap(drained);
+    } else {
+      for (auto& kv : drained) {
+        ReadCount& count = reads[kv.first];
+        count.reads += kv.second.reads;
+        count.device_bytes += kv.second.device_bytes;
+      }
+    }
+  }
+
+  for (auto& shard : stat_shards_) {
+    MutexLock g(&shard.lock);
+    for (auto& kv : shard.m) {
+      auto it = reads.find(kv.first);
+      if (it != reads.end()) {
+        kv.second.reads_in_last_interval += it->second.reads;
+        kv.second.reads += it->second.reads;
+        kv.second.device_bytes_read += it->second.device_bytes;
+      }
+      UpdateReadHotnessForOneLeaf(kv.second);
+    }
+  }
+}
+
+void LeafStatStore::ForEachLeaf(
+    std::function<void(const std::string&, const LeafStat&)> processor) {
+  for (auto& shard : stat_shards_) {
+    MutexLock g(&shard.lock);
+    for (auto& kv : shard.m) {
+      processor(kv.second.max_key, kv.second);
+    }
+  }
+}
+
+// Leaf stat snapshot format:
+//    version: fixed32
+//    entries[n]:
+//        leaf_max_key: length-prefixed slice
+//        group_id + 1: varint32
+//        write_hotness, read_hotness: fixed64 bit patterns of doubles
+//        last_write_time_in_s: varint64
+//    crc: fixed32 masked crc32c of everything above
+static const uint32_t kLeafStatSnapshotVersion = 1;
+
+static void PutDouble(std::string* dst, double v) {
+  uint64_t bits;
+  memcpy(&bits, &v, sizeof(bits));
+  PutFixed64(dst, bits);
+}
+
+static bool GetDouble(Slice* input, double* v) {
+  if (input->size() < sizeof(uint64_t)) return false;
+  uint64_t bits = DecodeFixed64(input->data());
+  memcpy(v, &bits, sizeof(bits));
+  input->remove_prefix(sizeof(uint64_t));
+  return true;
+}
+
+Status LeafStatStore::SaveSnapshot(Env* env, const std::string& fname) {
+  std::string buf;
+  PutFixed32(&buf, kLeafStatSnapshotVersion);
+  for (auto& shard : stat_shards_) {
+    MutexLock g(&shard.lock);
+    for (auto& kv : shard.m) {
+      const LeafStat& stat = kv.second;
+      PutLengthPrefixedSlice(&buf, stat.max_key);
+      PutVarint32(&buf, stat.group_id + 1);
+      PutDouble(&buf, stat.write_hotness);
+      PutDouble(&buf, stat.read_hotness);
+      PutVarint64(&buf, stat.last_write_time_in_s);
+    }
+  }
+  PutFixed32(&buf, crc32c::Mask(crc32c::Value(buf.data(), buf.size())));
+
+  std::string tmp = fname + ".tmp";
+  Status s = WriteStringToFileSync(env, buf, tmp);
+  if (s.ok()) {
+    s = env->RenameFile(tmp, fname);
+  }
+  if (!s.ok()) {
+    env->DeleteFile(tmp);
+  }
+  return s;
+}
+
+Status LeafStatStore::LoadSnapshot(Env* env, const std::string& fname) {
+  std::string buf;
+  Status s = ReadFileToString(env, fname, &buf);
+  if (!s.ok()) return s;
+  if (buf.size() < 2 * sizeof(uint32_t)) {
+    return Status::Corruption("leaf stat snapshot too short", fname);
+  }
+  size_t body_size = buf.size() - sizeof(uint32_t);
+  uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(buf.data() + body_size));
+  if (crc32c::Value(buf.data(), body_size) != expected_crc) {
+    return Status::Corruption("leaf stat snapshot checksum mismatch", fname);
+  }
+  if (DecodeFixed32(buf.data()) != kLeafStatSnapshotVersion) {
+    return Status::NotSupported("unknown leaf stat snapshot version", fname);
+  }
+
+  Slice input(buf.data() + sizeof(uint32_t), body_size - sizeof(uint32_t));
+  while (!input.empty()) {
+    Slice key;
+    uint32_t group_id;
+    double write_hotness;
+    double read_hotness;
+    uint64_t last_write_time_in_s;
+    if (!GetLengthPrefixedSlice(&input, &key) ||
+        !GetVarint32(&input, &group_id) ||
+        !GetDouble(&input, &write_hotness) ||
+        !GetDouble(&input, &read_hotness) ||
+        !GetVarint64(&input, &last_write_time_in_s)) {
+      return Status::Corruption("bad leaf stat snapshot entry", fname);
+    }
+    LeafId id = LeafIdOf(key);
+    StatShard& shard = ShardFor(id);
+    MutexLock g(&shard.lock);
+    auto it = shard.m.find(id);
+    if (it == shard.m.end()) continue;
+    LeafStat& stat = it->second;
+    stat.group_id = static_cast<int>(group_id) - 1;
+    stat.write_hotness = write_hotness;
+    stat.read_hotness = read_hotness;
+    stat.last_write_time_in_s = last_write_time_in_s;
+  }
+  return Status::OK();
+}
+
 class LeafStore::LeafStoreIterator : public Iterator {
  public:
   LeafStoreIterator(const ReadOptions& options, LeafStore* store)
@@ -148,7 +452,9 @@ class LeafStore::LeafStoreIterator : public Iterator {
     if (leaf_index_it_->Valid()) {
       LeafIndexEntry index_entry(leaf_index_it_->value());
       if (leaf_it_ != nullptr) delete leaf_it_;
-      leaf_it_ = store_->NewIteratorForLeaf(ropts_, index_entry, status_);
+      leaf_it_ = store_->NewIteratorForLeaf(
+          ropts_, index_entry, status_, 0,
+          std::numeric_limits<uint32_t>::max(), kDeviceBytesReadScan);
     } else {
       if (leaf_it_ != nullptr) delete leaf_it_;
       leaf_it_ = nullptr;
@@ -168,6 +474,8 @@ MiniRunIndexEntry::MiniRunIndexEntry(const Slice& data)
   run_no_within_segment_ = DecodeFixed32(p);
   p += 4;
   block_index_data_len_ = DecodeFixed32(p);
+  spilled_ = (block_index_data_len_ & kSpilledFlag) != 0;
+  block_index_data_len_ &= ~kSpilledFlag;
   p += 4;
   filter_data_len_ = DecodeFixed32(p);
 }
@@ -187,22 +495,97 @@ MiniRunIndexEntry MiniRunIndexEntry::Build(uint32_t seg_no, uint32_t run_no,
   return MiniRunIndexEntry(Slice(*buf));
 }
 
+MiniRunIndexEntry MiniRunIndexEntry::BuildSpilled(
+    uint32_t seg_no, uint32_t run_no, const BlockHandle& metadata_handle,
+    size_t run_datasize, std::string* buf) {
+  std::string handle_encoding;
+  metadata_handle.EncodeTo(&handle_encoding);
+  PutFixed32(buf, run_datasize);
+  PutFixed32(buf, seg_no);
+  PutFixed32(buf, run_no);
+  PutFixed32(buf, handle_encoding.size() | kSpilledFlag);
+  PutFixed32(buf, 0);
+  buf->append(handle_encoding);
+  return MiniRunIndexEntry(Slice(*buf));
+}
+
 Slice MiniRunIndexEntry::GetBlockIndexData() const {
+  assert(!spilled_);
   const char* p = raw_data_.data() + 20;
   return Slice(p, block_index_data_len_);
 }
 
 Slice MiniRunIndexEntry::GetFilterData() const {
+  assert(!spilled_);
   const char* p = raw_data_.data() + 20 + block_index_data_len_;
   return Slice(p, filter_data_len_);
 }
 
+BlockHandle MiniRunIndexEntry::GetMetadataHandle() const {
+  assert(spilled_);
+  BlockHandle handle;
+  Slice input(raw_data_.data() + 20, block_index_data_len_);
+  handle.DecodeFrom(&input);
+  return handle;
+}
+
 LeafIndexEntry::LeafIndexEntry(const Slice& data) : raw_data_(data) {}
 
 uint32_t LeafIndexEntry::GetNumMiniRuns() const {
   if (raw_data_.empty()) return 0;
   const char* p = raw_data_.data() + raw_data_.size() - 4;
-  return DecodeFixed32(p);
+  return DecodeFixed32(p) & ~(kLeafFilterFlag | kOffsetTableFlag);
+}
+
+bool LeafIndexEntry::HasLeafFilter() const {
+  if (raw_data_.empty()) return false;
+  const char* p = raw_data_.data() + raw_data_.size() - 4;
+  return (DecodeFixed32(p) & kLeafFilterFlag) != 0;
+}
+
+bool LeafIndexEntry::HasOffsetTable() const {
+  if (raw_data_.empty()) return false;
+  const char* p = raw_data_.data() + raw_data_.size() - 4;
+  return (DecodeFixed32(p) & kOffsetTableFlag) != 0;
+}
+
+Slice LeafIndexEntry::GetLeafFilter() const {
+  if (!HasLeafFilter()) return Slice();
+  const char* p = raw_data_.data() + raw_data_.size() - 8;
+  uint32_t filter_size = DecodeFixed32(p);
+  assert(p - filter_size >= raw_data_.data());
+  return Slice(p - filter_size, filter_size);
+}
+
+const char* LeafIndexEntry::MiniRunIndexEntriesEnd() const {
+  if (raw_data_.empty()) return raw_data_.data();
+  if (!HasLeafFilter()) return raw_data_.data() + raw_data_.size() - 4;
+  return GetLeafFilter().data();
+}
+
+const char* LeafIndexEntry::OffsetTable() const {
+  assert(HasOffsetTable());
+  const char* offset_table =
+      MiniRunIndexEntriesEnd() - 4 * (GetNumMiniRuns() + 1);
+  assert(offset_table >= raw_data_.data());
+  return offset_table;
+}
+
+uint32_t LeafIndexEntry::MiniRunOffset(uint32_t i) const {
+  assert(i <= GetNumMiniRuns());
+  return DecodeFixed32(OffsetTable() + 4 * i);
+}
+
+MiniRunIndexEntry LeafIndexEntry::GetMiniRunIndexEntry(uint32_t i) const {
+  assert(i < GetNumMiniRuns());
+  if (HasOffsetTable()) {
+    const uint32_t offset = MiniRunOffset(i);
+    return MiniRunIndexEntry(
+        Slice(raw_data_.data() + offset, MiniRunOffset(i + 1) - offset));
+  }
+  std::vector<MiniRunIndexEntry> entries =
+      GetAllMiniRunIndexEntry(TraversalOrder::forward);
+  return entries[i];
 }
 
 size_t LeafIndexEntry::GetLeafDataSize() const {
@@ -218,6 +601,7 @@ size_t LeafIndexEntry::GetLeafDataSize() const {
 std::vector<MiniRunIndexEntry> LeafIndexEntry::GetAllMiniRunIndexEntry(
     TraversalOrder order) const {
   std::vector<MiniRunIndexEntry> res;
+  res.reserve(GetNumMiniRuns());
   auto processor = [&res](const MiniRunIndexEntry& entry, uint32_t) {
     res.push_back(entry);
     return false;
@@ -247,8 +631,26 @@ void LeafIndexEntry::ForEachMiniRunIndexEntry(
   auto num_entries = GetNumMiniRuns();
   if (num_entries == 0) return;
 
-  if (order == TraversalOrder::backward) {
-    const char* p = raw_data_.data() + raw_data_.size() - 4;
+  if (HasOffsetTable()) {
+    const char* offset_table = OffsetTable();
+    auto entry_at = [this, offset_table](uint32_t i) {
+      const uint32_t offset = DecodeFixed32(offset_table + 4 * i);
+      const uint32_t limit = DecodeFixed32(offset_table + 4 * (i + 1));
+      assert(offset < limit);
+      return MiniRunIndexEntry(
+          Slice(raw_data_.data() + offset, limit - offset));
+    };
+    if (order == TraversalOrder::backward) {
+      for (int i = num_entries - 1; i >= 0; --i) {
+        if (processor(entry_at(i), i)) return;
+      }
+    } else {
+      for (uint32_t i = 0; i < num_entries; ++i) {
+        if (processor(entry_at(i), i)) return;
+      }
+    }
+  } else if (order == TraversalOrder::backward) {
+    const char* p = MiniRunIndexEntriesEnd();
     for (int i = num_entries - 1; i >= 0; --i) {
       p -= 4;
       assert(p >= raw_data_.data());
@@ -262,7 +664,7 @@ void LeafIndexEntry::ForEachMiniRunIndexEntry(
     }
   } else {
     std::vector<MiniRunIndexEntry> entries;
-    const char* p = raw_data_.data() + raw_data_.size() - 4;
+    const char* p = MiniRunIndexEntriesEnd();
     for (int i = num_entries - 1; i >= 0; --i) {
       p -= 4;
       assert(p >= raw_data_.data());
@@ -281,22 +683,95 @@ void LeafIndexEntry::ForEachMiniRunIndexEntry(
   }
 }
 
+uint32_t LeafIndexEntryBuilder::SpliceMiniRuns(const LeafIndexEntry& base,
+                                               uint32_t start, uint32_t limit,
+                                               const Slice& inserted,
+                                               std::string* buf) {
+  const uint32_t num_entries = base.GetNumMiniRuns();
+  assert(start <= limit && limit <= num_entries);
+  buf->clear();
+  if (num_entries == 0) {
+    buf->append(inserted.data(), inserted.size());
+    PutFixed32(buf, 0);
+    if (inserted.empty()) return 0;
+    PutFixed32(buf, inserted.size());
+    return 1;
+  }
+  if (base.HasOffsetTable()) {
+    // The kept entries are copied as two contiguous ranges, and so are the
+    // offsets up to start, which do not move.
+    const char* data = base.GetRawData().data();
+    const char* offset_table = base.OffsetTable();
+    const uint32_t start_offset = DecodeFixed32(offset_table + 4 * start);
+    const uint32_t limit_offset = DecodeFixed32(offset_table + 4 * limit);
+    const uint32_t end_offset = DecodeFixed32(offset_table + 4 * num_entries);
+    const uint32_t new_num_entries =
+        start + (inserted.empty() ? 0 : 1) + num_entries - limit;
+    const uint32_t moved_offset = start_offset + inserted.size();
+    const uint32_t new_end_offset = moved_offset + end_offset - limit_offset;
+    buf->resize(new_end_offset + 4 * (new_num_entries + 1));
+    char* dst = &(*buf)[0];
+    memcpy(dst, data, start_offset);
+    memcpy(dst + start_offset, inserted.data(), inserted.size());
+    memcpy(dst + moved_offset, data + limit_offset, end_offset - limit_offset);
+    char* dst_offsets = dst + new_end_offset;
+    memcpy(dst_offsets, offset_table, 4 * (start + 1));
+    dst_offsets += 4 * (start + 1);
+    if (!inserted.empty()) {
+      EncodeFixed32(dst_offsets, moved_offset);
+      dst_offsets += 4;
+    }
+    for (uint32_t i = limit + 1; i <= num_entries; i++) {
+      EncodeFixed32(dst_offsets, DecodeFixed32(offset_table + 4 * i) -
+                                     limit_offset + moved_offset);
+      dst_offsets += 4;
+    }
+    return new_num_entries;
+  }
+
+  std::vector<MiniRunIndexEntry> entries =
+      base.GetAllMiniRunIndexEntry(LeafIndexEntry::TraversalOrder::forward);
+  std::vector<uint32_t> offsets;
+  auto append_entry = [&](const Slice& entry) {
+    offsets.push_back(buf->size());
+    buf->append(entry.data(), entry.size());
+  };
+  for (uint32_t i = 0; i < start; i++) append_entry(entries[i].GetRawData());
+  if (!inserted.empty()) append_entry(inserted);
+  for (uint32_t i = limit; i < num_entries; i++) {
+    append_entry(entries[i].GetRawData());
+  }
+  offsets.push_back(buf->size());
+  for (uint32_t offset : offsets) PutFixed32(buf, offset);
+  return offsets.size() - 1;
+}
+
+// Append the leaf filter, if any, and the footer (# of minirun index
+// entries) to buf, or make buf an empty leaf if there are no entries.
+static void PutLeafIndexEntryFooter(std::string* buf, uint32_t num_entries,
+                                    const Slice& leaf_filter) {
+  if (num_entries == 0) {
+    buf->clear();
+    PutFixed32(buf, 0);
+  } else if (leaf_filter.empty()) {
+    PutFixed32(buf, num_entries | LeafIndexEntry::kOffsetTableFlag);
+  } else {
+    buf->append(leaf_filter.data(), leaf_filter.size());
+    PutFixed32(buf, leaf_filter.size());
+    PutFixed32(buf, num_entries | LeafIndexEntry::kOffsetTableFlag |
+                        LeafIndexEntry::kLeafFilterFlag);
+  }
+}
+
 void LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
     const LeafIndexEntry& base, const MiniRunIndexEntry& minirun_index_entry,
-    std::string* buf, LeafIndexEntry* new_entry) {
-  buf->clear();
-  buf->append(base.GetRawData().data(), base.GetRawData().size());
-  if (buf->size()) {
-    assert(buf->size() >= 4);
-    // Erase footer (# of minirun index entries).
-    buf->resize(buf->size() - 4);
-  }
-  size_t entry_size = minirun_index_entry.GetRawData().size();
-  assert(entry_size > 0);
-  buf->append(minirun_index_entry.GetRawData().data(), entry_size);
-  PutFixed32(buf, entry_size);
-  // Append new footer (# of minirun index entries).
-  PutFixed32(buf, base.GetNumMiniRuns() + 1);
+    std::string* buf, LeafIndexEntry* new_entry, const Slice& leaf_filter) {
+  assert(!minirun_index_entry.GetRawData().empty());
+  const uint32_t num_entries = base.GetNumMiniRuns();
+  uint32_t new_num_entries =
+      SpliceMiniRuns(base, num_entries, num_entries,
+                     minirun_index_entry.GetRawData(), buf);
+  PutLeafIndexEntryFooter(buf, new_num_entries, leaf_filter);
   *new_entry = LeafIndexEntry(Slice(*buf));
 }
 
@@ -307,30 +782,12 @@ Status LeafIndexEntryBuilder::ReplaceMiniRunRange(
   if (start >= base.GetNumMiniRuns() || end >= base.GetNumMiniRuns())
     return Status::InvalidArgument("[start, end] not within bound of [0, " +
                                    std::to_string(base.GetNumMiniRuns()) + "]");
-  buf->clear();
-  uint32_t new_num_entries = 0;
-  auto processor = [&](const MiniRunIndexEntry& entry, uint32_t idx) {
-    if (start <= idx && idx <= end) {
-      if (idx == start) {
-        size_t entry_size = replacement.GetRawData().size();
-        assert(entry_size);
-        buf->append(replacement.GetRawData().data(), entry_size);
-        PutFixed32(buf, entry_size);
-        ++new_num_entries;
-      }
-    } else {
-      size_t entry_size = entry.GetRawData().size();
-      assert(entry_size);
-      buf->append(entry.GetRawData().data(), entry_size);
-      PutFixed32(buf, entry_size);
-      ++new_num_entries;
-    }
-    return false;
-  };
-  base.ForEachMiniRunIndexEntry(processor,
-                                LeafIndexEntry::TraversalOrder::forward);
-  // Append footer (# of minirun index entries).
-  PutFixed32(buf, new_num_entries);
+  assert(!replacement.GetRawData().empty());
+  uint32_t new_num_entries =
+      SpliceMiniRuns(base, start, end + 1, replacement.GetRawData(), buf);
+  // The remaining keys are a subset of those of base, which the leaf filter
+  // of base still covers.
+  PutLeafIndexEntryFooter(buf, new_num_entries, base.GetLeafFilter());
   *new_entry = LeafIndexEntry(Slice(*buf));
   return Status::OK();
 }
@@ -342,21 +799,10 @@ Status LeafIndexEntryBuilder::RemoveMiniRunRange(const LeafIndexEntry& base,
   if (start >= base.GetNumMiniRuns() || end >= base.GetNumMiniRuns())
     return Status::InvalidArgument("[start, end] not within bound of [0, " +
                                    std::to_string(base.GetNumMiniRuns()) + "]");
-  buf->clear();
-  uint32_t new_num_entries = 0;
-  auto processor = [&](const MiniRunIndexEntry& entry, uint32_t idx) {
-    if (start <= idx && idx <= end) {
-    } else {
-      buf->append(entry.GetRawData().data(), entry.GetRawData().size());
-      PutFixed32(buf, entry.GetRawData().size());
-      ++new_num_entries;
-    }
-    return false;
-  };
-  base.ForEachMiniRunIndexEntry(processor,
-                                LeafIndexEntry::TraversalOrder::forward);
-  // Append footer (# of minirun index entries).
-  PutFixed32(buf, new_num_entries);
+  uint32_t new_num_entries = SpliceMiniRuns(base, start, end + 1, Slice(), buf);
+  // The remaining keys are a subset of those of base, which the leaf filter
+  // of base still covers.
+  PutLeafIndexEntryFooter(buf, new_num_entries, base.GetLeafFilter());
   *new_entry = LeafIndexEntry(Slice(*buf));
   return Status::OK();
 }
@@ -367,9 +813,13 @@ Iterator* LeafStore::NewIterator(const ReadOptions& options) {
 
 Status LeafStore::Get(const ReadOptions& options, const LookupKey& key,
                       std::string* value, LeafStatStore& stat_store) {
+  PerfContext* perf = options.perf_context;
   Iterator* it = leaf_index_->NewIterator(options);
   DeferCode c([it]() { delete it; });
-  it->Seek(key.user_key());
+  {
+    PerfTimer timer(SILKSTORE_PERF_FIELD(perf, leaf_index_seek_nanos));
+    it->Seek(key.user_key());
+  }
   if (it->Valid() == false) return Status::NotFound("");
   // TODO(yunxiao): Can get old data that contains a segment which has been
   // deleted.
@@ -377,40 +827,81 @@ Status LeafStore::Get(const ReadOptions& options, const LookupKey& key,
   Status s;
   Status key_status = Status::NotFound("");
   LeafIndexEntry index_entry(index_data);
+  if (index_entry.HasLeafFilter()) {
+    PerfTimer timer(SILKSTORE_PERF_FIELD(perf, filter_nanos));
+    if (!LeafFilter::KeyMayMatch(LeafFilter::HashKey(key.user_key()),
+                                 index_entry.GetLeafFilter())) {
+      stats_->Record(kLeafFilterUseful);
+      if (perf != nullptr) ++perf->leaf_filter_rejects;
+      timer.Stop();
+      stat_store.IncrementLeafReads(it->key());
+      return Status::NotFound("");
+    }
+  }
   ParsedInternalKey parsed_lookup_key;
   ParseInternalKey(key.internal_key(), &parsed_lookup_key);
+  uint64_t device_bytes = 0;
   auto processor = [&, this](const MiniRunIndexEntry& minirun_index_entry,
                              uint32_t) -> bool {
-    ++runs_searched;
+    stats_->Record(kRunsSearched);
+    if (perf != nullptr) ++perf->runs_searched;
+    Segment* seg = nullptr;
+    Cache::Handle* metadata_handle = nullptr;
+    std::string* owned_metadata = nullptr;
+    DeferCode c2([this, &seg, &metadata_handle, &owned_metadata]() {
+      if (metadata_handle != nullptr) metadata_cache_->Release(metadata_handle);
+      delete owned_metadata;
+      if (seg != nullptr) seg_manager_->DropSegment(seg);
+    });
+    Slice block_index_data, filter_data;
+    if (minirun_index_entry.IsSpilled()) {
+      PerfTimer timer(SILKSTORE_PERF_FIELD(perf, block_read_nanos));
+      s = seg_manager_->OpenSegment(minirun_index_entry.GetSegmentNumber(),
+                                    &seg);
+      if (!s.ok()) return true;
+      s = LoadSpilledMetadata(options, minirun_index_entry, seg,
+                              &block_index_data, &filter_data,
+                              &metadata_handle, &owned_metadata,
+                              &device_bytes);
+      if (!s.ok()) return true;
+    } else {
+      block_index_data = minirun_index_entry.GetBlockIndexData();
+      filter_data = minirun_index_entry.GetFilterData();
+    }
     if (options_.filter_policy) {
-      FilterBlockReader filter(options_.filter_policy,
-                               minirun_index_entry.GetFilterData());
+      PerfTimer timer(SILKSTORE_PERF_FIELD(perf, filter_nanos));
+      FilterBlockReader filter(options_.filter_policy, filter_data);
       if (filter.KeyMayMatch(0, key.internal_key()) == false) {
-        bloom_filter_counts++;
+        stats_->Record(kBloomFilterUseful);
+        if (perf != nullptr) ++perf->filter_rejects;
         return false;
       }
     }
-    uint32_t seg_no = minirun_index_entry.GetSegmentNumber();
-    Segment* seg = nullptr;
-    // todo  It must be terrible when GC delete this segment before open it.
-    s = seg_manager_->OpenSegment(seg_no, &seg);
-    if (!s.ok()) return true;
-    DeferCode c2([this, seg]() { seg_manager_->DropSegment(seg); });
+    PerfTimer read_timer(SILKSTORE_PERF_FIELD(perf, block_read_nanos));
+    if (seg == nullptr) {
+      uint32_t seg_no = minirun_index_entry.GetSegmentNumber();
+      // todo  It must be terrible when GC delete this segment before open it.
+      s = seg_manager_->OpenSegment(seg_no, &seg);
+      if (!s.ok()) return true;
+    }
 
-    Block index_block(
-        BlockContents{minirun_index_entry.GetBlockIndexData(), false, false});
+    Block index_block(BlockContents{block_index_data, false, false});
     MiniRun* run;
     uint32_t run_no = minirun_index_entry.GetRunNumberWithinSegment();
     s = seg->OpenMiniRun(run_no, index_block, &run);
     if (!s.ok()) return true;
-    DeferCode c3([run]() {
+    run->SetReadStatistics(stats_, kDeviceBytesReadGet);
+    DeferCode c3([run, &device_bytes]() {
+      device_bytes += run->BytesRead();
       delete run;
     });  // todo fix memory leak: new run but not delelte
 
     std::unique_ptr<Iterator> iter(run->NewIterator(options));
     iter->Seek(key.internal_key());
+    read_timer.Stop();
 
     if (iter->Valid()) {
+      PerfTimer decode_timer(SILKSTORE_PERF_FIELD(perf, decode_nanos));
       ParsedInternalKey parsed_key;
       if (!ParseInternalKey(iter->key(), &parsed_key)) {
         s = Status::Corruption("key corruption");
@@ -425,19 +916,19 @@ Status LeafStore::Get(const ReadOptions& options, const LookupKey& key,
           } else {  // kDeleted
             key_status = Status::NotFound("");
           }
-          runs_hit_counts++;
+          stats_->Record(kRunsHit);
           return true;
         }
       }
     }
 
-    runs_miss_counts++;
+    stats_->Record(kRunsMiss);
     return false;
   };
 
   index_entry.ForEachMiniRunIndexEntry(
       processor, LeafIndexEntry::TraversalOrder::backward);
-  stat_store.IncrementLeafReads(it->key().ToString());
+  stat_store.IncrementLeafReads(it->key(), device_bytes);
   return !s.ok() ? s : key_status;
 }
 
@@ -446,10 +937,78 @@ static void NewIteratorForLeafCleanupFunc(void* arg1, void* arg2) {
   static_cast<Segment*>(arg2)->UnRef();
 }
 
+static void ReleaseMetadataCleanupFunc(void* arg1, void* arg2) {
+  static_cast<Cache*>(arg1)->Release(static_cast<Cache::Handle*>(arg2));
+}
+
+static void DeleteOwnedMetadataCleanupFunc(void* arg1, void* arg2) {
+  delete static_cast<std::string*>(arg1);
+}
+
+static void DeleteCachedMetadata(const Slice& key, void* value) {
+  delete static_cast<std::string*>(value);
+}
+
+Status LeafStore::LoadSpilledMetadata(const ReadOptions& options,
+                                      const MiniRunIndexEntry& entry,
+                                      Segment* seg, Slice* block_index_data,
+                                      Slice* filter_data,
+                                      Cache::Handle** handle,
+                                      std::string** owned,
+                                      uint64_t* bytes_read) {
+  *handle = nullptr;
+  *owned = nullptr;
+  const BlockHandle metadata_handle = entry.GetMetadataHandle();
+  char key_buf[12];
+  EncodeFixed32(key_buf, entry.GetSegmentNumber());
+  EncodeFixed64(key_buf + 4, metadata_handle.offset());
+  const Slice key(key_buf, sizeof(key_buf));
+  const std::string* metadata;
+  // Reads that do not fill the cache, such as scans, leave it alone, so
+  // that they neither evict nor promote the metadata of hot runs.
+  if (options.fill_cache) *handle = metadata_cache_->Lookup(key);
+  if (*handle != nullptr) {
+    stats_->Record(kMetadataCacheHit);
+    metadata = static_cast<std::string*>(metadata_cache_->Value(*handle));
+  } else {
+    stats_->Record(kMetadataCacheMiss);
+    std::string* contents = new std::string;
+    Status s = seg->ReadBlock(metadata_handle, contents, bytes_read);
+    if (!s.ok()) {
+      delete contents;
+      return s;
+    }
+    if (options.fill_cache) {
+      *handle = metadata_cache_->Insert(key, contents, contents->size(),
+                                        &DeleteCachedMetadata);
+    } else {
+      *owned = contents;
+    }
+    metadata = contents;
+  }
+  // Laid out by MiniRunBuilder::SetSpillMetadata().
+  uint32_t index_size = 0;
+  if (metadata->size() >= 4) {
+    index_size = DecodeFixed32(metadata->data() + metadata->size() - 4);
+  }
+  if (metadata->size() < 4 || index_size > metadata->size() - 4) {
+    if (*handle != nullptr) metadata_cache_->Release(*handle);
+    delete *owned;
+    *handle = nullptr;
+    *owned = nullptr;
+    return Status::Corruption("bad spilled minirun metadata");
+  }
+  *block_index_data = Slice(metadata->data(), index_size);
+  *filter_data = Slice(metadata->data() + index_size,
+                       metadata->size() - 4 - index_size);
+  return Status::OK();
+}
+
 Iterator* LeafStore::NewIteratorForLeaf(const ReadOptions& options,
                                         const LeafIndexEntry& leaf_index_entry,
                                         Status& s, uint32_t start_minirun_no,
-                                        uint32_t end_minirun_no) {
+                                        uint32_t end_minirun_no,
+                                        Ticker read_ticker) {
   s = Status::OK();
   std::vector<Iterator*> iters;
   std::vector<MiniRun*> runs;
@@ -465,17 +1024,46 @@ Iterator* LeafStore::NewIteratorForLeaf(const ReadOptions& options,
       Segment* seg = nullptr;
       s = seg_manager_->OpenSegment(seg_no, &seg);
       if (!s.ok()) return true;  // error, early return
+      Slice block_index_data, filter_data;
+      Cache::Handle* metadata_handle = nullptr;
+      std::string* owned_metadata = nullptr;
+      if (minirun_index_entry.IsSpilled()) {
+        uint64_t bytes_read = 0;
+        s = LoadSpilledMetadata(options, minirun_index_entry, seg,
+                                &block_index_data, &filter_data,
+                                &metadata_handle, &owned_metadata,
+                                &bytes_read);
+        stats_->Record(read_ticker, bytes_read);
+        if (!s.ok()) {
+          seg->UnRef();
+          return true;  // error, early return
+        }
+      } else {
+        block_index_data = minirun_index_entry.GetBlockIndexData();
+      }
       MiniRun* run;
-      Block index_block(
-          BlockContents{minirun_index_entry.GetBlockIndexData(), false, false});
+      Block index_block(BlockContents{block_index_data, false, false});
       uint32_t run_idx_in_seg = minirun_index_entry.GetRunNumberWithinSegment();
       s = seg->OpenMiniRun(run_idx_in_seg, index_block, &run);
       if (!s.ok()) {
+        if (metadata_handle != nullptr) {
+          metadata_cache_->Release(metadata_handle);
+        }
+        delete owned_metadata;
         seg->UnRef();
         return true;  // error, early return
       }
+      run->SetReadStatistics(stats_, read_ticker);
 
       Iterator* iter = run->NewIterator(options);
+      if (metadata_handle != nullptr) {
+        // The index block stays pinned in the cache while iter uses it.
+        iter->RegisterCleanup(ReleaseMetadataCleanupFunc,
+                              metadata_cache_.get(), metadata_handle);
+      } else if (owned_metadata != nullptr) {
+        iter->RegisterCleanup(DeleteOwnedMetadataCleanupFunc, owned_metadata,
+                              nullptr);
+      }
       iters.push_back(iter);
       runs.push_back(run);
       segs.push_back(seg);
@@ -510,8 +1098,8 @@ Iterator* LeafStore::NewDBIterForLeaf(
 
 Status LeafStore::Open(SegmentManager* seg_manager, DB* leaf_index,
                        const Options& options, const Comparator* user_cmp,
-                       LeafStore** store) {
-  *store = new LeafStore(seg_manager, leaf_index, options, user_cmp);
+                       Statistics* stats, LeafStore** store) {
+  *store = new LeafStore(seg_manager, leaf_index, options, user_cmp, stats);
   return Status::OK();
 }
 
@@ -5,9 +5,12 @@
 #ifndef SILKSTORE_LEAF_INDEX_H
 #define SILKSTORE_LEAF_INDEX_H
 
+#include <algorithm>
 #include <climits>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <string>
 #include <unordered_map>
 #include <vector>
 
@@ -19,23 +22,41 @@
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/slice.h"
+#include "silkstore/statistics.h"
 #include "table/block.h"
+#include "table/format.h"
 #include "util/mutexlock.h"
 
 namespace leveldb {
 namespace silkstore {
 
 class SegmentManager;
+class Segment;
 // format
-//
+//    run data size, segment number, run number: fixed32
+//    block index size, filter size: fixed32
+//    block index, filter
+// If the block index and filter were spilled to the segment, the block index
+// size has kSpilledFlag set and the block index is replaced by the encoded
+// BlockHandle of the spilled metadata within the segment.
 class MiniRunIndexEntry {
  public:
+  static const uint32_t kSpilledFlag = 1u << 31;
+
   MiniRunIndexEntry(const Slice& data);
 
+  // REQUIRES: !IsSpilled()
   Slice GetBlockIndexData() const;
 
+  // REQUIRES: !IsSpilled()
   Slice GetFilterData() const;
 
+  bool IsSpilled() const { return spilled_; }
+
+  // Location of the spilled block index and filter in the segment.
+  // REQUIRES: IsSpilled()
+  BlockHandle GetMetadataHandle() const;
+
   uint32_t GetSegmentNumber() const { return segment_number_; };
 
   uint32_t GetRunNumberWithinSegment() const { return run_no_within_segment_; };
@@ -48,6 +69,10 @@ class MiniRunIndexEntry {
                                  Slice block_index_data, Slice filter_data,
                                  size_t run_datasize, std::string* buf);
 
+  static MiniRunIndexEntry BuildSpilled(uint32_t seg_no, uint32_t run_no,
+                                        const BlockHandle& metadata_handle,
+                                        size_t run_datasize, std::string* buf);
+
  private:
   Slice raw_data_;
   uint32_t segment_number_;
@@ -55,18 +80,44 @@ class MiniRunIndexEntry {
   uint32_t block_index_data_len_;
   uint32_t filter_data_len_;
   uint32_t run_datasize_;
+  bool spilled_;
 };
 
+// format
+//    minirun index entry[n]
+//    offset table: fixed32[n + 1], the offset of each minirun index entry
+//        followed by the end of the last one
+//    [leaf filter, leaf filter size as a fixed32]
+//    n as a fixed32, with kOffsetTableFlag set, and kLeafFilterFlag set if
+//        there is a leaf filter
+// An empty leaf is either empty or a single fixed32 0.  Entries written
+// before the offset table was added follow each minirun index entry by its
+// size as a fixed32 instead, and lack kOffsetTableFlag.  They are still
+// read, and rewritten in the current format by the next change to the leaf.
 class LeafIndexEntry {
  public:
+  static const uint32_t kLeafFilterFlag = 1u << 31;
+  static const uint32_t kOffsetTableFlag = 1u << 30;
+
   LeafIndexEntry(const Slice& data = Slice());
 
   enum TraversalOrder { forward, backward };
 
   uint32_t GetNumMiniRuns() const;
 
+  bool HasLeafFilter() const;
+
+  // The LeafFilter over the keys of all the miniruns, or an empty slice if
+  // the leaf has none.
+  Slice GetLeafFilter() const;
+
   bool Empty() const { return GetNumMiniRuns() == 0; }
 
+  // Return the index entry of the i-th oldest MiniRun, in constant time
+  // unless the entry predates the offset table.
+  // REQUIRES: i < GetNumMiniRuns()
+  MiniRunIndexEntry GetMiniRunIndexEntry(uint32_t i) const;
+
   // Return all index entries of MiniRun sorted on insert time
   std::vector<MiniRunIndexEntry> GetAllMiniRunIndexEntry(
       TraversalOrder order = backward) const;
@@ -83,6 +134,22 @@ class LeafIndexEntry {
   size_t GetLeafDataSize() const;
 
  private:
+  friend class LeafIndexEntryBuilder;
+
+  bool HasOffsetTable() const;
+
+  // End of the minirun index entries and their offset table or sizes
+  // within GetRawData().
+  const char* MiniRunIndexEntriesEnd() const;
+
+  // REQUIRES: HasOffsetTable()
+  const char* OffsetTable() const;
+
+  // Offset of the i-th minirun index entry, or of the end of the last one
+  // if i == GetNumMiniRuns().
+  // REQUIRES: HasOffsetTable(), i <= GetNumMiniRuns()
+  uint32_t MiniRunOffset(uint32_t i) const;
+
   Slice raw_data_;
 };
 
@@ -94,10 +161,15 @@ class LeafIndexEntryBuilder {
 
   LeafIndexEntry operator=(const LeafIndexEntryBuilder&) = delete;
 
+  // leaf_filter becomes the leaf filter of new_entry and must cover the keys
+  // of base and of the appended minirun.  The leaf filter of base is dropped.
   static void AppendMiniRunIndexEntry(
       const LeafIndexEntry& base, const MiniRunIndexEntry& minirun_index_entry,
-      std::string* buf, LeafIndexEntry* new_entry);
+      std::string* buf, LeafIndexEntry* new_entry,
+      const Slice& leaf_filter = Slice());
 
+  // The leaf filter of base is kept, so replacement must hold a subset of
+  // the keys of the replaced miniruns.
   static Status ReplaceMiniRunRange(const LeafIndexEntry& base, uint32_t start,
                                     uint32_t end,
                                     const MiniRunIndexEntry& replacement,
@@ -107,6 +179,14 @@ class LeafIndexEntryBuilder {
   static Status RemoveMiniRunRange(const LeafIndexEntry& base, uint32_t start,
                                    uint32_t end, std::string* buf,
                                    LeafIndexEntry* new_entry);
+
+ private:
+  // Store in *buf the minirun index entries of base with those in
+  // [start, limit) replaced by inserted, which may be empty, followed by
+  // their offset table.  Returns the number of entries stored.
+  static uint32_t SpliceMiniRuns(const LeafIndexEntry& base, uint32_t start,
+                                 uint32_t limit, const Slice& inserted,
+                                 std::string* buf);
 };
 
 /*
@@ -129,6 +209,14 @@ class LeafStatStore {
   static constexpr int read_interval_in_micros = 5000000;
   static constexpr double read_hotness_exp_smooth_factor = 0.8;
   static constexpr double write_hotness_exp_smooth_factor = 0.8;
+  // How often the stats are snapshotted to disk by the leaf optimizer.
+  static constexpr uint64_t snapshot_interval_in_micros = 60000000;
+
+  // Leaves are identified by a 64-bit hash of their max key so that the
+  // read path never has to copy the key.
+  typedef uint64_t LeafId;
+
+  static LeafId LeafIdOf(const Slice& leaf_key);
 
   struct LeafStat {
     int group_id;
@@ -139,134 +227,90 @@ class LeafStatStore {
     long long last_write_time_in_s;
     long long reads_in_last_interval;
     int num_runs;
+    std::string max_key;
+    // Amplification accounting since the leaf was created, not persisted.
+    uint64_t user_bytes_written;
+    uint64_t device_bytes_written;
+    uint64_t device_bytes_read;
+    uint64_t reads;
   };
 
-  void NewLeaf(const std::string& key) {
-    MutexLock g(&lock);
-    m[key] = {-1, 0, 0, (long long)Env::Default()->NowMicros() / 1000000, 0, 0};
-  }
+  LeafStatStore() : read_sample_rate_(1) {}
 
-  void NewLeaf(const std::string& key, int num_runs) {
-    MutexLock g(&lock);
-    m[key] = {-1, 0,       0, (long long)Env::Default()->NowMicros() / 1000000,
-              0,  num_runs};
-  }
+  // Record only one out of every rate reads, each weighted by rate.
+  void SetReadSampleRate(int rate) { read_sample_rate_ = std::max(1, rate); }
 
-  void IncrementLeafReads(const std::string& leaf_key) {
-    MutexLock g(&lock);
-    auto it = m.find(leaf_key);
-    if (it == m.end()) {
-      /* g.Release();
-      NewLeaf(leaf_key);
-      IncrementLeafReads(leaf_key); */
-      return;
-    }
-    LeafStat& stat = it->second;
-    ++stat.reads_in_last_interval;
-  }
+  void NewLeaf(const std::string& key) { NewLeaf(key, 0); }
 
-  double GetWriteHotness(const std::string& leaf_key) {
-    MutexLock g(&lock);
-    auto it = m.find(leaf_key);
-    if (it == m.end()) return -1;
-    return it->second.write_hotness;
-  }
+  void NewLeaf(const std::string& key, int num_runs);
 
-  double GetReadHotness(const std::string& leaf_key) {
-    MutexLock g(&lock);
-    auto it = m.find(leaf_key);
-    if (it == m.end()) return -1;
-    return it->second.read_hotness;
-  }
+  // Never takes the lock of a stat shard: reads are counted in the calling
+  // thread's read counter shard, under that shard's own lock, and folded in
+  // by UpdateReadHotness().  Reads skipped by sampling take no lock at all.
+  // device_bytes is what the read fetched from the segments.
+  void IncrementLeafReads(const Slice& leaf_key, uint64_t device_bytes = 0);
 
-  void DeleteLeaf(const std::string& leaf_key) {
-    MutexLock g(&lock);
-    m.erase(leaf_key);
-  }
+  // Account user_bytes of memtable data and device_bytes of segment data
+  // written to the leaf.
+  void AddLeafWrites(const std::string& leaf_key, uint64_t user_bytes,
+                     uint64_t device_bytes);
 
-  void UpdateLeafNumRuns(const std::string& leaf_key, int num_runs) {
-    MutexLock g(&lock);
-    auto it = m.find(leaf_key);
-    if (it == m.end()) {
-      return;
-    }
-    LeafStat& stat = it->second;
-    stat.num_runs = num_runs;
-  }
+  double GetWriteHotness(const std::string& leaf_key);
 
-  void UpdateWriteHotness(const std::string& leaf_key, int writes) {
-    MutexLock g(&lock);
-    auto it = m.find(leaf_key);
-    if (it == m.end()) {
-      g.Release();
-      NewLeaf(leaf_key);
-      UpdateWriteHotness(leaf_key, writes);
-      return;
-    }
-
-    LeafStat& stat = it->second;
-    long long cur_time_in_s = Env::Default()->NowMicros() / 1000000;
-    // We weight the writes by the inverse of the amount of time elapsed since
-    // last update. Therefore, the longer the elapsed time is, the less the
-    // writes contribute to the hotness. This reflects not only the amount of
-    // writes but also the frequency of writes.
-    double weighted_writes =
-        (double)writes /
-        std::max(1LL, cur_time_in_s - stat.last_write_time_in_s);
-    stat.write_hotness = ExpSmoothUpdate(stat.write_hotness, weighted_writes,
-                                         write_hotness_exp_smooth_factor);
-    stat.last_write_time_in_s = cur_time_in_s;
-  }
+  double GetReadHotness(const std::string& leaf_key);
+
+  void DeleteLeaf(const std::string& leaf_key);
+
+  void UpdateLeafNumRuns(const std::string& leaf_key, int num_runs);
+
+  void UpdateWriteHotness(const std::string& leaf_key, int writes);
 
   void SplitLeaf(const std::string& leaf_key,
-                 std::vector<std::string>& splitted_keys) {
-    // leaf_key is splitted into (first_half_key, leaf_key)
-    MutexLock g(&lock);
-    if (m.find(leaf_key) == m.end()) return;
-    LeafStat original_leaf_stat = m[leaf_key];
-    m.erase(leaf_key);
-    for (auto& subkey : splitted_keys) {
-      LeafStat& new_leaf_stat = m[subkey] = {
-          -1, 0, 0, (long long)Env::Default()->NowMicros() / 1000000, 0, 1};
-      new_leaf_stat.write_hotness =
-          original_leaf_stat.write_hotness / splitted_keys.size();
-      new_leaf_stat.read_hotness =
-          original_leaf_stat.read_hotness / splitted_keys.size();
-      new_leaf_stat.reads_in_last_interval =
-          original_leaf_stat.reads_in_last_interval / splitted_keys.size();
-      new_leaf_stat.group_id = original_leaf_stat.group_id;
-      new_leaf_stat.last_write_time_in_s =
-          original_leaf_stat.last_write_time_in_s;
-    }
-  }
+                 std::vector<std::string>& splitted_keys);
 
-  void UpdateReadHotness() {
-    MutexLock g(&lock);
-    for (auto& kv : m) {
-      UpdateReadHotnessForOneLeaf(kv.second);
-    }
-  }
+  // Aggregate the reads counted since the last call and fold them into the
+  // read hotness of every leaf.
+  void UpdateReadHotness();
 
   void ForEachLeaf(
-      std::function<void(const std::string&, const LeafStat&)> processor) {
-    MutexLock g(&lock);
-    // printf( "Leaf nums : %ld \n",  m.size() );
-    for (auto& kv : m) {
-      processor(kv.first, kv.second);
-    }
-  }
+      std::function<void(const std::string&, const LeafStat&)> processor);
+
+  // Atomically replace fname with a snapshot of the hotness of all leaves.
+  Status SaveSnapshot(Env* env, const std::string& fname);
+
+  // Restore hotness and group ids from a snapshot written by SaveSnapshot().
+  // Only leaves already known to the store are updated; leaves that were
+  // split or merged since the snapshot keep their fresh stats.
+  Status LoadSnapshot(Env* env, const std::string& fname);
 
  private:
+  static constexpr int kNumStatShards = 16;
+  static constexpr int kNumReadShards = 64;
+
+  struct StatShard {
+    port::Mutex lock;
+    std::unordered_map<LeafId, LeafStat> m;
+  };
+
+  // Padded so that threads counting into neighbouring shards do not share
+  // cache lines.
+  struct ReadCount {
+    long long reads;
+    uint64_t device_bytes;
+  };
+
+  struct ReadCounterShard {
+    port::Mutex lock;
+    std::unordered_map<LeafId, ReadCount> reads;
+    char padding[64];
+  };
+
+  StatShard& ShardFor(LeafId id) { return stat_shards_[id % kNumStatShards]; }
+
   double ExpSmoothUpdate(double old, double new_sample, double factor) {
     return old * (1 - factor) + new_sample * factor;
   }
 
-  inline double ComputeReadHotness(double current_read_hotness,
-                                   int current_interval_reads) {
-    return current_read_hotness * (1 - read_hotness_exp_smooth_factor) +
-           current_interval_reads * read_hotness_exp_smooth_factor;
-  }
-
   void UpdateReadHotnessForOneLeaf(LeafStat& stat) {
     stat.read_hotness =
         ExpSmoothUpdate(stat.read_hotness, stat.reads_in_last_interval,
@@ -274,25 +318,31 @@ class LeafStatStore {
     stat.reads_in_last_interval = 0;
   }
 
-  port::Mutex lock;
-  std::unordered_map<std::string, LeafStat> m;
+  void UpdateWriteHotnessLocked(LeafStat& stat, int writes);
+
+  int read_sample_rate_;
+  StatShard stat_shards_[kNumStatShards];
+  ReadCounterShard read_shards_[kNumReadShards];
 };
 
 class LeafStore {
  public:
+  // Lookup counters are recorded in *stats, which must outlive the store.
   static Status Open(SegmentManager* seg_manager, DB* leaf_index,
                      const Options& options, const Comparator* user_cmp,
-                     LeafStore** store);
+                     Statistics* stats, LeafStore** store);
 
   Status Get(const ReadOptions& options, const LookupKey& key,
              std::string* value, LeafStatStore& stat_store);
 
   Iterator* NewIterator(const ReadOptions& options);
 
+  // Bytes read by the iterator are accounted to read_ticker.
   Iterator* NewIteratorForLeaf(
       const ReadOptions& options, const LeafIndexEntry& leaf_index_entry,
       Status& s, uint32_t start_minirun_no = 0,
-      uint32_t end_minirun_no = std::numeric_limits<uint32_t>::max());
+      uint32_t end_minirun_no = std::numeric_limits<uint32_t>::max(),
+      Ticker read_ticker = kDeviceBytesReadBackground);
 
   Iterator* NewDBIterForLeaf(
       const ReadOptions& options, const LeafIndexEntry& leaf_index_entry,
@@ -304,16 +354,34 @@ class LeafStore {
   class LeafStoreIterator;
 
   LeafStore(SegmentManager* seg_manager, DB* leaf_index, const Options& options,
-            const Comparator* user_cmp)
+            const Comparator* user_cmp, Statistics* stats)
       : seg_manager_(seg_manager),
         leaf_index_(leaf_index),
         options_(options),
-        user_cmp_(user_cmp) {}
+        user_cmp_(user_cmp),
+        stats_(stats),
+        metadata_cache_(NewLRUCache(options.metadata_cache_size)) {}
+
+  // Point *block_index_data and *filter_data at the block index and filter
+  // that the run of entry spilled to seg.  If options.fill_cache, they are
+  // read through metadata_cache_ and stay valid until *handle is released;
+  // otherwise the cache is not used, and they are read into *owned, which
+  // the caller deletes.  On success, exactly one of *handle and *owned is
+  // set.  Bytes read from seg are added to *bytes_read.
+  // REQUIRES: entry.IsSpilled()
+  Status LoadSpilledMetadata(const ReadOptions& options,
+                             const MiniRunIndexEntry& entry, Segment* seg,
+                             Slice* block_index_data, Slice* filter_data,
+                             Cache::Handle** handle, std::string** owned,
+                             uint64_t* bytes_read);
 
   SegmentManager* seg_manager_;
   DB* leaf_index_;
   const Options options_;
   const Comparator* user_cmp_ = nullptr;
+  Statistics* stats_;
+  // Spilled minirun metadata, keyed by segment number and offset.
+  std::unique_ptr<Cache> metadata_cache_;
 };
 
 }  // namespace silkstore
@@ -0,0 +1,480 @@
+#include "silkstore/manifest.h"
+
+#include <algorithm>
+
+#include "db/filename.h"
+#include "db/log_reader.h"
+#include "db/log_writer.h"
+#include "util/coding.h"
+#include "util/logging.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// Version of the manifest format written by this code.
+static const uint32_t kManifestFormatVersion = 1;
+
+// The manifest is rewritten as a single snapshot once it grows past this.
+static const uint64_t kMaxManifestSize = 4 << 20;
+
+// Tag numbers for serialized ManifestEdit.  These numbers are written to
+// disk and should not be changed.
+enum Tag {
+  kFormatVersion = 1,
+  kNvmNextOffset = 2,
+  kLastSequence = 3,
+  kLeafIndexSequence = 4,
+  kAddNvmRegion = 5,
+  kRemoveNvmRegion = 6,
+  kAddSegment = 7,
+  kRemoveSegment = 8
+};
+
+void ManifestEdit::Clear() {
+  has_format_version_ = false;
+  has_nvm_next_offset_ = false;
+  has_last_sequence_ = false;
+  has_leaf_index_sequence_ = false;
+  format_version_ = 0;
+  nvm_next_offset_ = 0;
+  last_sequence_ = 0;
+  leaf_index_sequence_ = 0;
+  removed_nvm_regions_.clear();
+  added_nvm_regions_.clear();
+  removed_segments_.clear();
+  added_segments_.clear();
+}
+
+void ManifestEdit::EncodeTo(std::string* dst) const {
+  if (has_format_version_) {
+    PutVarint32(dst, kFormatVersion);
+    PutVarint32(dst, format_version_);
+  }
+  if (has_nvm_next_offset_) {
+    PutVarint32(dst, kNvmNextOffset);
+    PutVarint64(dst, nvm_next_offset_);
+  }
+  if (has_last_sequence_) {
+    PutVarint32(dst, kLastSequence);
+    PutVarint64(dst, last_sequence_);
+  }
+  if (has_leaf_index_sequence_) {
+    PutVarint32(dst, kLeafIndexSequence);
+    PutVarint64(dst, leaf_index_sequence_);
+  }
+  for (size_t i = 0; i < removed_nvm_regions_.size(); i++) {
+    PutVarint32(dst, kRemoveNvmRegion);
+    PutVarint64(dst, removed_nvm_regions_[i]);
+  }
+  for (size_t i = 0; i < added_nvm_regions_.size(); i++) {
+    PutVarint32(dst, kAddNvmRegion);
+    PutVarint64(dst, added_nvm_regions_[i].first);
+    PutVarint64(dst, added_nvm_regions_[i].second);
+  }
+  for (size_t i = 0; i < removed_segments_.size(); i++) {
+    PutVarint32(dst, kRemoveSegment);
+    PutVarint32(dst, removed_segments_[i]);
+  }
+  for (size_t i = 0; i < added_segments_.size(); i++) {
+    PutVarint32(dst, kAddSegment);
+    PutVarint32(dst, added_segments_[i]);
+  }
+}
+
+Status ManifestEdit::DecodeFrom(const Slice& src) {
+  Clear();
+  Slice input = src;
+  const char* msg = nullptr;
+  uint32_t tag;
+
+  // Temporary storage for parsing
+  uint64_t offset;
+  uint64_t size;
+  uint32_t seg_id;
+
+  while (msg == nullptr && GetVarint32(&input, &tag)) {
+    switch (tag) {
+      case kFormatVersion:
+        if (GetVarint32(&input, &format_version_)) {
+          has_format_version_ = true;
+          if (format_version_ > kManifestFormatVersion) {
+            msg = "unsupported format version";
+          }
+        } else {
+          msg = "format version";
+        }
+        break;
+
+      case kNvmNextOffset:
+        if (GetVarint64(&input, &nvm_next_offset_)) {
+          has_nvm_next_offset_ = true;
+        } else {
+          msg = "nvm next offset";
+        }
+        break;
+
+      case kLastSequence:
+        if (GetVarint64(&input, &last_sequence_)) {
+          has_last_sequence_ = true;
+        } else {
+          msg = "last sequence number";
+        }
+        break;
+
+      case kLeafIndexSequence:
+        if (GetVarint64(&input, &leaf_index_sequence_)) {
+          has_leaf_index_sequence_ = true;
+        } else {
+          msg = "leaf index sequence number";
+        }
+        break;
+
+      case kAddNvmRegion:
+        if (GetVarint64(&input, &offset) && GetVarint64(&input, &size)) {
+          added_nvm_regions_.push_back(std::make_pair(offset, size));
+        } else {
+          msg = "added nvm region";
+        }
+        break;
+
+      case kRemoveNvmRegion:
+        if (GetVarint64(&input, &offset)) {
+          removed_nvm_regions_.push_back(offset);
+        } else {
+          msg = "removed nvm region";
+        }
+        break;
+
+      case kAddSegment:
+        if (GetVarint32(&input, &seg_id)) {
+          added_segments_.push_back(seg_id);
+        } else {
+          msg = "added segment";
+        }
+        break;
+
+      case kRemoveSegment:
+        if (GetVarint32(&input, &seg_id)) {
+          removed_segments_.push_back(seg_id);
+        } else {
+          msg = "removed segment";
+        }
+        break;
+
+      default:
+        msg = "unknown tag";
+        break;
+    }
+  }
+
+  if (msg == nullptr && !input.empty()) {
+    msg = "invalid tag";
+  }
+
+  Status result;
+  if (msg != nullptr) {
+    result = Status::Corruption("ManifestEdit", msg);
+  }
+  return result;
+}
+
+std::string ManifestEdit::DebugString() const {
+  std::string r;
+  r.append("ManifestEdit {");
+  if (has_format_version_) {
+    r.append("\n  FormatVersion: ");
+    AppendNumberTo(&r, format_version_);
+  }
+  if (has_nvm_next_offset_) {
+    r.append("\n  NvmNextOffset: ");
+    AppendNumberTo(&r, nvm_next_offset_);
+  }
+  if (has_last_sequence_) {
+    r.append("\n  LastSeq: ");
+    AppendNumberTo(&r, last_sequence_);
+  }
+  if (has_leaf_index_sequence_) {
+    r.append("\n  LeafIndexSeq: ");
+    AppendNumberTo(&r, leaf_index_sequence_);
+  }
+  for (size_t i = 0; i < removed_nvm_regions_.size(); i++) {
+    r.append("\n  RemoveNvmRegion: ");
+    AppendNumberTo(&r, removed_nvm_regions_[i]);
+  }
+  for (size_t i = 0; i < added_nvm_regions_.size(); i++) {
+    r.append("\n  AddNvmRegion: ");
+    AppendNumberTo(&r, added_nvm_regions_[i].first);
+    r.append(" ");
+    AppendNumberTo(&r, added_nvm_regions_[i].second);
+  }
+  for (size_t i = 0; i < removed_segments_.size(); i++) {
+    r.append("\n  RemoveSegment: ");
+    AppendNumberTo(&r, removed_segments_[i]);
+  }
+  for (size_t i = 0; i < added_segments_.size(); i++) {
+    r.append("\n  AddSegment: ");
+    AppendNumberTo(&r, added_segments_[i]);
+  }
+  r.append("\n}\n");
+  return r;
+}
+
+void ManifestState::Apply(const ManifestEdit& edit) {
+  if (edit.has_format_version_) format_version = edit.format_version_;
+  if (edit.has_nvm_next_offset_) nvm_next_offset = edit.nvm_next_offset_;
+  if (edit.has_last_sequence_) last_sequence = edit.last_sequence_;
+  if (edit.has_leaf_index_sequence_) {
+    leaf_index_sequence = edit.leaf_index_sequence_;
+  }
+  for (uint64_t offset : edit.removed_nvm_regions_) {
+    nvm_regions.erase(
+        std::remove_if(nvm_regions.begin(), nvm_regions.end(),
+                       [offset](const std::pair<uint64_t, uint64_t>& region) {
+                         return region.first == offset;
+                       }),
+        nvm_regions.end());
+  }
+  for (auto& region : edit.added_nvm_regions_) {
+    nvm_regions.push_back(region);
+  }
+  for (uint32_t seg_id : edit.removed_segments_) {
+    segments.erase(seg_id);
+  }
+  for (uint32_t seg_id : edit.added_segments_) {
+    segments.insert(seg_id);
+  }
+}
+
+void ManifestState::EncodeSnapshot(ManifestEdit* edit) const {
+  edit->Clear();
+  edit->SetFormatVersion(kManifestFormatVersion);
+  edit->SetNvmNextOffset(nvm_next_offset);
+  edit->SetLastSequence(last_sequence);
+  edit->SetLeafIndexSequence(leaf_index_sequence);
+  for (auto& region : nvm_regions) {
+    edit->AddNvmRegion(region.first, region.second);
+  }
+  for (uint32_t seg_id : segments) {
+    edit->AddSegment(seg_id);
+  }
+}
+
+Manifest::Manifest(Env* env, const std::string& dbname)
+    : env_(env),
+      dbname_(dbname),
+      manifest_number_(0),
+      manifest_size_(0),
+      file_(nullptr),
+      log_(nullptr) {}
+
+Manifest::~Manifest() {
+  delete log_;
+  delete file_;
+}
+
+Status Manifest::Open(Env* env, const std::string& dbname,
+                      Manifest** manifest, bool* created) {
+  *manifest = nullptr;
+  Manifest* m = new Manifest(env, dbname);
+  std::string current;
+  Status s = ReadFileToString(env, CurrentFileName(dbname), &current);
+  if (s.IsNotFound()) {
+    *created = true;
+    m->state_.format_version = kManifestFormatVersion;
+    s = m->WriteSnapshot(1, m->state_);
+  } else if (s.ok()) {
+    *created = false;
+    Slice input(current);
+    uint64_t legacy_log_number;
+    std::string legacy_log;
+    if (ConsumeDecimalNumber(&input, &legacy_log_number) &&
+        (input.empty() || input == Slice("\n"))) {
+      legacy_log = LogFileName(dbname, legacy_log_number);
+      s = m->RecoverLegacy(legacy_log);
+    } else if (current.empty() || current[current.size() - 1] != '\n') {
+      s = Status::Corruption("CURRENT file does not end with newline");
+    } else {
+      current.resize(current.size() - 1);
+      s = m->Recover(dbname + "/" + current);
+    }
+    // Continue in a fresh file so that a torn tail record of the old one
+    // never precedes new edits.
+    if (s.ok()) {
+      s = m->WriteSnapshot(m->manifest_number_ + 1, m->state_);
+    }
+    if (s.ok() && !legacy_log.empty()) {
+      env->DeleteFile(legacy_log);
+    }
+  }
+  if (!s.ok()) {
+    delete m;
+    return s;
+  }
+  *manifest = m;
+  return s;
+}
+
+Status Manifest::Recover(const std::string& fname) {
+  struct LogReporter : public log::Reader::Reporter {
+    Status* status;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      if (this->status->ok()) *this->status = s;
+    }
+  };
+
+  uint64_t number;
+  FileType type;
+  Slice base(fname);
+  base.remove_prefix(dbname_.size() + 1);
+  if (!ParseFileName(base.ToString(), &number, &type) ||
+      type != kDescriptorFile) {
+    return Status::Corruption("CURRENT does not name a manifest", fname);
+  }
+  manifest_number_ = number;
+
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(fname, &file);
+  if (!s.ok()) {
+    if (s.IsNotFound()) {
+      return Status::Corruption("CURRENT points to a non-existent file",
+                                s.ToString());
+    }
+    return s;
+  }
+
+  LogReporter reporter;
+  reporter.status = &s;
+  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  Slice record;
+  std::string scratch;
+  ManifestEdit edit;
+  while (reader.ReadRecord(&record, &scratch) && s.ok()) {
+    s = edit.DecodeFrom(record);
+    if (s.ok()) {
+      state_.Apply(edit);
+    }
+  }
+  delete file;
+  return s;
+}
+
+// The log of a legacy database holds one record, the NVM allocator state
+// as decimal numbers each followed by a comma: the next offset, then the
+// offset and size of each live region.
+Status Manifest::RecoverLegacy(const std::string& fname) {
+  struct LogReporter : public log::Reader::Reporter {
+    Status* status;
+    virtual void Corruption(size_t bytes, const Status& s) {
+      if (this->status->ok()) *this->status = s;
+    }
+  };
+
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(fname, &file);
+  if (!s.ok()) {
+    if (s.IsNotFound()) {
+      return Status::Corruption("CURRENT points to a non-existent file",
+                                s.ToString());
+    }
+    return s;
+  }
+
+  LogReporter reporter;
+  reporter.status = &s;
+  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
+  Slice record;
+  std::string scratch;
+  std::vector<uint64_t> numbers;
+  if (reader.ReadRecord(&record, &scratch) && s.ok()) {
+    uint64_t n;
+    while (ConsumeDecimalNumber(&record, &n) && record.starts_with(",")) {
+      record.remove_prefix(1);
+      numbers.push_back(n);
+    }
+  }
+  delete file;
+  if (!s.ok()) return s;
+  if (!record.empty() || numbers.size() < 3 || numbers.size() % 2 != 1) {
+    return Status::Corruption("bad legacy nvm layout record", fname);
+  }
+
+  state_.format_version = kManifestFormatVersion;
+  state_.nvm_next_offset = numbers[0];
+  for (size_t i = 1; i < numbers.size(); i += 2) {
+    state_.nvm_regions.push_back(std::make_pair(numbers[i], numbers[i + 1]));
+  }
+  return s;
+}
+
+Status Manifest::WriteSnapshot(uint64_t manifest_number,
+                               const ManifestState& state) {
+  std::string fname = DescriptorFileName(dbname_, manifest_number);
+  WritableFile* file;
+  Status s = env_->NewWritableFile(fname, &file);
+  if (!s.ok()) return s;
+  log::Writer* log = new log::Writer(file);
+
+  ManifestEdit snapshot;
+  state.EncodeSnapshot(&snapshot);
+  std::string record;
+  snapshot.EncodeTo(&record);
+  s = log->AddRecord(record);
+  if (s.ok()) {
+    s = file->Sync();
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env_, dbname_, manifest_number);
+  }
+  if (!s.ok()) {
+    delete log;
+    delete file;
+    env_->DeleteFile(fname);
+    return s;
+  }
+
+  uint64_t old_number = manifest_number_;
+  delete log_;
+  delete file_;
+  log_ = log;
+  file_ = file;
+  manifest_size_ = record.size();
+  manifest_number_ = manifest_number;
+  if (old_number != 0 && old_number != manifest_number) {
+    env_->DeleteFile(DescriptorFileName(dbname_, old_number));
+  }
+  return s;
+}
+
+Status Manifest::LogAndApply(ManifestEdit* edit, bool sync) {
+  std::lock_guard<std::mutex> g(mutex_);
+  Status s;
+  if (manifest_size_ >= kMaxManifestSize) {
+    // The snapshot already includes *edit.
+    ManifestState state = state_;
+    state.Apply(*edit);
+    s = WriteSnapshot(manifest_number_ + 1, state);
+    if (s.ok()) {
+      state_ = std::move(state);
+    }
+  } else {
+    std::string record;
+    edit->EncodeTo(&record);
+    s = log_->AddRecord(record);
+    if (s.ok() && sync) {
+      s = file_->Sync();
+    }
+    manifest_size_ += record.size();
+    if (s.ok()) {
+      state_.Apply(*edit);
+    }
+  }
+  return s;
+}
+
+ManifestState Manifest::State() {
+  std::lock_guard<std::mutex> g(mutex_);
+  return state_;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
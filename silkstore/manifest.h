@@ -0,0 +1,161 @@
+//
+// Binary manifest recording NVM memtable regions, the segment catalog
+// and leaf-index checkpoints of a SilkStore.
+//
+
+#ifndef SILKSTORE_MANIFEST_H_
+#define SILKSTORE_MANIFEST_H_
+
+#include <stdint.h>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "db/dbformat.h"
+#include "leveldb/env.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+
+namespace log {
+class Writer;
+}
+
+namespace silkstore {
+
+// A ManifestEdit describes a change to the persistent state of a SilkStore
+// that is not kept in the leaf index: the NVM regions holding memtables,
+// the segment catalog and the leaf-index checkpoint. Edits are appended to
+// the MANIFEST as log records and replayed in order during recovery.
+class ManifestEdit {
+ public:
+  ManifestEdit() { Clear(); }
+
+  void Clear();
+
+  void SetFormatVersion(uint32_t version) {
+    has_format_version_ = true;
+    format_version_ = version;
+  }
+  void SetNvmNextOffset(uint64_t offset) {
+    has_nvm_next_offset_ = true;
+    nvm_next_offset_ = offset;
+  }
+  void SetLastSequence(SequenceNumber seq) {
+    has_last_sequence_ = true;
+    last_sequence_ = seq;
+  }
+  // Every update with a sequence number <= seq has been merged into the
+  // leaf index.
+  void SetLeafIndexSequence(SequenceNumber seq) {
+    has_leaf_index_sequence_ = true;
+    leaf_index_sequence_ = seq;
+  }
+
+  // An NVM region [offset, offset + size) now backs a memtable.
+  void AddNvmRegion(uint64_t offset, uint64_t size) {
+    added_nvm_regions_.push_back(std::make_pair(offset, size));
+  }
+  // The NVM region starting at offset has been released.
+  void RemoveNvmRegion(uint64_t offset) {
+    removed_nvm_regions_.push_back(offset);
+  }
+
+  void AddSegment(uint32_t seg_id) { added_segments_.push_back(seg_id); }
+  void RemoveSegment(uint32_t seg_id) { removed_segments_.push_back(seg_id); }
+
+  void EncodeTo(std::string* dst) const;
+  Status DecodeFrom(const Slice& src);
+
+  std::string DebugString() const;
+
+ private:
+  friend struct ManifestState;
+
+  bool has_format_version_;
+  bool has_nvm_next_offset_;
+  bool has_last_sequence_;
+  bool has_leaf_index_sequence_;
+  uint32_t format_version_;
+  uint64_t nvm_next_offset_;
+  SequenceNumber last_sequence_;
+  SequenceNumber leaf_index_sequence_;
+
+  // Applied in this order: removals first, then additions.
+  std::vector<uint64_t> removed_nvm_regions_;
+  std::vector<std::pair<uint64_t, uint64_t>> added_nvm_regions_;
+  std::vector<uint32_t> removed_segments_;
+  std::vector<uint32_t> added_segments_;
+};
+
+// The state obtained by applying every edit of a manifest in order.
+struct ManifestState {
+  uint32_t format_version = 0;
+  uint64_t nvm_next_offset = 0;
+  SequenceNumber last_sequence = 0;
+  SequenceNumber leaf_index_sequence = 0;
+  // Live NVM regions as (offset, size) pairs in allocation order.
+  std::vector<std::pair<uint64_t, uint64_t>> nvm_regions;
+  // Segment catalog.  Its edits are not synced, so it may lag behind the
+  // segment files; see SegmentManager::OpenManager().
+  std::set<uint32_t> segments;
+
+  void Apply(const ManifestEdit& edit);
+
+  // Store an edit in *edit that recreates this state from scratch.
+  void EncodeSnapshot(ManifestEdit* edit) const;
+};
+
+// The MANIFEST of a SilkStore. CURRENT names the live manifest file, which
+// starts with a snapshot edit followed by incremental edits. Once the file
+// grows past a few megabytes it is rewritten as a single snapshot.
+class Manifest {
+ public:
+  Manifest(const Manifest&) = delete;
+  Manifest& operator=(const Manifest&) = delete;
+
+  ~Manifest();
+
+  // Open the manifest named by dbname/CURRENT and replay it into the
+  // in-memory state, or create an empty one if CURRENT does not exist.
+  // Sets *created to whether a new manifest was created.
+  //
+  // A database written before the manifest existed has a CURRENT holding
+  // the number of a log whose record lists the NVM regions; it is migrated
+  // to a manifest with those regions and an empty segment catalog.
+  static Status Open(Env* env, const std::string& dbname, Manifest** manifest,
+                     bool* created);
+
+  // Append *edit to the manifest and apply it to the current state.
+  // If sync is set, the append is durable when this returns.  On error
+  // the current state is left unchanged.
+  // Thread-safe.
+  Status LogAndApply(ManifestEdit* edit, bool sync);
+
+  // Return a copy of the current state. Thread-safe.
+  ManifestState State();
+
+ private:
+  Manifest(Env* env, const std::string& dbname);
+
+  Status Recover(const std::string& fname);
+  Status RecoverLegacy(const std::string& fname);
+  // Start manifest_number with a snapshot of state and point CURRENT to it.
+  Status WriteSnapshot(uint64_t manifest_number, const ManifestState& state);
+
+  Env* const env_;
+  const std::string dbname_;
+  std::mutex mutex_;
+  ManifestState state_;
+  uint64_t manifest_number_;
+  uint64_t manifest_size_;
+  WritableFile* file_;
+  log::Writer* log_;
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_MANIFEST_H_
@@ -20,20 +20,58 @@
 namespace leveldb {
 namespace silkstore {
 
-MiniRun::MiniRun(const Options* options, RandomAccessFile* file, uint64_t off,
-                 uint64_t size, Block& index_block)
+MiniRun::MiniRun(const Options* options, RandomAccessFile* file,
+                 uint64_t cache_id, uint64_t off, uint64_t size,
+                 Block& index_block,
+                 std::shared_ptr<SecondaryBlockCache> secondary_cache)
     : options(options),
       file(file),
+      cache_id(cache_id),
       run_start_off(off),
       run_size(size),
-      index_block(index_block) {}
+      index_block(index_block),
+      secondary_cache_(std::move(secondary_cache)) {}
+
+MiniRun::~MiniRun() {
+  if (stats_ != nullptr && bytes_read_ > 0) {
+    stats_->Record(read_ticker_, bytes_read_);
+  }
+}
 
 static void DeleteBlock(void* arg, void* ignored) {
   delete reinterpret_cast<Block*>(arg);
 }
 
+namespace {
+
+// A block in the block cache, handed on to the secondary cache, if any,
+// when it leaves it.
+class CachedBlock : public Block {
+ public:
+  CachedBlock(const BlockContents& contents,
+              std::shared_ptr<SecondaryBlockCache> secondary_cache)
+      : Block(contents),
+        contents_(contents.data),
+        secondary_cache_(std::move(secondary_cache)) {}
+
+  // Called with the block cache key of the block.
+  void Evict(const Slice& key) {
+    if (secondary_cache_ != nullptr) {
+      secondary_cache_->Insert(DecodeFixed64(key.data()),
+                               DecodeFixed64(key.data() + 8), contents_);
+    }
+  }
+
+ private:
+  const Slice contents_;
+  const std::shared_ptr<SecondaryBlockCache> secondary_cache_;
+};
+
+}  // namespace
+
 static void DeleteCachedBlock(const Slice& key, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
+  CachedBlock* block = reinterpret_cast<CachedBlock*>(value);
+  block->Evict(key);
   delete block;
 }
 
@@ -50,6 +88,7 @@ Iterator* MiniRun::NewIteratorForOneBlock(
   BlockContents contents;
 
   Status s = ReadBlock(this->file, read_options, handle, &contents);
+  bytes_read_ += handle.size() + kBlockTrailerSize;
   if (s.ok()) {
     block = new Block(contents);
   }
@@ -82,35 +121,50 @@ Iterator* MiniRun::BlockReader(void* arg, const ReadOptions& options,
   if (s.ok()) {
     handle.set_offset(handle.offset() + run->run_start_off);
     BlockContents contents;
-    //        if (block_cache != nullptr) {
-    //            char cache_key_buffer[16];
-    //            EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
-    //            EncodeFixed64(cache_key_buffer+8, handle.offset());
-    //            Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-    //            cache_handle = block_cache->Lookup(key);
-    //            if (cache_handle != nullptr) {
-    //                block =
-    //                reinterpret_cast<Block*>(block_cache->Value(cache_handle));
-    //            } else {
-    //                s = ReadBlock(table->rep_->file, options, handle,
-    //                &contents); if (s.ok()) {
-    //                    block = new Block(contents);
-    //                    if (contents.cachable && options.fill_cache) {
-    //                        cache_handle = block_cache->Insert(
-    //                                key, block, block->size(),
-    //                                &DeleteCachedBlock);
-    //                    }
-    //                }
-    //            }
-    //        } else {
-    //            s = ReadBlock(table->rep_->file, options, handle, &contents);
-    //            if (s.ok()) {
-    //                block = new Block(contents);
-    //            }
-    //        }
-    s = ReadBlock(run->file, options, handle, &contents);
-    if (s.ok()) {
-      block = new Block(contents);
+    if (block_cache != nullptr) {
+      char cache_key_buffer[16];
+      EncodeFixed64(cache_key_buffer, run->cache_id);
+      EncodeFixed64(cache_key_buffer + 8, handle.offset());
+      Slice key(cache_key_buffer, sizeof(cache_key_buffer));
+      cache_handle = block_cache->Lookup(key);
+      if (cache_handle != nullptr) {
+        block =
+            reinterpret_cast<CachedBlock*>(block_cache->Value(cache_handle));
+        if (run->stats_ != nullptr) run->stats_->Record(kBlockCacheHit);
+      } else {
+        if (run->stats_ != nullptr) run->stats_->Record(kBlockCacheMiss);
+        SecondaryBlockCache* secondary_cache = run->secondary_cache_.get();
+        if (secondary_cache != nullptr &&
+            secondary_cache->Lookup(run->cache_id, handle.offset(),
+                                    &contents)) {
+          if (run->stats_ != nullptr) {
+            run->stats_->Record(kSecondaryCacheHit);
+          }
+        } else {
+          if (secondary_cache != nullptr && run->stats_ != nullptr) {
+            run->stats_->Record(kSecondaryCacheMiss);
+          }
+          s = ReadBlock(run->file, options, handle, &contents);
+          run->bytes_read_ += handle.size() + kBlockTrailerSize;
+        }
+        if (s.ok()) {
+          if (contents.cachable && options.fill_cache) {
+            CachedBlock* cached_block =
+                new CachedBlock(contents, run->secondary_cache_);
+            cache_handle = block_cache->Insert(
+                key, cached_block, cached_block->size(), &DeleteCachedBlock);
+            block = cached_block;
+          } else {
+            block = new Block(contents);
+          }
+        }
+      }
+    } else {
+      s = ReadBlock(run->file, options, handle, &contents);
+      run->bytes_read_ += handle.size() + kBlockTrailerSize;
+      if (s.ok()) {
+        block = new Block(contents);
+      }
     }
   }
 
@@ -6,12 +6,15 @@
 #define SILKSTORE_MINIRUN_H
 
 #include <stdint.h>
+#include <memory>
 
 #include "leveldb/cache.h"
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 #include "leveldb/options.h"
 #include "leveldb/slice.h"
+#include "silkstore/secondary_cache.h"
+#include "silkstore/statistics.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
@@ -30,8 +33,14 @@ class MiniRun {
   // Returns a iterator ranging over the entire minirun
   Iterator* NewIterator(const ReadOptions&);
 
-  MiniRun(const Options* options, RandomAccessFile* file, uint64_t off,
-          uint64_t size, Block& index_block);
+  // Data blocks are kept in options->block_cache, if any, under cache_id
+  // and their offset in file.  Those evicted from it go to secondary_cache,
+  // if any, which is looked up before file on a block cache miss.
+  MiniRun(const Options* options, RandomAccessFile* file, uint64_t cache_id,
+          uint64_t off, uint64_t size, Block& index_block,
+          std::shared_ptr<SecondaryBlockCache> secondary_cache = nullptr);
+
+  ~MiniRun();
 
   static Iterator* BlockReader(void*, const ReadOptions&, const Slice&);
 
@@ -39,12 +48,27 @@ class MiniRun {
   Iterator* NewIteratorForOneBlock(const leveldb::ReadOptions&,
                                    BlockHandle handle);
 
+  // Add the bytes this run reads from its segment to ticker of *stats when
+  // the run is deleted.
+  void SetReadStatistics(Statistics* stats, Ticker ticker) {
+    stats_ = stats;
+    read_ticker_ = ticker;
+  }
+
+  // Bytes read from the segment file so far, block trailers included.
+  uint64_t BytesRead() const { return bytes_read_; }
+
  private:
   const Options* options;
   RandomAccessFile* file;
+  uint64_t cache_id;
   uint64_t run_start_off;  // offset in the file
   uint64_t run_size;
   Block& index_block;
+  std::shared_ptr<SecondaryBlockCache> secondary_cache_;
+  Statistics* stats_ = nullptr;
+  Ticker read_ticker_ = kDeviceBytesReadBackground;
+  uint64_t bytes_read_ = 0;
 };
 
 /*
@@ -87,6 +111,27 @@ class MiniRunBuilder {
   // Return non-ok iff some error has been detected.
   Status status() const;
 
+  // Build the filter of the current run with policy instead of
+  // options.filter_policy.  Reset() reverts to options.filter_policy.
+  // REQUIRES: options.filter_policy != nullptr, Finish() has not been called
+  void SetFilterPolicy(const FilterPolicy* policy);
+
+  // Also write the index block and the filter of the current run to the file
+  // as one more block after its data blocks, laid out as
+  //    index block
+  //    filter
+  //    index block size: fixed32
+  // Reset() turns this off.
+  // REQUIRES: Finish() has not been called
+  void SetSpillMetadata(bool spill);
+
+  // Whether the finished run spilled its index block and filter, and the
+  // handle of the block they were written to, with an offset relative to
+  // the start of the file.
+  // REQUIRES: Finish() has been called
+  bool MetadataSpilled() const;
+  BlockHandle MetadataHandle() const;
+
   // Finish building the table.  Stops using the file passed to the
   // constructor after this function returns.
   // REQUIRES: Finish(), Abandon() have not been called
@@ -56,6 +56,9 @@ struct MiniRunBuilder::Rep {
   Slice finished_index_block;
   Slice finished_filter_block;
 
+  bool spill_metadata;
+  BlockHandle metadata_handle;
+
   Rep(const Options& opt, WritableFile* f, uint64_t offset = 0)
       : options(opt),
         index_block_options(opt),
@@ -69,8 +72,10 @@ struct MiniRunBuilder::Rep {
         filter_block_builder((opt.filter_policy == nullptr)
                                  ? nullptr
                                  : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
-    index_block_options.block_restart_interval = 1;
+        pending_index_entry(false),
+        spill_metadata(false) {
+    index_block_options.block_restart_interval =
+        opt.index_block_restart_interval;
   }
 };
 
@@ -196,6 +201,23 @@ void MiniRunBuilder::WriteRawBlock(const Slice& block_contents,
 
 Status MiniRunBuilder::status() const { return rep_->status; }
 
+void MiniRunBuilder::SetFilterPolicy(const FilterPolicy* policy) {
+  Rep* r = rep_;
+  assert(r->filter_block_builder != nullptr);
+  r->filter_block_builder->SetPolicy(policy);
+}
+
+void MiniRunBuilder::SetSpillMetadata(bool spill) {
+  Rep* r = rep_;
+  r->spill_metadata = spill;
+}
+
+bool MiniRunBuilder::MetadataSpilled() const { return rep_->spill_metadata; }
+
+BlockHandle MiniRunBuilder::MetadataHandle() const {
+  return rep_->metadata_handle;
+}
+
 Status MiniRunBuilder::Finish() {
   Rep* r = rep_;
   Flush();
@@ -241,6 +263,18 @@ Status MiniRunBuilder::Finish() {
     r->finished_index_block = r->index_block.Finish();
   }
 
+  // Spill the index block and filter next to the data of cold runs
+  if (ok() && r->spill_metadata) {
+    std::string metadata;
+    metadata.append(r->finished_index_block.data(),
+                    r->finished_index_block.size());
+    metadata.append(r->finished_filter_block.data(),
+                    r->finished_filter_block.size());
+    PutFixed32(&metadata, r->finished_index_block.size());
+    WriteRawBlock(metadata, kNoCompression, &r->metadata_handle);
+    if (ok()) r->status = r->file->Flush();
+  }
+
   //    // silkstore's minirun has no footer
   //
   //    // Write footer
@@ -280,6 +314,7 @@ void MiniRunBuilder::Reset(uint64_t file_offset) {
   r->run_datasize = 0;
   r->finished_index_block = Slice();
   r->finished_filter_block = Slice();
+  r->spill_metadata = false;
   r->status = Status::OK();
   r->last_key.clear();
   r->compressed_output.clear();
@@ -287,6 +322,7 @@ void MiniRunBuilder::Reset(uint64_t file_offset) {
   r->data_block.Reset();
   r->index_block.Reset();
   if (r->filter_block_builder) {
+    r->filter_block_builder->SetPolicy(r->options.filter_policy);
     r->filter_block_builder->Reset();
     r->filter_block_builder->StartBlock(0);
   }
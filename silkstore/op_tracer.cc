@@ -0,0 +1,133 @@
+//
+// Sampled capture of the operations issued against a SilkStore.
+//
+
+#include "silkstore/op_tracer.h"
+
+#include <algorithm>
+#include <atomic>
+
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+namespace leveldb {
+namespace silkstore {
+
+static const char kTraceMagic[] = "SILKTRC1";
+static const size_t kTraceMagicSize = sizeof(kTraceMagic) - 1;
+static const size_t kTraceHeaderSize = kTraceMagicSize + 4;
+
+static bool HasValue(TraceOpType type) {
+  return type == kTracePut || type == kTraceWrite;
+}
+
+static bool HasNexts(TraceOpType type) {
+  return type == kTraceSeek || type == kTraceSeekToFirst;
+}
+
+Status OpTracer::Open(Env* env, const std::string& fname, int sample_rate,
+                      OpTracer** tracer) {
+  *tracer = nullptr;
+  if (sample_rate < 1) sample_rate = 1;
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) return s;
+  std::string header(kTraceMagic, kTraceMagicSize);
+  PutFixed32(&header, sample_rate);
+  s = file->Append(header);
+  if (!s.ok()) {
+    delete file;
+    return s;
+  }
+  *tracer = new OpTracer(env, file, sample_rate);
+  return s;
+}
+
+OpTracer::OpTracer(Env* env, WritableFile* file, int sample_rate)
+    : env_(env),
+      sample_rate_(sample_rate),
+      start_micros_(env->NowMicros()),
+      file_(file) {}
+
+OpTracer::~OpTracer() {
+  MutexLock l(&mutex_);
+  file_->Close();
+  delete file_;
+}
+
+bool OpTracer::Sample() {
+  if (sample_rate_ == 1) return true;
+  static std::atomic<uint32_t> next_seed(1);
+  thread_local Random rnd(next_seed.fetch_add(1));
+  return rnd.OneIn(sample_rate_);
+}
+
+void OpTracer::Record(uint64_t start_micros, TraceOpType type,
+                      const Slice& key, const Slice& value, uint64_t nexts) {
+  std::string rec;
+  PutFixed32(&rec, 0);  // Patched below once the length is known
+  PutFixed64(&rec,
+             start_micros >= start_micros_ ? start_micros - start_micros_ : 0);
+  rec.push_back(static_cast<char>(type));
+  PutLengthPrefixedSlice(&rec, key);
+  if (HasValue(type)) PutLengthPrefixedSlice(&rec, value);
+  if (HasNexts(type)) PutVarint64(&rec, nexts);
+  EncodeFixed32(&rec[0], static_cast<uint32_t>(rec.size() - 4));
+
+  MutexLock l(&mutex_);
+  if (status_.ok()) {
+    status_ = file_->Append(rec);
+  }
+}
+
+Status ReadOpTrace(Env* env, const std::string& fname,
+                   std::vector<TraceRecord>* records) {
+  records->clear();
+  std::string contents;
+  Status s = ReadFileToString(env, fname, &contents);
+  if (!s.ok()) return s;
+  if (contents.size() < kTraceHeaderSize ||
+      Slice(contents.data(), kTraceMagicSize) !=
+          Slice(kTraceMagic, kTraceMagicSize)) {
+    return Status::Corruption(fname, "not a silkstore op trace");
+  }
+  Slice input(contents.data() + kTraceHeaderSize,
+              contents.size() - kTraceHeaderSize);
+  while (!input.empty()) {
+    if (input.size() < 4) {
+      return Status::Corruption(fname, "truncated trace record");
+    }
+    uint32_t length = DecodeFixed32(input.data());
+    input.remove_prefix(4);
+    if (input.size() < length || length < 9) {
+      return Status::Corruption(fname, "truncated trace record");
+    }
+    Slice rec(input.data(), length);
+    input.remove_prefix(length);
+
+    TraceRecord r;
+    r.micros = DecodeFixed64(rec.data());
+    r.type = static_cast<TraceOpType>(rec[8]);
+    r.nexts = 0;
+    rec.remove_prefix(9);
+    Slice key, value;
+    if (r.type < kTraceGet || r.type > kTraceSeekToFirst ||
+        !GetLengthPrefixedSlice(&rec, &key) ||
+        (HasValue(r.type) && !GetLengthPrefixedSlice(&rec, &value)) ||
+        (HasNexts(r.type) && !GetVarint64(&rec, &r.nexts))) {
+      return Status::Corruption(fname, "bad trace record");
+    }
+    r.key = key.ToString();
+    r.value = value.ToString();
+    records->push_back(std::move(r));
+  }
+  std::stable_sort(records->begin(), records->end(),
+                   [](const TraceRecord& a, const TraceRecord& b) {
+                     return a.micros < b.micros;
+                   });
+  return s;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
@@ -0,0 +1,99 @@
+//
+// Sampled capture of the operations issued against a SilkStore, so that
+// production traffic can be replayed by nvm_db_bench.
+//
+
+#ifndef SILKSTORE_OP_TRACER_H_
+#define SILKSTORE_OP_TRACER_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
+namespace leveldb {
+namespace silkstore {
+
+enum TraceOpType : uint8_t {
+  kTraceGet = 1,
+  kTracePut = 2,
+  kTraceDelete = 3,
+  // A whole WriteBatch; the value holds its serialized contents.
+  kTraceWrite = 4,
+  // An iterator Seek followed by a number of Next calls. An empty key with
+  // kTraceSeekToFirst stands for SeekToFirst.
+  kTraceSeek = 5,
+  kTraceSeekToFirst = 6,
+};
+
+struct TraceRecord {
+  // Microseconds since the trace was started.
+  uint64_t micros;
+  TraceOpType type;
+  std::string key;
+  // Value of a kTracePut, contents of a kTraceWrite batch.
+  std::string value;
+  // Next calls after a kTraceSeek or kTraceSeekToFirst.
+  uint64_t nexts;
+};
+
+// The trace file starts with a header
+//    magic: char[8] ("SILKTRC1")
+//    sample_rate: fixed32
+// followed by records
+//    length: fixed32 (of the rest of the record)
+//    micros: fixed64
+//    type: uint8
+//    key: length-prefixed slice
+//    value: length-prefixed slice (kTracePut, kTraceWrite)
+//    nexts: varint64 (kTraceSeek, kTraceSeekToFirst)
+// Records are appended when the operation is issued, except for seeks,
+// which are appended once their Next count is known. Readers should order
+// records by micros.
+class OpTracer {
+ public:
+  // Create a tracer writing to fname that records one out of every
+  // sample_rate operations on average.
+  static Status Open(Env* env, const std::string& fname, int sample_rate,
+                     OpTracer** tracer);
+
+  OpTracer(const OpTracer&) = delete;
+  OpTracer& operator=(const OpTracer&) = delete;
+
+  ~OpTracer();
+
+  // Decide whether the next operation of the calling thread is recorded.
+  // Cheap enough to call on every operation.
+  bool Sample();
+
+  // Record an operation that Sample() selected. start_micros is the
+  // Env::NowMicros() at which it was issued. Safe to call concurrently.
+  void Record(uint64_t start_micros, TraceOpType type, const Slice& key,
+              const Slice& value = Slice(), uint64_t nexts = 0);
+
+  Env* env() const { return env_; }
+
+ private:
+  OpTracer(Env* env, WritableFile* file, int sample_rate);
+
+  Env* const env_;
+  const int sample_rate_;
+  const uint64_t start_micros_;
+  port::Mutex mutex_;
+  WritableFile* file_ GUARDED_BY(mutex_);
+  Status status_ GUARDED_BY(mutex_);
+};
+
+// Reads all records of a trace file written by OpTracer, ordered by micros.
+Status ReadOpTrace(Env* env, const std::string& fname,
+                   std::vector<TraceRecord>* records);
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_OP_TRACER_H_
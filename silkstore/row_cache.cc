@@ -0,0 +1,66 @@
+//
+// Cache of the results of point lookups in the leaf store.
+//
+
+#include "silkstore/row_cache.h"
+
+#include "util/hash.h"
+
+namespace leveldb {
+namespace silkstore {
+
+RowCache::RowCache(size_t capacity) : cache_(NewLRUCache(capacity)) {
+  for (int i = 0; i < kNumStripes; i++) {
+    stripe_sequence_[i].store(0, std::memory_order_relaxed);
+  }
+}
+
+void RowCache::DeleteEntry(const Slice& key, void* value) {
+  delete static_cast<Entry*>(value);
+}
+
+uint32_t RowCache::StripeOf(const Slice& user_key) {
+  return Hash(user_key.data(), user_key.size(), 0x5bd1e995) % kNumStripes;
+}
+
+bool RowCache::Lookup(const Slice& user_key, SequenceNumber snapshot,
+                      std::string* value, Status* s) {
+  Cache::Handle* handle = cache_->Lookup(user_key);
+  if (handle == nullptr) return false;
+  const Entry* entry = static_cast<const Entry*>(cache_->Value(handle));
+  const bool hit = entry->sequence <= snapshot;
+  if (hit) {
+    if (entry->found) {
+      value->assign(entry->value);
+      *s = Status::OK();
+    } else {
+      *s = Status::NotFound(Slice());
+    }
+  }
+  cache_->Release(handle);
+  return hit;
+}
+
+void RowCache::Insert(const Slice& user_key, SequenceNumber snapshot,
+                      const Slice& value, bool found) {
+  std::atomic<SequenceNumber>& stripe = stripe_sequence_[StripeOf(user_key)];
+  if (stripe.load() > snapshot) return;
+  Entry* entry = new Entry;
+  entry->sequence = snapshot;
+  entry->found = found;
+  if (found) entry->value.assign(value.data(), value.size());
+  const size_t charge = sizeof(Entry) + user_key.size() + value.size();
+  cache_->Release(cache_->Insert(user_key, entry, charge, &DeleteEntry));
+  // A write invalidating user_key may have run between the check above and
+  // the insertion; it published its sequence number before erasing, so it
+  // is seen here and the possibly stale entry is dropped.
+  if (stripe.load() > snapshot) cache_->Erase(user_key);
+}
+
+void RowCache::Invalidate(const Slice& user_key, SequenceNumber seq) {
+  stripe_sequence_[StripeOf(user_key)].store(seq);
+  cache_->Erase(user_key);
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
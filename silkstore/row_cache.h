@@ -0,0 +1,82 @@
+//
+// Cache of the results of point lookups in the leaf store.
+//
+
+#ifndef SILKSTORE_ROW_CACHE_H_
+#define SILKSTORE_ROW_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "db/dbformat.h"
+#include "leveldb/cache.h"
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// RowCache maps user keys to the value, or absence, that a lookup found in
+// the leaf store, so that a hot key missing from the memtables is served
+// without seeking the leaf index, probing filters and parsing blocks.
+//
+// An entry filled by a lookup at sequence number s says that no version of
+// its key newer than s exists, and so holds for any snapshot at or after s.
+// Writes keep that true by invalidating the keys they write before they
+// are visible.  The keys are hashed to a fixed number of stripes, each
+// remembering the sequence number of its last write: a lookup whose
+// snapshot predates it may have raced with that write, so its result is
+// not kept.  Invalidation is thus exact for the written keys and
+// conservative, within a stripe, for the results filled concurrently.
+//
+// Thread-safe.
+class RowCache {
+ public:
+  // A cache of at most capacity bytes of keys and values.
+  explicit RowCache(size_t capacity);
+
+  RowCache(const RowCache&) = delete;
+  RowCache& operator=(const RowCache&) = delete;
+
+  // If the result of looking up user_key as of snapshot is cached, stores
+  // it in *s, and in *value if found, and returns true.
+  bool Lookup(const Slice& user_key, SequenceNumber snapshot,
+              std::string* value, Status* s);
+
+  // Remembers that a lookup of user_key as of snapshot in the leaf store
+  // found value, or nothing if !found.  Only valid once the memtables have
+  // been found to hold no version of user_key visible at snapshot.
+  void Insert(const Slice& user_key, SequenceNumber snapshot,
+              const Slice& value, bool found);
+
+  // Drops what is cached about user_key, which a write with sequence
+  // number seq is about to make visible.  Writes must be invalidated in
+  // increasing sequence order, as the write queue does.
+  void Invalidate(const Slice& user_key, SequenceNumber seq);
+
+  size_t TotalCharge() const { return cache_->TotalCharge(); }
+
+ private:
+  static const int kNumStripes = 1024;
+
+  struct Entry {
+    SequenceNumber sequence;
+    bool found;
+    std::string value;
+  };
+
+  static void DeleteEntry(const Slice& key, void* value);
+
+  static uint32_t StripeOf(const Slice& user_key);
+
+  std::unique_ptr<Cache> cache_;
+  std::atomic<SequenceNumber> stripe_sequence_[kNumStripes];
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_ROW_CACHE_H_
@@ -0,0 +1,167 @@
+//
+// Second-chance cache of data blocks on NVM or SSD, below the block cache.
+//
+
+#include "silkstore/secondary_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// Evicted blocks queued beyond this many bytes are dropped, so that a
+// device slower than the eviction rate does not pile them up in DRAM.
+static const size_t kMaxPendingBytes = 8 << 20;
+
+Status SecondaryBlockCache::Open(const std::string& path, size_t capacity,
+                                 std::shared_ptr<SecondaryBlockCache>* cache) {
+  if (capacity < kNumRegions) {
+    return Status::InvalidArgument(path, "secondary cache is too small");
+  }
+  // A previous instance may still hold the old file open; unlinking it
+  // keeps the two apart.
+  ::unlink(path.c_str());
+  int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd < 0) return Status::IOError(path, strerror(errno));
+  if (::ftruncate(fd, capacity) != 0) {
+    Status s = Status::IOError(path, strerror(errno));
+    ::close(fd);
+    return s;
+  }
+  cache->reset(new SecondaryBlockCache(fd, capacity));
+  return Status::OK();
+}
+
+SecondaryBlockCache::SecondaryBlockCache(int fd, size_t capacity)
+    : fd_(fd),
+      region_size_(capacity / kNumRegions),
+      max_pending_bytes_(std::min<size_t>(region_size_, kMaxPendingBytes)),
+      cv_(&mutex_),
+      closed_(false),
+      pending_bytes_(0),
+      writing_(false),
+      head_(0),
+      usage_(0),
+      writer_(&SecondaryBlockCache::WriteQueuedBlocks, this) {}
+
+SecondaryBlockCache::~SecondaryBlockCache() {
+  Close();
+  writer_.join();
+  ::close(fd_);
+}
+
+void SecondaryBlockCache::Close() {
+  MutexLock l(&mutex_);
+  closed_ = true;
+  pending_.clear();
+  pending_bytes_ = 0;
+  cv_.SignalAll();
+}
+
+void SecondaryBlockCache::WaitForPendingWrites() {
+  MutexLock l(&mutex_);
+  while (!pending_.empty() || writing_) cv_.Wait();
+}
+
+void SecondaryBlockCache::EvictRegion(size_t region) {
+  for (const BlockId& id : region_blocks_[region]) {
+    auto it = index_.find(id);
+    usage_ -= it->second.size;
+    index_.erase(it);
+  }
+  region_blocks_[region].clear();
+}
+
+void SecondaryBlockCache::Insert(uint64_t cache_id, uint64_t offset,
+                                 const Slice& contents) {
+  if (contents.size() > region_size_) return;
+  MutexLock l(&mutex_);
+  if (closed_ || pending_bytes_ + contents.size() > max_pending_bytes_) {
+    return;
+  }
+  const BlockId id{cache_id, offset};
+  if (index_.count(id)) return;
+  pending_.push_back(PendingBlock{id, contents.ToString()});
+  pending_bytes_ += contents.size();
+  cv_.SignalAll();
+}
+
+void SecondaryBlockCache::WriteQueuedBlocks() {
+  MutexLock l(&mutex_);
+  while (true) {
+    while (!closed_ && pending_.empty()) cv_.Wait();
+    if (closed_) break;
+    PendingBlock block = std::move(pending_.front());
+    pending_.pop_front();
+    pending_bytes_ -= block.contents.size();
+    // A block may be queued again before its first copy is written.
+    if (index_.count(block.id)) {
+      if (pending_.empty()) cv_.SignalAll();
+      continue;
+    }
+    const size_t size = block.contents.size();
+    // Blocks do not straddle regions, so that each is dropped with one.
+    const uint64_t region_end = (head_ / region_size_ + 1) * region_size_;
+    if (head_ + size > region_end) head_ = region_end;
+    if (head_ == kNumRegions * region_size_) head_ = 0;
+    const size_t region = head_ / region_size_;
+    if (head_ == region * region_size_) EvictRegion(region);
+    const uint64_t offset = head_;
+    head_ += size;
+    writing_ = true;
+
+    mutex_.Unlock();
+    const uint32_t crc = crc32c::Value(block.contents.data(), size);
+    ssize_t n = ::pwrite(fd_, block.contents.data(), size, offset);
+    mutex_.Lock();
+
+    writing_ = false;
+    // The region cannot have been recycled meanwhile: only this thread
+    // moves the head.
+    if (n == static_cast<ssize_t>(size)) {
+      index_[block.id] = Location{offset, static_cast<uint32_t>(size), crc};
+      region_blocks_[region].push_back(block.id);
+      usage_ += size;
+    }
+    if (pending_.empty()) cv_.SignalAll();
+  }
+  cv_.SignalAll();
+}
+
+bool SecondaryBlockCache::Lookup(uint64_t cache_id, uint64_t offset,
+                                 BlockContents* contents) {
+  Location loc;
+  {
+    MutexLock l(&mutex_);
+    auto it = index_.find(BlockId{cache_id, offset});
+    if (it == index_.end()) return false;
+    loc = it->second;
+  }
+  char* buf = new char[loc.size];
+  ssize_t n = ::pread(fd_, buf, loc.size, loc.offset);
+  if (n != static_cast<ssize_t>(loc.size) ||
+      crc32c::Value(buf, loc.size) != loc.crc) {
+    delete[] buf;
+    return false;
+  }
+  contents->data = Slice(buf, loc.size);
+  contents->cachable = true;
+  contents->heap_allocated = true;
+  return true;
+}
+
+size_t SecondaryBlockCache::Usage() {
+  MutexLock l(&mutex_);
+  return usage_;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
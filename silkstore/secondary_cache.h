@@ -0,0 +1,142 @@
+//
+// Second-chance cache of data blocks on NVM or SSD, below the block cache.
+//
+
+#ifndef SILKSTORE_SECONDARY_CACHE_H_
+#define SILKSTORE_SECONDARY_CACHE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "leveldb/slice.h"
+#include "leveldb/status.h"
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "table/format.h"
+
+namespace leveldb {
+namespace silkstore {
+
+// SecondaryBlockCache keeps the run data blocks evicted from
+// Options::block_cache in a file on a device that is cheaper than DRAM but
+// faster than the one of the segments, so that a block that falls out of
+// DRAM can still be read back without going to its segment.
+//
+// The file is a circular log: blocks are appended at a head that wraps
+// around, and only an index from block to location is kept in memory.
+// The file is split in kNumRegions regions; when the head enters a region,
+// all the blocks the region held are dropped from the index at once, which
+// makes eviction FIFO.  Blocks are identified like in the block cache, by
+// the cache id of their segment and their offset, and never change, so
+// entries are never invalidated otherwise.
+//
+// Insert() is called by the block cache as it drops a block, with the lock
+// of a cache shard held, so it only copies the block to a bounded staging
+// queue; a background thread writes the queue to the file.  Lookups read
+// outside the lock and check the checksum of the block, so that one
+// overwritten meanwhile is a miss.
+//
+// Thread-safe.
+class SecondaryBlockCache {
+ public:
+  // Creates the file at path, replacing any existing one, for a cache of
+  // capacity bytes.
+  static Status Open(const std::string& path, size_t capacity,
+                     std::shared_ptr<SecondaryBlockCache>* cache);
+
+  SecondaryBlockCache(const SecondaryBlockCache&) = delete;
+  SecondaryBlockCache& operator=(const SecondaryBlockCache&) = delete;
+
+  ~SecondaryBlockCache();
+
+  // Queues the contents of the block at offset in the segment with
+  // cache_id to be stored, unless it is already stored.  Drops it if the
+  // staging queue is full or the cache is closed.
+  void Insert(uint64_t cache_id, uint64_t offset, const Slice& contents);
+
+  // If the block at offset in the segment with cache_id is stored, reads it
+  // into *contents, which then owns a heap allocated copy, and returns true.
+  bool Lookup(uint64_t cache_id, uint64_t offset, BlockContents* contents);
+
+  // Total size of the blocks stored.
+  size_t Usage();
+
+  // Waits until the blocks queued so far are stored.
+  void WaitForPendingWrites();
+
+  // Discards the queued blocks and stops storing new ones, such as those
+  // dropped by the block cache as it is destroyed.  Lookups keep working.
+  void Close();
+
+ private:
+  static const int kNumRegions = 16;
+
+  struct BlockId {
+    uint64_t cache_id;
+    uint64_t offset;
+
+    bool operator==(const BlockId& other) const {
+      return cache_id == other.cache_id && offset == other.offset;
+    }
+  };
+
+  struct BlockIdHash {
+    size_t operator()(const BlockId& id) const {
+      return static_cast<size_t>(id.cache_id * 0x9e3779b97f4a7c15ULL ^
+                                 id.offset);
+    }
+  };
+
+  struct Location {
+    uint64_t offset;
+    uint32_t size;
+    uint32_t crc;
+  };
+
+  struct PendingBlock {
+    BlockId id;
+    std::string contents;
+  };
+
+  SecondaryBlockCache(int fd, size_t capacity);
+
+  // Drops the blocks of region from the index, before it is overwritten.
+  void EvictRegion(size_t region) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Body of writer_.
+  void WriteQueuedBlocks();
+
+  const int fd_;
+  const size_t region_size_;
+  // Bound of pending_bytes_.
+  const size_t max_pending_bytes_;
+
+  port::Mutex mutex_;
+  // Signalled when blocks are queued, when the queue is drained and on
+  // Close().
+  port::CondVar cv_;
+  bool closed_ GUARDED_BY(mutex_);
+  // Blocks waiting for writer_, and whether writer_ is writing one.
+  std::deque<PendingBlock> pending_ GUARDED_BY(mutex_);
+  size_t pending_bytes_ GUARDED_BY(mutex_);
+  bool writing_ GUARDED_BY(mutex_);
+  // Offset in the file of the next block.  Only writer_ moves it.
+  uint64_t head_ GUARDED_BY(mutex_);
+  size_t usage_ GUARDED_BY(mutex_);
+  std::unordered_map<BlockId, Location, BlockIdHash> index_
+      GUARDED_BY(mutex_);
+  std::vector<BlockId> region_blocks_[kNumRegions] GUARDED_BY(mutex_);
+
+  std::thread writer_;
+};
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_SECONDARY_CACHE_H_
@@ -7,7 +7,9 @@
 #include <algorithm>
 #include <cmath>
 #include <queue>
+#include <set>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <vector>
@@ -23,6 +25,7 @@
 #include "util/crc32c.h"
 #include "util/mutexlock.h"
 
+#include "silkstore/manifest.h"
 #include "silkstore/minirun.h"
 
 namespace leveldb {
@@ -41,6 +44,9 @@ struct Segment::Rep {
   std::string invalidated_runs;
   std::vector<MiniRunHandle> run_handles;
   uint32_t id;
+  // Prefix of the keys of the blocks of the segment in options.block_cache.
+  uint64_t cache_id;
+  std::shared_ptr<SecondaryBlockCache> secondary_cache;
   RandomAccessFile* file;
   uint64_t file_size;
   Options options;
@@ -72,12 +78,16 @@ Segment::~Segment() {
 
 Status Segment::Open(const Options& options, uint32_t segment_id,
                      RandomAccessFile* file, uint64_t file_size,
+                     std::shared_ptr<SecondaryBlockCache> secondary_cache,
                      silkstore::Segment** segment) {
   Rep* r = new Rep;
   r->file = file;
   r->file_size = file_size;
   r->id = segment_id;
   r->options = options;
+  r->cache_id =
+      (options.block_cache != nullptr) ? options.block_cache->NewId() : 0;
+  r->secondary_cache = std::move(secondary_cache);
   *segment = new Segment(r);
 
   size_t footer_offset = file_size - sizeof(uint64_t);
@@ -130,7 +140,22 @@ Status Segment::OpenMiniRun(int run_no, Block& index_block, MiniRun** run) {
           ? r->file_size - run_offset
           : r->run_handles[run_no + 1].run_start_pos - run_offset;
 
-  *run = new MiniRun(&r->options, r->file, run_offset, run_size, index_block);
+  *run = new MiniRun(&r->options, r->file, r->cache_id, run_offset, run_size,
+                     index_block, r->secondary_cache);
+  return Status::OK();
+}
+
+Status Segment::ReadBlock(const BlockHandle& handle, std::string* contents,
+                         uint64_t* bytes_read) {
+  Rep* r = rep_;
+  ReadOptions ropts;
+  ropts.verify_checksums = true;
+  BlockContents block;
+  Status s = leveldb::ReadBlock(r->file, ropts, handle, &block);
+  *bytes_read += handle.size() + kBlockTrailerSize;
+  if (!s.ok()) return s;
+  contents->assign(block.data.data(), block.data.size());
+  if (block.heap_allocated) delete[] block.data.data();
   return Status::OK();
 }
 
@@ -182,6 +207,8 @@ struct SegmentManager::Rep {
   Options options;
   std::string dbname;
   std::function<void()> gc_func;
+  Manifest* manifest = nullptr;
+  std::shared_ptr<SecondaryBlockCache> secondary_cache;
 };
 
 static bool GetSegmentFileInfo(const std::string& filename, uint32_t* seg_id) {
@@ -262,7 +289,7 @@ Status SegmentManager::NewSegmentBuilder(
     uint32_t* seg_id, std::unique_ptr<SegmentBuilder>& seg_builder_ptr,
     bool gc_on_segment_shortage) {
   Rep* r = rep_;
-  Env* default_env = Env::Default();
+  Env* env = r->options.env;
 
   //    while (gc_on_segment_shortage &&
   //    r->options.maximum_segments_storage_size && ApproximateSize() >=
@@ -279,7 +306,7 @@ Status SegmentManager::NewSegmentBuilder(
   std::string target_segment_filepath =
       r->dbname + "/seg." + std::to_string(exp_seg_id);
   WritableFile* wfile = nullptr;
-  Status s = default_env->NewAppendableFile(src_segment_filepath, &wfile);
+  Status s = env->NewAppendableFile(src_segment_filepath, &wfile);
   if (!s.ok()) {
     return s;
   }
@@ -305,42 +332,56 @@ Status SegmentManager::InvalidateSegmentRun(uint32_t seg_id, uint32_t run_no) {
 Status SegmentManager::RenameSegment(uint32_t seg_id,
                                      const std::string target_filepath) {
   Rep* r = rep_;
-  std::lock_guard<std::mutex> g(r->mutex);
+  std::unique_lock<std::mutex> l(r->mutex);
   auto filepath_it = r->segment_filepaths.find(seg_id);
   if (filepath_it == r->segment_filepaths.end())
     return Status::NotFound(
         "RenameSegment failed because the segment does not exist");
   const std::string filepath = filepath_it->second;
   r->segment_filepaths[seg_id] = target_filepath;
-  Status s = Env::Default()->RenameFile(filepath, target_filepath);
+  Status s = r->options.env->RenameFile(filepath, target_filepath);
   if (!s.ok()) return s;
+  ManifestEdit edit;
+  edit.AddSegment(seg_id);
   auto segment_it = r->segments.find(seg_id);
-  if (segment_it == r->segments.end()) return s;
-  Segment* segment = segment_it->second;
-  // Wait for all the old readers to drop reference to the current segment
-  // New readers will be blocked by r->mutex
-  while (segment->NumRef()) Env::Default()->SleepForMicroseconds(10);
+  if (segment_it != r->segments.end()) {
+    Segment* segment = segment_it->second;
+    // Wait for all the old readers to drop reference to the current segment
+    // New readers will be blocked by r->mutex
+    while (segment->NumRef()) r->options.env->SleepForMicroseconds(10);
 
-  RandomAccessFile* rfile;
-  s = Env::Default()->NewRandomAccessFile(target_filepath, &rfile);
-  if (!s.ok()) {
-    return s;
+    RandomAccessFile* rfile;
+    s = r->options.env->NewRandomAccessFile(target_filepath, &rfile);
+    if (s.ok()) {
+      RandomAccessFile* old_file = segment->SetNewSegmentFile(rfile);
+      // FIXME: fix this leak
+      // delete old_file;
+    }
   }
-  RandomAccessFile* old_file = segment->SetNewSegmentFile(rfile);
-  // FIXME: fix this leak
-  // delete old_file;
-  return Status::OK();
+  l.unlock();
+
+  // The manifest serializes its own edits; logging under r->mutex would
+  // stall every segment lookup behind the manifest write.
+  if (r->manifest != nullptr) {
+    Status log_status = r->manifest->LogAndApply(&edit, false);
+    if (s.ok()) s = log_status;
+  }
+  return s;
+}
+
+void SegmentManager::CloseSecondaryCache() {
+  if (rep_->secondary_cache != nullptr) rep_->secondary_cache->Close();
 }
 
 size_t SegmentManager::ApproximateSize() {
   Rep* r = rep_;
   std::lock_guard<std::mutex> g(r->mutex);
   size_t size = 0;
-  Env* default_env = Env::Default();
+  Env* env = r->options.env;
   for (auto kv : r->segment_filepaths) {
     auto filepath = kv.second;
     uint64_t filesize;
-    Status s = default_env->GetFileSize(filepath, &filesize);
+    Status s = env->GetFileSize(filepath, &filesize);
     if (s.ok()) {
       size += filesize;
     } else {
@@ -370,14 +411,20 @@ Status SegmentManager::RemoveSegment(uint32_t seg_id) {
     Segment* seg = it->second;
     r->segments.erase(seg_id);
     r->segment_filepaths.erase(seg_id);
-    Env* default_env = Env::Default();
+    Env* env = r->options.env;
     r->mutex.unlock();
     // Wait for all read references to this segment to drop
-    while (seg->NumRef()) default_env->SleepForMicroseconds(10);
-    s = default_env->DeleteFile(filepath);
-    if (!s.ok()) return s;
-    r->mutex.lock();
+    while (seg->NumRef()) env->SleepForMicroseconds(10);
+    // The segment is unreachable now, whatever happens to its file.
     delete seg;
+    s = env->DeleteFile(filepath);
+    if (!s.ok()) return s;
+    if (r->manifest != nullptr) {
+      ManifestEdit edit;
+      edit.RemoveSegment(seg_id);
+      s = r->manifest->LogAndApply(&edit, false);
+    }
+    return s;
   }
   r->mutex.unlock();
   return s;
@@ -385,58 +432,148 @@ Status SegmentManager::RemoveSegment(uint32_t seg_id) {
 
 void SegmentManager::DropSegment(Segment* seg_ptr) { seg_ptr->UnRef(); }
 
+// Opens the segment file at filepath and decodes its run handles.
+// Performs file I/O, so callers must not hold the manager mutex.
+static Status LoadSegment(
+    const Options& options,
+    const std::shared_ptr<SecondaryBlockCache>& secondary_cache,
+    uint32_t seg_id, const std::string& filepath, Segment** seg_ptr) {
+  Env* env = options.env;
+  RandomAccessFile* rfile;
+  Status s = env->NewRandomAccessFile(filepath, &rfile);
+  if (!s.ok()) {
+    return s;
+  }
+
+  uint64_t filesize;
+  s = env->GetFileSize(filepath, &filesize);
+  if (!s.ok()) {
+    delete rfile;
+    return s;
+  }
+  Segment* seg = nullptr;
+  s = Segment::Open(options, seg_id, rfile, filesize, secondary_cache, &seg);
+  if (!s.ok()) {
+    delete seg;
+    delete rfile;
+    return s;
+  }
+  *seg_ptr = seg;
+  return s;
+}
+
+// Releases a segment that was loaded but never published to the manager.
+static void DiscardSegment(Segment* seg) {
+  delete seg->SetNewSegmentFile(nullptr);
+  delete seg;
+}
+
 Status SegmentManager::OpenSegment(uint32_t seg_id, Segment** seg_ptr) {
   Rep* r = rep_;
-  r->mutex.lock();
-  auto filepath_it = r->segment_filepaths.find(seg_id);
-  if (filepath_it == r->segment_filepaths.end()) {
-    r->mutex.unlock();
-    return Status::NotFound("segment[" + std::to_string(seg_id) +
-                            "] is not found");
-  }
+  std::unique_lock<std::mutex> l(r->mutex);
+  while (true) {
+    auto filepath_it = r->segment_filepaths.find(seg_id);
+    if (filepath_it == r->segment_filepaths.end()) {
+      return Status::NotFound("segment[" + std::to_string(seg_id) +
+                              "] is not found");
+    }
 
-  auto it = r->segments.find(seg_id);
-  if (it == r->segments.end()) {
-    std::string filepath = filepath_it->second;
-    r->mutex.unlock();
-    Env* default_env = Env::Default();
-    RandomAccessFile* rfile;
-    Status s = default_env->NewRandomAccessFile(filepath, &rfile);
-    if (!s.ok()) {
-      return s;
+    auto it = r->segments.find(seg_id);
+    if (it != r->segments.end()) {
+      *seg_ptr = it->second;
+      break;
     }
 
-    uint64_t filesize;
-    s = default_env->GetFileSize(filepath, &filesize);
+    // Load the segment without holding the mutex so that concurrent
+    // openers of other segments are not serialized behind this I/O.
+    std::string filepath = filepath_it->second;
+    l.unlock();
+    Segment* seg;
+    Status s = LoadSegment(r->options, r->secondary_cache, seg_id, filepath,
+                           &seg);
+    l.lock();
     if (!s.ok()) {
       return s;
     }
-    r->mutex.lock();
-    s = Segment::Open(r->options, seg_id, rfile, filesize, seg_ptr);
-    if (!s.ok()) {
-      r->mutex.unlock();
-      return s;
+
+    filepath_it = r->segment_filepaths.find(seg_id);
+    if (filepath_it == r->segment_filepaths.end() ||
+        filepath_it->second != filepath ||
+        r->segments.count(seg_id)) {
+      // The segment was renamed, removed or opened by another thread while
+      // we were loading it.  Drop our copy and look it up again.
+      DiscardSegment(seg);
+      continue;
     }
-    r->segments[seg_id] = *seg_ptr;
-    r->segment_filepaths[seg_id] = filepath;
-  } else {
-    *seg_ptr = it->second;
+    r->segments[seg_id] = seg;
+    *seg_ptr = seg;
+    break;
   }
   (*seg_ptr)->Ref();
-  r->mutex.unlock();
   return Status::OK();
 }
 
+void SegmentManager::WarmUpSegments(int num_threads) {
+  Rep* r = rep_;
+  std::vector<std::pair<uint32_t, std::string>> pending;
+  {
+    std::lock_guard<std::mutex> g(r->mutex);
+    for (auto& kv : r->segment_filepaths) {
+      if (r->segments.find(kv.first) == r->segments.end()) {
+        pending.emplace_back(kv.first, kv.second);
+      }
+    }
+  }
+  if (pending.empty() || num_threads <= 0) return;
+  num_threads = std::min<int>(num_threads, pending.size());
+
+  auto worker = [r, &pending, num_threads](int tid) {
+    for (size_t i = tid; i < pending.size(); i += num_threads) {
+      uint32_t seg_id = pending[i].first;
+      const std::string& filepath = pending[i].second;
+      Segment* seg;
+      Status s = LoadSegment(r->options, r->secondary_cache, seg_id,
+                             filepath, &seg);
+      if (!s.ok()) {
+        // Leave the segment to be opened lazily, which reports the error
+        // to whoever actually needs it.
+        Log(r->options.info_log, "Failed warming up segment %s: %s\n",
+            filepath.c_str(), s.ToString().c_str());
+        continue;
+      }
+      std::lock_guard<std::mutex> g(r->mutex);
+      auto filepath_it = r->segment_filepaths.find(seg_id);
+      if (filepath_it == r->segment_filepaths.end() ||
+          filepath_it->second != filepath || r->segments.count(seg_id)) {
+        DiscardSegment(seg);
+      } else {
+        r->segments[seg_id] = seg;
+      }
+    }
+  };
+
+  std::vector<std::thread> thread_pool;
+  thread_pool.reserve(num_threads - 1);
+  for (int i = 1; i < num_threads; ++i) {
+    thread_pool.emplace_back(worker, i);
+  }
+  worker(0);
+  for (auto& thread : thread_pool) {
+    thread.join();
+  }
+}
+
 Status SegmentManager::OpenManager(const Options& options,
                                    const std::string& dbname,
                                    SegmentManager** manager_ptr,
-                                   std::function<void()> gc_func) {
-  Env* default_env = Env::Default();
-  if (default_env->FileExists(dbname) == false) {
+                                   std::function<void()> gc_func,
+                                   Manifest* manifest) {
+  Env* env = options.env;
+  if (env->FileExists(dbname) == false) {
     if (options.create_if_missing == false) {
       return Status::NotFound("dbname[" + dbname + "] not found");
     }
-    Status s = default_env->CreateDir(dbname);
+    Status s = env->CreateDir(dbname);
     if (!s.ok()) {
       return s;
     }
@@ -445,8 +582,19 @@ Status SegmentManager::OpenManager(const Options& options,
   r->options = options;
   r->dbname = dbname;
   r->gc_func = gc_func;
+  r->manifest = manifest;
+  if (options.secondary_cache_file != nullptr &&
+      options.block_cache != nullptr) {
+    Status s = SecondaryBlockCache::Open(options.secondary_cache_file,
+                                         options.secondary_cache_size,
+                                         &r->secondary_cache);
+    if (!s.ok()) {
+      Log(options.info_log, "Secondary block cache disabled: %s\n",
+          s.ToString().c_str());
+    }
+  }
   std::vector<std::string> subfiles;
-  Status s = default_env->GetChildren(dbname, &subfiles);
+  Status s = env->GetChildren(dbname, &subfiles);
   if (!s.ok()) {
     return s;
   }
@@ -464,7 +612,37 @@ Status SegmentManager::OpenManager(const Options& options,
     }
   }
 
+  if (manifest != nullptr) {
+    // The catalog is not used to decide which segments exist.  Its edits
+    // are appended without a sync, so a crash can lose the addition of a
+    // segment that the leaf index already points to, and dropping the
+    // files it does not list would lose data.  The directory listing stays
+    // authoritative: a mismatch is only reported, and an empty catalog, as
+    // left by a database migrated from before the manifest, is seeded from
+    // the listing.
+    std::set<uint32_t> catalog = manifest->State().segments;
+    if (catalog.empty() && !seg_ids.empty()) {
+      ManifestEdit edit;
+      for (auto seg_id : seg_ids) edit.AddSegment(seg_id);
+      s = manifest->LogAndApply(&edit, false);
+      if (!s.ok()) {
+        delete r;
+        return s;
+      }
+    } else {
+      size_t unknown = 0;
+      for (auto seg_id : seg_ids) {
+        if (catalog.count(seg_id) == 0) ++unknown;
+      }
+      if (unknown) {
+        Log(options.info_log, "%zu segment files are not in the manifest\n",
+            unknown);
+      }
+    }
+  }
+
   *manager_ptr = new SegmentManager(r);
+  (*manager_ptr)->WarmUpSegments(options.segment_open_threads);
   return Status::OK();
 }
 
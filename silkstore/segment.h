@@ -8,6 +8,7 @@
 #include <functional>
 #include <memory>
 #include <stdint.h>
+#include <vector>
 #include "leveldb/slice.h"
 #include "table/block.h"
 
@@ -16,6 +17,7 @@
 namespace leveldb {
 namespace silkstore {
 
+class Manifest;
 class SegmentManager;
 
 static std::string MakeSegmentFileName(uint32_t segment_id);
@@ -52,16 +54,37 @@ class SegmentBuilder {
 
   // Finish building a minirun.
   // Store the pointer to the current minirun in run_handle.
+  // If filter_policy is non-null, the filter of the run is built with it
+  // instead of options.filter_policy.  If spill_metadata is true, the index
+  // block and filter of the run are also written to the segment (see
+  // MiniRunBuilder::SetSpillMetadata()).
   // REQUIRES: Finish(), Abandon() have not been called.
-  Status FinishMiniRun(uint32_t* run_no);
+  Status FinishMiniRun(uint32_t* run_no,
+                       const FilterPolicy* filter_policy = nullptr,
+                       bool spill_metadata = false);
+
+  // Number of calls to Add() since the current minirun was started.
+  uint64_t RunNumEntries() const;
 
   // Return the index block for the previously finished run.
   // REQUIRES: FinishMiniRun() has been called and StartMiniRun() has not.
-  Slice GetFinishedRunIndexBlock();
+  Slice GetFinishedRunIndexBlock() const;
 
   // Return the filter block for the previously finished run.
   // REQUIRES: FinishMiniRun() has been called and StartMiniRun() has not.
-  Slice GetFinishedRunFilterBlock();
+  Slice GetFinishedRunFilterBlock() const;
+
+  // Return the LeafFilter::HashKey() of the user keys of the previously
+  // finished run, or nothing if options.leaf_filter_bits_per_key is not
+  // positive.
+  // REQUIRES: FinishMiniRun() has been called and StartMiniRun() has not.
+  const std::vector<uint64_t>& GetFinishedRunKeyHashes() const;
+
+  // Store in *handle the location of the index block and filter of the
+  // previously finished run within the segment and return true if they were
+  // spilled to it.
+  // REQUIRES: FinishMiniRun() has been called and StartMiniRun() has not.
+  bool GetFinishedRunMetadataHandle(BlockHandle* handle) const;
 
   // Finish building the segment.
   // REQUIRES: all mini runs has finished building through pairs of
@@ -77,7 +100,7 @@ class SegmentBuilder {
 
   bool RunStarted() const;
 
-  uint32_t GetFinishedRunDataSize();
+  uint32_t GetFinishedRunDataSize() const;
 
  private:
   bool ok() const { return status().ok(); }
@@ -103,8 +126,11 @@ class SegmentBuilder {
  */
 class Segment {
  public:
+  // The blocks of the runs of the segment evicted from options.block_cache
+  // go to secondary_cache, if not null.
   static Status Open(const Options& options, uint32_t segment_id,
                      RandomAccessFile* file, uint64_t file_size,
+                     std::shared_ptr<SecondaryBlockCache> secondary_cache,
                      Segment** segment);
 
   ~Segment();
@@ -123,6 +149,11 @@ class Segment {
 
   Status OpenMiniRun(int run_no, Block& index_block, MiniRun** run);
 
+  // Read the block at handle, such as the metadata spilled by a run, into
+  // *contents.  Adds the bytes read to *bytes_read.
+  Status ReadBlock(const BlockHandle& handle, std::string* contents,
+                   uint64_t* bytes_read);
+
   // Mark the minirun indicated by the segment.run_handle[run_no] as invalid.
   // Later GCs can simply skip this run without querying index for validness.
   Status InvalidateMiniRun(const int& run_no);
@@ -157,9 +188,12 @@ class SegmentManager {
 
   SegmentManager& operator=(const SegmentManager&&) = delete;
 
+  // If manifest is not null, segments becoming visible or being removed
+  // are recorded in it.
   static Status OpenManager(const Options& options, const std::string& dbname,
                             SegmentManager** manager_ptr,
-                            std::function<void()> gc_func);
+                            std::function<void()> gc_func,
+                            Manifest* manifest = nullptr);
 
   // Get the top K most invalidated segments
   std::vector<Segment*> GetMostInvalidatedSegments(int K);
@@ -188,6 +222,15 @@ class SegmentManager {
 
   void ForEachSegment(std::function<void(Segment* seg)> processor);
 
+  // Load the metadata of every segment that has not been opened yet using
+  // num_threads threads. Failures are logged and left to lazy opening.
+  void WarmUpSegments(int num_threads);
+
+  // Stop storing the blocks evicted from options.block_cache in the
+  // secondary cache, if any.  Called before the block cache is destroyed,
+  // so that its teardown does not write back every block it holds.
+  void CloseSecondaryCache();
+
  private:
   struct Rep;
   Rep* rep_;
@@ -4,6 +4,7 @@
 
 #include <string>
 
+#include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
@@ -14,6 +15,7 @@
 #include "util/coding.h"
 #include "util/crc32c.h"
 
+#include "silkstore/leaf_filter.h"
 #include "silkstore/minirun.h"
 #include "silkstore/segment.h"
 
@@ -33,6 +35,10 @@ struct SegmentBuilder::Rep {
   std::string target_segment_filepath;
   uint32_t seg_id;
   SegmentManager* segment_mgr;
+  // LeafFilter hashes of the user keys of the current or last run, if leaf
+  // filters are enabled.
+  bool collect_key_hashes;
+  std::vector<uint64_t> run_key_hashes;
 
   Rep(const Options& opt, const std::string& src_segment_filepath,
       const std::string& target_segment_filepath, WritableFile* f,
@@ -46,7 +52,8 @@ struct SegmentBuilder::Rep {
         src_segment_filepath(src_segment_filepath),
         target_segment_filepath(target_segment_filepath),
         seg_id(seg_id),
-        segment_mgr(segment_mgr) {}
+        segment_mgr(segment_mgr),
+        collect_key_hashes(opt.leaf_filter_bits_per_key > 0) {}
 
   ~Rep() { delete file; }
 };
@@ -71,6 +78,7 @@ Status SegmentBuilder::StartMiniRun() {
   assert(r->run_started == false);
   r->run_started = true;
   r->run_builder->Reset(r->prev_file_size);
+  r->run_key_hashes.clear();
   return Status::OK();
 }
 
@@ -79,27 +87,47 @@ bool SegmentBuilder::RunStarted() const {
   return r->run_started;
 }
 
-Slice SegmentBuilder::GetFinishedRunIndexBlock() {
+Slice SegmentBuilder::GetFinishedRunIndexBlock() const {
   Rep* r = rep_;
   assert(r->run_started == false);
   return r->run_builder->IndexBlock();
 }
 
-uint32_t SegmentBuilder::GetFinishedRunDataSize() {
+uint32_t SegmentBuilder::GetFinishedRunDataSize() const {
   Rep* r = rep_;
   assert(r->run_started == false);
   return r->run_builder->GetCurrentRunDataSize();
 }
 
-Slice SegmentBuilder::GetFinishedRunFilterBlock() {
+const std::vector<uint64_t>& SegmentBuilder::GetFinishedRunKeyHashes() const {
+  Rep* r = rep_;
+  assert(r->run_started == false);
+  return r->run_key_hashes;
+}
+
+bool SegmentBuilder::GetFinishedRunMetadataHandle(BlockHandle* handle) const {
+  Rep* r = rep_;
+  assert(r->run_started == false);
+  if (!r->run_builder->MetadataSpilled()) return false;
+  *handle = r->run_builder->MetadataHandle();
+  return true;
+}
+
+Slice SegmentBuilder::GetFinishedRunFilterBlock() const {
   Rep* r = rep_;
   assert(r->run_started == false);
   return r->run_builder->FilterBlock();
 }
 
-Status SegmentBuilder::FinishMiniRun(uint32_t* run_no) {
+Status SegmentBuilder::FinishMiniRun(uint32_t* run_no,
+                                     const FilterPolicy* filter_policy,
+                                     bool spill_metadata) {
   Rep* r = rep_;
   assert(r->run_started == true);
+  if (filter_policy != nullptr && r->options.filter_policy != nullptr) {
+    r->run_builder->SetFilterPolicy(filter_policy);
+  }
+  r->run_builder->SetSpillMetadata(spill_metadata);
   r->status = r->run_builder->Finish();
   if (!ok()) return status();
   *run_no = r->run_handles.size();
@@ -117,6 +145,9 @@ void SegmentBuilder::Add(const Slice& key, const Slice& value) {
   r->run_builder->Add(key, value);
   r->status = r->run_builder->status();
   if (ok()) ++r->num_entries;
+  if (r->collect_key_hashes) {
+    r->run_key_hashes.push_back(LeafFilter::HashKey(ExtractUserKey(key)));
+  }
 }
 
 Status SegmentBuilder::status() const { return rep_->status; }
@@ -146,6 +177,10 @@ Status SegmentBuilder::Finish() {
 
 uint64_t SegmentBuilder::NumEntries() const { return rep_->num_entries; }
 
+uint64_t SegmentBuilder::RunNumEntries() const {
+  return rep_->run_builder->NumEntries();
+}
+
 uint64_t SegmentBuilder::FileSize() const {
   return rep_->run_builder->FileSize();
 }
@@ -16,25 +16,22 @@
 #include "db/log_reader.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/write_batch.h"
 #include "table/merger.h"
 #include "util/mutexlock.h"
 
 #include "util/histogram.h"
+#include "silkstore/leaf_filter.h"
 #include "silkstore/silkstore_impl.h"
 #include "silkstore/silkstore_iter.h"
 #include "silkstore/util.h"
 
-int runs_searched = 0;
-int runs_hit_counts = 0;
-int runs_miss_counts = 0;
-int bloom_filter_counts = 0;
 namespace leveldb {
 
 Status DB::OpenSilkStore(const Options& options, const std::string& name,
                          DB** dbptr) {
   Options silkstore_options = options;
-  silkstore_options.env = Env::NewPosixEnv();
   *dbptr = nullptr;
   silkstore::SilkStore* store =
       new silkstore::SilkStore(silkstore_options, name);
@@ -50,7 +47,38 @@ Status DB::OpenSilkStore(const Options& options, const std::string& name,
 
 namespace silkstore {
 
-const std::string kCURRENTFilename = "CURRENT";
+static std::string LeafStatFileName(const std::string& dbname) {
+  return dbname + "/LEAFSTATS";
+}
+
+// Options for the reads of scans over all the leaves or all the entries of
+// a leaf, such as merges, splits, garbage collection and the statistics,
+// which must not evict the blocks point lookups keep coming back to.
+static ReadOptions ScanReadOptions() {
+  ReadOptions ropts;
+  ropts.fill_cache = false;
+  return ropts;
+}
+
+// Drops the row cache entries of the keys of a write batch, all
+// invalidated with the sequence number of its last write.
+class RowCacheInvalidator : public WriteBatch::Handler {
+ public:
+  RowCacheInvalidator(RowCache* row_cache, SequenceNumber sequence)
+      : row_cache_(row_cache), sequence_(sequence) {}
+
+  void Put(const Slice& key, const Slice& value) override {
+    row_cache_->Invalidate(key, sequence_);
+  }
+
+  void Delete(const Slice& key) override {
+    row_cache_->Invalidate(key, sequence_);
+  }
+
+ private:
+  RowCache* const row_cache_;
+  const SequenceNumber sequence_;
+};
 
 // Fix user-supplied options to be reasonable
 template <class T, class V>
@@ -87,6 +115,8 @@ SilkStore::SilkStore(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
       internal_comparator_(raw_options.comparator),
       internal_filter_policy_(raw_options.filter_policy),
+      filter_allocator_(raw_options.filter_policy,
+                        raw_options.adaptive_filter_bits_per_key),
       options_(SanitizeOptions(dbname, &internal_comparator_,
                                &internal_filter_policy_, raw_options)),
       owns_info_log_(options_.info_log != raw_options.info_log),
@@ -98,12 +128,14 @@ SilkStore::SilkStore(const Options& raw_options, const std::string& dbname)
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
-      logfile_(nullptr),
-      logfile_number_(0),
-      log_(nullptr),
+      manifest_(nullptr),
+      mem_nvm_offset_(0),
+      imm_nvm_offset_(0),
+      imm_sequence_(0),
       max_sequence_(0),
       memtable_capacity_(options_.write_buffer_size),
       seed_(0),
+      segment_manager_(nullptr),
       tmp_batch_(new WriteBatch),
       background_compaction_scheduled_(false),
       leaf_optimization_func_([]() {}),
@@ -112,6 +144,28 @@ SilkStore::SilkStore(const Options& raw_options, const std::string& dbname)
       manual_compaction_(nullptr) {
   nvm_manager_ =
       new NvmManager(raw_options.nvmemtable_file, raw_options.nvmemtable_size);
+  stat_store_.SetReadSampleRate(options_.leaf_read_sample_rate);
+  // stats_ counts from zero, so only the time of the first sample is set.
+  amp_window_start_.micros = env_->NowMicros();
+  amp_last_sample_ = amp_window_start_;
+  if (options_.row_cache_size > 0) {
+    row_cache_.reset(new RowCache(options_.row_cache_size));
+  }
+  if (options_.op_trace_file != nullptr) {
+    Status s = OpTracer::Open(env_, options_.op_trace_file,
+                              options_.op_trace_sample_rate, &op_tracer_);
+    if (!s.ok()) {
+      Log(options_.info_log, "Operation tracing disabled: %s\n",
+          s.ToString().c_str());
+    }
+  }
+  if (options_.event_trace_file != nullptr) {
+    Status s = EventTracer::Open(env_, options_.event_trace_file, &tracer_);
+    if (!s.ok()) {
+      Log(options_.info_log, "Event tracing disabled: %s\n",
+          s.ToString().c_str());
+    }
+  }
   has_imm_.Release_Store(nullptr);
 }
 
@@ -130,6 +184,10 @@ SilkStore::~SilkStore() {
   }
   leaf_op_mutex_.Unlock();
 
+  if (leaf_index_ != nullptr) {
+    stat_store_.SaveSnapshot(env_, LeafStatFileName(dbname_));
+  }
+
   // Delete leaf index
   delete leaf_index_;
   leaf_index_ = nullptr;
@@ -142,12 +200,15 @@ SilkStore::~SilkStore() {
   if (mem_ != nullptr) mem_->Unref();
   if (imm_ != nullptr) imm_->Unref();
   delete tmp_batch_;
-  delete log_;
-  delete logfile_;
+  delete manifest_;
+  delete tracer_;
+  delete op_tracer_;
   // delete table_cache_
   if (owns_info_log_) {
     delete options_.info_log;
   }
+  // Blocks the block cache drops from now on will not be read again.
+  if (segment_manager_ != nullptr) segment_manager_->CloseSecondaryCache();
   if (owns_cache_) {
     delete options_.block_cache;
   }
@@ -158,7 +219,7 @@ Status SilkStore::OpenIndex(const Options& index_options) {
   Status s =
       NvmLeafIndex::OpenNvmLeafIndex(index_options, dbname_, &leaf_index_);
 
-  auto it = leaf_index_->NewIterator(ReadOptions{});
+  auto it = leaf_index_->NewIterator(ScanReadOptions());
   DeferCode c([it]() { delete it; });
   int cnt = 0;
   std::map<int, int> counts;
@@ -171,6 +232,12 @@ Status SilkStore::OpenIndex(const Options& index_options) {
     counts[nums]++;
     it->Next();
   }
+  // Resume read optimization with the hotness observed before the restart.
+  Status ls = stat_store_.LoadSnapshot(env_, LeafStatFileName(dbname_));
+  if (!ls.ok() && !ls.IsNotFound()) {
+    Log(options_.info_log, "Ignoring leaf stat snapshot: %s\n",
+        ls.ToString().c_str());
+  }
   std::cout << "NvmLeafIndex NumMiniRuns\n";
   for (auto it : counts) {
     std::cout << "NumMiniRuns: " << it.first << " count " << it.second << "\n";
@@ -178,120 +245,42 @@ Status SilkStore::OpenIndex(const Options& index_options) {
   return s;
 }
 
-static std::string MakeFileName(const std::string& dbname, uint64_t number,
-                                const char* prefix, const char* suffix) {
-  char buf[100];
-  snprintf(buf, sizeof(buf), "/%s%06llu.%s", prefix,
-           static_cast<unsigned long long>(number), suffix);
-  return dbname + buf;
-}
-
-static std::string LogFileName(const std::string& dbname, uint64_t number) {
-  assert(number > 0);
-  return MakeFileName(dbname, number, "", "log");
-}
-
-static std::string CurrentFilename(const std::string& dbname) {
-  return dbname + "/" + kCURRENTFilename;
-}
-
-Status SilkStore::RecoverNvmemtable(uint64_t log_number,
+Status SilkStore::RecoverNvmemtable(const ManifestState& state,
                                     SequenceNumber* max_sequence) {
-  struct LogReporter : public log::Reader::Reporter {
-    Env* env;
-    Logger* info_log;
-    const char* fname;
-    Status* status;  // null if options_.paranoid_checks==false
-    virtual void Corruption(size_t bytes, const Status& s) {
-      Log(info_log, "%s%s: dropping %d bytes; %s",
-          (this->status == nullptr ? "(ignoring error) " : ""), fname,
-          static_cast<int>(bytes), s.ToString().c_str());
-      if (this->status != nullptr && this->status->ok()) *this->status = s;
-    }
-  };
-
-  // Open the log file.
-  std::string fname = LogFileName(dbname_, log_number);
-  SequentialFile* file;
-  Status status = env_->NewSequentialFile(fname, &file);
-  if (!status.ok()) {
-    return status;
-  }
-
-  // Create a log reader.
-  LogReporter reporter;
-  reporter.env = env_;
-  reporter.info_log = options_.info_log;
-  reporter.fname = fname.c_str();
-  reporter.status = (options_.paranoid_checks ? &status : nullptr);
-  // We intentionally make log::Reader do checksumming even if
-  // paranoid_checks==false so that corruptions cause entire commits
-  // to be skipped instead of propagating bad information (like overly
-  // large sequence numbers).
-  log::Reader reader(file, &reporter, true /*checksum*/, 0 /*initial_offset*/);
-  Log(options_.info_log, "Recovering log #%llu",
-      (unsigned long long)log_number);
-
-  // Read log records.
-  std::string scratch;
-  Slice record;
-  WriteBatch batch;
-  int compactions = 0;
-  NvmemTable* mem = nullptr;
-  if (reader.ReadRecord(&record, &scratch)) {
-    if (record.size() < 12) {
-      reporter.Corruption(record.size(),
-                          Status::Corruption("log record too small"));
-      fprintf(stderr, "RecoverMemtable Corruption log record too small\n");
-    }
-  }
-  // split record into string numbers.
-  std::string rec = record.ToString();
-  std::string delimiter = ",";
-  std::vector<size_t> records;
-  size_t pos;
-  while ((pos = rec.find(delimiter)) != std::string::npos) {
-    records.push_back(std::stoll(rec.substr(0, pos)));
-    rec.erase(0, pos + delimiter.length());
-  }
-
-  if (records.size() < 3 || records.size() % 2 != 1) {
-    fprintf(stderr, "RecoverMemtable Corruption\n");
-    std::cout << "records.size:" << records.size() << " ";
-    for (auto it : records) {
-      std::cout << it << " ";
-    }
-    std::cout << " \n";
-    return Status::NotSupported("RecoverMemtable");
-  }
-  // recovery nvm_manager_
-  nvm_manager_->recovery(records);
-  // recovery memtable;
-  int len = records.size() - 1;
-  mem_ =
-      new NvmemTable(internal_comparator_, nullptr,
-                     nvm_manager_->reallocate(records[len - 1], records[len]));
-  SequenceNumber last_seq;
-  mem_->Recovery(last_seq);
+  // The last region backs the mutable memtable. An older region is the
+  // immutable memtable of a compaction that did not commit before the
+  // crash; at most one may exist since switches wait for imm_ to drain.
+  const auto& regions = state.nvm_regions;
+  if (regions.empty() || regions.size() > 2) {
+    return Status::Corruption("manifest lists " +
+                              std::to_string(regions.size()) +
+                              " nvm memtable regions");
+  }
+  nvm_manager_->recovery(state.nvm_next_offset, regions);
+  *max_sequence = std::max(*max_sequence, state.last_sequence);
+
+  SequenceNumber last_seq = 0;
+  mem_nvm_offset_ = regions.back().first;
+  mem_ = new NvmemTable(
+      internal_comparator_, nullptr,
+      nvm_manager_->reallocate(regions.back().first, regions.back().second));
+  mem_->Recovery(&last_seq, options_.nvmemtable_recovery_threads);
   mem_->Ref();
-
-  if (last_seq > *max_sequence) {
-    *max_sequence = last_seq;
-  }
-  // recovery imm memtable
-  if (records.size() > 3) {
-    for (int i = len - 2; i >= 1; i -= 2) {
-      NvmemTable* imm =
-          new NvmemTable(internal_comparator_, nullptr,
-                         nvm_manager_->reallocate(records[i - 1], records[i]));
-      imm->Recovery(last_seq);
-      if (last_seq > *max_sequence) {
-        *max_sequence = last_seq;
-      }
-      imm->Ref();
-    }
+  *max_sequence = std::max(*max_sequence, last_seq);
+
+  if (regions.size() == 2) {
+    imm_nvm_offset_ = regions.front().first;
+    imm_ = new NvmemTable(
+        internal_comparator_, nullptr,
+        nvm_manager_->reallocate(regions.front().first,
+                                 regions.front().second));
+    last_seq = 0;
+    imm_->Recovery(&last_seq, options_.nvmemtable_recovery_threads);
+    imm_->Ref();
+    imm_sequence_ = std::max(state.leaf_index_sequence, last_seq);
+    has_imm_.Release_Store(imm_);
+    *max_sequence = std::max(*max_sequence, last_seq);
   }
-  delete file;
   return Status::OK();
 }
 
@@ -303,44 +292,32 @@ Status SilkStore::Recover() {
   this->leaf_index_options_.compression = kNoCompression;
   Status s = OpenIndex(this->leaf_index_options_);
   if (!s.ok()) return s;
+  bool created = false;
+  s = Manifest::Open(env_, dbname_, &manifest_, &created);
+  if (!s.ok()) return s;
   // Open segment manager
   s = SegmentManager::OpenManager(this->options_, dbname_, &segment_manager_,
-                                  std::bind(&SilkStore::GarbageCollect, this));
+                                  std::bind(&SilkStore::GarbageCollect, this),
+                                  manifest_);
   if (!s.ok()) return s;
   s = LeafStore::Open(segment_manager_, leaf_index_, options_,
-                      internal_comparator_.user_comparator(), &leaf_store_);
+                      internal_comparator_.user_comparator(), &stats_,
+                      &leaf_store_);
   if (!s.ok()) return s;
-  std::string current_content;
-  s = ReadFileToString(env_, CurrentFilename(dbname_), &current_content);
-  if (s.IsNotFound()) {
+  if (created) {
     // new db
-    mem_ = new NvmemTable(internal_comparator_, nullptr,
-                          nvm_manager_->allocate(100 * MB));
+    Nvmem* nvmem = nvm_manager_->allocate(100 * MB);
+    mem_nvm_offset_ = nvm_manager_->getOffset(nvmem);
+    mem_ = new NvmemTable(internal_comparator_, nullptr, nvmem);
     mem_->Ref();
-    SequenceNumber log_start_seq_num = max_sequence_ = 1;
-    WritableFile* lfile = nullptr;
-    s = env_->NewWritableFile(LogFileName(dbname_, log_start_seq_num), &lfile);
-    if (!s.ok()) return s;
-    logfile_ = lfile;
-    log_ = new log::Writer(logfile_);
-    std::string temp_current = dbname_ + "/" + "CURRENT_temp";
-    s = WriteStringToFile(env_, std::to_string(log_start_seq_num),
-                          temp_current);
-    if (!s.ok()) return s;
-    s = env_->RenameFile(temp_current, CurrentFilename(dbname_));
-    // modified by yunxiao to record nvm info
-    Status status = log_->AddRecord(nvm_manager_->getNvmInfo());
-    if (!status.ok()) {
-      printf("logfile_->Sync() Error \n");
-      return Status::NotSupported("logfile_->Sync() Error");
-    }
-    status = logfile_->Sync();
-    if (!status.ok()) {
-      printf("logfile_->Sync() Error \n");
-      return Status::NotSupported("logfile_->Sync() Error");
-    }
+    max_sequence_ = 1;
+    ManifestEdit edit;
+    edit.AddNvmRegion(mem_nvm_offset_, 100 * MB);
+    edit.SetNvmNextOffset(nvm_manager_->getNextOffset());
+    edit.SetLastSequence(max_sequence_);
+    s = manifest_->LogAndApply(&edit, true);
   } else {
-    Iterator* it = leaf_index_->NewIterator(ReadOptions{});
+    Iterator* it = leaf_index_->NewIterator(ScanReadOptions());
     DeferCode c([it]() { delete it; });
     it->SeekToFirst();
     num_leaves = 0;
@@ -355,13 +332,14 @@ Status SilkStore::Recover() {
     memtable_capacity_ = new_memtable_capacity_ > memtable_capacity_
                              ? new_memtable_capacity_
                              : memtable_capacity_;
-    SequenceNumber log_start_seq_num = std::stoi(current_content);
-    s = RecoverNvmemtable(log_start_seq_num, &max_sequence_);
+    s = RecoverNvmemtable(manifest_->State(), &max_sequence_);
+    if (s.ok()) MaybeScheduleCompaction();
   }
   if (!s.ok()) return s;
 
   leaf_optimization_func_ = [this]() {
     this->OptimizeLeaf();
+    if (tracer_ != nullptr) tracer_->Flush();
     background_leaf_optimization_scheduled_ = false;
     background_leaf_op_finished_signal_.SignalAll();
     leaf_op_mutex_.Unlock();
@@ -401,11 +379,21 @@ Status SilkStore::TEST_CompactMemTable() {
 // Convenience methods
 Status SilkStore::Put(const WriteOptions& o, const Slice& key,
                       const Slice& val) {
-  return DB::Put(o, key, val);
+  if (op_tracer_ != nullptr && op_tracer_->Sample()) {
+    op_tracer_->Record(env_->NowMicros(), kTracePut, key, val);
+  }
+  WriteBatch batch;
+  batch.Put(key, val);
+  return WriteImpl(o, &batch);
 }
 
 Status SilkStore::Delete(const WriteOptions& options, const Slice& key) {
-  return DB::Delete(options, key);
+  if (op_tracer_ != nullptr && op_tracer_->Sample()) {
+    op_tracer_->Record(env_->NowMicros(), kTraceDelete, key);
+  }
+  WriteBatch batch;
+  batch.Delete(key);
+  return WriteImpl(options, &batch);
 }
 
 namespace {
@@ -458,7 +446,8 @@ Iterator* SilkStore::NewIterator(const ReadOptions& ropts) {
   IterState* cleanup = new IterState(&mutex_, mem_, imm_);
   internal_iter->RegisterCleanup(SilkStoreNewIteratorCleanup, cleanup, nullptr);
   return leveldb::silkstore::NewDBIterator(
-      internal_comparator_.user_comparator(), internal_iter, seqno);
+      internal_comparator_.user_comparator(), internal_iter, seqno, &stats_,
+      op_tracer_);
 }
 
 // REQUIRES: mutex_ is held
@@ -475,21 +464,17 @@ Status SilkStore::MakeRoomForWrite(bool force) {
     } else if (imm_ != nullptr) {
       Log(options_.info_log,
           "Current memtable full;Compaction ongoing; waiting...\n");
+      StopWatch sw(&stats_, kWriteStallMicros);
+      TraceSpan span(tracer_, "write_stall");
+      span.SetArg("memtable_bytes", memtbl_size);
       background_work_finished_signal_.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
-      uint64_t new_log_number = max_sequence_;
-      WritableFile* lfile = nullptr;
-      s = env_->NewWritableFile(LogFileName(dbname_, new_log_number), &lfile);
-      if (!s.ok()) {
-        break;
-      }
-      delete log_;
-      delete logfile_;
-      logfile_ = lfile;
-      logfile_number_ = new_log_number;
-      log_ = new log::Writer(lfile);
+      TraceSpan span(tracer_, "memtable_switch");
+      span.SetArg("bytes", memtbl_size);
       imm_ = mem_;
+      imm_nvm_offset_ = mem_nvm_offset_;
+      imm_sequence_ = max_sequence_;
       has_imm_.Release_Store(imm_);
       size_t old_memtable_capacity = memtable_capacity_;
       size_t new_memtable_capacity =
@@ -524,22 +509,24 @@ Status SilkStore::MakeRoomForWrite(bool force) {
                                   options_.memtable_dynamic_filter_fp_rate);
       }
       // TODO(yunxiao) Opt nvm's alllocate
-      mem_ = new NvmemTable(
-          internal_comparator_, dynamic_filter,
-          nvm_manager_->allocate(new_memtable_capacity + 4 * MB));
-      Status status = log_->AddRecord(nvm_manager_->getNvmInfo());
-      if (!status.ok()) {
-        printf("logfile_->Sync() Error \n");
-        assert(false);
-      }
-      status = logfile_->Sync();
-      if (!status.ok()) {
-        printf("logfile_->Sync() Error \n");
-        assert(false);
-      }
+      size_t nvm_size = new_memtable_capacity + 4 * MB;
+      Nvmem* nvmem = nvm_manager_->allocate(nvm_size);
+      mem_nvm_offset_ = nvm_manager_->getOffset(nvmem);
+      mem_ = new NvmemTable(internal_comparator_, dynamic_filter, nvmem);
+      // Make the new region durable before any write lands in it.
+      ManifestEdit edit;
+      edit.AddNvmRegion(mem_nvm_offset_, nvm_size);
+      edit.SetNvmNextOffset(nvm_manager_->getNextOffset());
+      edit.SetLastSequence(max_sequence_);
+      s = manifest_->LogAndApply(&edit, true);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
+      if (!s.ok()) {
+        Log(options_.info_log, "Failed logging memtable switch: %s\n",
+            s.ToString().c_str());
+        break;
+      }
     }
   }
   return s;
@@ -563,7 +550,10 @@ void SilkStore::BackgroundCall() {
 }
 
 void SilkStore::BGWork(void* db) {
-  reinterpret_cast<SilkStore*>(db)->BackgroundCall();
+  SilkStore* store = reinterpret_cast<SilkStore*>(db);
+  store->BackgroundCall();
+  // Write the spans that ended under mutex_, now that it is released.
+  if (store->tracer_ != nullptr) store->tracer_->Flush();
 }
 
 void SilkStore::MaybeScheduleCompaction() {
@@ -593,6 +583,19 @@ struct SilkStore::Writer {
 };
 
 Status SilkStore::Write(const WriteOptions& options, WriteBatch* my_batch) {
+  // A null batch only forces a memtable switch and is not traced.
+  if (my_batch != nullptr && op_tracer_ != nullptr && op_tracer_->Sample()) {
+    op_tracer_->Record(env_->NowMicros(), kTraceWrite, Slice(),
+                       WriteBatchInternal::Contents(my_batch));
+  }
+  return WriteImpl(options, my_batch);
+}
+
+Status SilkStore::WriteImpl(const WriteOptions& options,
+                            WriteBatch* my_batch) {
+  StopWatch sw(&stats_, kWriteMicros);
+  PerfTimer wait_timer(SILKSTORE_PERF_FIELD(options.perf_context,
+                                            write_wait_nanos));
   Writer w(&mutex_);
   w.batch = my_batch;
   w.sync = options.sync;
@@ -608,6 +611,7 @@ Status SilkStore::Write(const WriteOptions& options, WriteBatch* my_batch) {
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(my_batch == nullptr);
+  wait_timer.Stop();
   uint64_t last_sequence = max_sequence_;
   Writer* last_writer = &w;
 
@@ -615,12 +619,24 @@ Status SilkStore::Write(const WriteOptions& options, WriteBatch* my_batch) {
   if (status.ok() && my_batch != nullptr) {  // nullptr batch is for compactions
     WriteBatch* updates = BuildBatchGroup(&last_writer);
     WriteBatchInternal::SetSequence(updates, last_sequence + 1);
+    // Batch payload, i.e. keys and values plus a few bytes of framing.
+    stats_.Record(kUserBytesWritten, WriteBatchInternal::ByteSize(updates));
     size_t nums = WriteBatchInternal::Count(updates);
     last_sequence += nums;
     {
       mutex_.Unlock();
-      status = WriteBatchInternal::InsertInto(updates, mem_);
-      mem_->AddCounter(nums);
+      PerfTimer mem_timer(SILKSTORE_PERF_FIELD(options.perf_context,
+                                               write_memtable_nanos));
+      if (row_cache_ != nullptr) {
+        RowCacheInvalidator invalidator(row_cache_.get(), last_sequence);
+        updates->Iterate(&invalidator);
+      }
+      {
+        StopWatch persist_sw(&stats_, kNvmPersistMicros);
+        status = WriteBatchInternal::InsertInto(updates, mem_);
+        mem_->AddCounter(nums);
+      }
+      mem_timer.Stop();
       mutex_.Lock();
     }
     if (updates == tmp_batch_) tmp_batch_->Clear();
@@ -646,16 +662,56 @@ Status SilkStore::Write(const WriteOptions& options, WriteBatch* my_batch) {
 
 bool SilkStore::GetProperty(const Slice& property, std::string* value) {
   if (property.ToString() == "silkstore.runs_searched") {
-    *value = std::to_string(runs_searched) + "\n";
+    *value = std::to_string(stats_.Get(kRunsSearched)) + "\n";
     value->append("runs_hit_counts: ");
-    value->append(std::to_string(runs_hit_counts) + "\n");
+    value->append(std::to_string(stats_.Get(kRunsHit)) + "\n");
     value->append("runs_miss_counts: ");
-    value->append(std::to_string(runs_miss_counts) + "\n");
+    value->append(std::to_string(stats_.Get(kRunsMiss)) + "\n");
     value->append("bloom_filter_counts: ");
-    value->append(std::to_string(bloom_filter_counts) + "\n");
+    value->append(std::to_string(stats_.Get(kBloomFilterUseful)) + "\n");
+    value->append("leaf_filter_counts: ");
+    value->append(std::to_string(stats_.Get(kLeafFilterUseful)) + "\n");
+    if (options_.cold_leaf_read_hotness > 0) {
+      value->append("metadata_cache_hit: ");
+      value->append(std::to_string(stats_.Get(kMetadataCacheHit)) + "\n");
+      value->append("metadata_cache_miss: ");
+      value->append(std::to_string(stats_.Get(kMetadataCacheMiss)) + "\n");
+    }
+    if (options_.block_cache != nullptr) {
+      value->append("block_cache_hit: ");
+      value->append(std::to_string(stats_.Get(kBlockCacheHit)) + "\n");
+      value->append("block_cache_miss: ");
+      value->append(std::to_string(stats_.Get(kBlockCacheMiss)) + "\n");
+    }
+    if (options_.block_cache != nullptr &&
+        options_.secondary_cache_file != nullptr) {
+      value->append("secondary_cache_hit: ");
+      value->append(std::to_string(stats_.Get(kSecondaryCacheHit)) + "\n");
+      value->append("secondary_cache_miss: ");
+      value->append(std::to_string(stats_.Get(kSecondaryCacheMiss)) + "\n");
+    }
+    if (row_cache_ != nullptr) {
+      const uint64_t hits = stats_.Get(kRowCacheHit);
+      const uint64_t misses = stats_.Get(kRowCacheMiss);
+      value->append("row_cache_hit: ");
+      value->append(std::to_string(hits) + "\n");
+      value->append("row_cache_miss: ");
+      value->append(std::to_string(misses) + "\n");
+      value->append("row_cache_hit_ratio: ");
+      value->append(std::to_string(
+                        hits + misses == 0
+                            ? 0.0
+                            : static_cast<double>(hits) / (hits + misses)) +
+                    "\n");
+    }
+    if (filter_allocator_.enabled()) {
+      value->append("filter_bits_per_key: ");
+      value->append(std::to_string(filter_allocator_.AverageBitsPerKey()) +
+                    "\n");
+    }
     return true;
   } else if (property.ToString() == "silkstore.num_leaves") {
-    auto it = leaf_index_->NewIterator(ReadOptions{});
+    auto it = leaf_index_->NewIterator(ScanReadOptions());
     DeferCode c([it]() { delete it; });
     int cnt = 0;
     std::map<int, int> counts;
@@ -676,7 +732,7 @@ bool SilkStore::GetProperty(const Slice& property, std::string* value) {
 
     return true;
   } else if (property.ToString() == "silkstore.leaf_stats") {
-    auto it = leaf_index_->NewIterator(ReadOptions{});
+    auto it = leaf_index_->NewIterator(ScanReadOptions());
     DeferCode c([it]() { delete it; });
     int cnt = 0;
     it->SeekToFirst();
@@ -692,7 +748,7 @@ bool SilkStore::GetProperty(const Slice& property, std::string* value) {
     }
     return true;
   } else if (property.ToString() == "silkstore.leaf_avg_num_runs") {
-    auto it = leaf_index_->NewIterator(ReadOptions{});
+    auto it = leaf_index_->NewIterator(ScanReadOptions());
     DeferCode c([it]() { delete it; });
     int leaf_cnt = 0;
     int run_cnt = 0;
@@ -716,7 +772,7 @@ bool SilkStore::GetProperty(const Slice& property, std::string* value) {
     return true;
   } else if (property.ToString() == "silkstore.gcstat") {
     *value =
-        "\ntime spent in gc: " + std::to_string(stats_.time_spent_gc) + "us\n";
+        "\ntime spent in gc: " + std::to_string(stats_.Get(kGCMicros)) + "us\n";
     return true;
   } else if (property.ToString() == "silkstore.segment_util") {
     *value = this->SegmentsSpaceUtilityHistogram();
@@ -731,18 +787,24 @@ bool SilkStore::GetProperty(const Slice& property, std::string* value) {
              "bytes wt gc %lu\n"
              "# miniruns checked for gc %lu\n"
              "# miniruns queried for gc %lu\n",
-             stats_.bytes_read, stats_.bytes_written,
-             stats_.gc_bytes_read_unopt, stats_.gc_bytes_read,
-             stats_.gc_bytes_written, stats_.gc_miniruns_total,
-             stats_.gc_miniruns_queried);
+             stats_.Get(kBytesRead), stats_.Get(kBytesWritten),
+             stats_.Get(kGCBytesReadUnopt), stats_.Get(kGCBytesRead),
+             stats_.Get(kGCBytesWritten), stats_.Get(kGCMiniRunsTotal),
+             stats_.Get(kGCMiniRunsQueried));
 
     *value = buf;
     std::string leaf_index_stats;
     leaf_index_->GetProperty("leveldb.stats", &leaf_index_stats);
     value->append(leaf_index_stats);
     return true;
+  } else if (property.ToString() == "silkstore.amplification") {
+    *value = this->AmplificationReport();
+    return true;
+  } else if (property.ToString() == "silkstore.histograms") {
+    *value = stats_.HistogramsToJson();
+    return true;
   } else if (property.ToString() == "silkstore.write_volume") {
-    *value = std::to_string(stats_.bytes_written);
+    *value = std::to_string(stats_.Get(kBytesWritten));
     return true;
   }
   return false;
@@ -750,6 +812,10 @@ bool SilkStore::GetProperty(const Slice& property, std::string* value) {
 
 Status SilkStore::Get(const ReadOptions& options, const Slice& key,
                       std::string* value) {
+  StopWatch sw(&stats_, kGetMicros);
+  if (op_tracer_ != nullptr && op_tracer_->Sample()) {
+    op_tracer_->Record(env_->NowMicros(), kTraceGet, key);
+  }
   Status s;
   MutexLock l(&mutex_);
   SequenceNumber snapshot;
@@ -768,13 +834,35 @@ Status SilkStore::Get(const ReadOptions& options, const Slice& key,
     mutex_.Unlock();
     // First look in the memtable, then in the immutable memtable (if any).
     LookupKey lkey(key, snapshot);
+    PerfTimer mem_timer(SILKSTORE_PERF_FIELD(options.perf_context,
+                                             memtable_nanos));
     if (mem->Get(lkey, value, &s)) {
       // Done
     } else if (imm != nullptr && imm->Get(lkey, value, &s)) {
       // Done
     } else {
-      s = leaf_store_->Get(options, lkey, value, stat_store_);
+      mem_timer.Stop();
+      if (row_cache_ == nullptr) {
+        s = leaf_store_->Get(options, lkey, value, stat_store_);
+      } else {
+        const uint64_t start = StopWatch::NowMicros();
+        if (row_cache_->Lookup(key, snapshot, value, &s)) {
+          stats_.Record(kRowCacheHit);
+          stats_.MeasureTime(kRowCacheHitMicros,
+                             StopWatch::NowMicros() - start);
+        } else {
+          stats_.Record(kRowCacheMiss);
+          s = leaf_store_->Get(options, lkey, value, stat_store_);
+          if (options.fill_cache && (s.ok() || s.IsNotFound())) {
+            row_cache_->Insert(key, snapshot, *value, s.ok());
+          }
+          stats_.MeasureTime(kRowCacheMissMicros,
+                             StopWatch::NowMicros() - start);
+        }
+      }
     }
+    mem_timer.Stop();
+    if (s.ok()) stats_.Record(kUserBytesRead, key.size() + value->size());
     mutex_.Lock();
   }
 
@@ -837,12 +925,17 @@ WriteBatch* SilkStore::BuildBatchGroup(Writer** last_writer) {
 
 class GroupedSegmentAppender {
  public:
+  // The size of every finished segment is added to written_ticker of
+  // *stats.
   GroupedSegmentAppender(int num_groups, SegmentManager* segment_manager,
-                         const Options& options,
+                         const Options& options, Statistics* stats,
+                         Ticker written_ticker,
                          bool gc_on_segment_shortage = true)
       : builders(num_groups),
         segment_manager(segment_manager),
         options(options),
+        stats(stats),
+        written_ticker(written_ticker),
         gc_on_segment_shortage(gc_on_segment_shortage) {}
 
   // Make sure the segment that is being built by a group has enough space.
@@ -865,6 +958,7 @@ class GroupedSegmentAppender {
       if (!s.ok()) {
         return s;
       }
+      stats->Record(written_ticker, builders[group_id]->FileSize());
       delete builders[group_id];
       builders[group_id] = nullptr;
     }
@@ -884,7 +978,9 @@ class GroupedSegmentAppender {
     // Finish off unfinished segments
     for (size_t i = 0; i < builders.size(); ++i) {
       if (builders[i] == nullptr) continue;
-      builders[i]->Finish();
+      if (builders[i]->Finish().ok()) {
+        stats->Record(written_ticker, builders[i]->FileSize());
+      }
       delete builders[i];
       builders[i] = nullptr;
     }
@@ -894,6 +990,8 @@ class GroupedSegmentAppender {
   std::vector<SegmentBuilder*> builders;
   SegmentManager* segment_manager;
   Options options;
+  Statistics* stats;
+  Ticker written_ticker;
   bool gc_on_segment_shortage;
 };
 
@@ -905,8 +1003,61 @@ std::pair<uint32_t, uint32_t> SilkStore::ChooseLeafCompactionRunRange(
   return {num_runs - 2, num_runs - 1};
 }
 
+const FilterPolicy* SilkStore::RunFilterPolicy(
+    const Slice& leaf_max_key, const SegmentBuilder* seg_builder) {
+  if (!filter_allocator_.enabled()) return nullptr;
+  return filter_allocator_.PolicyForRun(
+      stat_store_.GetReadHotness(leaf_max_key.ToString()),
+      seg_builder->RunNumEntries());
+}
+
+bool SilkStore::SpillRunMetadata(const Slice& leaf_max_key) {
+  if (options_.cold_leaf_read_hotness <= 0) return false;
+  // Leaves without statistics yet have not been read either.
+  return stat_store_.GetReadHotness(leaf_max_key.ToString()) <
+         options_.cold_leaf_read_hotness;
+}
+
+MiniRunIndexEntry SilkStore::FinishedRunIndexEntry(
+    const SegmentBuilder* seg_builder, uint32_t run_no, std::string* buf) {
+  BlockHandle metadata_handle;
+  if (seg_builder->GetFinishedRunMetadataHandle(&metadata_handle)) {
+    return MiniRunIndexEntry::BuildSpilled(
+        seg_builder->SegmentId(), run_no, metadata_handle,
+        seg_builder->GetFinishedRunDataSize(), buf);
+  }
+  return MiniRunIndexEntry::Build(seg_builder->SegmentId(), run_no,
+                                  seg_builder->GetFinishedRunIndexBlock(),
+                                  seg_builder->GetFinishedRunFilterBlock(),
+                                  seg_builder->GetFinishedRunDataSize(), buf);
+}
+
+void SilkStore::BuildLeafFilter(const LeafIndexEntry& base,
+                                const SegmentBuilder* seg_builder,
+                                std::string* filter) {
+  filter->clear();
+  if (options_.leaf_filter_bits_per_key <= 0) return;
+  const std::vector<uint64_t>& hashes = seg_builder->GetFinishedRunKeyHashes();
+  if (base.Empty()) {
+    // Leave room for the keys the leaf may take in before it is split,
+    // estimated from the size of the entries of this run.
+    const uint64_t run_size =
+        std::max<uint64_t>(seg_builder->GetFinishedRunDataSize(), 1);
+    const uint64_t capacity = std::max<uint64_t>(
+        hashes.size(), hashes.size() * options_.leaf_datasize_thresh / run_size);
+    LeafFilter::Build(hashes.data(), hashes.size(), capacity,
+                      options_.leaf_filter_bits_per_key, filter);
+  } else if (base.HasLeafFilter()) {
+    if (!LeafFilter::Extend(base.GetLeafFilter(), hashes.data(), hashes.size(),
+                            filter)) {
+      filter->clear();
+    }
+  }
+}
+
 LeafIndexEntry SilkStore::CompactLeaf(SegmentBuilder* seg_builder,
                                       uint32_t seg_no,
+                                      const std::string& leaf_max_key,
                                       const LeafIndexEntry& leaf_index_entry,
                                       Status& s, std::string* buf,
                                       uint32_t start_minirun_no,
@@ -915,7 +1066,7 @@ LeafIndexEntry SilkStore::CompactLeaf(SegmentBuilder* seg_builder,
   buf->clear();
   bool cover_whole_range = end_minirun_no - start_minirun_no + 1 ==
                            leaf_index_entry.GetNumMiniRuns();
-  ReadOptions ropts;
+  ReadOptions ropts = ScanReadOptions();
   ropts.snapshot = leaf_index_snap;
   Iterator* it = leaf_store_->NewIteratorForLeaf(
       ropts, leaf_index_entry, s, start_minirun_no, end_minirun_no);
@@ -937,8 +1088,7 @@ LeafIndexEntry SilkStore::CompactLeaf(SegmentBuilder* seg_builder,
     } else {
       auto itvalue = it->value();
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
+          CompareUserKeys(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -970,17 +1120,27 @@ LeafIndexEntry SilkStore::CompactLeaf(SegmentBuilder* seg_builder,
         &new_leaf_index_entry);
   } else {
     uint32_t run_no;
-    seg_builder->FinishMiniRun(&run_no);
+    seg_builder->FinishMiniRun(&run_no,
+                               RunFilterPolicy(leaf_max_key, seg_builder),
+                               SpillRunMetadata(leaf_max_key));
     // Otherwise, replace the compacted range minirun index entries with the
     // result minirun index entry
     std::string buf2;
-    MiniRunIndexEntry replacement = MiniRunIndexEntry::Build(
-        seg_no, run_no, seg_builder->GetFinishedRunIndexBlock(),
-        seg_builder->GetFinishedRunFilterBlock(),
-        seg_builder->GetFinishedRunDataSize(), &buf2);
-    s = LeafIndexEntryBuilder::ReplaceMiniRunRange(
-        leaf_index_entry, start_minirun_no, end_minirun_no, replacement, buf,
-        &new_leaf_index_entry);
+    MiniRunIndexEntry replacement =
+        FinishedRunIndexEntry(seg_builder, run_no, &buf2);
+    if (cover_whole_range) {
+      // The leaf is now made of the replacement alone: rebuild its filter
+      // without the keys dropped by the compaction.
+      std::string leaf_filter;
+      BuildLeafFilter(LeafIndexEntry{}, seg_builder, &leaf_filter);
+      LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
+          LeafIndexEntry{}, replacement, buf, &new_leaf_index_entry,
+          leaf_filter);
+    } else {
+      s = LeafIndexEntryBuilder::ReplaceMiniRunRange(
+          leaf_index_entry, start_minirun_no, end_minirun_no, replacement, buf,
+          &new_leaf_index_entry);
+    }
   }
 
   if (!s.ok()) return {};
@@ -995,7 +1155,8 @@ Status SilkStore::CopyMinirunRun(Slice leaf_max_key,
   Status s;
   assert(run_idx_in_index_entry < leaf_index_entry.GetNumMiniRuns());
   std::unique_ptr<Iterator> source_it(leaf_store_->NewIteratorForLeaf(
-      {}, leaf_index_entry, s, run_idx_in_index_entry, run_idx_in_index_entry));
+      ScanReadOptions(), leaf_index_entry, s, run_idx_in_index_entry,
+      run_idx_in_index_entry));
   if (!s.ok()) return s;
   assert(target_seg_builder->RunStarted() == false);
   source_it->SeekToFirst();
@@ -1006,15 +1167,16 @@ Status SilkStore::CopyMinirunRun(Slice leaf_max_key,
     source_it->Next();
   }
   uint32_t run_no;
-  s = target_seg_builder->FinishMiniRun(&run_no);
+  s = target_seg_builder->FinishMiniRun(
+      &run_no, RunFilterPolicy(leaf_max_key, target_seg_builder),
+      SpillRunMetadata(leaf_max_key));
   if (!s.ok()) return s;
   std::string buf;
   buf.clear();
-  MiniRunIndexEntry new_minirun_index_entry = MiniRunIndexEntry::Build(
-      target_seg_builder->SegmentId(), run_no,
-      target_seg_builder->GetFinishedRunIndexBlock(),
-      target_seg_builder->GetFinishedRunFilterBlock(),
-      target_seg_builder->GetFinishedRunDataSize(), &buf);
+  MiniRunIndexEntry new_minirun_index_entry =
+      FinishedRunIndexEntry(target_seg_builder, run_no, &buf);
+  stat_store_.AddLeafWrites(leaf_max_key.ToString(), 0,
+                            target_seg_builder->GetFinishedRunDataSize());
   LeafIndexEntry new_leaf_index_entry;
   std::string buf2;
   s = LeafIndexEntryBuilder::ReplaceMiniRunRange(
@@ -1048,11 +1210,12 @@ Status SilkStore::GarbageCollectSegment(Segment* seg,
     s = seg->OpenMiniRun(run_no, index_block, &run);
     if (!s.ok())  // error, early exit
       return true;
+    run->SetReadStatistics(&stats_, kDeviceBytesReadBackground);
     DeferCode c([run]() { delete run; });
     BlockHandle last_block_handle = run_handle.last_block_handle;
 
     std::unique_ptr<Iterator> block_it(
-        run->NewIteratorForOneBlock({}, last_block_handle));
+        run->NewIteratorForOneBlock(ScanReadOptions(), last_block_handle));
 
     // Read the last block aligned by options_.block_size
     stats_.AddGCStats(std::max(options_.block_size, last_block_handle.size()),
@@ -1068,7 +1231,8 @@ Status SilkStore::GarbageCollectSegment(Segment* seg,
         return true;
       }
       auto user_key = parsed_internal_key.user_key;
-      std::unique_ptr<Iterator> leaf_it(leaf_index_->NewIterator({}));
+      std::unique_ptr<Iterator> leaf_it(
+          leaf_index_->NewIterator(ScanReadOptions()));
       leaf_it->Seek(user_key);
       if (!leaf_it->Valid()) return false;
 
@@ -1124,6 +1288,130 @@ Status SilkStore::GarbageCollectSegment(Segment* seg,
   return Status::OK();
 }
 
+static double Ratio(uint64_t numerator, uint64_t denominator) {
+  return denominator == 0 ? 0 : static_cast<double>(numerator) / denominator;
+}
+
+std::string SilkStore::AmplificationReport() {
+  AmplificationSample cur;
+  cur.micros = env_->NowMicros();
+  cur.user_bytes_written = stats_.Get(kUserBytesWritten);
+  cur.user_bytes_read = stats_.Get(kUserBytesRead);
+  uint64_t merge_written = stats_.Get(kDeviceBytesWrittenMerge);
+  uint64_t split_written = stats_.Get(kDeviceBytesWrittenSplit);
+  uint64_t optimize_written = stats_.Get(kDeviceBytesWrittenOptimize);
+  uint64_t gc_written = stats_.Get(kDeviceBytesWrittenGC);
+  cur.device_bytes_written =
+      merge_written + split_written + optimize_written + gc_written;
+  uint64_t get_read = stats_.Get(kDeviceBytesReadGet);
+  uint64_t scan_read = stats_.Get(kDeviceBytesReadScan);
+  uint64_t background_read = stats_.Get(kDeviceBytesReadBackground);
+  // Read amplification only charges the reads done on behalf of users.
+  cur.device_bytes_read = get_read + scan_read;
+
+  AmplificationSample start;
+  {
+    MutexLock l(&amp_mutex_);
+    if (cur.micros - amp_last_sample_.micros >= kAmplificationWindowMicros) {
+      amp_window_start_ = amp_last_sample_;
+      amp_last_sample_ = cur;
+    }
+    start = amp_window_start_;
+  }
+
+  // Space amplification compares the segments against the data that the
+  // leaf index still references.
+  uint64_t live_bytes = 0;
+  {
+    std::unique_ptr<Iterator> it(leaf_index_->NewIterator(ScanReadOptions()));
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+      live_bytes += LeafIndexEntry(it->value()).GetLeafDataSize();
+    }
+  }
+  uint64_t segment_bytes = segment_manager_->ApproximateSize();
+
+  struct GroupTotals {
+    uint64_t leaves = 0;
+    uint64_t user_bytes_written = 0;
+    uint64_t device_bytes_written = 0;
+    uint64_t device_bytes_read = 0;
+    uint64_t reads = 0;
+  };
+  std::map<int, GroupTotals> groups;
+  stat_store_.ForEachLeaf(
+      [&groups](const std::string&, const LeafStatStore::LeafStat& stat) {
+        GroupTotals& g = groups[stat.group_id];
+        ++g.leaves;
+        g.user_bytes_written += stat.user_bytes_written;
+        g.device_bytes_written += stat.device_bytes_written;
+        g.device_bytes_read += stat.device_bytes_read;
+        g.reads += stat.reads;
+      });
+
+  typedef unsigned long long ull;
+  char buf[1024];
+  std::string r;
+  snprintf(buf, sizeof(buf),
+           "{\"overall\": {\"user_bytes_written\": %llu, "
+           "\"user_bytes_read\": %llu, "
+           "\"device_bytes_written\": {\"merge\": %llu, \"split\": %llu, "
+           "\"optimize\": %llu, \"gc\": %llu}, "
+           "\"device_bytes_read\": {\"get\": %llu, \"scan\": %llu, "
+           "\"background\": %llu}, "
+           "\"segment_bytes\": %llu, \"live_bytes\": %llu, "
+           "\"write_amp\": %.3f, \"read_amp\": %.3f, "
+           "\"space_amp\": %.3f}, ",
+           (ull)cur.user_bytes_written, (ull)cur.user_bytes_read,
+           (ull)merge_written, (ull)split_written, (ull)optimize_written,
+           (ull)gc_written, (ull)get_read, (ull)scan_read,
+           (ull)background_read, (ull)segment_bytes, (ull)live_bytes,
+           Ratio(cur.device_bytes_written, cur.user_bytes_written),
+           Ratio(cur.device_bytes_read, cur.user_bytes_read),
+           Ratio(segment_bytes, live_bytes));
+  r.append(buf);
+
+  uint64_t recent_user_written =
+      cur.user_bytes_written - start.user_bytes_written;
+  uint64_t recent_user_read = cur.user_bytes_read - start.user_bytes_read;
+  uint64_t recent_device_written =
+      cur.device_bytes_written - start.device_bytes_written;
+  uint64_t recent_device_read =
+      cur.device_bytes_read - start.device_bytes_read;
+  snprintf(buf, sizeof(buf),
+           "\"recent\": {\"seconds\": %.1f, \"user_bytes_written\": %llu, "
+           "\"user_bytes_read\": %llu, \"device_bytes_written\": %llu, "
+           "\"device_bytes_read\": %llu, \"write_amp\": %.3f, "
+           "\"read_amp\": %.3f}, ",
+           (cur.micros - start.micros) / 1e6, (ull)recent_user_written,
+           (ull)recent_user_read, (ull)recent_device_written,
+           (ull)recent_device_read,
+           Ratio(recent_device_written, recent_user_written),
+           Ratio(recent_device_read, recent_user_read));
+  r.append(buf);
+
+  // Per leaf group, by LeafStat::group_id. Leaves without a group are
+  // reported under -1.
+  r.append("\"groups\": {");
+  bool first = true;
+  for (auto& kv : groups) {
+    const GroupTotals& g = kv.second;
+    snprintf(buf, sizeof(buf),
+             "%s\"%d\": {\"leaves\": %llu, \"user_bytes_written\": %llu, "
+             "\"device_bytes_written\": %llu, \"device_bytes_read\": %llu, "
+             "\"reads\": %llu, \"write_amp\": %.3f, "
+             "\"device_bytes_per_read\": %.3f}",
+             first ? "" : ", ", kv.first, (ull)g.leaves,
+             (ull)g.user_bytes_written, (ull)g.device_bytes_written,
+             (ull)g.device_bytes_read, (ull)g.reads,
+             Ratio(g.device_bytes_written, g.user_bytes_written),
+             Ratio(g.device_bytes_read, g.reads));
+    r.append(buf);
+    first = false;
+  }
+  r.append("}}");
+  return r;
+}
+
 std::string SilkStore::SegmentsSpaceUtilityHistogram() {
   MutexLock g(&GCMutex);
   Histogram hist;
@@ -1158,7 +1446,7 @@ std::string SilkStore::SegmentsSpaceUtilityHistogram() {
       BlockHandle last_block_handle = run_handle.last_block_handle;
 
       std::unique_ptr<Iterator> block_it(
-          run->NewIteratorForOneBlock({}, last_block_handle));
+          run->NewIteratorForOneBlock(ScanReadOptions(), last_block_handle));
 
       // Read the last block aligned by options_.block_size
       block_it->SeekToFirst();
@@ -1172,7 +1460,8 @@ std::string SilkStore::SegmentsSpaceUtilityHistogram() {
           return true;
         }
         auto user_key = parsed_internal_key.user_key;
-        std::unique_ptr<Iterator> leaf_it(leaf_index_->NewIterator({}));
+        std::unique_ptr<Iterator> leaf_it(
+          leaf_index_->NewIterator(ScanReadOptions()));
         leaf_it->Seek(user_key);
         if (!leaf_it->Valid()) return false;
 
@@ -1226,9 +1515,16 @@ int SilkStore::GarbageCollect() {
   if (candidates.empty()) return 0;
   // Disable nested garbage collection
   bool gc_on_segment_shortage = false;
-  GroupedSegmentAppender appender(1, segment_manager_, options_,
+  GroupedSegmentAppender appender(1, segment_manager_, options_, &stats_,
+                                  kDeviceBytesWrittenGC,
                                   gc_on_segment_shortage);
+  TraceSpan span(tracer_, "gc");
+  span.SetArg("segments", candidates.size());
   for (auto seg : candidates) {
+    StopWatch sw(&stats_, kGCSegmentMicros);
+    TraceSpan seg_span(tracer_, "gc_segment");
+    seg_span.SetArg("segment_id", seg->SegmentId());
+    seg_span.SetArg("bytes", seg->SegmentSize());
     GarbageCollectSegment(seg, appender, leaf_index_wb);
   }
 
@@ -1268,7 +1564,19 @@ Status SilkStore::OptimizeLeaf() {
   Log(options_.info_log, "Updating read hotness for all leaves.");
   stat_store_.UpdateReadHotness();
 
+  uint64_t now = env_->NowMicros();
+  if (now - last_leaf_stat_snapshot_micros_ >=
+      LeafStatStore::snapshot_interval_in_micros) {
+    Status ss = stat_store_.SaveSnapshot(env_, LeafStatFileName(dbname_));
+    if (!ss.ok()) {
+      Log(options_.info_log, "Failed saving leaf stat snapshot: %s\n",
+          ss.ToString().c_str());
+    }
+    last_leaf_stat_snapshot_micros_ = now;
+  }
+
   if (options_.enable_leaf_read_opt == false) return Status::OK();
+  TraceSpan span(tracer_, "optimize_leaf");
   Log(options_.info_log,
       "Scanning for leaves that are suitable for optimization.");
 
@@ -1335,6 +1643,7 @@ Status SilkStore::OptimizeLeaf() {
       if (!s.ok()) {
         return s;
       }
+      stats_.Record(kDeviceBytesWrittenOptimize, seg_builder->FileSize());
       bool gc_on_segment_shortage = true;
       s = segment_manager_->NewSegmentBuilder(&seg_id, seg_builder,
                                               gc_on_segment_shortage);
@@ -1349,7 +1658,7 @@ Status SilkStore::OptimizeLeaf() {
     }
     HeapItem item = candidate_heap.top();
     candidate_heap.pop();
-    ReadOptions ropts;
+    ReadOptions ropts = ScanReadOptions();
     ropts.snapshot = leaf_index_snapshot;
     std::string leaf_index_entry_payload;
     s = leaf_index_->Get(ropts, *item.leaf_max_key, &leaf_index_entry_payload);
@@ -1360,8 +1669,9 @@ Status SilkStore::OptimizeLeaf() {
     // index_entry.GetNumMiniRuns() - 1);
     assert(seg_builder->RunStarted() == false);
     LeafIndexEntry new_index_entry =
-        CompactLeaf(seg_builder.get(), seg_id, index_entry, s, &buf, 0,
-                    index_entry.GetNumMiniRuns() - 1, leaf_index_snapshot);
+        CompactLeaf(seg_builder.get(), seg_id, *item.leaf_max_key, index_entry,
+                    s, &buf, 0, index_entry.GetNumMiniRuns() - 1,
+                    leaf_index_snapshot);
     assert(seg_builder->RunStarted() == false);
     if (!s.ok()) {
       return s;
@@ -1372,7 +1682,10 @@ Status SilkStore::OptimizeLeaf() {
       return s;
     }
     compacted_runs += index_entry.GetNumMiniRuns();
+    span.SetArg("runs", compacted_runs);
     stat_store_.UpdateLeafNumRuns(*item.leaf_max_key, 1);
+    stat_store_.AddLeafWrites(*item.leaf_max_key, 0,
+                              new_index_entry.GetLeafDataSize());
   }
   if (compacted_runs) {
     Log(options_.info_log, "Leaf Optimization compacted %d runs\n",
@@ -1380,7 +1693,11 @@ Status SilkStore::OptimizeLeaf() {
     // fprintf(stderr, "Leaf Optimization compacted %d runs\n", compacted_runs);
   }
   if (seg_builder.get()) {
-    return seg_builder->Finish();
+    s = seg_builder->Finish();
+    if (s.ok()) {
+      stats_.Record(kDeviceBytesWrittenOptimize, seg_builder->FileSize());
+    }
+    return s;
   }
   if (leaf_index_wb.ApproximateSize()) {
     return leaf_index_->Write(WriteOptions{}, &leaf_index_wb);
@@ -1391,7 +1708,7 @@ Status SilkStore::OptimizeLeaf() {
 constexpr size_t kLeafIndexWriteBufferMaxSize = 4 * 1024 * 1024;
 
 void SilkStore::PrepareLeafsNeedSplit(bool force) {
-  ReadOptions ro;
+  ReadOptions ro = ScanReadOptions();
   ro.snapshot = leaf_index_->GetSnapshot();
   // Release snapshot after the traversal is done
   DeferCode c([&ro, this]() { leaf_index_->ReleaseSnapshot(ro.snapshot); });
@@ -1425,6 +1742,7 @@ void SilkStore::ProcessOneLeaf(
   SequenceNumber seq_num = max_sequence_;
 
   auto SplitLeaf = [&grouped_segment_appender, &leaf_index_wb, this](
+                       const Slice& leaf_max_key,
                        const LeafIndexEntry& leaf_index_entry,
                        SequenceNumber seq_num,
                        std::vector<std::string>& max_keys,
@@ -1432,7 +1750,7 @@ void SilkStore::ProcessOneLeaf(
     Status s;
     /* We use DBIter to get the most recent non-deleted keys. */
     auto it = dynamic_cast<silkstore::DBIter*>(leaf_store_->NewDBIterForLeaf(
-        ReadOptions{}, leaf_index_entry, s, user_comparator(), seq_num));
+        ScanReadOptions(), leaf_index_entry, s, user_comparator(), seq_num));
 
     DeferCode c([it]() { delete it; });
 
@@ -1480,19 +1798,21 @@ void SilkStore::ProcessOneLeaf(
       it->Next();
       if (bytes_current_leaf >= options_.leaf_datasize_thresh / 2 ||
           it->Valid() == false) {
+        // The new leaves inherit the read hotness of the split one.
         uint32_t run_no;
-        seg_builder->FinishMiniRun(&run_no);
+        seg_builder->FinishMiniRun(&run_no,
+                                   RunFilterPolicy(leaf_max_key, seg_builder),
+                                   SpillRunMetadata(leaf_max_key));
         max_key_index_entry_buf.clear();
         std::string buf;
-        MiniRunIndexEntry minirun_index_entry = MiniRunIndexEntry::Build(
-            seg_builder->SegmentId(), run_no,
-            seg_builder->GetFinishedRunIndexBlock(),
-            seg_builder->GetFinishedRunFilterBlock(),
-            seg_builder->GetFinishedRunDataSize(), &buf);
+        MiniRunIndexEntry minirun_index_entry =
+            FinishedRunIndexEntry(seg_builder, run_no, &buf);
+        std::string leaf_filter;
+        BuildLeafFilter(LeafIndexEntry{}, seg_builder, &leaf_filter);
         LeafIndexEntry new_leaf_index_entry;
         LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
             LeafIndexEntry{}, minirun_index_entry, &max_key_index_entry_buf,
-            &new_leaf_index_entry);
+            &new_leaf_index_entry, leaf_filter);
         max_keys.push_back(max_key);
         max_key_index_entry_bufs.push_back(max_key_index_entry_buf);
         // Log(options_.info_log, "%d Split k: %s   v: %s\n", max_keys.size(),
@@ -1539,7 +1859,14 @@ void SilkStore::ProcessOneLeaf(
   std::vector<std::string> max_keys;
   std::vector<std::string> max_key_index_entry_bufs;
   // Log(options_.info_log, "Start split k: %s\n", leaf.max_key_.c_str());
-  s = SplitLeaf(leaf_index_entry, seq_num, max_keys, max_key_index_entry_bufs);
+  {
+    StopWatch sw(&stats_, kLeafSplitMicros);
+    TraceSpan span(tracer_, "split_leaf");
+    span.SetArg("bytes", leaf_index_entry.GetLeafDataSize());
+    s = SplitLeaf(leaf_max_key, leaf_index_entry, seq_num, max_keys,
+                  max_key_index_entry_bufs);
+    span.SetArg("leaves", max_keys.size());
+  }
   assert(max_keys.size() == max_key_index_entry_bufs.size());
   if (!s.ok()) return;
   // ++num_splits;
@@ -1558,6 +1885,9 @@ void SilkStore::ProcessOneLeaf(
   for (size_t i = 0; i < max_keys.size(); ++i) {
     leaf_index_wb.Put(Slice(max_keys[i]), Slice(max_key_index_entry_bufs[i]));
     stat_store_.UpdateLeafNumRuns(max_keys[i], 1);
+    stat_store_.AddLeafWrites(
+        max_keys[i], 0,
+        LeafIndexEntry(max_key_index_entry_bufs[i]).GetLeafDataSize());
   }
   // num_leaves += max_keys.size();
   state.leaf_change_num_ += max_keys.size();
@@ -1569,8 +1899,14 @@ void SilkStore::ProcessOneLeaf(
 }
 
 void SilkStore::ProcessSplitLeafSubTasks(int tid) {
-  GroupedSegmentAppender grouped_segment_appender(1, segment_manager_,
-                                                  options_);
+  TraceSpan span(tracer_, "split_subtask");
+  span.SetArg("subtask", tid);
+  DeferCode c([this, tid, &span]() {
+    span.SetArg("bytes", split_subtask_states_[tid].written_);
+    span.SetArg("leaves", split_subtask_states_[tid].leaf_change_num_);
+  });
+  GroupedSegmentAppender grouped_segment_appender(
+      1, segment_manager_, options_, &stats_, kDeviceBytesWrittenSplit);
 
   for (size_t i = 0; i < leafs_need_split.size(); ++i) {
     if (tid == (i % split_leaf_num_threads_)) {
@@ -1639,7 +1975,9 @@ Status SilkStore::MakeRoomInLeafLayer(bool force) {
 
 restart : {
   DeferCode c([this]() { mutex_.Lock(); });
+  TraceSpan span(tracer_, "make_room_in_leaf_layer");
   PrepareLeafsNeedSplit(force);
+  span.SetArg("leaves", leafs_need_split.size());
   RunSplitLeafTasks();
   Status s = FinishSplitLeafTasks();
   Log(options_.info_log, "MakeRoomInLeafLayer End\n");
@@ -1650,7 +1988,7 @@ restart : {
 static int num_compactions = 0;
 
 void SilkStore::GenSubcompactionBoundaries() {
-  ReadOptions ro;
+  ReadOptions ro = ScanReadOptions();
   ro.snapshot = leaf_index_->GetSnapshot();
   // Release snapshot after the traversal is done
   DeferCode c([&ro, this]() { leaf_index_->ReleaseSnapshot(ro.snapshot); });
@@ -1743,8 +2081,7 @@ void SilkStore::ProcessKeyValueCompaction(
             "error parsing key from immutable table during compaction");
         return;
       }
-      if (this->user_comparator()->Compare(parsed_internal_key.user_key,
-                                           start_slice) > 0) {
+      if (CompareUserKeys(parsed_internal_key.user_key, start_slice) > 0) {
         break;
       }
       mit->Next();
@@ -1758,6 +2095,7 @@ void SilkStore::ProcessKeyValueCompaction(
 
     // normal process
     int minirun_key_cnt = 0;
+    size_t minirun_user_bytes = 0;
     // Build up a minirun of key value payloads
     while (mit->Valid() && s.ok()) {
       Slice imm_internal_key = mit->key();
@@ -1767,8 +2105,7 @@ void SilkStore::ProcessKeyValueCompaction(
             "error parsing key from immutable table during compaction");
         return;
       }
-      if (this->user_comparator()->Compare(parsed_internal_key.user_key,
-                                           leaf_max_key) > 0) {
+      if (CompareUserKeys(parsed_internal_key.user_key, leaf_max_key) > 0) {
         break;
       }
       if (seg_builder->RunStarted() == false) {
@@ -1783,6 +2120,7 @@ void SilkStore::ProcessKeyValueCompaction(
       // Reading data from memtable costs no read io.
       // Record the write to segment.
       state.written_ += (mit->key().size() + mit->value().size());
+      minirun_user_bytes += mit->key().size() + mit->value().size();
       ++minirun_key_cnt;
 
       mit->Next();
@@ -1794,21 +2132,23 @@ void SilkStore::ProcessKeyValueCompaction(
     uint32_t run_no;
 
     if (seg_builder->RunStarted()) {
-      s = seg_builder->FinishMiniRun(&run_no);
+      s = seg_builder->FinishMiniRun(
+          &run_no, RunFilterPolicy(leaf_max_key, seg_builder),
+          SpillRunMetadata(leaf_max_key));
       if (!s.ok()) {
         return;
       }
       // Generate an index entry for the new minirun
       buf.clear();
-      MiniRunIndexEntry new_minirun_index_entry = MiniRunIndexEntry::Build(
-          seg_id, run_no, seg_builder->GetFinishedRunIndexBlock(),
-          seg_builder->GetFinishedRunFilterBlock(),
-          seg_builder->GetFinishedRunDataSize(), &buf);
+      MiniRunIndexEntry new_minirun_index_entry =
+          FinishedRunIndexEntry(seg_builder, run_no, &buf);
       // Update the leaf index entry
+      std::string leaf_filter;
+      BuildLeafFilter(leaf_index_entry, seg_builder, &leaf_filter);
       LeafIndexEntry new_leaf_index_entry;
       LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
           leaf_index_entry, new_minirun_index_entry, &buf2,
-          &new_leaf_index_entry);
+          &new_leaf_index_entry, leaf_filter);
 
       assert(leaf_index_entry.GetNumMiniRuns() + 1 ==
              new_leaf_index_entry.GetNumMiniRuns());
@@ -1816,6 +2156,8 @@ void SilkStore::ProcessKeyValueCompaction(
       leaf_index_wb.Put(leaf_max_key, new_leaf_index_entry.GetRawData());
       stat_store_.UpdateLeafNumRuns(leaf_max_key.ToString(),
                                     new_leaf_index_entry.GetNumMiniRuns());
+      stat_store_.AddLeafWrites(leaf_max_key.ToString(), minirun_user_bytes,
+                                seg_builder->GetFinishedRunDataSize());
     } else {
       // Memtable has no keys intersected with this leaf
       if (leaf_index_entry.Empty()) {
@@ -1900,27 +2242,38 @@ void SilkStore::ProcessKeyValueCompaction(
       }
 
       uint32_t run_no;
-      seg_builder->FinishMiniRun(&run_no);
+      seg_builder->FinishMiniRun(&run_no,
+                                 RunFilterPolicy(leaf_max_key, seg_builder),
+                                 SpillRunMetadata(leaf_max_key));
       assert(seg_builder->GetFinishedRunDataSize());
       // Generate an index entry for the new minirun
-      MiniRunIndexEntry minirun_index_entry = MiniRunIndexEntry::Build(
-          seg_id, run_no, seg_builder->GetFinishedRunIndexBlock(),
-          seg_builder->GetFinishedRunFilterBlock(),
-          seg_builder->GetFinishedRunDataSize(), &buf);
+      MiniRunIndexEntry minirun_index_entry =
+          FinishedRunIndexEntry(seg_builder, run_no, &buf);
+      std::string leaf_filter;
+      BuildLeafFilter(LeafIndexEntry{}, seg_builder, &leaf_filter);
       LeafIndexEntry new_leaf_index_entry;
       LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
-          LeafIndexEntry{}, minirun_index_entry, &buf2, &new_leaf_index_entry);
+          LeafIndexEntry{}, minirun_index_entry, &buf2, &new_leaf_index_entry,
+          leaf_filter);
       leaf_index_wb.Put(leaf_max_key, new_leaf_index_entry.GetRawData());
       ++(state.leaf_change_num_);
       stat_store_.NewLeaf(leaf_max_key.ToString());
       stat_store_.UpdateWriteHotness(leaf_max_key.ToString(), minirun_key_cnt);
+      stat_store_.AddLeafWrites(leaf_max_key.ToString(), bytes,
+                                seg_builder->GetFinishedRunDataSize());
     }
   }
 }
 
 void SilkStore::ProcessCompactionSubTasks(int tid) {
-  GroupedSegmentAppender grouped_segment_appender(1, segment_manager_,
-                                                  options_);
+  TraceSpan span(tracer_, "merge_subtask");
+  span.SetArg("subtask", tid);
+  DeferCode c([this, tid, &span]() {
+    span.SetArg("bytes", compact_subtask_states_[tid].written_);
+    span.SetArg("leaves", compact_subtask_states_[tid].leaf_change_num_);
+  });
+  GroupedSegmentAppender grouped_segment_appender(
+      1, segment_manager_, options_, &stats_, kDeviceBytesWrittenMerge);
 
   for (size_t i = 0; i < sub_compact_tasks_.size(); ++i) {
     if (tid == (i % compact_num_threads_)) {
@@ -2003,7 +2356,7 @@ Status SilkStore::DoCompactionWork(WriteBatch &leaf_index_wb) {
 Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
   Log(options_.info_log, "DoCompactionWork start\n");
   mutex_.Unlock();
-  ReadOptions ro;
+  ReadOptions ro = ScanReadOptions();
   ro.snapshot = leaf_index_->GetSnapshot();
 
   // Release snapshot after the traversal is done
@@ -2016,6 +2369,9 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
   int self_compaction = 0;
   int num_leaves_snap = (num_leaves == 0 ? 1 : num_leaves);
   int num_splits = 0;
+  TraceSpan span(tracer_, "merge_memtable");
+  span.SetArg("memtable_bytes", imm_->ApproximateMemoryUsage());
+  span.SetArg("leaves", num_leaves_snap);
   iit->SeekToFirst();
   std::unique_ptr<Iterator> mit(imm_->NewIterator());
   mit->SeekToFirst();
@@ -2023,8 +2379,8 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
   uint32_t run_no;
   Status s;
 
-  GroupedSegmentAppender grouped_segment_appender(1, segment_manager_,
-                                                  options_);
+  GroupedSegmentAppender grouped_segment_appender(
+      1, segment_manager_, options_, &stats_, kDeviceBytesWrittenMerge);
 
   Slice next_leaf_max_key;
   Slice next_leaf_index_value;
@@ -2062,6 +2418,7 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
     assert(seg_builder->RunStarted() == false);
 
     int minirun_key_cnt = 0;
+    size_t minirun_user_bytes = 0;
     // Build up a minirun of key value payloads
     while (mit->Valid() /*  && minirun_key_cnt < 1024*10 */) {
       Slice imm_internal_key = mit->key();
@@ -2071,8 +2428,7 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
             "error parsing key from immutable table during compaction");
         return s;
       }
-      if (this->user_comparator()->Compare(parsed_internal_key.user_key,
-                                           leaf_max_key) > 0) {
+      if (CompareUserKeys(parsed_internal_key.user_key, leaf_max_key) > 0) {
         break;
       }
       if (seg_builder->RunStarted() == false) {
@@ -2087,6 +2443,7 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
       // Reading data from memtable costs no read io.
       // Record the write to segment.
       stats_.Add(0, mit->key().size() + mit->value().size());
+      minirun_user_bytes += mit->key().size() + mit->value().size();
       ++minirun_key_cnt;
 
       mit->Next();
@@ -2095,22 +2452,24 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
     stat_store_.UpdateWriteHotness(leaf_max_key.ToString(), minirun_key_cnt);
 
     if (seg_builder->RunStarted()) {
-      s = seg_builder->FinishMiniRun(&run_no);
+      s = seg_builder->FinishMiniRun(
+          &run_no, RunFilterPolicy(leaf_max_key, seg_builder),
+          SpillRunMetadata(leaf_max_key));
       if (!s.ok()) {
         return s;
       }
       // Generate an index entry for the new minirun
       buf.clear();
-      MiniRunIndexEntry new_minirun_index_entry = MiniRunIndexEntry::Build(
-          seg_id, run_no, seg_builder->GetFinishedRunIndexBlock(),
-          seg_builder->GetFinishedRunFilterBlock(),
-          seg_builder->GetFinishedRunDataSize(), &buf);
+      MiniRunIndexEntry new_minirun_index_entry =
+          FinishedRunIndexEntry(seg_builder, run_no, &buf);
 
       // Update the leaf index entry
+      std::string leaf_filter;
+      BuildLeafFilter(leaf_index_entry, seg_builder, &leaf_filter);
       LeafIndexEntry new_leaf_index_entry;
       LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
           leaf_index_entry, new_minirun_index_entry, &buf2,
-          &new_leaf_index_entry);
+          &new_leaf_index_entry, leaf_filter);
 
       assert(leaf_index_entry.GetNumMiniRuns() + 1 ==
              new_leaf_index_entry.GetNumMiniRuns());
@@ -2118,6 +2477,8 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
       leaf_index_wb.Put(leaf_max_key, new_leaf_index_entry.GetRawData());
       stat_store_.UpdateLeafNumRuns(leaf_max_key.ToString(),
                                     new_leaf_index_entry.GetNumMiniRuns());
+      stat_store_.AddLeafWrites(leaf_max_key.ToString(), minirun_user_bytes,
+                                seg_builder->GetFinishedRunDataSize());
     } else {
       // Memtable has no keys intersected with this leaf
       if (leaf_index_entry.Empty()) {
@@ -2195,20 +2556,25 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
       mit->Next();
     }
     uint32_t run_no;
-    seg_builder->FinishMiniRun(&run_no);
+    seg_builder->FinishMiniRun(&run_no,
+                               RunFilterPolicy(leaf_max_key, seg_builder),
+                               SpillRunMetadata(leaf_max_key));
     assert(seg_builder->GetFinishedRunDataSize());
     // Generate an index entry for the new minirun
-    MiniRunIndexEntry minirun_index_entry = MiniRunIndexEntry::Build(
-        seg_id, run_no, seg_builder->GetFinishedRunIndexBlock(),
-        seg_builder->GetFinishedRunFilterBlock(),
-        seg_builder->GetFinishedRunDataSize(), &buf);
+    MiniRunIndexEntry minirun_index_entry =
+        FinishedRunIndexEntry(seg_builder, run_no, &buf);
+    std::string leaf_filter;
+    BuildLeafFilter(LeafIndexEntry{}, seg_builder, &leaf_filter);
     LeafIndexEntry new_leaf_index_entry;
     LeafIndexEntryBuilder::AppendMiniRunIndexEntry(
-        LeafIndexEntry{}, minirun_index_entry, &buf2, &new_leaf_index_entry);
+        LeafIndexEntry{}, minirun_index_entry, &buf2, &new_leaf_index_entry,
+        leaf_filter);
     leaf_index_wb.Put(leaf_max_key, new_leaf_index_entry.GetRawData());
     ++num_leaves;
     stat_store_.NewLeaf(leaf_max_key.ToString());
     stat_store_.UpdateWriteHotness(leaf_max_key.ToString(), minirun_key_cnt);
+    stat_store_.AddLeafWrites(leaf_max_key.ToString(), bytes,
+                              seg_builder->GetFinishedRunDataSize());
   }
   //    fprintf(stderr, "Background compaction finished, last segment %d\n",
   //    seg_id); fprintf(stderr, "avg runsize %d, self compactions %d,
@@ -2231,9 +2597,12 @@ Status SilkStore::DoCompactionWork(WriteBatch& leaf_index_wb) {
 // Perform a merge between leaves and the immutable memtable.
 // Single threaded version.
 void SilkStore::BackgroundCompaction() {
+  TraceSpan span(tracer_, "background_compaction");
   auto t_start_compaction = env_->NowMicros();
   DeferCode c([this, t_start_compaction]() {
-    stats_.AddTimeCompaction(env_->NowMicros() - t_start_compaction);
+    uint64_t micros = env_->NowMicros() - t_start_compaction;
+    stats_.AddTimeCompaction(micros);
+    stats_.MeasureTime(kMergeMicros, micros);
   });
   mutex_.Unlock();
   Status s;
@@ -2310,9 +2679,18 @@ void SilkStore::BackgroundCompaction() {
           s.ToString().c_str());
       return;
     }
-    // Save a new Current File
-    SetCurrentFileWithLogNumber(env_, dbname_, logfile_number_);
-    // Commit to the new state
+    // Commit to the new state: the immutable memtable is now covered by
+    // the leaf index and its NVM region can be reused.
+    ManifestEdit edit;
+    edit.RemoveNvmRegion(imm_nvm_offset_);
+    edit.SetLeafIndexSequence(imm_sequence_);
+    s = manifest_->LogAndApply(&edit, true);
+    if (!s.ok()) {
+      bg_error_ = s;
+      Log(options_.info_log, "Failed logging compaction: %s\n",
+          s.ToString().c_str());
+      return;
+    }
 
     imm_->Unref();
     imm_ = nullptr;
@@ -2349,6 +2727,7 @@ Status DestroyDB(const std::string& dbname, const Options& options) {
     env->UnlockFile(lock);  // Ignore error since state is already gone
     env->DeleteFile(lockname);
     env->DeleteFile(dbname + "/leafindex_recovery");
+    env->DeleteFile(LeafStatFileName(dbname));
 
     env->DeleteDir(dbname);  // Ignore error in case dir contains other files
   }
@@ -20,10 +20,16 @@
 #include "port/port.h"
 #include "port/thread_annotations.h"
 #include "leaf_store.h"
+#include "manifest.h"
 #include "nvm/nvm_leaf_index.h"
 #include "nvm/nvm_manager.h"
 #include "nvm/nvmemtable.h"
 #include "segment.h"
+#include "statistics.h"
+#include "event_tracer.h"
+#include "filter_allocator.h"
+#include "op_tracer.h"
+#include "row_cache.h"
 namespace leveldb {
 namespace silkstore {
 
@@ -95,6 +101,13 @@ class SilkStore : public DB {
 
   std::string SegmentsSpaceUtilityHistogram();
 
+  // JSON report of the write, read and space amplification, overall and
+  // per leaf group.  The "recent" figures cover the time since the last
+  // poll, for polls at least kAmplificationWindowMicros apart; more
+  // frequent polls keep measuring from the same start until a window has
+  // passed.  Until then, they cover the time since the store was opened.
+  std::string AmplificationReport();
+
   void Destroy();
 
  private:
@@ -107,6 +120,8 @@ class SilkStore : public DB {
   Env* const env_;
   const InternalKeyComparator internal_comparator_;
   const InternalFilterPolicy internal_filter_policy_;
+  // Sizes the filters of new runs if options_.adaptive_filter_bits_per_key.
+  FilterAllocator filter_allocator_;
   // const Options options_;  // options_.comparator == &internal_comparator_
   Options options_;
   const bool owns_info_log_;
@@ -134,9 +149,12 @@ class SilkStore : public DB {
   NvmManager* nvm_manager_;
 
   port::AtomicPointer has_imm_;  // So bg thread can detect non-null imm_
-  WritableFile* logfile_;
-  uint64_t logfile_number_ GUARDED_BY(mutex_);
-  log::Writer* log_;
+  Manifest* manifest_;
+  // Offsets of the NVM regions backing mem_ and imm_.
+  uint64_t mem_nvm_offset_ GUARDED_BY(mutex_);
+  uint64_t imm_nvm_offset_ GUARDED_BY(mutex_);
+  // Largest sequence number that may be stored in imm_.
+  SequenceNumber imm_sequence_ GUARDED_BY(mutex_);
   uint32_t seed_ GUARDED_BY(mutex_);  // For sampling.
   SequenceNumber max_sequence_ GUARDED_BY(mutex_);
   size_t memtable_capacity_ GUARDED_BY(mutex_);
@@ -164,6 +182,24 @@ class SilkStore : public DB {
   // =====================================================================
 
   std::function<void()> leaf_optimization_func_;
+  // Last time the leaf stats were snapshotted, only used by OptimizeLeaf().
+  uint64_t last_leaf_stat_snapshot_micros_ = 0;
+
+  // Byte counters sampled by AmplificationReport(). The "recent" figures
+  // of the report cover the time since amp_window_start_, which is moved
+  // forward to amp_last_sample_ once per kAmplificationWindowMicros.  Both
+  // start as the zero counters of the store at open.
+  struct AmplificationSample {
+    uint64_t micros;
+    uint64_t user_bytes_written;
+    uint64_t user_bytes_read;
+    uint64_t device_bytes_written;
+    uint64_t device_bytes_read;
+  };
+  static constexpr uint64_t kAmplificationWindowMicros = 60000000;
+  port::Mutex amp_mutex_;
+  AmplificationSample amp_window_start_ GUARDED_BY(amp_mutex_) = {};
+  AmplificationSample amp_last_sample_ GUARDED_BY(amp_mutex_) = {};
   // Information for a manual compaction
   struct ManualCompaction {
     int level;
@@ -202,6 +238,17 @@ class SilkStore : public DB {
     return internal_comparator_.user_comparator();
   }
 
+  // Compare user keys, inline rather than through the vtable when they are
+  // ordered bytewise.
+  int CompareUserKeys(const Slice& a, const Slice& b) const {
+    return internal_comparator_.bytewise()
+               ? a.compare(b)
+               : user_comparator()->Compare(a, b);
+  }
+
+  // Write() without operation tracing; Put() and Delete() trace themselves.
+  Status WriteImpl(const WriteOptions& options, WriteBatch* updates);
+
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -209,7 +256,8 @@ class SilkStore : public DB {
   // amount of work to recover recently logged updates.  Any changes to
   // be made to the descriptor are added to *edit.
   Status Recover() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  Status RecoverNvmemtable(uint64_t log_number, SequenceNumber* max_sequence)
+  Status RecoverNvmemtable(const ManifestState& state,
+                           SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   ;
 
@@ -236,11 +284,32 @@ class SilkStore : public DB {
                             size_t start_run, size_t end_run);
 
   LeafIndexEntry CompactLeaf(SegmentBuilder* seg_builder, uint32_t seg_no,
+                             const std::string& leaf_max_key,
                              const LeafIndexEntry& leaf_index_entry, Status& s,
                              std::string* buf, uint32_t start_minirun_no,
                              uint32_t end_minirun_no,
                              const Snapshot* leaf_index_snap = nullptr);
 
+  // Filter policy for the run of seg_builder about to be finished in the
+  // leaf with max key leaf_max_key, or nullptr for options_.filter_policy.
+  const FilterPolicy* RunFilterPolicy(const Slice& leaf_max_key,
+                                      const SegmentBuilder* seg_builder);
+
+  // Leaf filter of a leaf made of the miniruns of base followed by the run
+  // just finished by seg_builder, into *filter, which is left empty if leaf
+  // filters are disabled or base has runs but no usable leaf filter.
+  void BuildLeafFilter(const LeafIndexEntry& base,
+                       const SegmentBuilder* seg_builder, std::string* filter);
+
+  // Whether the run about to be finished in the leaf with max key
+  // leaf_max_key should keep its block index and filter in its segment.
+  bool SpillRunMetadata(const Slice& leaf_max_key);
+
+  // Index entry of the run just finished by seg_builder as run_no, backed
+  // by *buf, which holds its metadata or a handle to it if it was spilled.
+  MiniRunIndexEntry FinishedRunIndexEntry(const SegmentBuilder* seg_builder,
+                                          uint32_t run_no, std::string* buf);
+
   std::pair<uint32_t, uint32_t> ChooseLeafCompactionRunRange(
       const LeafIndexEntry& leaf_index_entry);
 
@@ -248,45 +317,42 @@ class SilkStore : public DB {
   LeafStore* leaf_store_ = nullptr;
   LeafStatStore stat_store_;
 
-  struct MergeStats {
-    size_t bytes_written = 0;
-    size_t bytes_read = 0;
-
-    size_t gc_bytes_written = 0;
-    size_t gc_bytes_read = 0;
-    size_t gc_bytes_read_unopt = 0;
-
-    // # miniruns queried in leaf_index_ for validness during GC.
-    size_t gc_miniruns_queried;
-    // # miniruns in total checked during GC.
-    // gc_miniruns_total - gc_miniruns_queried => # miniruns that are skipped by
-    size_t gc_miniruns_total;
-
+  // Merges run on several threads at once, so the counters are kept in
+  // thread-safe Statistics tickers.
+  struct MergeStats : public Statistics {
     void Add(size_t read, size_t written) {
-      bytes_read += read;
-      bytes_written += written;
+      Record(kBytesRead, read);
+      Record(kBytesWritten, written);
     }
 
-    void AddGCUnoptStats(size_t read) { gc_bytes_read_unopt += read; }
+    void AddGCUnoptStats(size_t read) { Record(kGCBytesReadUnopt, read); }
 
     void AddGCStats(size_t read, size_t written) {
-      gc_bytes_written += written;
-      gc_bytes_read += read;
+      Record(kGCBytesWritten, written);
+      Record(kGCBytesRead, read);
     }
 
+    // gc_miniruns_total - gc_miniruns_queried => # miniruns that are skipped
     void AddGCMiniRunStats(size_t miniruns_queried, size_t miniruns_total) {
-      gc_miniruns_queried += miniruns_queried;
-      gc_miniruns_total += miniruns_total;
+      Record(kGCMiniRunsQueried, miniruns_queried);
+      Record(kGCMiniRunsTotal, miniruns_total);
     }
 
-    size_t time_spent_compaction = 0;
-    size_t time_spent_gc = 0;
+    void AddTimeCompaction(size_t t) { Record(kCompactionMicros, t); }
 
-    void AddTimeCompaction(size_t t) { time_spent_compaction += t; }
-
-    void AddTimeGC(size_t t) { time_spent_gc += t; }
+    void AddTimeGC(size_t t) { Record(kGCMicros, t); }
   } stats_;
 
+  // Timeline of background jobs, null unless options_.event_trace_file is
+  // set.
+  EventTracer* tracer_ = nullptr;
+
+  // Sampled user operations, null unless options_.op_trace_file is set.
+  OpTracer* op_tracer_ = nullptr;
+  // Results of point lookups in leaf_store_, if options_.row_cache_size is
+  // positive.
+  std::unique_ptr<RowCache> row_cache_;
+
   // parallel compaction
   // Maintains state for each sub-compaction
   struct SubCompaction {
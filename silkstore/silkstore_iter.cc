@@ -13,8 +13,10 @@ namespace leveldb {
 namespace silkstore {
 
 Iterator* NewDBIterator(const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence) {
-  return new DBIter(user_key_comparator, internal_iter, sequence);
+                        Iterator* internal_iter, SequenceNumber sequence,
+                        Statistics* stats, OpTracer* tracer) {
+  return new DBIter(user_key_comparator, internal_iter, sequence, stats,
+                    tracer);
 }
 
 }  // namespace silkstore
@@ -8,6 +8,8 @@
 #include "db/dbformat.h"
 #include <stdint.h>
 #include "leveldb/db.h"
+#include "silkstore/op_tracer.h"
+#include "silkstore/statistics.h"
 
 namespace leveldb {
 namespace silkstore {
@@ -25,14 +27,22 @@ class DBIter : public Iterator {
   //     just before all entries whose user key == this->key().
   enum Direction { kForward, kReverse };
 
-  DBIter(const Comparator* cmp, Iterator* iter, SequenceNumber s)
+  DBIter(const Comparator* cmp, Iterator* iter, SequenceNumber s,
+         Statistics* stats = nullptr, OpTracer* tracer = nullptr)
       : user_comparator_(cmp),
+        bytewise_(cmp == BytewiseComparator()),
         iter_(iter),
         sequence_(s),
+        stats_(stats),
+        tracer_(tracer),
+        tracing_(false),
         direction_(kForward),
         valid_(false) {}
 
-  virtual ~DBIter() { delete iter_; }
+  virtual ~DBIter() {
+    FinishTrace();
+    delete iter_;
+  }
 
   virtual bool Valid() const { return valid_; }
 
@@ -61,6 +71,7 @@ class DBIter : public Iterator {
 
   virtual void Next() {
     assert(valid_);
+    StopWatch sw(stats_, kIterNextMicros);
 
     if (direction_ == kReverse) {  // Switch directions?
       direction_ = kForward;
@@ -84,6 +95,8 @@ class DBIter : public Iterator {
     }
 
     FindNextUserEntry(true, &saved_key_);
+    RecordUserRead();
+    if (tracing_) ++trace_nexts_;
   }
 
   virtual void Prev() {
@@ -102,8 +115,7 @@ class DBIter : public Iterator {
           ClearSavedValue();
           return;
         }
-        if (user_comparator_->Compare(ExtractUserKey(iter_->key()),
-                                      saved_key_) < 0) {
+        if (CompareUserKeys(ExtractUserKey(iter_->key()), saved_key_) < 0) {
           break;
         }
       }
@@ -111,9 +123,12 @@ class DBIter : public Iterator {
     }
 
     FindPrevUserEntry();
+    RecordUserRead();
   }
 
   virtual void Seek(const Slice& target) {
+    StopWatch sw(stats_, kIterSeekMicros);
+    StartTrace(kTraceSeek, target);
     direction_ = kForward;
     ClearSavedValue();
     saved_key_.clear();
@@ -125,9 +140,11 @@ class DBIter : public Iterator {
     } else {
       valid_ = false;
     }
+    RecordUserRead();
   }
 
   virtual void SeekToFirst() {
+    StartTrace(kTraceSeekToFirst, Slice());
     direction_ = kForward;
     ClearSavedValue();
     iter_->SeekToFirst();
@@ -136,16 +153,46 @@ class DBIter : public Iterator {
     } else {
       valid_ = false;
     }
+    RecordUserRead();
   }
 
   virtual void SeekToLast() {
+    FinishTrace();
     direction_ = kReverse;
     ClearSavedValue();
     iter_->SeekToLast();
     FindPrevUserEntry();
+    RecordUserRead();
   }
 
  private:
+  // A traced seek is recorded together with the Next calls that follow
+  // it, once the iterator is repositioned or deleted.
+  void StartTrace(TraceOpType type, const Slice& key) {
+    FinishTrace();
+    if (tracer_ != nullptr && tracer_->Sample()) {
+      tracing_ = true;
+      trace_type_ = type;
+      trace_key_.assign(key.data(), key.size());
+      trace_start_micros_ = tracer_->env()->NowMicros();
+      trace_nexts_ = 0;
+    }
+  }
+
+  void FinishTrace() {
+    if (tracing_) {
+      tracer_->Record(trace_start_micros_, trace_type_, trace_key_, Slice(),
+                      trace_nexts_);
+      tracing_ = false;
+    }
+  }
+
+  void RecordUserRead() {
+    if (stats_ != nullptr && valid_) {
+      stats_->Record(kUserBytesRead, key().size() + value().size());
+    }
+  }
+
   void FindNextUserEntry(bool skipping, std::string* skip) {
     // Loop until we hit an acceptable entry to yield
     assert(iter_->Valid());
@@ -161,8 +208,7 @@ class DBIter : public Iterator {
             skipping = true;
             break;
           case kTypeValue:
-            if (skipping &&
-                user_comparator_->Compare(ikey.user_key, *skip) <= 0) {
+            if (skipping && CompareUserKeys(ikey.user_key, *skip) <= 0) {
               // Entry hidden
             } else {
               valid_ = true;
@@ -187,7 +233,7 @@ class DBIter : public Iterator {
         ParsedInternalKey ikey;
         if (ParseKey(&ikey) && ikey.sequence <= sequence_) {
           if ((value_type != kTypeDeletion) &&
-              user_comparator_->Compare(ikey.user_key, saved_key_) < 0) {
+              CompareUserKeys(ikey.user_key, saved_key_) < 0) {
             // We encountered a non-deleted value in entries for previous keys,
             break;
           }
@@ -231,6 +277,11 @@ class DBIter : public Iterator {
     }
   }
 
+  // Bytewise user keys are compared inline rather than through the vtable.
+  inline int CompareUserKeys(const Slice& a, const Slice& b) const {
+    return bytewise_ ? a.compare(b) : user_comparator_->Compare(a, b);
+  }
+
   inline void SaveKey(const Slice& k, std::string* dst) {
     dst->assign(k.data(), k.size());
   }
@@ -245,9 +296,20 @@ class DBIter : public Iterator {
   }
 
   const Comparator* const user_comparator_;
+  const bool bytewise_;  // user_comparator_ == BytewiseComparator()
   Iterator* const iter_;
   SequenceNumber const sequence_;
 
+  Statistics* const stats_;  // Seek/Next latencies; may be null
+  OpTracer* const tracer_;   // May be null
+
+  // State of the seek being traced, if tracing_
+  bool tracing_;
+  TraceOpType trace_type_;
+  std::string trace_key_;
+  uint64_t trace_start_micros_;
+  uint64_t trace_nexts_;
+
   Status status_;
   std::string saved_key_;    // == current key when direction_==kReverse
   std::string saved_value_;  // == current raw value when direction_==kReverse
@@ -262,9 +324,13 @@ class DBIter : public Iterator {
 
 // Return a new iterator that converts internal keys (yielded by
 // "*internal_iter") that were live at the specified "sequence" number
-// into appropriate user keys.
+// into appropriate user keys.  If stats is non-null, the latencies of
+// Seek() and Next() are recorded in it.  If tracer is non-null, sampled
+// seeks are recorded in it together with their Next() counts.
 Iterator* NewDBIterator(const Comparator* user_key_comparator,
-                        Iterator* internal_iter, SequenceNumber sequence);
+                        Iterator* internal_iter, SequenceNumber sequence,
+                        Statistics* stats = nullptr,
+                        OpTracer* tracer = nullptr);
 
 }  // namespace silkstore
 }  // namespace leveldb
@@ -0,0 +1,722 @@
+// Microbenchmarks of the building blocks on the SilkStore read and write
+// paths. Keys are 16 byte user keys plus the 8 byte internal key tag and
+// values default to the 128 bytes of nvm_db_bench; every benchmark reports
+// heap allocations per operation in addition to the time per operation.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <atomic>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "benchmark/benchmark.h"
+#include "db/dbformat.h"
+#include "leveldb/cache.h"
+#include "leveldb/comparator.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "nvm/nvm_manager.h"
+#include "nvm/nvmemtable.h"
+#include "silkstore/leaf_store.h"
+#include "silkstore/minirun.h"
+#include "silkstore/segment.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/filter_block.h"
+#include "table/format.h"
+#include "table/merger.h"
+#include "util/coding.h"
+#include "util/random.h"
+
+namespace {
+std::atomic<uint64_t> g_allocations(0);
+}  // namespace
+
+// The replacements allocate with malloc() and free with free(), which GCC
+// cannot tell from the inlined calls it sees at the delete sites.
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void* operator new(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+#pragma GCC diagnostic pop
+
+namespace leveldb {
+namespace silkstore {
+namespace {
+
+const int kValueSize = 128;
+
+// Reports the heap allocations made between its construction and
+// destruction as "allocs/op".
+class AllocationCounter {
+ public:
+  explicit AllocationCounter(benchmark::State& state)
+      : state_(state), start_(g_allocations.load()) {}
+
+  ~AllocationCounter() {
+    state_.counters["allocs/op"] = benchmark::Counter(
+        static_cast<double>(g_allocations.load() - start_),
+        benchmark::Counter::kAvgIterations);
+  }
+
+ private:
+  benchmark::State& state_;
+  const uint64_t start_;
+};
+
+std::string UserKey(uint64_t k) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%016llu", static_cast<unsigned long long>(k));
+  return std::string(buf, 16);
+}
+
+std::string InternalKeyOf(uint64_t k, SequenceNumber seq = 1) {
+  std::string result;
+  AppendInternalKey(&result, ParsedInternalKey(UserKey(k), seq, kTypeValue));
+  return result;
+}
+
+// Discards everything written to it, so that builders are measured
+// without the cost of the device.
+class NullWritableFile : public WritableFile {
+ public:
+  Status Append(const Slice& data) override { return Status::OK(); }
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+};
+
+// Orders keys like BytewiseComparator() without being it, so that
+// iterators over its keys compare them through the vtable.
+class OpaqueBytewiseComparator : public Comparator {
+ public:
+  const char* Name() const override { return "leveldb.BytewiseComparator"; }
+  int Compare(const Slice& a, const Slice& b) const override {
+    return BytewiseComparator()->Compare(a, b);
+  }
+  void FindShortestSeparator(std::string* start,
+                             const Slice& limit) const override {
+    BytewiseComparator()->FindShortestSeparator(start, limit);
+  }
+  void FindShortSuccessor(std::string* key) const override {
+    BytewiseComparator()->FindShortSuccessor(key);
+  }
+};
+
+// The bytewise user comparator if bytewise, else one compared through the
+// vtable.
+const Comparator* UserComparator(bool bytewise) {
+  static OpaqueBytewiseComparator opaque;
+  return bytewise ? BytewiseComparator() : &opaque;
+}
+
+Options BenchOptions(const Comparator* cmp) {
+  Options options;
+  options.comparator = cmp;
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.compression = kNoCompression;
+  return options;
+}
+
+// A MiniRun of num_entries entries as it is stored in a leaf index entry.
+struct BuiltRun {
+  std::string index_block;
+  std::string filter_block;
+  uint32_t data_size;
+};
+
+BuiltRun BuildRun(const Options& options, uint64_t first_key,
+                  int num_entries) {
+  NullWritableFile file;
+  MiniRunBuilder builder(options, &file, 0);
+  std::string value(kValueSize, 'v');
+  for (int i = 0; i < num_entries; i++) {
+    builder.Add(InternalKeyOf(first_key + i), value);
+  }
+  builder.Finish();
+  return BuiltRun{builder.IndexBlock().ToString(),
+                  builder.FilterBlock().ToString(),
+                  builder.GetCurrentRunDataSize()};
+}
+
+void BM_MiniRunBuilderAdd(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  NullWritableFile file;
+  MiniRunBuilder builder(options, &file, 0);
+  std::string value(state.range(0), 'v');
+  uint64_t k = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    builder.Add(InternalKeyOf(k++), value);
+    if (k % 4096 == 0) {
+      // Bound the run size the way a leaf bounds it.
+      state.PauseTiming();
+      builder.Finish();
+      builder.Reset(0);
+      state.ResumeTiming();
+    }
+  }
+  builder.Finish();
+  state.SetBytesProcessed(state.iterations() * (24 + state.range(0)));
+  delete options.filter_policy;
+}
+BENCHMARK(BM_MiniRunBuilderAdd)->Arg(kValueSize)->Arg(1024);
+
+// allocs/op also counts the Add() calls made while the timer is paused.
+void BM_MiniRunBuilderFinish(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  NullWritableFile file;
+  MiniRunBuilder builder(options, &file, 0);
+  std::string value(kValueSize, 'v');
+  uint64_t k = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    state.PauseTiming();
+    builder.Reset(0);
+    for (int i = 0; i < state.range(0); i++) {
+      builder.Add(InternalKeyOf(k++), value);
+    }
+    state.ResumeTiming();
+    builder.Finish();
+  }
+  delete options.filter_policy;
+}
+BENCHMARK(BM_MiniRunBuilderFinish)->Arg(64)->Arg(4096);
+
+// A leaf index entry of num_runs miniruns of 64 entries each.
+std::string BuildLeafIndexEntry(const Options& options, int num_runs) {
+  std::string entry;
+  for (int run = 0; run < num_runs; run++) {
+    BuiltRun r = BuildRun(options, run * 64, 64);
+    std::string run_buf, leaf_buf;
+    MiniRunIndexEntry run_entry = MiniRunIndexEntry::Build(
+        1, run, r.index_block, r.filter_block, r.data_size, &run_buf);
+    LeafIndexEntry new_entry;
+    LeafIndexEntryBuilder::AppendMiniRunIndexEntry(LeafIndexEntry(entry),
+                                                   run_entry, &leaf_buf,
+                                                   &new_entry);
+    entry = new_entry.GetRawData().ToString();
+  }
+  return entry;
+}
+
+void BM_LeafIndexEntryForEachMiniRun(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  std::string raw = BuildLeafIndexEntry(options, state.range(0));
+  LeafIndexEntry entry(raw);
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    size_t total = 0;
+    entry.ForEachMiniRunIndexEntry(
+        [&total](const MiniRunIndexEntry& run, uint32_t no) -> bool {
+          total += run.GetRunDataSize();
+          return false;
+        });
+    benchmark::DoNotOptimize(total);
+  }
+  delete options.filter_policy;
+}
+BENCHMARK(BM_LeafIndexEntryForEachMiniRun)->Arg(1)->Arg(7)->Arg(16);
+
+void BM_LeafIndexEntryForEachMiniRunForward(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  std::string raw = BuildLeafIndexEntry(options, state.range(0));
+  LeafIndexEntry entry(raw);
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    size_t total = 0;
+    entry.ForEachMiniRunIndexEntry(
+        [&total](const MiniRunIndexEntry& run, uint32_t no) -> bool {
+          total += run.GetRunDataSize();
+          return false;
+        },
+        LeafIndexEntry::TraversalOrder::forward);
+    benchmark::DoNotOptimize(total);
+  }
+  state.counters["entry_bytes"] = raw.size();
+  delete options.filter_policy;
+}
+BENCHMARK(BM_LeafIndexEntryForEachMiniRunForward)->Arg(1)->Arg(7)->Arg(16);
+
+// Replaces the two newest runs, as a leaf compaction does.
+void BM_LeafIndexEntryReplaceMiniRunRange(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  std::string raw = BuildLeafIndexEntry(options, state.range(0));
+  LeafIndexEntry base(raw);
+  BuiltRun r = BuildRun(options, 1 << 20, 128);
+  std::string run_buf;
+  MiniRunIndexEntry run_entry = MiniRunIndexEntry::Build(
+      1, 99, r.index_block, r.filter_block, r.data_size, &run_buf);
+  std::string buf;
+  const uint32_t num_runs = base.GetNumMiniRuns();
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    LeafIndexEntry new_entry;
+    LeafIndexEntryBuilder::ReplaceMiniRunRange(
+        base, num_runs - 2, num_runs - 1, run_entry, &buf, &new_entry);
+    benchmark::DoNotOptimize(new_entry.GetRawData().data());
+  }
+  delete options.filter_policy;
+}
+BENCHMARK(BM_LeafIndexEntryReplaceMiniRunRange)->Arg(7)->Arg(16);
+
+void BM_LeafIndexEntryAppendMiniRun(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  std::string raw = BuildLeafIndexEntry(options, state.range(0));
+  LeafIndexEntry base(raw);
+  BuiltRun r = BuildRun(options, 1 << 20, 64);
+  std::string run_buf;
+  MiniRunIndexEntry run_entry = MiniRunIndexEntry::Build(
+      1, 99, r.index_block, r.filter_block, r.data_size, &run_buf);
+  std::string buf;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    LeafIndexEntry new_entry;
+    LeafIndexEntryBuilder::AppendMiniRunIndexEntry(base, run_entry, &buf,
+                                                   &new_entry);
+    benchmark::DoNotOptimize(new_entry.GetRawData().data());
+  }
+  delete options.filter_policy;
+}
+BENCHMARK(BM_LeafIndexEntryAppendMiniRun)->Arg(0)->Arg(6);
+
+// kind is 0 for standard bloom filters, 1 for blocked bloom filters and 2
+// for Ribbon filters.
+const FilterPolicy* NewFilterPolicyOf(int kind) {
+  switch (kind) {
+    case 1:
+      return NewBlockedBloomFilterPolicy(10);
+    case 2:
+      return NewRibbonFilterPolicy(10);
+    default:
+      return NewBloomFilterPolicy(10);
+  }
+}
+
+// range(0) is 1 for lookups of present keys, 0 for absent keys.
+// range(1) is the kind of filter (see NewFilterPolicyOf()).
+void BM_FilterBlockKeyMayMatch(benchmark::State& state) {
+  const FilterPolicy* policy = NewFilterPolicyOf(state.range(1));
+  FilterBlockBuilder builder(policy);
+  const int kNumKeys = 4096;
+  builder.StartBlock(0);
+  for (int i = 0; i < kNumKeys; i++) builder.AddKey(InternalKeyOf(i * 2));
+  std::string contents = builder.Finish().ToString();
+  FilterBlockReader reader(policy, contents);
+  std::vector<std::string> keys;
+  for (int i = 0; i < kNumKeys; i++) {
+    keys.push_back(InternalKeyOf(i * 2 + (state.range(0) ? 0 : 1)));
+  }
+  size_t i = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(reader.KeyMayMatch(0, keys[i++ % kNumKeys]));
+  }
+  delete policy;
+}
+BENCHMARK(BM_FilterBlockKeyMayMatch)
+    ->Args({1, 0})
+    ->Args({0, 0})
+    ->Args({1, 1})
+    ->Args({0, 1})
+    ->Args({1, 2})
+    ->Args({0, 2});
+
+// Models the filter probes of a LeafStore::Get of an absent key: every one
+// of the leaf's miniruns is checked, and the leaves together hold more
+// filter data than fits in the CPU caches, so the time per operation is
+// dominated by cache misses.  range(0) is the kind of filter (see
+// NewFilterPolicyOf()); the "bytes/key" counter is the filter memory.
+void BM_LeafFiltersKeyMayMatch(benchmark::State& state) {
+  const FilterPolicy* policy = NewFilterPolicyOf(state.range(0));
+  const int kNumLeaves = 2048;
+  const int kMiniRunsPerLeaf = 7;
+  const int kKeysPerMiniRun = 256;
+  std::vector<std::string> contents;
+  contents.reserve(kNumLeaves * kMiniRunsPerLeaf);
+  for (int l = 0; l < kNumLeaves; l++) {
+    for (int r = 0; r < kMiniRunsPerLeaf; r++) {
+      FilterBlockBuilder builder(policy);
+      builder.StartBlock(0);
+      for (int i = 0; i < kKeysPerMiniRun; i++) {
+        const uint64_t k = (static_cast<uint64_t>(l) * kKeysPerMiniRun + i) *
+                               kMiniRunsPerLeaf + r;
+        builder.AddKey(InternalKeyOf(k * 2));
+      }
+      contents.push_back(builder.Finish().ToString());
+    }
+  }
+  std::vector<FilterBlockReader> readers;
+  readers.reserve(contents.size());
+  size_t filter_bytes = 0;
+  for (const std::string& c : contents) {
+    readers.emplace_back(policy, c);
+    filter_bytes += c.size();
+  }
+  state.counters["bytes/key"] =
+      static_cast<double>(filter_bytes) /
+      (kNumLeaves * kMiniRunsPerLeaf * kKeysPerMiniRun);
+  const int kNumLookups = 4096;
+  std::vector<std::pair<size_t, std::string>> lookups;
+  Random rnd(301);
+  for (int i = 0; i < kNumLookups; i++) {
+    const uint64_t k =
+        rnd.Uniform(kNumLeaves * kKeysPerMiniRun * kMiniRunsPerLeaf);
+    lookups.emplace_back(k / (kKeysPerMiniRun * kMiniRunsPerLeaf),
+                         InternalKeyOf(k * 2 + 1));
+  }
+  size_t i = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    const auto& lookup = lookups[i++ % kNumLookups];
+    int matches = 0;
+    for (int r = 0; r < kMiniRunsPerLeaf; r++) {
+      matches += readers[lookup.first * kMiniRunsPerLeaf + r].KeyMayMatch(
+          0, lookup.second);
+    }
+    benchmark::DoNotOptimize(matches);
+  }
+  delete policy;
+}
+BENCHMARK(BM_LeafFiltersKeyMayMatch)->Arg(0)->Arg(1)->Arg(2);
+
+// range(0) is 1 for the bytewise comparator, 0 for an opaque one.
+void BM_BlockIterSeek(benchmark::State& state) {
+  InternalKeyComparator icmp(UserComparator(state.range(0)));
+  Options options = BenchOptions(&icmp);
+  BlockBuilder builder(&options);
+  std::string value(kValueSize, 'v');
+  int num_entries = 0;
+  while (builder.CurrentSizeEstimate() < options.block_size) {
+    builder.Add(InternalKeyOf(num_entries++), value);
+  }
+  std::string data = builder.Finish().ToString();
+  BlockContents contents;
+  contents.data = data;
+  contents.cachable = false;
+  contents.heap_allocated = false;
+  Block block(contents);
+  std::unique_ptr<Iterator> iter(block.NewIterator(&icmp));
+  std::vector<std::string> targets;
+  Random rnd(301);
+  for (int i = 0; i < 1024; i++) {
+    targets.push_back(InternalKeyOf(rnd.Uniform(num_entries)));
+  }
+  size_t i = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    iter->Seek(targets[i++ % targets.size()]);
+    benchmark::DoNotOptimize(iter->Valid());
+  }
+  delete options.filter_policy;
+}
+BENCHMARK(BM_BlockIterSeek)->Arg(1)->Arg(0);
+
+// Scans the merge of range(0) blocks, as a leaf of that many runs, holding
+// keys dealt to the blocks in turns of range(1) consecutive keys.  range(2)
+// is 1 for the bytewise comparator, 0 for an opaque one.
+void BM_MergingIteratorScan(benchmark::State& state) {
+  InternalKeyComparator icmp(UserComparator(state.range(2)));
+  Options options = BenchOptions(&icmp);
+  const int num_children = state.range(0);
+  const int span = state.range(1);
+  const int kNumKeys = 16384;
+  std::vector<std::unique_ptr<BlockBuilder>> builders;
+  for (int i = 0; i < num_children; i++) {
+    builders.emplace_back(new BlockBuilder(&options));
+  }
+  for (int k = 0; k < kNumKeys; k++) {
+    builders[(k / span) % num_children]->Add(InternalKeyOf(k), "v");
+  }
+  std::vector<std::string> data;
+  std::vector<std::unique_ptr<Block>> blocks;
+  for (auto& builder : builders) data.push_back(builder->Finish().ToString());
+  for (const std::string& d : data) {
+    BlockContents contents;
+    contents.data = d;
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    blocks.emplace_back(new Block(contents));
+  }
+  std::vector<Iterator*> children;
+  for (auto& block : blocks) children.push_back(block->NewIterator(&icmp));
+  std::unique_ptr<Iterator> iter(
+      NewMergingIterator(&icmp, children.data(), num_children));
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    int n = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) n++;
+    benchmark::DoNotOptimize(n);
+  }
+  state.SetItemsProcessed(state.iterations() * kNumKeys);
+  delete options.filter_policy;
+}
+BENCHMARK(BM_MergingIteratorScan)
+    ->Args({2, 1, 1})
+    ->Args({12, 1, 1})
+    ->Args({12, 1, 0})
+    ->Args({12, 64, 1})
+    ->Args({16, 1, 1});
+
+// An NvmemTable backed by a file under the test directory, standing in for
+// the NVM device.
+class NvmemTableFixture {
+ public:
+  static const size_t kPoolSize = 1ul << 30;
+  static const size_t kTableSize = 256ul << 20;
+
+  NvmemTableFixture()
+      : icmp_(BytewiseComparator()),
+        fname_(TestDir() + "/microbench_nvmem"),
+        manager_(fname_.c_str(), kPoolSize),
+        table_(nullptr) {
+    Renew();
+  }
+
+  ~NvmemTableFixture() {
+    table_->Unref();
+    Env::Default()->DeleteFile(fname_);
+  }
+
+  NvmemTable* table() { return table_; }
+
+  // Replace the table by an empty one.
+  void Renew() {
+    if (table_ != nullptr) table_->Unref();
+    table_ = new NvmemTable(icmp_, nullptr, manager_.allocate(kTableSize));
+    table_->Ref();
+  }
+
+  bool NearlyFull() {
+    return table_->ApproximateMemoryUsage() > kTableSize - (16ul << 20);
+  }
+
+  static std::string TestDir() {
+    std::string dir;
+    Env::Default()->GetTestDirectory(&dir);
+    return dir;
+  }
+
+ private:
+  InternalKeyComparator icmp_;
+  std::string fname_;
+  NvmManager manager_;
+  NvmemTable* table_;
+};
+
+void BM_NvmemTableAdd(benchmark::State& state) {
+  NvmemTableFixture fixture;
+  std::string value(kValueSize, 'v');
+  Random rnd(301);
+  SequenceNumber seq = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    fixture.table()->Add(++seq, kTypeValue, UserKey(rnd.Next()), value);
+    if ((seq & 1023) == 0 && fixture.NearlyFull()) {
+      state.PauseTiming();
+      fixture.Renew();
+      state.ResumeTiming();
+    }
+  }
+}
+BENCHMARK(BM_NvmemTableAdd);
+
+void BM_NvmemTableGet(benchmark::State& state) {
+  NvmemTableFixture fixture;
+  std::string value(kValueSize, 'v');
+  const int kNumKeys = 500000;
+  for (int i = 0; i < kNumKeys; i++) {
+    fixture.table()->Add(i + 1, kTypeValue, UserKey(i * 2), value);
+  }
+  std::vector<std::string> keys;
+  Random rnd(301);
+  for (int i = 0; i < 4096; i++) {
+    // range(0) is 1 for present keys, 0 for absent keys.
+    keys.push_back(
+        UserKey(rnd.Uniform(kNumKeys) * 2 + (state.range(0) ? 0 : 1)));
+  }
+  std::string result;
+  size_t i = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    LookupKey lkey(keys[i++ % keys.size()], kMaxSequenceNumber);
+    Status s;
+    benchmark::DoNotOptimize(fixture.table()->Get(lkey, &result, &s));
+  }
+}
+BENCHMARK(BM_NvmemTableGet)->Arg(1)->Arg(0);
+
+// A clock cache if clock, else an LRU cache.
+Cache* NewBenchCache(bool clock, size_t capacity) {
+  return clock ? NewClockCache(capacity) : NewLRUCache(capacity);
+}
+
+void NoopDeleter(const Slice& key, void* value) {}
+
+void InsertBlock(Cache* cache, uint64_t k) {
+  char key[8];
+  EncodeFixed64(key, k);
+  cache->Release(cache->Insert(Slice(key, sizeof(key)), nullptr, 4096,
+                               &NoopDeleter));
+}
+
+// Hits on 4096 blocks, in a cache shared by all the threads.  range(0) is 1
+// for a clock cache, 0 for an LRU cache.
+void BM_CacheLookup(benchmark::State& state) {
+  const int kNumBlocks = 4096;
+  static Cache* const caches[2] = {NewBenchCache(false, 64 << 20),
+                                   NewBenchCache(true, 64 << 20)};
+  Cache* const cache = caches[state.range(0)];
+  if (state.thread_index() == 0) {
+    for (int k = 0; k < kNumBlocks; k++) InsertBlock(cache, k);
+  }
+  Random rnd(301 + state.thread_index());
+  char key[8];
+  for (auto _ : state) {
+    EncodeFixed64(key, rnd.Uniform(kNumBlocks));
+    cache->Release(cache->Lookup(Slice(key, sizeof(key))));
+  }
+}
+BENCHMARK(BM_CacheLookup)->Arg(0)->Arg(1)->ThreadRange(1, 8);
+
+// Point lookups over 512 hot blocks interleaved with a scan reading four
+// new blocks per lookup, in a cache of 1024 blocks.  Reports the hit ratio
+// of the point lookups.
+void BM_CacheScanPollution(benchmark::State& state) {
+  const int kNumHotBlocks = 512;
+  std::unique_ptr<Cache> cache(NewBenchCache(state.range(0), 1024 * 4096));
+  Random rnd(301);
+  uint64_t scan_key = 1 << 20;
+  uint64_t hits = 0;
+  uint64_t lookups = 0;
+  char key[8];
+  for (auto _ : state) {
+    const uint64_t k = rnd.Uniform(kNumHotBlocks);
+    EncodeFixed64(key, k);
+    Cache::Handle* h = cache->Lookup(Slice(key, sizeof(key)));
+    if (h != nullptr) {
+      hits++;
+      cache->Release(h);
+    } else {
+      InsertBlock(cache.get(), k);
+    }
+    lookups++;
+    for (int i = 0; i < 4; i++) {
+      EncodeFixed64(key, scan_key);
+      Cache::Handle* scan_h = cache->Lookup(Slice(key, sizeof(key)));
+      if (scan_h != nullptr) cache->Release(scan_h);
+      InsertBlock(cache.get(), scan_key++);
+    }
+  }
+  state.counters["hit_ratio"] =
+      lookups == 0 ? 0 : static_cast<double>(hits) / lookups;
+}
+BENCHMARK(BM_CacheScanPollution)->Arg(0)->Arg(1);
+
+void BM_DynamicFilterBloomAdd(benchmark::State& state) {
+  std::unique_ptr<DynamicFilter> filter(NewDynamicFilterBloom(1 << 20, 0.1));
+  uint64_t k = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    filter->Add(UserKey(k++));
+  }
+}
+BENCHMARK(BM_DynamicFilterBloomAdd);
+
+void BM_DynamicFilterBloomKeyMayMatch(benchmark::State& state) {
+  const int kNumKeys = 1 << 20;
+  std::unique_ptr<DynamicFilter> filter(NewDynamicFilterBloom(kNumKeys, 0.1));
+  for (int i = 0; i < kNumKeys; i++) filter->Add(UserKey(i * 2));
+  std::vector<std::string> keys;
+  for (int i = 0; i < 4096; i++) {
+    keys.push_back(UserKey(i * 2 + (state.range(0) ? 0 : 1)));
+  }
+  size_t i = 0;
+  AllocationCounter allocs(state);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(filter->KeyMayMatch(keys[i++ % keys.size()]));
+  }
+}
+BENCHMARK(BM_DynamicFilterBloomKeyMayMatch)->Arg(1)->Arg(0);
+
+// Deletes dir and the files in it.
+void RemoveSegmentDir(const std::string& dir) {
+  std::vector<std::string> files;
+  Env::Default()->GetChildren(dir, &files);
+  for (const std::string& f : files) Env::Default()->DeleteFile(dir + "/" + f);
+  Env::Default()->DeleteDir(dir);
+}
+
+void BM_SegmentForEachRun(benchmark::State& state) {
+  InternalKeyComparator icmp(BytewiseComparator());
+  Options options = BenchOptions(&icmp);
+  std::string dbname = NvmemTableFixture::TestDir() + "/microbench_segments";
+  // Left behind by an aborted run.
+  RemoveSegmentDir(dbname);
+  Env::Default()->CreateDir(dbname);
+  SegmentManager* manager = nullptr;
+  Status s = SegmentManager::OpenManager(options, dbname, &manager, []() {});
+  uint32_t seg_id;
+  std::unique_ptr<SegmentBuilder> builder;
+  if (s.ok()) s = manager->NewSegmentBuilder(&seg_id, builder, false);
+  Segment* seg = nullptr;
+  if (s.ok()) {
+    std::string value(kValueSize, 'v');
+    uint64_t k = 0;
+    for (int run = 0; run < state.range(0); run++) {
+      uint32_t run_no;
+      builder->StartMiniRun();
+      for (int i = 0; i < 64; i++) builder->Add(InternalKeyOf(k++), value);
+      builder->FinishMiniRun(&run_no);
+    }
+    builder->Finish();
+    builder.reset();
+    s = manager->OpenSegment(seg_id, &seg);
+  }
+  if (!s.ok()) {
+    state.SkipWithError(s.ToString().c_str());
+  } else {
+    AllocationCounter allocs(state);
+    for (auto _ : state) {
+      size_t total = 0;
+      seg->ForEachRun([&total](int run_no, MiniRunHandle handle,
+                               size_t run_size, bool valid) -> bool {
+        total += run_size;
+        return false;
+      });
+      benchmark::DoNotOptimize(total);
+    }
+    manager->DropSegment(seg);
+    manager->RemoveSegment(seg_id);
+  }
+  builder.reset();
+  delete manager;
+  RemoveSegmentDir(dbname);
+  delete options.filter_policy;
+}
+BENCHMARK(BM_SegmentForEachRun)->Arg(16)->Arg(256);
+
+}  // namespace
+}  // namespace silkstore
+}  // namespace leveldb
+
+BENCHMARK_MAIN();
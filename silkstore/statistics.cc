@@ -0,0 +1,259 @@
+//
+// Thread-safe counters and latency histograms of a SilkStore.
+//
+
+#include "silkstore/statistics.h"
+
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+
+namespace leveldb {
+namespace silkstore {
+
+Statistics::Statistics() { Reset(); }
+
+int Statistics::ThisThreadShard() {
+  static std::atomic<int> next_shard(0);
+  thread_local int shard = next_shard.fetch_add(1) % kNumShards;
+  return shard;
+}
+
+int Statistics::BucketIndex(uint64_t value) {
+  if (value < 4) return static_cast<int>(value);
+  int exp = 63 - __builtin_clzll(value);
+  int sub_bucket = static_cast<int>(value >> (exp - 2)) & 3;
+  return 4 * (exp - 1) + sub_bucket;
+}
+
+uint64_t Statistics::BucketLimit(int bucket) {
+  if (bucket < 4) return bucket + 1;
+  if (bucket == kNumBuckets - 1) return std::numeric_limits<uint64_t>::max();
+  return static_cast<uint64_t>(5 + bucket % 4) << (bucket / 4 - 1);
+}
+
+void Statistics::MeasureTime(HistogramType type, uint64_t micros) {
+  Histogram& h = shards_[ThisThreadShard()].histograms[type];
+  h.count.fetch_add(1, std::memory_order_relaxed);
+  h.sum.fetch_add(micros, std::memory_order_relaxed);
+  h.buckets[BucketIndex(micros)].fetch_add(1, std::memory_order_relaxed);
+  uint64_t cur = h.min.load(std::memory_order_relaxed);
+  while (micros < cur &&
+         !h.min.compare_exchange_weak(cur, micros, std::memory_order_relaxed)) {
+  }
+  cur = h.max.load(std::memory_order_relaxed);
+  while (micros > cur &&
+         !h.max.compare_exchange_weak(cur, micros, std::memory_order_relaxed)) {
+  }
+}
+
+uint64_t Statistics::Get(Ticker ticker) const {
+  uint64_t sum = 0;
+  for (const Shard& shard : shards_) {
+    sum += shard.tickers[ticker].load(std::memory_order_relaxed);
+  }
+  return sum;
+}
+
+HistogramData Statistics::GetHistogram(HistogramType type) const {
+  HistogramData data;
+  data.count = 0;
+  data.sum = 0;
+  data.min = std::numeric_limits<uint64_t>::max();
+  data.max = 0;
+  uint64_t buckets[kNumBuckets] = {0};
+  for (const Shard& shard : shards_) {
+    const Histogram& h = shard.histograms[type];
+    data.count += h.count.load(std::memory_order_relaxed);
+    data.sum += h.sum.load(std::memory_order_relaxed);
+    data.min = std::min(data.min, h.min.load(std::memory_order_relaxed));
+    data.max = std::max(data.max, h.max.load(std::memory_order_relaxed));
+    for (int b = 0; b < kNumBuckets; ++b) {
+      buckets[b] += h.buckets[b].load(std::memory_order_relaxed);
+    }
+  }
+  if (data.count == 0) data.min = 0;
+
+  // The bucket counts are read one by one while other threads keep
+  // recording, so use their own total rather than data.count.
+  uint64_t total = 0;
+  for (int b = 0; b < kNumBuckets; ++b) total += buckets[b];
+  auto percentile = [&](double p) -> double {
+    if (total == 0) return 0;
+    double threshold = total * (p / 100.0);
+    double cumulative = 0;
+    for (int b = 0; b < kNumBuckets; ++b) {
+      if (buckets[b] == 0) continue;
+      double prev = cumulative;
+      cumulative += buckets[b];
+      if (cumulative >= threshold) {
+        // Interpolate within the bucket, then clamp to the observed range.
+        double left = b == 0 ? 0 : BucketLimit(b - 1);
+        double right = BucketLimit(b);
+        double r = left + (right - left) * (threshold - prev) / buckets[b];
+        r = std::max(r, static_cast<double>(data.min));
+        r = std::min(r, static_cast<double>(data.max));
+        return r;
+      }
+    }
+    return data.max;
+  };
+  data.average =
+      data.count == 0 ? 0 : static_cast<double>(data.sum) / data.count;
+  data.p50 = percentile(50);
+  data.p95 = percentile(95);
+  data.p99 = percentile(99);
+  data.p999 = percentile(99.9);
+  return data;
+}
+
+void Statistics::Reset() {
+  for (Shard& shard : shards_) {
+    for (auto& ticker : shard.tickers) {
+      ticker.store(0, std::memory_order_relaxed);
+    }
+    for (Histogram& h : shard.histograms) {
+      h.count.store(0, std::memory_order_relaxed);
+      h.sum.store(0, std::memory_order_relaxed);
+      h.min.store(std::numeric_limits<uint64_t>::max(),
+                  std::memory_order_relaxed);
+      h.max.store(0, std::memory_order_relaxed);
+      for (auto& bucket : h.buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+}
+
+std::string Statistics::ToString() const {
+  std::string result;
+  for (int t = 0; t < kNumTickers; ++t) {
+    result.append(TickerName(static_cast<Ticker>(t)));
+    result.append(": ");
+    result.append(std::to_string(Get(static_cast<Ticker>(t))));
+    result.append("\n");
+  }
+  return result;
+}
+
+std::string Statistics::HistogramsToJson() const {
+  std::string result = "{";
+  for (int t = 0; t < kNumHistograms; ++t) {
+    HistogramData d = GetHistogram(static_cast<HistogramType>(t));
+    char buf[400];
+    snprintf(buf, sizeof(buf),
+             "%s\"%s\": {\"count\": %llu, \"sum\": %llu, \"min\": %llu, "
+             "\"max\": %llu, \"average\": %.3f, \"p50\": %.3f, "
+             "\"p95\": %.3f, \"p99\": %.3f, \"p999\": %.3f}",
+             t == 0 ? "" : ", ", HistogramName(static_cast<HistogramType>(t)),
+             (unsigned long long)d.count, (unsigned long long)d.sum,
+             (unsigned long long)d.min, (unsigned long long)d.max, d.average,
+             d.p50, d.p95, d.p99, d.p999);
+    result.append(buf);
+  }
+  result.append("}");
+  return result;
+}
+
+const char* Statistics::TickerName(Ticker ticker) {
+  switch (ticker) {
+    case kRunsSearched:
+      return "runs_searched";
+    case kRunsHit:
+      return "runs_hit_counts";
+    case kRunsMiss:
+      return "runs_miss_counts";
+    case kBloomFilterUseful:
+      return "bloom_filter_counts";
+    case kLeafFilterUseful:
+      return "leaf_filter_counts";
+    case kMetadataCacheHit:
+      return "metadata_cache_hit";
+    case kMetadataCacheMiss:
+      return "metadata_cache_miss";
+    case kBlockCacheHit:
+      return "block_cache_hit";
+    case kBlockCacheMiss:
+      return "block_cache_miss";
+    case kSecondaryCacheHit:
+      return "secondary_cache_hit";
+    case kSecondaryCacheMiss:
+      return "secondary_cache_miss";
+    case kRowCacheHit:
+      return "row_cache_hit";
+    case kRowCacheMiss:
+      return "row_cache_miss";
+    case kBytesRead:
+      return "bytes_read";
+    case kBytesWritten:
+      return "bytes_written";
+    case kGCBytesRead:
+      return "gc_bytes_read";
+    case kGCBytesReadUnopt:
+      return "gc_bytes_read_unopt";
+    case kGCBytesWritten:
+      return "gc_bytes_written";
+    case kGCMiniRunsQueried:
+      return "gc_miniruns_queried";
+    case kGCMiniRunsTotal:
+      return "gc_miniruns_total";
+    case kCompactionMicros:
+      return "compaction_micros";
+    case kGCMicros:
+      return "gc_micros";
+    case kUserBytesWritten:
+      return "user_bytes_written";
+    case kUserBytesRead:
+      return "user_bytes_read";
+    case kDeviceBytesWrittenMerge:
+      return "device_bytes_written_merge";
+    case kDeviceBytesWrittenSplit:
+      return "device_bytes_written_split";
+    case kDeviceBytesWrittenOptimize:
+      return "device_bytes_written_optimize";
+    case kDeviceBytesWrittenGC:
+      return "device_bytes_written_gc";
+    case kDeviceBytesReadGet:
+      return "device_bytes_read_get";
+    case kDeviceBytesReadScan:
+      return "device_bytes_read_scan";
+    case kDeviceBytesReadBackground:
+      return "device_bytes_read_background";
+    case kNumTickers:
+      break;
+  }
+  return "unknown";
+}
+
+const char* Statistics::HistogramName(HistogramType type) {
+  switch (type) {
+    case kGetMicros:
+      return "get_micros";
+    case kWriteMicros:
+      return "write_micros";
+    case kIterSeekMicros:
+      return "iter_seek_micros";
+    case kIterNextMicros:
+      return "iter_next_micros";
+    case kWriteStallMicros:
+      return "write_stall_micros";
+    case kNvmPersistMicros:
+      return "nvm_persist_micros";
+    case kMergeMicros:
+      return "merge_micros";
+    case kLeafSplitMicros:
+      return "leaf_split_micros";
+    case kGCSegmentMicros:
+      return "gc_segment_micros";
+    case kRowCacheHitMicros:
+      return "row_cache_hit_micros";
+    case kRowCacheMissMicros:
+      return "row_cache_miss_micros";
+    case kNumHistograms:
+      break;
+  }
+  return "unknown";
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
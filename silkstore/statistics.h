@@ -0,0 +1,234 @@
+//
+// Thread-safe counters and latency histograms of a SilkStore, and the
+// timers used to fill them in and to fill in per-request PerfContexts.
+//
+
+#ifndef SILKSTORE_STATISTICS_H_
+#define SILKSTORE_STATISTICS_H_
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+
+namespace leveldb {
+namespace silkstore {
+
+enum Ticker {
+  // Point lookups in the leaf store.
+  kRunsSearched = 0,
+  kRunsHit,
+  kRunsMiss,
+  kBloomFilterUseful,
+  // Lookups that skipped all the runs of their leaf thanks to its filter.
+  kLeafFilterUseful,
+  // Lookups of the metadata that cold runs spilled to their segment.
+  kMetadataCacheHit,
+  kMetadataCacheMiss,
+  // Lookups of run data blocks in Options::block_cache.
+  kBlockCacheHit,
+  kBlockCacheMiss,
+  // Lookups of run data blocks missing from the block cache in the
+  // secondary cache.
+  kSecondaryCacheHit,
+  kSecondaryCacheMiss,
+  // Point lookups that missed the memtables, in the row cache.
+  kRowCacheHit,
+  kRowCacheMiss,
+
+  // Merges and garbage collection.
+  kBytesRead,
+  kBytesWritten,
+  kGCBytesRead,
+  kGCBytesReadUnopt,
+  kGCBytesWritten,
+  // # miniruns queried in leaf_index_ for validness during GC.
+  kGCMiniRunsQueried,
+  // # miniruns in total checked during GC.
+  kGCMiniRunsTotal,
+  kCompactionMicros,
+  kGCMicros,
+
+  // Amplification accounting. User bytes are keys and values as passed to
+  // or returned by the DB; device bytes are what reaches the segment files.
+  kUserBytesWritten,
+  kUserBytesRead,
+  kDeviceBytesWrittenMerge,
+  kDeviceBytesWrittenSplit,
+  kDeviceBytesWrittenOptimize,
+  kDeviceBytesWrittenGC,
+  kDeviceBytesReadGet,
+  kDeviceBytesReadScan,
+  // Reads by merges, splits, leaf optimization and GC.
+  kDeviceBytesReadBackground,
+
+  kNumTickers
+};
+
+// Latencies, all in microseconds.
+enum HistogramType {
+  kGetMicros = 0,
+  kWriteMicros,
+  kIterSeekMicros,
+  kIterNextMicros,
+  // Writers blocked until the immutable memtable is merged.
+  kWriteStallMicros,
+  // Batch insert into the NVM memtable, including persisting its log.
+  kNvmPersistMicros,
+  // One background merge of the immutable memtable, including GC.
+  kMergeMicros,
+  kLeafSplitMicros,
+  // Garbage collection of one segment.
+  kGCSegmentMicros,
+  // The part after the memtables of the point lookups that hit or missed
+  // the row cache.
+  kRowCacheHitMicros,
+  kRowCacheMissMicros,
+
+  kNumHistograms
+};
+
+struct HistogramData {
+  uint64_t count;
+  uint64_t sum;
+  uint64_t min;
+  uint64_t max;
+  double average;
+  double p50;
+  double p95;
+  double p99;
+  double p999;
+};
+
+// Statistics keeps a set of counters and histograms that any thread may
+// update without locking. Every thread is bound to one of a fixed number
+// of cache-line separated shards; the shards are summed on demand.
+class Statistics {
+ public:
+  Statistics();
+
+  Statistics(const Statistics&) = delete;
+  Statistics& operator=(const Statistics&) = delete;
+
+  void Record(Ticker ticker, uint64_t count = 1) {
+    shards_[ThisThreadShard()].tickers[ticker].fetch_add(
+        count, std::memory_order_relaxed);
+  }
+
+  void MeasureTime(HistogramType type, uint64_t micros);
+
+  // Sum of all counts recorded for ticker so far.
+  uint64_t Get(Ticker ticker) const;
+
+  HistogramData GetHistogram(HistogramType type) const;
+
+  void Reset();
+
+  // One "name: value" line per ticker.
+  std::string ToString() const;
+
+  // A JSON object mapping every histogram name to an object with its
+  // count, sum, min, max, average, p50, p95, p99 and p999.
+  std::string HistogramsToJson() const;
+
+  static const char* TickerName(Ticker ticker);
+  static const char* HistogramName(HistogramType type);
+
+ private:
+  static constexpr int kNumShards = 16;
+
+  // Bucket i >= 4 covers [(4 + i % 4) << (i / 4 - 1), (5 + i % 4) << (i / 4
+  // - 1)), so that every bucket is at most 25% wide; buckets 0 to 3 hold
+  // the values 0 to 3.
+  static constexpr int kNumBuckets = 252;
+
+  static int BucketIndex(uint64_t value);
+  static uint64_t BucketLimit(int bucket);
+
+  struct Histogram {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;
+    std::atomic<uint64_t> min;
+    std::atomic<uint64_t> max;
+    std::atomic<uint64_t> buckets[kNumBuckets];
+  };
+
+  struct Shard {
+    std::atomic<uint64_t> tickers[kNumTickers];
+    Histogram histograms[kNumHistograms];
+    char padding[64];
+  };
+
+  static int ThisThreadShard();
+
+  Shard shards_[kNumShards];
+};
+
+// Records the microseconds elapsed between construction and destruction
+// in a histogram of stats. A null stats disables the watch.
+class StopWatch {
+ public:
+  StopWatch(Statistics* stats, HistogramType type)
+      : stats_(stats),
+        type_(type),
+        start_(stats != nullptr ? NowMicros() : 0) {}
+
+  StopWatch(const StopWatch&) = delete;
+  StopWatch& operator=(const StopWatch&) = delete;
+
+  ~StopWatch() {
+    if (stats_ != nullptr) stats_->MeasureTime(type_, NowMicros() - start_);
+  }
+
+  static uint64_t NowMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  Statistics* const stats_;
+  const HistogramType type_;
+  const uint64_t start_;
+};
+
+// Adds the nanoseconds elapsed between construction and Stop() (or
+// destruction) to *sink. Does nothing, not even read the clock, when sink
+// is null so that requests without a PerfContext pay no cost.
+class PerfTimer {
+ public:
+  explicit PerfTimer(uint64_t* sink)
+      : sink_(sink), start_(sink != nullptr ? NowNanos() : 0) {}
+
+  PerfTimer(const PerfTimer&) = delete;
+  PerfTimer& operator=(const PerfTimer&) = delete;
+
+  ~PerfTimer() { Stop(); }
+
+  void Stop() {
+    if (sink_ != nullptr) {
+      *sink_ += NowNanos() - start_;
+      sink_ = nullptr;
+    }
+  }
+
+  static uint64_t NowNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+  }
+
+ private:
+  uint64_t* sink_;
+  uint64_t start_;
+};
+
+// Yields the address of field within the PerfContext pc, or null if pc is
+// null, for use with PerfTimer.
+#define SILKSTORE_PERF_FIELD(pc, field) \
+  ((pc) != nullptr ? &(pc)->field : nullptr)
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+#endif  // SILKSTORE_STATISTICS_H_
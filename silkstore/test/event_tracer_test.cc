@@ -0,0 +1,86 @@
+#include "silkstore/event_tracer.h"
+
+#include <thread>
+#include <vector>
+
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class EventTracerTest {};
+
+static size_t CountOccurrences(const std::string& s, const std::string& sub) {
+  size_t n = 0;
+  for (size_t pos = s.find(sub); pos != std::string::npos;
+       pos = s.find(sub, pos + 1)) {
+    ++n;
+  }
+  return n;
+}
+
+TEST(EventTracerTest, WritesChromeTraceJson) {
+  Env* env = Env::Default();
+  std::string fname = test::TmpDir() + "/event_tracer_test.json";
+  EventTracer* tracer;
+  ASSERT_OK(EventTracer::Open(env, fname, &tracer));
+
+  {
+    TraceSpan disabled(nullptr, "ignored");
+    disabled.SetArg("bytes", 1);
+  }
+  {
+    TraceSpan span(tracer, "merge_memtable");
+    span.SetArg("bytes", 1);
+    span.SetArg("leaves", 7);
+    span.SetArg("bytes", 4096);
+  }
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([tracer]() {
+      for (int i = 0; i < 100; ++i) {
+        TraceSpan span(tracer, "split_leaf");
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  delete tracer;
+
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env, fname, &contents));
+  ASSERT_EQ(0, contents.find("[\n{\"name\": \"merge_memtable\""));
+  ASSERT_EQ(contents.size() - 3, contents.rfind("\n]\n"));
+  ASSERT_TRUE(contents.find("\"args\": {\"bytes\": 4096, \"leaves\": 7}}") !=
+              std::string::npos);
+  ASSERT_EQ(0, CountOccurrences(contents, "ignored"));
+  ASSERT_EQ(400, CountOccurrences(contents, "\"name\": \"split_leaf\""));
+  ASSERT_EQ(400, CountOccurrences(contents, "},\n"));
+  ASSERT_EQ(401, CountOccurrences(contents, "\"ph\": \"X\""));
+  env->DeleteFile(fname);
+}
+
+TEST(EventTracerTest, BuffersSpansUntilFlush) {
+  Env* env = Env::Default();
+  std::string fname = test::TmpDir() + "/event_tracer_test.json";
+  EventTracer* tracer;
+  ASSERT_OK(EventTracer::Open(env, fname, &tracer));
+  { TraceSpan span(tracer, "write_stall"); }
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env, fname, &contents));
+  ASSERT_EQ(0, CountOccurrences(contents, "write_stall"));
+  tracer->Flush();
+  ASSERT_OK(ReadFileToString(env, fname, &contents));
+  ASSERT_EQ(1, CountOccurrences(contents, "write_stall"));
+  { TraceSpan span(tracer, "memtable_switch"); }
+  delete tracer;
+  ASSERT_OK(ReadFileToString(env, fname, &contents));
+  ASSERT_EQ(0, contents.find("[\n{"));
+  ASSERT_EQ(1, CountOccurrences(contents, "},\n"));
+  ASSERT_EQ(1, CountOccurrences(contents, "memtable_switch"));
+  env->DeleteFile(fname);
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -0,0 +1,95 @@
+#include "silkstore/filter_allocator.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class FilterAllocatorTest {};
+
+// A policy without NewWithBitsPerKey().
+class FixedFilterPolicy : public FilterPolicy {
+ public:
+  const char* Name() const override { return "FixedFilterPolicy"; }
+  void CreateFilter(const Slice* keys, int n, std::string* dst) const override {
+  }
+  bool KeyMayMatch(const Slice& key, const Slice& filter) const override {
+    return true;
+  }
+};
+
+TEST(FilterAllocatorTest, Disabled) {
+  std::unique_ptr<const FilterPolicy> bloom(NewBloomFilterPolicy(10));
+  FilterAllocator no_budget(bloom.get(), 0);
+  ASSERT_TRUE(!no_budget.enabled());
+  ASSERT_TRUE(no_budget.PolicyForRun(100, 1000) == nullptr);
+
+  FilterAllocator no_policy(nullptr, 10);
+  ASSERT_TRUE(!no_policy.enabled());
+
+  FixedFilterPolicy fixed;
+  FilterAllocator fixed_size(&fixed, 10);
+  ASSERT_TRUE(!fixed_size.enabled());
+  ASSERT_TRUE(fixed_size.PolicyForRun(100, 1000) == nullptr);
+}
+
+TEST(FilterAllocatorTest, FirstRunGetsBudget) {
+  std::unique_ptr<const FilterPolicy> bloom(NewBloomFilterPolicy(10));
+  FilterAllocator allocator(bloom.get(), 10);
+  ASSERT_TRUE(allocator.enabled());
+  ASSERT_EQ(10, allocator.BitsPerKeyForRun(5, 1000));
+}
+
+TEST(FilterAllocatorTest, HotSmallRunsGetMoreBits) {
+  std::unique_ptr<const FilterPolicy> bloom(NewBloomFilterPolicy(10));
+  FilterAllocator allocator(bloom.get(), 10);
+  // A population of large cold runs and small hot runs.
+  Random rnd(301);
+  int cold_bits = 0, hot_bits = 0;
+  for (int i = 0; i < 1000; i++) {
+    if (rnd.OneIn(2)) {
+      cold_bits = allocator.BitsPerKeyForRun(0, 100000);
+    } else {
+      hot_bits = allocator.BitsPerKeyForRun(1000, 1000);
+    }
+  }
+  ASSERT_LE(cold_bits, 10);
+  ASSERT_GT(hot_bits, cold_bits);
+  ASSERT_LE(hot_bits, FilterAllocator::kMaxBitsPerKey);
+  // Most keys are in cold runs, which stay close to the budget.
+  ASSERT_GT(allocator.AverageBitsPerKey(), 8.5);
+  ASSERT_LT(allocator.AverageBitsPerKey(), 10.5);
+}
+
+TEST(FilterAllocatorTest, FiltersReadableByBasePolicy) {
+  std::unique_ptr<const FilterPolicy> ribbon(NewRibbonFilterPolicy(10));
+  InternalFilterPolicy base(ribbon.get());
+  FilterAllocator allocator(ribbon.get(), 10);
+  const uint64_t hotness[] = {0, 10, 100000};
+  for (uint64_t h : hotness) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 3000; i++) {
+      InternalKey ikey("key" + std::to_string(i), 1, kTypeValue);
+      keys.push_back(ikey.Encode().ToString());
+    }
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    const FilterPolicy* policy = allocator.PolicyForRun(h, keys.size());
+    ASSERT_TRUE(policy != nullptr);
+    std::string filter;
+    policy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+    for (const std::string& key : keys) {
+      ASSERT_TRUE(base.KeyMayMatch(key, filter));
+    }
+  }
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
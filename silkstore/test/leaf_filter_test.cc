@@ -0,0 +1,112 @@
+#include "silkstore/leaf_filter.h"
+
+#include <string>
+#include <vector>
+
+#include "silkstore/leaf_store.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class LeafFilterTest {};
+
+static std::vector<uint64_t> HashKeys(int start, int end) {
+  std::vector<uint64_t> hashes;
+  for (int i = start; i < end; i++) {
+    hashes.push_back(LeafFilter::HashKey("key" + std::to_string(i)));
+  }
+  return hashes;
+}
+
+static double FalsePositiveRate(const Slice& filter) {
+  int result = 0;
+  for (int i = 0; i < 10000; i++) {
+    if (LeafFilter::KeyMayMatch(
+            LeafFilter::HashKey("absent" + std::to_string(i)), filter)) {
+      result++;
+    }
+  }
+  return result / 10000.0;
+}
+
+TEST(LeafFilterTest, BuildAndExtend) {
+  std::vector<uint64_t> run1 = HashKeys(0, 1000);
+  std::vector<uint64_t> run2 = HashKeys(1000, 3000);
+  std::string filter1;
+  LeafFilter::Build(run1.data(), run1.size(), 4000, 10, &filter1);
+  ASSERT_EQ(1000, LeafFilter::NumKeys(filter1));
+  for (uint64_t h : run1) ASSERT_TRUE(LeafFilter::KeyMayMatch(h, filter1));
+
+  std::string filter2;
+  ASSERT_TRUE(
+      LeafFilter::Extend(filter1, run2.data(), run2.size(), &filter2));
+  ASSERT_EQ(filter1.size(), filter2.size());
+  ASSERT_EQ(3000, LeafFilter::NumKeys(filter2));
+  for (uint64_t h : run1) ASSERT_TRUE(LeafFilter::KeyMayMatch(h, filter2));
+  for (uint64_t h : run2) ASSERT_TRUE(LeafFilter::KeyMayMatch(h, filter2));
+  ASSERT_LE(FalsePositiveRate(filter2), 0.03);
+}
+
+TEST(LeafFilterTest, ExtendBeyondCapacity) {
+  std::vector<uint64_t> run1 = HashKeys(0, 1000);
+  std::vector<uint64_t> run2 = HashKeys(1000, 2001);
+  std::string filter;
+  LeafFilter::Build(run1.data(), run1.size(), 2000, 10, &filter);
+  std::string extended = "unchanged";
+  ASSERT_TRUE(
+      !LeafFilter::Extend(filter, run2.data(), run2.size(), &extended));
+  ASSERT_EQ("unchanged", extended);
+  ASSERT_TRUE(!LeafFilter::Extend("garbage", run2.data(), 1, &extended));
+}
+
+TEST(LeafFilterTest, LeafIndexEntryWithFilter) {
+  std::vector<uint64_t> hashes = HashKeys(0, 100);
+  std::string leaf_filter;
+  LeafFilter::Build(hashes.data(), hashes.size(), 1000, 10, &leaf_filter);
+
+  std::vector<std::string> run_bufs(3);
+  std::vector<MiniRunIndexEntry> runs;
+  for (int i = 0; i < 3; i++) {
+    runs.push_back(MiniRunIndexEntry::Build(i, i, Slice("index"),
+                                            Slice("filter"), 100, &run_bufs[i]));
+  }
+  std::string buf1, buf2, buf3, buf4;
+  LeafIndexEntry e1, e2, e3, e4;
+  LeafIndexEntryBuilder::AppendMiniRunIndexEntry(LeafIndexEntry{}, runs[0],
+                                                 &buf1, &e1, leaf_filter);
+  ASSERT_TRUE(e1.HasLeafFilter());
+  ASSERT_EQ(1, e1.GetNumMiniRuns());
+  ASSERT_EQ(leaf_filter, e1.GetLeafFilter().ToString());
+
+  LeafIndexEntryBuilder::AppendMiniRunIndexEntry(e1, runs[1], &buf2, &e2,
+                                                 leaf_filter);
+  ASSERT_EQ(2, e2.GetNumMiniRuns());
+  ASSERT_EQ(leaf_filter, e2.GetLeafFilter().ToString());
+  std::vector<MiniRunIndexEntry> entries =
+      e2.GetAllMiniRunIndexEntry(LeafIndexEntry::TraversalOrder::forward);
+  ASSERT_EQ(2, entries.size());
+  ASSERT_EQ(0, entries[0].GetSegmentNumber());
+  ASSERT_EQ(1, entries[1].GetSegmentNumber());
+  ASSERT_EQ("filter", entries[1].GetFilterData().ToString());
+  ASSERT_EQ(200, e2.GetLeafDataSize());
+
+  // Replacing runs keeps the filter.
+  ASSERT_OK(
+      LeafIndexEntryBuilder::ReplaceMiniRunRange(e2, 0, 1, runs[2], &buf3, &e3));
+  ASSERT_EQ(1, e3.GetNumMiniRuns());
+  ASSERT_EQ(leaf_filter, e3.GetLeafFilter().ToString());
+  ASSERT_EQ(2, e3.GetAllMiniRunIndexEntry()[0].GetSegmentNumber());
+
+  // Appending without a filter drops it.
+  LeafIndexEntryBuilder::AppendMiniRunIndexEntry(e3, runs[0], &buf4, &e4);
+  ASSERT_TRUE(!e4.HasLeafFilter());
+  ASSERT_TRUE(e4.GetLeafFilter().empty());
+  ASSERT_EQ(2, e4.GetNumMiniRuns());
+  ASSERT_EQ(0, e4.GetAllMiniRunIndexEntry()[0].GetSegmentNumber());
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
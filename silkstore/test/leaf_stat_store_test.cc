@@ -0,0 +1,127 @@
+#include "silkstore/leaf_store.h"
+
+#include <thread>
+#include <vector>
+
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class LeafStatStoreTest {
+ public:
+  Env* env_;
+  std::string fname_;
+
+  LeafStatStoreTest() : env_(Env::Default()) {
+    fname_ = test::TmpDir() + "/leaf_stat_store_test";
+    env_->DeleteFile(fname_);
+  }
+
+  ~LeafStatStoreTest() { env_->DeleteFile(fname_); }
+};
+
+TEST(LeafStatStoreTest, SnapshotRoundTrip) {
+  LeafStatStore store;
+  store.NewLeaf("a", 3);
+  store.NewLeaf("b", 1);
+  store.NewLeaf("c", 2);
+  for (int i = 0; i < 10; ++i) store.IncrementLeafReads("a");
+  store.IncrementLeafReads("b");
+  store.UpdateReadHotness();
+  store.UpdateWriteHotness("c", 100);
+  ASSERT_OK(store.SaveSnapshot(env_, fname_));
+
+  // "b" was merged away and "d" created since the snapshot.
+  LeafStatStore restored;
+  restored.NewLeaf("a", 5);
+  restored.NewLeaf("c", 2);
+  restored.NewLeaf("d", 1);
+  ASSERT_OK(restored.LoadSnapshot(env_, fname_));
+
+  ASSERT_EQ(store.GetReadHotness("a"), restored.GetReadHotness("a"));
+  ASSERT_EQ(store.GetWriteHotness("c"), restored.GetWriteHotness("c"));
+  ASSERT_EQ(0, restored.GetReadHotness("d"));
+  ASSERT_EQ(-1, restored.GetReadHotness("b"));
+  restored.ForEachLeaf(
+      [](const std::string& key, const LeafStatStore::LeafStat& stat) {
+        // Run counts come from the leaf index, not from the snapshot.
+        if (key == "a") ASSERT_EQ(5, stat.num_runs);
+      });
+}
+
+TEST(LeafStatStoreTest, CorruptSnapshotIsRejected) {
+  LeafStatStore store;
+  store.NewLeaf("a", 1);
+  ASSERT_OK(store.SaveSnapshot(env_, fname_));
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname_, &contents));
+  contents[contents.size() / 2] ^= 0x1;
+  ASSERT_OK(WriteStringToFile(env_, contents, fname_));
+  ASSERT_TRUE(store.LoadSnapshot(env_, fname_).IsCorruption());
+  ASSERT_TRUE(store.LoadSnapshot(env_, fname_ + ".missing").IsNotFound());
+}
+
+TEST(LeafStatStoreTest, ConcurrentReadsAreAllCounted) {
+  static const int kThreads = 8;
+  static const int kReadsPerThread = 10000;
+  LeafStatStore store;
+  store.NewLeaf("a", 1);
+  store.NewLeaf("b", 1);
+  std::vector<std::thread> readers;
+  for (int t = 0; t < kThreads; ++t) {
+    readers.emplace_back([&store, t]() {
+      for (int i = 0; i < kReadsPerThread; ++i) {
+        store.IncrementLeafReads(t % 2 == 0 ? "a" : "b");
+        // Reads of unknown leaves are dropped.
+        store.IncrementLeafReads("unknown");
+      }
+    });
+  }
+  for (auto& t : readers) t.join();
+  store.UpdateReadHotness();
+  double expected = kThreads / 2 * kReadsPerThread *
+                    LeafStatStore::read_hotness_exp_smooth_factor;
+  ASSERT_EQ(expected, store.GetReadHotness("a"));
+  ASSERT_EQ(expected, store.GetReadHotness("b"));
+  ASSERT_EQ(-1, store.GetReadHotness("unknown"));
+}
+
+TEST(LeafStatStoreTest, SampledReads) {
+  LeafStatStore store;
+  store.SetReadSampleRate(10);
+  store.NewLeaf("a", 1);
+  for (int i = 0; i < 1000; ++i) store.IncrementLeafReads("a");
+  store.UpdateReadHotness();
+  ASSERT_EQ(1000 * LeafStatStore::read_hotness_exp_smooth_factor,
+            store.GetReadHotness("a"));
+}
+
+TEST(LeafStatStoreTest, ByteAccounting) {
+  LeafStatStore store;
+  store.NewLeaf("a", 1);
+  store.AddLeafWrites("a", 100, 250);
+  store.AddLeafWrites("missing", 100, 250);
+  store.IncrementLeafReads("a", 4096);
+  store.IncrementLeafReads("a", 8192);
+  store.UpdateReadHotness();
+
+  std::vector<std::string> halves = {"a0", "a"};
+  store.SplitLeaf("a", halves);
+  int leaves = 0;
+  store.ForEachLeaf(
+      [&leaves](const std::string& key, const LeafStatStore::LeafStat& stat) {
+        ++leaves;
+        ASSERT_EQ(50, stat.user_bytes_written);
+        ASSERT_EQ(125, stat.device_bytes_written);
+        ASSERT_EQ(6144, stat.device_bytes_read);
+        ASSERT_EQ(1, stat.reads);
+      });
+  ASSERT_EQ(2, leaves);
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -0,0 +1,200 @@
+#include "silkstore/manifest.h"
+
+#include "db/filename.h"
+#include "db/log_writer.h"
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+static void TestEncodeDecode(const ManifestEdit& edit) {
+  std::string encoded, encoded2;
+  edit.EncodeTo(&encoded);
+  ManifestEdit parsed;
+  Status s = parsed.DecodeFrom(encoded);
+  ASSERT_TRUE(s.ok()) << s.ToString();
+  parsed.EncodeTo(&encoded2);
+  ASSERT_EQ(encoded, encoded2);
+}
+
+static void DestroyManifestDir(Env* env, const std::string& dbname) {
+  std::vector<std::string> files;
+  env->GetChildren(dbname, &files);
+  for (auto& f : files) {
+    env->DeleteFile(dbname + "/" + f);
+  }
+  env->DeleteDir(dbname);
+}
+
+class ManifestTest {
+ public:
+  Env* env_;
+  std::string dbname_;
+
+  ManifestTest() : env_(Env::Default()) {
+    dbname_ = test::TmpDir() + "/silkstore_manifest_test";
+    DestroyManifestDir(env_, dbname_);
+    env_->CreateDir(dbname_);
+  }
+
+  ~ManifestTest() { DestroyManifestDir(env_, dbname_); }
+};
+
+TEST(ManifestTest, EncodeDecode) {
+  static const uint64_t kBig = 1ull << 50;
+
+  ManifestEdit edit;
+  for (int i = 0; i < 4; i++) {
+    TestEncodeDecode(edit);
+    edit.AddNvmRegion(kBig + 100 + i, kBig + 200 + i);
+    edit.RemoveNvmRegion(kBig + 300 + i);
+    edit.AddSegment(1000 + i);
+    edit.RemoveSegment(2000 + i);
+  }
+  edit.SetFormatVersion(1);
+  edit.SetNvmNextOffset(kBig + 400);
+  edit.SetLastSequence(kBig + 500);
+  edit.SetLeafIndexSequence(kBig + 600);
+  TestEncodeDecode(edit);
+}
+
+TEST(ManifestTest, DecodeRejectsGarbage) {
+  ManifestEdit edit;
+  ASSERT_TRUE(edit.DecodeFrom(Slice("\x7f\x01", 2)).IsCorruption());
+  std::string truncated;
+  edit.AddNvmRegion(1 << 20, 1 << 20);
+  edit.EncodeTo(&truncated);
+  truncated.resize(truncated.size() - 1);
+  ASSERT_TRUE(edit.DecodeFrom(truncated).IsCorruption());
+}
+
+TEST(ManifestTest, ApplyInOrder) {
+  ManifestState state;
+  ManifestEdit edit;
+  edit.AddNvmRegion(100, 10);
+  edit.AddSegment(1);
+  edit.AddSegment(2);
+  state.Apply(edit);
+
+  edit.Clear();
+  edit.AddNvmRegion(200, 20);
+  edit.RemoveSegment(1);
+  state.Apply(edit);
+
+  edit.Clear();
+  edit.RemoveNvmRegion(100);
+  edit.SetLeafIndexSequence(42);
+  state.Apply(edit);
+
+  ASSERT_EQ(1, state.nvm_regions.size());
+  ASSERT_EQ(200, state.nvm_regions[0].first);
+  ASSERT_EQ(20, state.nvm_regions[0].second);
+  ASSERT_EQ(1, state.segments.size());
+  ASSERT_EQ(1, state.segments.count(2));
+  ASSERT_EQ(42, state.leaf_index_sequence);
+}
+
+TEST(ManifestTest, ReopenReplaysEdits) {
+  Manifest* manifest;
+  bool created = false;
+  ASSERT_OK(Manifest::Open(env_, dbname_, &manifest, &created));
+  ASSERT_TRUE(created);
+
+  ManifestEdit edit;
+  edit.AddNvmRegion(4096, 8192);
+  edit.SetNvmNextOffset(4096 + 8192);
+  edit.SetLastSequence(7);
+  ASSERT_OK(manifest->LogAndApply(&edit, true));
+  for (uint32_t seg_id = 1; seg_id <= 100; ++seg_id) {
+    edit.Clear();
+    edit.AddSegment(seg_id);
+    ASSERT_OK(manifest->LogAndApply(&edit, false));
+  }
+  edit.Clear();
+  edit.RemoveSegment(50);
+  edit.AddNvmRegion(12288, 4096);
+  edit.SetNvmNextOffset(12288 + 4096);
+  ASSERT_OK(manifest->LogAndApply(&edit, true));
+  edit.Clear();
+  edit.RemoveNvmRegion(4096);
+  edit.SetLeafIndexSequence(7);
+  ASSERT_OK(manifest->LogAndApply(&edit, true));
+  delete manifest;
+
+  ASSERT_OK(Manifest::Open(env_, dbname_, &manifest, &created));
+  ASSERT_TRUE(!created);
+  ManifestState state = manifest->State();
+  ASSERT_EQ(1, state.nvm_regions.size());
+  ASSERT_EQ(12288, state.nvm_regions[0].first);
+  ASSERT_EQ(4096, state.nvm_regions[0].second);
+  ASSERT_EQ(12288 + 4096, state.nvm_next_offset);
+  ASSERT_EQ(7, state.last_sequence);
+  ASSERT_EQ(7, state.leaf_index_sequence);
+  ASSERT_EQ(99, state.segments.size());
+  ASSERT_EQ(0, state.segments.count(50));
+  delete manifest;
+
+  // Reopening starts a new manifest file and removes the old one.
+  std::vector<std::string> files;
+  ASSERT_OK(env_->GetChildren(dbname_, &files));
+  int manifests = 0;
+  for (auto& f : files) {
+    uint64_t number;
+    FileType type;
+    if (ParseFileName(f, &number, &type) && type == kDescriptorFile) {
+      ++manifests;
+    }
+  }
+  ASSERT_EQ(1, manifests);
+}
+
+TEST(ManifestTest, MigrateLegacyCurrent) {
+  // CURRENT of a database written before the manifest holds a log number.
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(LogFileName(dbname_, 5), &file));
+  log::Writer writer(file);
+  ASSERT_OK(writer.AddRecord("12288,4096,4096,8192,4096,"));
+  ASSERT_OK(file->Close());
+  delete file;
+  ASSERT_OK(WriteStringToFile(env_, "5\n", CurrentFileName(dbname_)));
+
+  Manifest* manifest;
+  bool created = true;
+  ASSERT_OK(Manifest::Open(env_, dbname_, &manifest, &created));
+  ASSERT_TRUE(!created);
+  ManifestState state = manifest->State();
+  ASSERT_EQ(12288, state.nvm_next_offset);
+  ASSERT_EQ(2, state.nvm_regions.size());
+  ASSERT_EQ(4096, state.nvm_regions[0].first);
+  ASSERT_EQ(8192, state.nvm_regions[1].first);
+  ASSERT_EQ(4096, state.nvm_regions[1].second);
+  ASSERT_EQ(0, state.segments.size());
+  delete manifest;
+
+  // The migrated database reopens from its manifest.
+  ASSERT_TRUE(!env_->FileExists(LogFileName(dbname_, 5)));
+  ASSERT_OK(Manifest::Open(env_, dbname_, &manifest, &created));
+  ASSERT_EQ(2, manifest->State().nvm_regions.size());
+  delete manifest;
+}
+
+TEST(ManifestTest, RejectBadLegacyRecord) {
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(LogFileName(dbname_, 5), &file));
+  log::Writer writer(file);
+  ASSERT_OK(writer.AddRecord("12288,4096,"));
+  ASSERT_OK(file->Close());
+  delete file;
+  ASSERT_OK(WriteStringToFile(env_, "5", CurrentFileName(dbname_)));
+
+  Manifest* manifest;
+  bool created;
+  ASSERT_TRUE(
+      Manifest::Open(env_, dbname_, &manifest, &created).IsCorruption());
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
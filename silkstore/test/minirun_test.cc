@@ -9,6 +9,7 @@
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "util/coding.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -55,7 +56,7 @@ TEST(MinirunTest, BuilderTestSmall) {
   RandomAccessFile* rndfile;
   s = Env::Default()->NewRandomAccessFile(fname, &rndfile);
   ASSERT_OK(s);
-  MiniRun run(&options, rndfile, 0, run_size, index_block);
+  MiniRun run(&options, rndfile, 0, 0, run_size, index_block);
   Iterator* run_iter = run.NewIterator(ReadOptions());
   DeferCode code([&run_iter]() { delete run_iter; });
 
@@ -209,7 +210,7 @@ TEST(MinirunTest, BuilderTestLarge) {
   RandomAccessFile* rndfile;
   s = Env::Default()->NewRandomAccessFile(fname, &rndfile);
   ASSERT_OK(s);
-  MiniRun run(&options, rndfile, 0, run_size, index_block);
+  MiniRun run(&options, rndfile, 0, 0, run_size, index_block);
   Iterator* run_iter = run.NewIterator(ReadOptions());
   DeferCode code([&run_iter]() { delete run_iter; });
 
@@ -413,6 +414,26 @@ TEST(MinirunTest, MiniRunIndexEntryTest) {
   );
 }
 
+TEST(MinirunTest, SpilledMiniRunIndexEntryTest) {
+  BlockHandle handle;
+  handle.set_offset(123456789);
+  handle.set_size(4321);
+  string buf;
+  auto e = MiniRunIndexEntry::BuildSpilled(7, 3, handle, 1000, &buf);
+  ASSERT_TRUE(e.IsSpilled());
+  ASSERT_EQ(7, e.GetSegmentNumber());
+  ASSERT_EQ(3, e.GetRunNumberWithinSegment());
+  ASSERT_EQ(1000, e.GetRunDataSize());
+  ASSERT_EQ(123456789, e.GetMetadataHandle().offset());
+  ASSERT_EQ(4321, e.GetMetadataHandle().size());
+
+  string buf2;
+  auto e2 = MiniRunIndexEntry::Build(7, 3, Slice("index"), Slice("filter"),
+                                     1000, &buf2);
+  ASSERT_TRUE(!e2.IsSpilled());
+  ASSERT_LT(buf.size(), buf2.size());
+}
+
 TEST(MinirunTest, LeafIndexEntryTest) {
   {
     LeafIndexEntry base;
@@ -746,6 +767,145 @@ TEST(MinirunTest, LeafIndexEntryTest) {
   }
 }
 
+static uint32_t LeafIndexEntryFooter(const LeafIndexEntry& e) {
+  Slice raw = e.GetRawData();
+  return DecodeFixed32(raw.data() + raw.size() - 4);
+}
+
+static void CheckSegmentNumbers(const LeafIndexEntry& e,
+                                const std::vector<uint32_t>& expected) {
+  ASSERT_EQ(expected.size(), e.GetNumMiniRuns());
+  for (uint32_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[i], e.GetMiniRunIndexEntry(i).GetSegmentNumber());
+    ASSERT_EQ(std::to_string(expected[i]),
+              e.GetMiniRunIndexEntry(i).GetBlockIndexData().ToString());
+  }
+  std::vector<MiniRunIndexEntry> backward = e.GetAllMiniRunIndexEntry();
+  ASSERT_EQ(expected.size(), backward.size());
+  for (uint32_t i = 0; i < expected.size(); i++) {
+    ASSERT_EQ(expected[expected.size() - 1 - i],
+              backward[i].GetSegmentNumber());
+  }
+}
+
+TEST(MinirunTest, LeafIndexEntrySplice) {
+  std::vector<string> run_bufs(5);
+  std::vector<MiniRunIndexEntry> runs;
+  for (int i = 0; i < 5; i++) {
+    runs.push_back(MiniRunIndexEntry::Build(
+        i, i, Slice(std::to_string(i)), Slice("filter"), 10, &run_bufs[i]));
+  }
+
+  // An entry in the format without an offset table.
+  string legacy;
+  for (int i = 0; i < 3; i++) {
+    legacy.append(runs[i].GetRawData().data(), runs[i].GetRawData().size());
+    PutFixed32(&legacy, runs[i].GetRawData().size());
+  }
+  PutFixed32(&legacy, 3);
+  LeafIndexEntry e0(legacy);
+  CheckSegmentNumbers(e0, {0, 1, 2});
+  ASSERT_EQ(30, e0.GetLeafDataSize());
+
+  string buf1, buf2, buf3, buf4;
+  LeafIndexEntry e1, e2, e3, e4;
+  LeafIndexEntryBuilder::AppendMiniRunIndexEntry(e0, runs[3], &buf1, &e1);
+  ASSERT_TRUE(LeafIndexEntryFooter(e1) & LeafIndexEntry::kOffsetTableFlag);
+  CheckSegmentNumbers(e1, {0, 1, 2, 3});
+
+  LeafIndexEntryBuilder::AppendMiniRunIndexEntry(e1, runs[4], &buf2, &e2);
+  CheckSegmentNumbers(e2, {0, 1, 2, 3, 4});
+
+  ASSERT_OK(
+      LeafIndexEntryBuilder::ReplaceMiniRunRange(e2, 1, 2, runs[0], &buf3, &e3));
+  CheckSegmentNumbers(e3, {0, 0, 3, 4});
+
+  ASSERT_OK(LeafIndexEntryBuilder::RemoveMiniRunRange(e3, 0, 1, &buf4, &e4));
+  CheckSegmentNumbers(e4, {3, 4});
+  ASSERT_OK(LeafIndexEntryBuilder::RemoveMiniRunRange(e4, 0, 1, &buf1, &e1));
+  ASSERT_TRUE(e1.Empty());
+  ASSERT_TRUE(LeafIndexEntryBuilder::RemoveMiniRunRange(e4, 1, 2, &buf1, &e1)
+                  .IsInvalidArgument());
+}
+
+// Reads through file into the caller's buffer, so that the blocks read from
+// it can be cached, unlike those of the mmapped files of Env::Default().
+class CopyingFile : public RandomAccessFile {
+ public:
+  explicit CopyingFile(RandomAccessFile* file) : file_(file) {}
+  ~CopyingFile() override { delete file_; }
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    Status s = file_->Read(offset, n, result, scratch);
+    if (s.ok() && result->data() != scratch) {
+      memcpy(scratch, result->data(), result->size());
+      *result = Slice(scratch, result->size());
+    }
+    return s;
+  }
+
+ private:
+  RandomAccessFile* const file_;
+};
+
+TEST(MinirunTest, SecondaryBlockCache) {
+  static const int kNum = 10000;
+  string fname = TempFileName("/tmp", 1240);
+  WritableFile* file = nullptr;
+  ASSERT_OK(Env::Default()->NewWritableFile(fname, &file));
+  Options options;
+  MiniRunBuilder builder(options, file, 0);
+  std::vector<string> values(kNum);
+  Random rnd(301);
+  for (int i = 0; i < kNum; ++i) {
+    char key_buf[100];
+    snprintf(key_buf, sizeof(key_buf), "key %06d", i);
+    values[i] = RandomString(&rnd, 100);
+    builder.Add(key_buf, values[i]);
+  }
+  ASSERT_OK(builder.Finish());
+  ASSERT_OK(file->Close());
+  delete file;
+  size_t run_size = builder.FileSize();
+  Block index_block(BlockContents{builder.IndexBlock(), false, false});
+
+  std::shared_ptr<SecondaryBlockCache> secondary_cache;
+  ASSERT_OK(SecondaryBlockCache::Open(TempFileName("/tmp", 1241), 4 << 20,
+                                      &secondary_cache));
+  std::unique_ptr<Cache> block_cache(NewLRUCache(64 << 10));
+  options.block_cache = block_cache.get();
+  RandomAccessFile* rndfile;
+  ASSERT_OK(Env::Default()->NewRandomAccessFile(fname, &rndfile));
+  CopyingFile copying_file(rndfile);
+  Statistics stats;
+  MiniRun run(&options, &copying_file, block_cache->NewId(), 0, run_size,
+              index_block, secondary_cache);
+  run.SetReadStatistics(&stats, kDeviceBytesReadGet);
+
+  uint64_t first_pass_misses = 0;
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = run.NewIterator(ReadOptions());
+    int i = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), i++) {
+      ASSERT_EQ(values[i], iter->value().ToString());
+      // Keep the staging queue from overflowing, which drops blocks.
+      secondary_cache->WaitForPendingWrites();
+    }
+    ASSERT_EQ(kNum, i);
+    ASSERT_OK(iter->status());
+    delete iter;
+    if (pass == 0) first_pass_misses = stats.Get(kBlockCacheMiss);
+  }
+  // The blocks evicted from the small block cache during the first pass
+  // are all read back from the secondary cache during the second.
+  ASSERT_GT(first_pass_misses, 100);
+  ASSERT_EQ(first_pass_misses, stats.Get(kSecondaryCacheMiss));
+  ASSERT_EQ(stats.Get(kBlockCacheMiss) - first_pass_misses,
+            stats.Get(kSecondaryCacheHit));
+  ASSERT_GT(secondary_cache->Usage(), 0);
+}
+
 }  // namespace silkstore
 }  // namespace leveldb
 
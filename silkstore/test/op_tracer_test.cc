@@ -0,0 +1,86 @@
+#include "silkstore/op_tracer.h"
+
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class OpTracerTest {
+ public:
+  OpTracerTest()
+      : env_(Env::Default()), fname_(test::TmpDir() + "/op_tracer_test") {}
+
+  ~OpTracerTest() { env_->DeleteFile(fname_); }
+
+  Env* const env_;
+  const std::string fname_;
+};
+
+TEST(OpTracerTest, RoundTrip) {
+  OpTracer* tracer;
+  ASSERT_OK(OpTracer::Open(env_, fname_, 1, &tracer));
+  uint64_t now = env_->NowMicros();
+  ASSERT_TRUE(tracer->Sample());
+  tracer->Record(now + 10, kTracePut, "k1", "v1");
+  tracer->Record(now + 30, kTraceGet, "k1");
+  // Seeks are recorded late, with their original start time.
+  tracer->Record(now + 20, kTraceSeek, "k0", Slice(), 42);
+  tracer->Record(now + 40, kTraceDelete, "k1");
+  tracer->Record(now + 50, kTraceWrite, Slice(), std::string(20, 'b'));
+  tracer->Record(now + 60, kTraceSeekToFirst, Slice(), Slice(), 3);
+  delete tracer;
+
+  std::vector<TraceRecord> records;
+  ASSERT_OK(ReadOpTrace(env_, fname_, &records));
+  ASSERT_EQ(6, records.size());
+  for (size_t i = 1; i < records.size(); ++i) {
+    ASSERT_LE(records[i - 1].micros, records[i].micros);
+  }
+  ASSERT_EQ(kTracePut, records[0].type);
+  ASSERT_EQ("k1", records[0].key);
+  ASSERT_EQ("v1", records[0].value);
+  ASSERT_EQ(kTraceSeek, records[1].type);
+  ASSERT_EQ("k0", records[1].key);
+  ASSERT_EQ(42, records[1].nexts);
+  ASSERT_EQ(kTraceGet, records[2].type);
+  ASSERT_EQ("", records[2].value);
+  ASSERT_EQ(kTraceDelete, records[3].type);
+  ASSERT_EQ(kTraceWrite, records[4].type);
+  ASSERT_EQ(std::string(20, 'b'), records[4].value);
+  ASSERT_EQ(kTraceSeekToFirst, records[5].type);
+  ASSERT_EQ(3, records[5].nexts);
+  ASSERT_EQ(10, records[1].micros - records[0].micros);
+}
+
+TEST(OpTracerTest, Sampling) {
+  OpTracer* tracer;
+  ASSERT_OK(OpTracer::Open(env_, fname_, 100, &tracer));
+  int sampled = 0;
+  for (int i = 0; i < 100000; ++i) {
+    if (tracer->Sample()) ++sampled;
+  }
+  delete tracer;
+  ASSERT_GT(sampled, 500);
+  ASSERT_LT(sampled, 2000);
+}
+
+TEST(OpTracerTest, RejectsCorruptTrace) {
+  std::vector<TraceRecord> records;
+  ASSERT_OK(WriteStringToFile(env_, "not a trace", fname_));
+  ASSERT_TRUE(ReadOpTrace(env_, fname_, &records).IsCorruption());
+
+  OpTracer* tracer;
+  ASSERT_OK(OpTracer::Open(env_, fname_, 1, &tracer));
+  tracer->Record(env_->NowMicros(), kTracePut, "key", "value");
+  delete tracer;
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname_, &contents));
+  contents.resize(contents.size() - 1);
+  ASSERT_OK(WriteStringToFile(env_, contents, fname_));
+  ASSERT_TRUE(ReadOpTrace(env_, fname_, &records).IsCorruption());
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
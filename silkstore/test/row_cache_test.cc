@@ -0,0 +1,64 @@
+#include "silkstore/row_cache.h"
+
+#include <string>
+
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class RowCacheTest {
+ public:
+  RowCacheTest() : cache_(1 << 20) {}
+
+  // The cached result of looking up key at snapshot, "MISS" if none.
+  std::string Lookup(const std::string& key, SequenceNumber snapshot) {
+    std::string value;
+    Status s;
+    if (!cache_.Lookup(key, snapshot, &value, &s)) return "MISS";
+    if (s.IsNotFound()) return "NOT_FOUND";
+    return value;
+  }
+
+  RowCache cache_;
+};
+
+TEST(RowCacheTest, Snapshots) {
+  cache_.Insert("k", 10, "v", true);
+  cache_.Insert("absent", 10, Slice(), false);
+  ASSERT_EQ("v", Lookup("k", 10));
+  ASSERT_EQ("v", Lookup("k", 100));
+  ASSERT_EQ("NOT_FOUND", Lookup("absent", 100));
+  // Older snapshots may not see the same version.
+  ASSERT_EQ("MISS", Lookup("k", 9));
+  ASSERT_EQ("MISS", Lookup("other", 100));
+}
+
+TEST(RowCacheTest, Invalidate) {
+  cache_.Insert("k", 10, "v1", true);
+  cache_.Invalidate("k", 11);
+  ASSERT_EQ("MISS", Lookup("k", 20));
+  // A lookup that started before the write must not refill the cache.
+  cache_.Insert("k", 10, "v1", true);
+  ASSERT_EQ("MISS", Lookup("k", 20));
+  cache_.Insert("k", 11, "v2", true);
+  ASSERT_EQ("v2", Lookup("k", 20));
+  ASSERT_EQ("MISS", Lookup("k", 10));
+  cache_.Invalidate("k", 12);
+  ASSERT_EQ("MISS", Lookup("k", 20));
+}
+
+TEST(RowCacheTest, Capacity) {
+  RowCache cache(64 << 10);
+  const std::string value(1000, 'x');
+  for (int i = 0; i < 1000; i++) {
+    cache.Insert("key" + std::to_string(i), 1, value, true);
+  }
+  ASSERT_LE(cache.TotalCharge(), 64 << 10);
+  ASSERT_GT(cache.TotalCharge(), 32 << 10);
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -0,0 +1,109 @@
+#include "silkstore/secondary_cache.h"
+
+#include <string>
+
+#include "leveldb/env.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class SecondaryCacheTest {
+ public:
+  SecondaryCacheTest() : fname_(test::TmpDir() + "/secondary_cache_test") {}
+
+  ~SecondaryCacheTest() { Env::Default()->DeleteFile(fname_); }
+
+  // The contents of block (id, offset) in cache, "MISS" if absent.
+  static std::string Lookup(SecondaryBlockCache* cache, uint64_t id,
+                            uint64_t offset) {
+    BlockContents contents;
+    if (!cache->Lookup(id, offset, &contents)) return "MISS";
+    std::string result = contents.data.ToString();
+    delete[] contents.data.data();
+    return result;
+  }
+
+  const std::string fname_;
+};
+
+TEST(SecondaryCacheTest, InsertAndLookup) {
+  std::shared_ptr<SecondaryBlockCache> cache;
+  ASSERT_OK(SecondaryBlockCache::Open(fname_, 1 << 20, &cache));
+  cache->Insert(1, 0, "block0");
+  cache->Insert(1, 100, "block100");
+  cache->Insert(2, 0, "other");
+  cache->WaitForPendingWrites();
+  ASSERT_EQ("block0", Lookup(cache.get(), 1, 0));
+  ASSERT_EQ("block100", Lookup(cache.get(), 1, 100));
+  ASSERT_EQ("other", Lookup(cache.get(), 2, 0));
+  ASSERT_EQ("MISS", Lookup(cache.get(), 2, 100));
+  ASSERT_EQ(19, cache->Usage());
+
+  // Blocks never change, so a block already stored is not written again.
+  cache->Insert(1, 0, "changed");
+  cache->WaitForPendingWrites();
+  ASSERT_EQ("block0", Lookup(cache.get(), 1, 0));
+  ASSERT_EQ(19, cache->Usage());
+}
+
+TEST(SecondaryCacheTest, FifoEviction) {
+  const int kCapacity = 16 << 10;
+  std::shared_ptr<SecondaryBlockCache> cache;
+  ASSERT_OK(SecondaryBlockCache::Open(fname_, kCapacity, &cache));
+  const int kBlocks = 1000;
+  for (int i = 0; i < kBlocks; i++) {
+    cache->Insert(1, i, std::string(100, 'a' + i % 26));
+    cache->WaitForPendingWrites();
+    ASSERT_LE(cache->Usage(), kCapacity);
+  }
+  ASSERT_GT(cache->Usage(), kCapacity * 3 / 4);
+  for (int i = 0; i < kBlocks; i++) {
+    const std::string result = Lookup(cache.get(), 1, i);
+    if (i < kBlocks - kCapacity / 100) {
+      ASSERT_EQ("MISS", result);
+    } else if (i >= kBlocks - kCapacity / 200) {
+      ASSERT_EQ(std::string(100, 'a' + i % 26), result);
+    }
+  }
+
+  // Blocks larger than a region are not stored.
+  cache->Insert(2, 0, std::string(kCapacity / 8, 'x'));
+  cache->WaitForPendingWrites();
+  ASSERT_EQ("MISS", Lookup(cache.get(), 2, 0));
+}
+
+TEST(SecondaryCacheTest, Close) {
+  std::shared_ptr<SecondaryBlockCache> cache;
+  ASSERT_OK(SecondaryBlockCache::Open(fname_, 1 << 20, &cache));
+  cache->Insert(1, 0, "block0");
+  cache->WaitForPendingWrites();
+  cache->Close();
+  cache->Insert(1, 100, "block100");
+  cache->WaitForPendingWrites();
+  ASSERT_EQ("block0", Lookup(cache.get(), 1, 0));
+  ASSERT_EQ("MISS", Lookup(cache.get(), 1, 100));
+}
+
+TEST(SecondaryCacheTest, StagingQueueIsBounded) {
+  // Regions of 1KB bound the queue to 1KB.
+  std::shared_ptr<SecondaryBlockCache> cache;
+  ASSERT_OK(SecondaryBlockCache::Open(fname_, 16 << 10, &cache));
+  for (int i = 0; i < 100; i++) {
+    cache->Insert(1, i, std::string(100, 'a'));
+  }
+  cache->WaitForPendingWrites();
+  // Inserts never block on the writer; blocks queued beyond the bound are
+  // dropped, and the others all make it to the file.
+  int stored = 0;
+  for (int i = 0; i < 100; i++) {
+    if (Lookup(cache.get(), 1, i) != "MISS") stored++;
+  }
+  ASSERT_GT(stored, 0);
+  ASSERT_EQ(stored * 100, cache->Usage());
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
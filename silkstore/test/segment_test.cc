@@ -0,0 +1,91 @@
+#include "silkstore/segment.h"
+
+#include "db/dbformat.h"
+#include "helpers/memenv/memenv.h"
+#include "leveldb/env.h"
+#include "leveldb/filter_policy.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class SegmentTest {
+ public:
+  SegmentTest()
+      : env_(NewMemEnv(Env::Default())),
+        icmp_(BytewiseComparator()),
+        dbname_("/segment_test") {
+    options_.env = env_;
+    options_.create_if_missing = true;
+    options_.comparator = &icmp_;
+    options_.filter_policy = NewBloomFilterPolicy(10);
+    options_.compression = kNoCompression;
+  }
+
+  ~SegmentTest() {
+    delete options_.filter_policy;
+    delete env_;
+  }
+
+  std::string Key(int i) {
+    std::string result;
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%08d", i);
+    AppendInternalKey(&result, ParsedInternalKey(buf, 1, kTypeValue));
+    return result;
+  }
+
+  Env* const env_;
+  InternalKeyComparator icmp_;
+  const std::string dbname_;
+  Options options_;
+};
+
+TEST(SegmentTest, UsesOptionsEnv) {
+  SegmentManager* manager;
+  ASSERT_OK(
+      SegmentManager::OpenManager(options_, dbname_, &manager, []() {}));
+  uint32_t seg_id;
+  std::unique_ptr<SegmentBuilder> builder;
+  ASSERT_OK(manager->NewSegmentBuilder(&seg_id, builder, false));
+  int k = 0;
+  for (int run = 0; run < 3; run++) {
+    uint32_t run_no;
+    ASSERT_OK(builder->StartMiniRun());
+    for (int i = 0; i < 100; i++) builder->Add(Key(k++), "value");
+    ASSERT_OK(builder->FinishMiniRun(&run_no));
+    ASSERT_EQ(run, run_no);
+  }
+  ASSERT_OK(builder->Finish());
+  builder.reset();
+
+  // Everything lives in the in-memory env.
+  ASSERT_TRUE(!Env::Default()->FileExists(dbname_));
+  std::vector<std::string> children;
+  ASSERT_OK(env_->GetChildren(dbname_, &children));
+  ASSERT_EQ(1, children.size());
+  ASSERT_GT(manager->ApproximateSize(), 0);
+  delete manager;
+
+  ASSERT_OK(
+      SegmentManager::OpenManager(options_, dbname_, &manager, []() {}));
+  Segment* seg;
+  ASSERT_OK(manager->OpenSegment(seg_id, &seg));
+  int runs = 0;
+  seg->ForEachRun([&runs](int run_no, MiniRunHandle handle, size_t run_size,
+                          bool valid) -> bool {
+    ++runs;
+    return false;
+  });
+  ASSERT_EQ(3, runs);
+  manager->DropSegment(seg);
+  ASSERT_OK(manager->RemoveSegment(seg_id));
+  ASSERT_OK(env_->GetChildren(dbname_, &children));
+  ASSERT_EQ(0, children.size());
+  delete manager;
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -14,6 +14,7 @@
 #include "leveldb/db.h"
 #include "leveldb/env.h"
 #include "leveldb/filter_policy.h"
+#include "leveldb/perf_context.h"
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
@@ -239,7 +240,14 @@ class DBTest {
   const FilterPolicy* filter_policy_;
 
   // Sequence of option configurations to try
-  enum OptionConfig { kDefault, kReuse, kFilter, kUncompressed, kEnd };
+  enum OptionConfig {
+    kDefault,
+    kReuse,
+    kFilter,
+    kLeafFilter,
+    kUncompressed,
+    kEnd
+  };
   int option_config_;
 
  public:
@@ -288,6 +296,10 @@ class DBTest {
       case kFilter:
         options.filter_policy = filter_policy_;
         break;
+      case kLeafFilter:
+        options.filter_policy = filter_policy_;
+        options.leaf_filter_bits_per_key = 10;
+        break;
       case kUncompressed:
         options.compression = kNoCompression;
         break;
@@ -933,6 +945,134 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_EQ(std::string(10, '4'), Get("small4"));
 }
 
+TEST(DBTest, LeafFilterSkipsAbsentKeys) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.leaf_filter_bits_per_key = 10;
+  DestroyAndReopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i += 2) ASSERT_OK(Put(Key(i), Key(i)));
+  dbfull()->TEST_CompactMemTable();
+  // Appends a run to the leaf, extending its filter.
+  for (int i = 1; i < N; i += 4) ASSERT_OK(Put(Key(i), Key(i)));
+  dbfull()->TEST_CompactMemTable();
+
+  PerfContext perf;
+  ReadOptions ropts;
+  ropts.perf_context = &perf;
+  std::string value;
+  for (int i = 0; i < N; i++) {
+    Status s = db_->Get(ropts, Key(i), &value);
+    if (i % 2 == 0 || i % 4 == 1) {
+      ASSERT_OK(s);
+      ASSERT_EQ(Key(i), value);
+    } else {
+      ASSERT_TRUE(s.IsNotFound());
+    }
+  }
+  for (int i = 0; i < N; i++) {
+    ASSERT_TRUE(db_->Get(ropts, Key(i) + ".missing", &value).IsNotFound());
+  }
+  ASSERT_GT(perf.leaf_filter_rejects, N);
+  Close();
+  delete options.filter_policy;
+}
+
+TEST(DBTest, ColdLeafMetadataSpilled) {
+  Options options = CurrentOptions();
+  options.filter_policy = NewBloomFilterPolicy(10);
+  options.cold_leaf_read_hotness = 1e9;  // Every leaf is cold
+  DestroyAndReopen(&options);
+
+  const int N = 2000;
+  for (int i = 0; i < N; i += 2) ASSERT_OK(Put(Key(i), Key(i)));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 1; i < N; i += 2) ASSERT_OK(Put(Key(i), Key(i)));
+  dbfull()->TEST_CompactMemTable();
+
+  for (int i = 0; i < N; i++) ASSERT_EQ(Key(i), Get(Key(i)));
+  ASSERT_EQ("NOT_FOUND", Get(Key(N)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ASSERT_EQ(Key(count), iter->key().ToString());
+    count++;
+  }
+  ASSERT_EQ(N, count);
+  delete iter;
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("silkstore.runs_searched", &stats));
+  ASSERT_TRUE(stats.find("metadata_cache_hit: 0\n") == std::string::npos);
+  ASSERT_TRUE(stats.find("metadata_cache_miss: 0\n") == std::string::npos);
+
+  // A scan that does not fill the cache leaves the cached metadata alone.
+  auto misses = [this]() {
+    std::string stats;
+    db_->GetProperty("silkstore.runs_searched", &stats);
+    const std::string tag = "metadata_cache_miss: ";
+    return atoll(stats.c_str() + stats.find(tag) + tag.size());
+  };
+  for (int i = 0; i < N; i++) ASSERT_EQ(Key(i), Get(Key(i)));
+  ReadOptions scan_options;
+  scan_options.fill_cache = false;
+  iter = db_->NewIterator(scan_options);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+  }
+  delete iter;
+  const long long before = misses();
+  for (int i = 0; i < N; i++) ASSERT_EQ(Key(i), Get(Key(i)));
+  ASSERT_EQ(before, misses());
+
+  Close();
+  delete options.filter_policy;
+}
+
+TEST(DBTest, RowCache) {
+  Options options = CurrentOptions();
+  options.row_cache_size = 1 << 20;
+  DestroyAndReopen(&options);
+
+  const int N = 1000;
+  for (int i = 0; i < N; i++) ASSERT_OK(Put(Key(i), "v1"));
+  dbfull()->TEST_CompactMemTable();
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < N; i++) ASSERT_EQ("v1", Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(N)));
+  }
+  std::string stats;
+  ASSERT_TRUE(db_->GetProperty("silkstore.runs_searched", &stats));
+  ASSERT_TRUE(stats.find("row_cache_hit: " + std::to_string(N + 1) + "\n") !=
+              std::string::npos);
+
+  // Overwrites and deletes invalidate the cached versions, which are not
+  // served again once the new ones have left the memtables.
+  for (int i = 0; i < N; i += 2) ASSERT_OK(Put(Key(i), "v2"));
+  for (int i = 1; i < N; i += 4) ASSERT_OK(Delete(Key(i)));
+  dbfull()->TEST_CompactMemTable();
+  for (int round = 0; round < 2; round++) {
+    for (int i = 0; i < N; i++) {
+      ASSERT_EQ(i % 2 == 0 ? "v2" : i % 4 == 1 ? "NOT_FOUND" : "v1",
+                Get(Key(i)));
+    }
+  }
+  Close();
+}
+
+TEST(DBTest, AmplificationRecentWindowStartsAtOpen) {
+  Reopen();
+  ASSERT_OK(Put("foo", "v1"));
+  std::string report;
+  ASSERT_TRUE(db_->GetProperty("silkstore.amplification", &report));
+  const std::string tag = "\"recent\": {\"seconds\": ";
+  size_t pos = report.find(tag);
+  ASSERT_TRUE(pos != std::string::npos) << report;
+  // Measured from the open, not from the epoch.
+  double seconds = atof(report.c_str() + pos + tag.size());
+  ASSERT_GE(seconds, 0);
+  ASSERT_LT(seconds, 60);
+}
+
 // TEST(DBTest, CompactionsGenerateMultipleFiles) {
 //    Options options = CurrentOptions();
 //    options.write_buffer_size = 100000000;        // Large write buffer
@@ -0,0 +1,111 @@
+#include "silkstore/statistics.h"
+
+#include <thread>
+#include <vector>
+
+#include "leveldb/perf_context.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace silkstore {
+
+class StatisticsTest {};
+
+TEST(StatisticsTest, ConcurrentRecords) {
+  static const int kThreads = 32;
+  static const int kRecordsPerThread = 100000;
+  Statistics stats;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; ++t) {
+    threads.emplace_back([&stats]() {
+      for (int i = 0; i < kRecordsPerThread; ++i) {
+        stats.Record(kRunsSearched);
+        stats.Record(kBytesRead, 3);
+      }
+    });
+  }
+  for (auto& t : threads) t.join();
+  ASSERT_EQ(kThreads * kRecordsPerThread, stats.Get(kRunsSearched));
+  ASSERT_EQ(3ull * kThreads * kRecordsPerThread, stats.Get(kBytesRead));
+  ASSERT_EQ(0, stats.Get(kRunsHit));
+
+  stats.Reset();
+  ASSERT_EQ(0, stats.Get(kRunsSearched));
+  ASSERT_TRUE(stats.ToString().find("runs_searched: 0\n") !=
+              std::string::npos);
+}
+
+TEST(StatisticsTest, HistogramPercentiles) {
+  Statistics stats;
+  HistogramData empty = stats.GetHistogram(kGetMicros);
+  ASSERT_EQ(0, empty.count);
+  ASSERT_EQ(0, empty.p999);
+
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&stats]() {
+      for (uint64_t v = 1; v <= 10000; ++v) stats.MeasureTime(kGetMicros, v);
+    });
+  }
+  for (auto& t : threads) t.join();
+
+  HistogramData d = stats.GetHistogram(kGetMicros);
+  ASSERT_EQ(40000, d.count);
+  ASSERT_EQ(4 * 10000ull * 10001 / 2, d.sum);
+  ASSERT_EQ(1, d.min);
+  ASSERT_EQ(10000, d.max);
+  // Buckets are at most 25% wide.
+  ASSERT_GE(d.p50, 5000 * 0.75);
+  ASSERT_LE(d.p50, 5000 * 1.25);
+  ASSERT_GE(d.p999, 9990 * 0.75);
+  ASSERT_LE(d.p999, 10000);
+  ASSERT_LE(d.p50, d.p95);
+  ASSERT_LE(d.p95, d.p99);
+  ASSERT_LE(d.p99, d.p999);
+  ASSERT_EQ(0, stats.GetHistogram(kWriteMicros).count);
+
+  std::string json = stats.HistogramsToJson();
+  ASSERT_EQ('{', json.front());
+  ASSERT_EQ('}', json.back());
+  ASSERT_TRUE(json.find("\"get_micros\": {\"count\": 40000,") !=
+              std::string::npos);
+
+  {
+    StopWatch sw(&stats, kWriteMicros);
+  }
+  ASSERT_EQ(1, stats.GetHistogram(kWriteMicros).count);
+  {
+    StopWatch disabled(nullptr, kWriteMicros);
+  }
+  stats.Reset();
+  ASSERT_EQ(0, stats.GetHistogram(kGetMicros).count);
+}
+
+TEST(StatisticsTest, PerfTimer) {
+  PerfContext* none = nullptr;
+  {
+    // A null context is never dereferenced.
+    PerfTimer timer(SILKSTORE_PERF_FIELD(none, memtable_nanos));
+  }
+
+  PerfContext perf;
+  ASSERT_EQ("", perf.ToString());
+  {
+    PerfTimer timer(SILKSTORE_PERF_FIELD(&perf, block_read_nanos));
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    timer.Stop();
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+  }
+  ASSERT_GE(perf.block_read_nanos, 2000000);
+  ASSERT_LT(perf.block_read_nanos, 50000000);
+  ASSERT_EQ(0, perf.memtable_nanos);
+  ASSERT_TRUE(perf.ToString().find("block_read_nanos = ") == 0);
+
+  perf.Reset();
+  ASSERT_EQ(0, perf.block_read_nanos);
+}
+
+}  // namespace silkstore
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
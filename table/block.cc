@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <vector>
+#include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "table/format.h"
 #include "util/coding.h"
@@ -72,9 +73,10 @@ static inline const char* DecodeEntry(const char* p, const char* limit,
   return p;
 }
 
+template <typename KeyCompare>
 class Block::Iter : public Iterator {
  private:
-  const Comparator* const comparator_;
+  const KeyCompare compare_;
   const char* const data_;       // underlying block contents
   uint32_t const restarts_;      // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_;  // Number of uint32_t entries in restart array
@@ -87,7 +89,7 @@ class Block::Iter : public Iterator {
   Status status_;
 
   inline int Compare(const Slice& a, const Slice& b) const {
-    return comparator_->Compare(a, b);
+    return compare_(a, b);
   }
 
   // Return the offset in data_ just past the end of the current entry.
@@ -111,9 +113,9 @@ class Block::Iter : public Iterator {
   }
 
  public:
-  Iter(const Comparator* comparator, const char* data, uint32_t restarts,
+  Iter(const KeyCompare& compare, const char* data, uint32_t restarts,
        uint32_t num_restarts)
-      : comparator_(comparator),
+      : compare_(compare),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
@@ -258,7 +260,18 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    switch (GetKeyCompareKind(cmp)) {
+      case kBytewiseKeyCompare:
+        return new Iter<BytewiseKeyCompare>(BytewiseKeyCompare(), data_,
+                                            restart_offset_, num_restarts);
+      case kBytewiseInternalKeyCompare:
+        return new Iter<BytewiseInternalKeyCompare>(
+            BytewiseInternalKeyCompare(), data_, restart_offset_,
+            num_restarts);
+      default:
+        return new Iter<VirtualKeyCompare>(VirtualKeyCompare(cmp), data_,
+                                           restart_offset_, num_restarts);
+    }
   }
 }
 
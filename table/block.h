@@ -36,6 +36,7 @@ class Block {
   Block(const Block&);
   void operator=(const Block&);
 
+  template <typename KeyCompare>
   class Iter;
 };
 
@@ -36,6 +36,9 @@ class FilterBlockBuilder {
   Slice FinishWithoutOffsets();
   void Reset();
 
+  // Generate the filters not generated yet with policy instead.
+  void SetPolicy(const FilterPolicy* policy) { policy_ = policy; }
+
  private:
   void GenerateFilter();
 
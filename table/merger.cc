@@ -4,6 +4,9 @@
 
 #include "table/merger.h"
 
+#include <utility>
+
+#include "db/dbformat.h"
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
@@ -11,20 +14,40 @@
 namespace leveldb {
 
 namespace {
+// Merges the children with a tournament tree of losers.  tree_[1, n_ - 1]
+// are the internal nodes of a complete binary tree whose leaves n_ to
+// 2 * n_ - 1 are the children, and each node holds the index of the child
+// that lost the match between the winners of its two subtrees.  After the
+// winner moves, it only replays the matches on its path to the root, which
+// takes O(log n) comparisons instead of comparing every child.
+//
+// Children that yield long runs of consecutive keys are common, such as the
+// newest run of a leaf taking most of the writes.  So once the winner wins
+// again, the best of the children it beat is remembered, and while the
+// winner keeps beating it each step costs a single comparison.
+//
+// Keys are compared with a KeyCompare from db/dbformat.h, so that merging
+// bytewise keys makes no virtual call per comparison.
+template <typename KeyCompare>
 class MergingIterator : public Iterator {
  public:
-  MergingIterator(const Comparator* comparator, Iterator** children, int n)
-      : comparator_(comparator),
+  MergingIterator(const KeyCompare& compare, Iterator** children, int n)
+      : compare_(compare),
         children_(new IteratorWrapper[n]),
+        tree_(new int[n]),
         n_(n),
         current_(nullptr),
+        runner_up_(-1),
         direction_(kForward) {
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
     }
   }
 
-  virtual ~MergingIterator() { delete[] children_; }
+  virtual ~MergingIterator() {
+    delete[] children_;
+    delete[] tree_;
+  }
 
   virtual bool Valid() const { return (current_ != nullptr); }
 
@@ -32,24 +55,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   virtual void SeekToLast() {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    Rebuild();
   }
 
   virtual void Seek(const Slice& target) {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   virtual void Next() {
@@ -65,17 +88,19 @@ class MergingIterator : public Iterator {
         IteratorWrapper* child = &children_[i];
         if (child != current_) {
           child->Seek(key());
-          if (child->Valid() &&
-              comparator_->Compare(key(), child->key()) == 0) {
+          if (child->Valid() && compare_(key(), child->key()) == 0) {
             child->Next();
           }
         }
       }
       direction_ = kForward;
+      current_->Next();
+      Rebuild();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    Replay();
   }
 
   virtual void Prev() {
@@ -101,10 +126,13 @@ class MergingIterator : public Iterator {
         }
       }
       direction_ = kReverse;
+      current_->Prev();
+      Rebuild();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    Replay();
   }
 
   virtual Slice key() const {
@@ -129,50 +157,98 @@ class MergingIterator : public Iterator {
   }
 
  private:
-  void FindSmallest();
-  void FindLargest();
+  // Whether child a comes before child b in the current direction.  Ties
+  // go to the lower index when moving forward and to the higher index in
+  // reverse, as a scan over the children in that order would pick.
+  bool Beats(int a, int b) const;
+
+  // Play all the matches of the subtree rooted at node and return its
+  // winner.
+  int PlaySubtree(int node);
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
-  const Comparator* comparator_;
+  // Rebuild the tree after all the children were repositioned.
+  void Rebuild();
+
+  // Update the tree after the winner moved to its next entry.
+  void Replay();
+
+  void SetWinner(int winner) {
+    current_ = children_[winner].Valid() ? &children_[winner] : nullptr;
+  }
+
+  const KeyCompare compare_;
   IteratorWrapper* children_;
+  int* tree_;
   int n_;
   IteratorWrapper* current_;
+  // If non-negative, the child that would win if the winner were removed.
+  int runner_up_;
 
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
   Direction direction_;
 };
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
-  for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
-    }
+template <typename KeyCompare>
+bool MergingIterator<KeyCompare>::Beats(int a, int b) const {
+  const IteratorWrapper& x = children_[a];
+  const IteratorWrapper& y = children_[b];
+  if (!x.Valid()) return false;
+  if (!y.Valid()) return true;
+  const int r = compare_(x.key(), y.key());
+  if (direction_ == kForward) {
+    return r < 0 || (r == 0 && a < b);
+  } else {
+    return r > 0 || (r == 0 && a > b);
+  }
+}
+
+template <typename KeyCompare>
+int MergingIterator<KeyCompare>::PlaySubtree(int node) {
+  if (node >= n_) return node - n_;
+  const int left = PlaySubtree(2 * node);
+  const int right = PlaySubtree(2 * node + 1);
+  if (Beats(right, left)) {
+    tree_[node] = left;
+    return right;
+  } else {
+    tree_[node] = right;
+    return left;
   }
-  current_ = smallest;
 }
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
+template <typename KeyCompare>
+void MergingIterator<KeyCompare>::Rebuild() {
+  runner_up_ = -1;
+  SetWinner(PlaySubtree(1));
+}
+
+template <typename KeyCompare>
+void MergingIterator<KeyCompare>::Replay() {
+  const int moved = current_ - children_;
+  if (runner_up_ >= 0 && Beats(moved, runner_up_)) {
+    // Still ahead of every other child, so no match changes.
+    return;
+  }
+
+  int winner = moved;
+  for (int node = (moved + n_) / 2; node >= 1; node /= 2) {
+    if (Beats(tree_[node], winner)) {
+      std::swap(tree_[node], winner);
+    }
+  }
+  SetWinner(winner);
+
+  runner_up_ = -1;
+  if (winner == moved && current_ != nullptr) {
+    // The children the winner beat on its way to the root hold the
+    // runner-up.
+    for (int node = (moved + n_) / 2; node >= 1; node /= 2) {
+      if (runner_up_ < 0 || Beats(tree_[node], runner_up_)) {
+        runner_up_ = tree_[node];
       }
     }
   }
-  current_ = largest;
 }
 }  // namespace
 
@@ -183,7 +259,17 @@ Iterator* NewMergingIterator(const Comparator* cmp, Iterator** list, int n) {
   } else if (n == 1) {
     return list[0];
   } else {
-    return new MergingIterator(cmp, list, n);
+    switch (GetKeyCompareKind(cmp)) {
+      case kBytewiseKeyCompare:
+        return new MergingIterator<BytewiseKeyCompare>(BytewiseKeyCompare(),
+                                                       list, n);
+      case kBytewiseInternalKeyCompare:
+        return new MergingIterator<BytewiseInternalKeyCompare>(
+            BytewiseInternalKeyCompare(), list, n);
+      default:
+        return new MergingIterator<VirtualKeyCompare>(VirtualKeyCompare(cmp),
+                                                      list, n);
+    }
   }
 }
 
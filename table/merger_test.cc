@@ -0,0 +1,157 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+typedef std::vector<std::pair<std::string, std::string>> KVList;
+
+// Iterates over a sorted list of key/value pairs.
+class KVListIterator : public Iterator {
+ public:
+  explicit KVListIterator(const KVList* list) : list_(list), pos_(-1) {}
+
+  bool Valid() const override {
+    return pos_ >= 0 && pos_ < static_cast<int>(list_->size());
+  }
+  void SeekToFirst() override { pos_ = 0; }
+  void SeekToLast() override { pos_ = static_cast<int>(list_->size()) - 1; }
+  void Seek(const Slice& target) override {
+    pos_ = std::lower_bound(list_->begin(), list_->end(), target.ToString(),
+                            [](const std::pair<std::string, std::string>& kv,
+                               const std::string& key) {
+                              return kv.first < key;
+                            }) -
+           list_->begin();
+  }
+  void Next() override {
+    assert(Valid());
+    pos_++;
+  }
+  void Prev() override {
+    assert(Valid());
+    pos_--;
+  }
+  Slice key() const override { return (*list_)[pos_].first; }
+  Slice value() const override { return (*list_)[pos_].second; }
+  Status status() const override { return Status::OK(); }
+
+ private:
+  const KVList* list_;
+  int pos_;
+};
+
+class MergerTest {
+ public:
+  Iterator* NewMerger(const std::vector<KVList>& children) {
+    std::vector<Iterator*> iters;
+    for (const KVList& child : children) {
+      iters.push_back(new KVListIterator(&child));
+    }
+    return NewMergingIterator(BytewiseComparator(), iters.data(),
+                              static_cast<int>(iters.size()));
+  }
+};
+
+static std::string Key(int i) {
+  char buf[16];
+  snprintf(buf, sizeof(buf), "%06d", i);
+  return buf;
+}
+
+TEST(MergerTest, RandomOperations) {
+  Random rnd(301);
+  const int kNumChildren[] = {2, 3, 5, 8, 13};
+  for (int n : kNumChildren) {
+    std::vector<KVList> children(n);
+    std::vector<std::string> expected;
+    for (int i = 0; i < 1000; i++) {
+      if (rnd.OneIn(10)) continue;
+      // Long spans of keys from the same child, as in the runs of a leaf.
+      const int child = (i / 50) % 2 == 0 ? 0 : rnd.Uniform(n);
+      children[child].emplace_back(Key(i), std::to_string(child));
+      expected.push_back(Key(i));
+    }
+
+    Iterator* iter = NewMerger(children);
+    int pos = -1;
+    for (int op = 0; op < 20000; op++) {
+      switch (rnd.Uniform(pos >= 0 && pos < expected.size() ? 8 : 3)) {
+        case 0:
+          iter->SeekToFirst();
+          pos = 0;
+          break;
+        case 1:
+          iter->SeekToLast();
+          pos = static_cast<int>(expected.size()) - 1;
+          break;
+        case 2: {
+          const std::string target = Key(rnd.Uniform(1100));
+          iter->Seek(target);
+          pos = std::lower_bound(expected.begin(), expected.end(), target) -
+                expected.begin();
+          break;
+        }
+        case 3:
+          iter->Prev();
+          pos--;
+          break;
+        default:
+          iter->Next();
+          pos++;
+          break;
+      }
+      if (pos >= 0 && pos < expected.size()) {
+        ASSERT_TRUE(iter->Valid());
+        ASSERT_EQ(expected[pos], iter->key().ToString());
+      } else {
+        ASSERT_TRUE(!iter->Valid());
+      }
+    }
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(MergerTest, EqualKeys) {
+  std::vector<KVList> children(3);
+  for (int c = 0; c < 3; c++) {
+    for (int i = 0; i < 10; i++) {
+      children[c].emplace_back(Key(i), std::to_string(c));
+    }
+  }
+  Iterator* iter = NewMerger(children);
+  // Moving forward, equal keys come from the children in order, and in
+  // reverse order when moving backward.
+  std::string forward, reverse;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    forward += iter->value().ToString();
+  }
+  for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+    reverse += iter->value().ToString();
+  }
+  std::string expected_forward, expected_reverse;
+  for (int i = 0; i < 10; i++) {
+    expected_forward += "012";
+    expected_reverse += "210";
+  }
+  ASSERT_EQ(expected_forward, forward);
+  ASSERT_EQ(expected_reverse, reverse);
+  delete iter;
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
@@ -0,0 +1,101 @@
+// Copyright (c) 2012 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Layout of the lines of blocked bloom filters, shared by the filters of the
+// runs (util/bloom.cc) and the leaf filters (silkstore/leaf_filter.cc).
+
+#ifndef STORAGE_LEVELDB_UTIL_BLOCKED_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_BLOCKED_BLOOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <immintrin.h>
+#define BLOCKED_BLOOM_HAVE_AVX2 1
+#endif
+
+namespace leveldb {
+namespace blocked_bloom {
+
+// All the probes of a key are in one line, so that a lookup touches a single
+// cache line (when the filter is line aligned) instead of k random ones.
+static const size_t kLineBytes = 64;
+static const int kMaxProbes = 16;
+// Successive probes multiply the hash by kMultiplier, so the i-th probe is
+// h * kMultiplier^i.
+static const uint32_t kMultiplier = 0x9e3779b9;
+
+// Maps the low half of the 64-bit hash of a key to a line, and leaves the
+// high half for picking the bits within it.
+inline size_t LineOf(uint64_t h, size_t num_lines) {
+  return static_cast<size_t>(
+      (static_cast<uint64_t>(static_cast<uint32_t>(h)) * num_lines) >> 32);
+}
+
+// Sets the k bits of the key with high half h in line.
+inline void AddToLine(char* line, uint32_t h, int k) {
+  for (int j = 0; j < k; j++) {
+    const uint32_t bitpos = h >> 23;  // 9 bits, one of 512
+    line[bitpos / 8] |= (1 << (bitpos % 8));
+    h *= kMultiplier;
+  }
+}
+
+// Return true if all the k bits of the key with high half h are set in line.
+inline bool ProbeLine(const char* line, uint32_t h, int k) {
+  for (int j = 0; j < k; j++) {
+    const uint32_t bitpos = h >> 23;
+    if ((line[bitpos / 8] & (1 << (bitpos % 8))) == 0) return false;
+    h *= kMultiplier;
+  }
+  return true;
+}
+
+#ifdef BLOCKED_BLOOM_HAVE_AVX2
+// Same probes as ProbeLine(), eight at a time.  Only call it if HaveAVX2().
+__attribute__((target("avx2"))) inline bool ProbeLineAVX2(const char* line,
+                                                          uint32_t h, int k) {
+  uint32_t m[9];
+  m[0] = 1;
+  for (int i = 1; i < 9; i++) m[i] = m[i - 1] * kMultiplier;
+  const __m256i multipliers =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(m));
+  const __m256i lo = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line));
+  const __m256i hi =
+      _mm256_loadu_si256(reinterpret_cast<const __m256i*>(line + 32));
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  while (true) {
+    const __m256i bitpos = _mm256_srli_epi32(
+        _mm256_mullo_epi32(_mm256_set1_epi32(h), multipliers), 23);
+    // Pick the 32-bit word of the line holding each bit.
+    const __m256i word = _mm256_srli_epi32(bitpos, 5);
+    const __m256i words =
+        _mm256_blendv_epi8(_mm256_permutevar8x32_epi32(lo, word),
+                           _mm256_permutevar8x32_epi32(hi, word),
+                           _mm256_cmpgt_epi32(word, _mm256_set1_epi32(7)));
+    __m256i bits =
+        _mm256_sllv_epi32(_mm256_set1_epi32(1),
+                          _mm256_and_si256(bitpos, _mm256_set1_epi32(31)));
+    if (k < 8) {
+      bits = _mm256_and_si256(bits,
+                              _mm256_cmpgt_epi32(_mm256_set1_epi32(k), lanes));
+    }
+    if (!_mm256_testc_si256(words, bits)) return false;
+    if (k <= 8) return true;
+    k -= 8;
+    h *= m[8];
+  }
+}
+
+inline bool HaveAVX2() {
+  static const bool have_avx2 = __builtin_cpu_supports("avx2");
+  return have_avx2;
+}
+#endif  // BLOCKED_BLOOM_HAVE_AVX2
+
+}  // namespace blocked_bloom
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_BLOCKED_BLOOM_H_
@@ -7,6 +7,7 @@
 #include "leveldb/filter_policy.h"
 
 #include "leveldb/slice.h"
+#include "util/blocked_bloom.h"
 #include "util/hash.h"
 
 #include "util/murmur.h"
@@ -86,6 +87,92 @@ class BloomFilterPolicy : public FilterPolicy {
     }
     return true;
   }
+
+  virtual const FilterPolicy* NewWithBitsPerKey(int bits_per_key) const {
+    return new BloomFilterPolicy(bits_per_key);
+  }
+};
+
+// Places all probes of a key in one 64-byte line, so that a lookup touches a
+// single cache line (when the filter is line aligned) instead of k random
+// ones. The filter is laid out as
+//    lines: char[num_lines * 64]
+//    num_probes: uint8
+//    marker: uint8 (kBlockedBloomMarker)
+// The marker is a k above 30, which BloomFilterPolicy treats as "always
+// match", and this policy falls back to BloomFilterPolicy for filters
+// without the marker, so both kinds of filters may be read by either policy.
+class BlockedBloomFilterPolicy : public FilterPolicy {
+ private:
+  static const unsigned char kBlockedBloomMarker = 0xff;
+
+  const BloomFilterPolicy legacy_;
+  size_t bits_per_key_;
+  int k_;
+
+  static uint64_t BlockedBloomHash(const Slice& key) {
+    return MurmurHash64A(key.data(), static_cast<int>(key.size()),
+                         0xbc9f1d34a2d5b3c9ULL);
+  }
+
+ public:
+  explicit BlockedBloomFilterPolicy(int bits_per_key)
+      : legacy_(bits_per_key), bits_per_key_(bits_per_key) {
+    k_ = static_cast<int>(bits_per_key * 0.69);  // 0.69 =~ ln(2)
+    if (k_ < 1) k_ = 1;
+    if (k_ > blocked_bloom::kMaxProbes) k_ = blocked_bloom::kMaxProbes;
+  }
+
+  virtual const char* Name() const { return "leveldb.BlockedBloomFilter"; }
+
+  virtual void CreateFilter(const Slice* keys, int n, std::string* dst) const {
+    using blocked_bloom::kLineBytes;
+    size_t bits = n * bits_per_key_;
+    size_t num_lines = (bits + kLineBytes * 8 - 1) / (kLineBytes * 8);
+    if (num_lines == 0) num_lines = 1;
+
+    const size_t init_size = dst->size();
+    dst->resize(init_size + num_lines * kLineBytes, 0);
+    dst->push_back(static_cast<char>(k_));
+    dst->push_back(static_cast<char>(kBlockedBloomMarker));
+    char* array = &(*dst)[init_size];
+    for (int i = 0; i < n; i++) {
+      const uint64_t h = BlockedBloomHash(keys[i]);
+      char* line = array + blocked_bloom::LineOf(h, num_lines) * kLineBytes;
+      blocked_bloom::AddToLine(line, static_cast<uint32_t>(h >> 32), k_);
+    }
+  }
+
+  virtual bool KeyMayMatch(const Slice& key, const Slice& filter) const {
+    using blocked_bloom::kLineBytes;
+    const size_t len = filter.size();
+    if (len < 2) return false;
+    if (static_cast<unsigned char>(filter[len - 1]) != kBlockedBloomMarker) {
+      return legacy_.KeyMayMatch(key, filter);
+    }
+    const int k = static_cast<unsigned char>(filter[len - 2]);
+    const size_t num_lines = (len - 2) / kLineBytes;
+    if (k == 0 || k > blocked_bloom::kMaxProbes || num_lines == 0 ||
+        (len - 2) % kLineBytes != 0) {
+      // Reserved for new encodings. Consider it a match.
+      return true;
+    }
+
+    const uint64_t h = BlockedBloomHash(key);
+    const char* line =
+        filter.data() + blocked_bloom::LineOf(h, num_lines) * kLineBytes;
+#ifdef BLOCKED_BLOOM_HAVE_AVX2
+    if (blocked_bloom::HaveAVX2()) {
+      return blocked_bloom::ProbeLineAVX2(line, static_cast<uint32_t>(h >> 32),
+                                          k);
+    }
+#endif
+    return blocked_bloom::ProbeLine(line, static_cast<uint32_t>(h >> 32), k);
+  }
+
+  virtual const FilterPolicy* NewWithBitsPerKey(int bits_per_key) const {
+    return new BlockedBloomFilterPolicy(bits_per_key);
+  }
 };
 }  // namespace
 
@@ -93,6 +180,10 @@ const FilterPolicy* NewBloomFilterPolicy(int bits_per_key) {
   return new BloomFilterPolicy(bits_per_key);
 }
 
+const FilterPolicy* NewBlockedBloomFilterPolicy(int bits_per_key) {
+  return new BlockedBloomFilterPolicy(bits_per_key);
+}
+
 static uint64_t BloomHashMurmur(const Slice& key) {
   return MurmurHash64A(key.data(), key.size(), 0xdeadbeef12345678ULL);
 }
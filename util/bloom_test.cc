@@ -4,6 +4,7 @@
 
 #include "leveldb/filter_policy.h"
 
+#include "util/blocked_bloom.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/testharness.h"
@@ -25,7 +26,8 @@ class BloomTest {
   std::vector<std::string> keys_;
 
  public:
-  BloomTest() : policy_(NewBloomFilterPolicy(10)) {}
+  explicit BloomTest(const FilterPolicy* policy = NewBloomFilterPolicy(10))
+      : policy_(policy) {}
 
   ~BloomTest() { delete policy_; }
 
@@ -149,6 +151,217 @@ TEST(BloomTest, VaryingLengths) {
   ASSERT_LE(mediocre_filters, good_filters / 5);
 }
 
+// Blocked bloom filters
+
+class BlockedBloomTest : public BloomTest {
+ public:
+  BlockedBloomTest() : BloomTest(NewBlockedBloomFilterPolicy(10)) {}
+};
+
+TEST(BlockedBloomTest, BlockedEmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST(BlockedBloomTest, BlockedSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST(BlockedBloomTest, BlockedVaryingLengths) {
+  char buffer[sizeof(int)];
+
+  // Keeping the probes in one cache line costs some accuracy, so the
+  // bounds are looser than for the standard bloom filter.
+  int mediocre_filters = 0;
+  int good_filters = 0;
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    Build();
+
+    // Filters are rounded up to whole 64-byte lines.
+    ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 66))
+        << length;
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.03);  // Must not be over 3%
+    if (rate > 0.02)
+      mediocre_filters++;  // Allowed, but not too often
+    else
+      good_filters++;
+  }
+  if (kVerbose >= 1) {
+    fprintf(stderr, "Filters: %d good, %d mediocre\n", good_filters,
+            mediocre_filters);
+  }
+  ASSERT_LE(mediocre_filters, good_filters / 5);
+}
+
+// Filters written by the standard policy must stay readable after a
+// database switches to blocked bloom filters.
+TEST(BlockedBloomTest, ReadsStandardFilters) {
+  char buffer[sizeof(int)];
+  const FilterPolicy* standard = NewBloomFilterPolicy(10);
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) keys.push_back(Key(i, buffer).ToString());
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  std::string filter;
+  standard->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+
+  const FilterPolicy* blocked = NewBlockedBloomFilterPolicy(10);
+  int false_positives = 0;
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_TRUE(blocked->KeyMayMatch(Key(i, buffer), filter));
+    ASSERT_EQ(standard->KeyMayMatch(Key(i + 1000000000, buffer), filter),
+              blocked->KeyMayMatch(Key(i + 1000000000, buffer), filter));
+    if (blocked->KeyMayMatch(Key(i + 1000000000, buffer), filter)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 20);
+  delete blocked;
+  delete standard;
+}
+
+// The AVX2 probe must agree with the scalar one, which lookups use on CPUs
+// without AVX2, for every number of probes.
+TEST(BlockedBloomTest, ScalarAndAVX2ProbesAgree) {
+#ifdef BLOCKED_BLOOM_HAVE_AVX2
+  if (!blocked_bloom::HaveAVX2()) {
+    fprintf(stderr, "skipping: no AVX2\n");
+    return;
+  }
+  Random rnd(301);
+  const size_t kNumLines = 16;
+  for (int k = 1; k <= blocked_bloom::kMaxProbes; k++) {
+    std::string filter(kNumLines * blocked_bloom::kLineBytes, 0);
+    std::vector<uint64_t> hashes;
+    for (int i = 0; i < 50 * static_cast<int>(kNumLines); i++) {
+      const uint64_t h = (static_cast<uint64_t>(rnd.Next()) << 33) ^ rnd.Next();
+      hashes.push_back(h);
+      char* line = &filter[blocked_bloom::LineOf(h, kNumLines) *
+                           blocked_bloom::kLineBytes];
+      blocked_bloom::AddToLine(line, static_cast<uint32_t>(h >> 32), k);
+    }
+    int matches = 0;
+    for (int i = 0; i < 20000; i++) {
+      // Half the probes are for added keys, half for random ones.
+      const uint64_t h =
+          (i % 2 == 0) ? hashes[i / 2 % hashes.size()]
+                       : (static_cast<uint64_t>(rnd.Next()) << 33) ^ rnd.Next();
+      const char* line = filter.data() + blocked_bloom::LineOf(h, kNumLines) *
+                                             blocked_bloom::kLineBytes;
+      const bool scalar =
+          blocked_bloom::ProbeLine(line, static_cast<uint32_t>(h >> 32), k);
+      ASSERT_EQ(scalar, blocked_bloom::ProbeLineAVX2(
+                            line, static_cast<uint32_t>(h >> 32), k))
+          << "k " << k << "; hash " << h;
+      if (i % 2 == 0) ASSERT_TRUE(scalar);
+      if (scalar) matches++;
+    }
+    // Both outcomes are exercised.
+    ASSERT_LT(matches, 20000);
+  }
+#else
+  fprintf(stderr, "skipping: no AVX2 probe on this platform\n");
+#endif
+}
+
+class RibbonTest : public BloomTest {
+ public:
+  RibbonTest() : BloomTest(NewRibbonFilterPolicy(10)) {}
+};
+
+TEST(RibbonTest, RibbonEmptyFilter) {
+  ASSERT_TRUE(!Matches("hello"));
+  ASSERT_TRUE(!Matches("world"));
+}
+
+TEST(RibbonTest, RibbonSmall) {
+  Add("hello");
+  Add("world");
+  ASSERT_TRUE(Matches("hello"));
+  ASSERT_TRUE(Matches("world"));
+  ASSERT_TRUE(!Matches("x"));
+  ASSERT_TRUE(!Matches("foo"));
+}
+
+TEST(RibbonTest, RibbonVaryingLengths) {
+  char buffer[sizeof(int)];
+
+  for (int length = 1; length <= 10000; length = NextLength(length)) {
+    Reset();
+    for (int i = 0; i < length; i++) {
+      Add(Key(i, buffer));
+    }
+    // Duplicates must not break the construction.
+    Add(Key(0, buffer));
+    Build();
+
+    // Small key sets get bloom filters, larger ones Ribbon filters at least
+    // 15% smaller than bloom filters.
+    if (length >= 2000) {
+      ASSERT_LE(FilterSize(), static_cast<size_t>(length * 10 / 8 * 0.85))
+          << length;
+    } else {
+      ASSERT_LE(FilterSize(), static_cast<size_t>((length * 10 / 8) + 40))
+          << length;
+    }
+
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(Matches(Key(i, buffer)))
+          << "Length " << length << "; key " << i;
+    }
+
+    double rate = FalsePositiveRate();
+    if (kVerbose >= 1) {
+      fprintf(stderr, "False positives: %5.2f%% @ length = %6d ; bytes = %6d\n",
+              rate * 100.0, length, static_cast<int>(FilterSize()));
+    }
+    ASSERT_LE(rate, 0.02);  // Must not be over 2%
+  }
+}
+
+TEST(RibbonTest, ReadsBloomFilters) {
+  char buffer[sizeof(int)];
+  std::vector<std::string> keys;
+  for (int i = 0; i < 1000; i++) keys.push_back(Key(i, buffer).ToString());
+  std::vector<Slice> key_slices(keys.begin(), keys.end());
+  const FilterPolicy* ribbon = NewRibbonFilterPolicy(10);
+  const FilterPolicy* policies[] = {NewBloomFilterPolicy(10),
+                                    NewBlockedBloomFilterPolicy(10)};
+  for (const FilterPolicy* policy : policies) {
+    std::string filter;
+    policy->CreateFilter(&key_slices[0], static_cast<int>(key_slices.size()),
+                         &filter);
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_TRUE(ribbon->KeyMayMatch(Key(i, buffer), filter));
+      ASSERT_EQ(policy->KeyMayMatch(Key(i + 1000000000, buffer), filter),
+                ribbon->KeyMayMatch(Key(i + 1000000000, buffer), filter));
+    }
+    delete policy;
+  }
+  delete ribbon;
+}
+
 // Different bits-per-byte
 
 }  // namespace leveldb
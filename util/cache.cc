@@ -3,8 +3,13 @@
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <memory>
+#include <new>
 
 #include "leveldb/cache.h"
 #include "port/port.h"
@@ -65,19 +70,20 @@ struct LRUHandle {
 // of porting hacks and is also faster than some of the built-in hash
 // table implementations in some of the compiler/runtime combinations
 // we have tested.  E.g., readrandom speeds up by ~5% over the g++
-// 4.4.3's builtin hashtable.
+// 4.4.3's builtin hashtable.  HandleType is LRUHandle or ClockHandle.
+template <typename HandleType>
 class HandleTable {
  public:
   HandleTable() : length_(0), elems_(0), list_(nullptr) { Resize(); }
   ~HandleTable() { delete[] list_; }
 
-  LRUHandle* Lookup(const Slice& key, uint32_t hash) {
+  HandleType* Lookup(const Slice& key, uint32_t hash) {
     return *FindPointer(key, hash);
   }
 
-  LRUHandle* Insert(LRUHandle* h) {
-    LRUHandle** ptr = FindPointer(h->key(), h->hash);
-    LRUHandle* old = *ptr;
+  HandleType* Insert(HandleType* h) {
+    HandleType** ptr = FindPointer(h->key(), h->hash);
+    HandleType* old = *ptr;
     h->next_hash = (old == nullptr ? nullptr : old->next_hash);
     *ptr = h;
     if (old == nullptr) {
@@ -91,9 +97,9 @@ class HandleTable {
     return old;
   }
 
-  LRUHandle* Remove(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = FindPointer(key, hash);
-    LRUHandle* result = *ptr;
+  HandleType* Remove(const Slice& key, uint32_t hash) {
+    HandleType** ptr = FindPointer(key, hash);
+    HandleType* result = *ptr;
     if (result != nullptr) {
       *ptr = result->next_hash;
       --elems_;
@@ -106,13 +112,13 @@ class HandleTable {
   // a linked list of cache entries that hash into the bucket.
   uint32_t length_;
   uint32_t elems_;
-  LRUHandle** list_;
+  HandleType** list_;
 
   // Return a pointer to slot that points to a cache entry that
   // matches key/hash.  If there is no such cache entry, return a
   // pointer to the trailing slot in the corresponding linked list.
-  LRUHandle** FindPointer(const Slice& key, uint32_t hash) {
-    LRUHandle** ptr = &list_[hash & (length_ - 1)];
+  HandleType** FindPointer(const Slice& key, uint32_t hash) {
+    HandleType** ptr = &list_[hash & (length_ - 1)];
     while (*ptr != nullptr && ((*ptr)->hash != hash || key != (*ptr)->key())) {
       ptr = &(*ptr)->next_hash;
     }
@@ -124,15 +130,15 @@ class HandleTable {
     while (new_length < elems_) {
       new_length *= 2;
     }
-    LRUHandle** new_list = new LRUHandle*[new_length];
+    HandleType** new_list = new HandleType*[new_length];
     memset(new_list, 0, sizeof(new_list[0]) * new_length);
     uint32_t count = 0;
     for (uint32_t i = 0; i < length_; i++) {
-      LRUHandle* h = list_[i];
+      HandleType* h = list_[i];
       while (h != nullptr) {
-        LRUHandle* next = h->next_hash;
+        HandleType* next = h->next_hash;
         uint32_t hash = h->hash;
-        LRUHandle** ptr = &new_list[hash & (new_length - 1)];
+        HandleType** ptr = &new_list[hash & (new_length - 1)];
         h->next_hash = *ptr;
         *ptr = h;
         h = next;
@@ -191,7 +197,7 @@ class LRUCache {
   // Entries are in use by clients, and have refs >= 2 and in_cache==true.
   LRUHandle in_use_ GUARDED_BY(mutex_);
 
-  HandleTable table_ GUARDED_BY(mutex_);
+  HandleTable<LRUHandle> table_ GUARDED_BY(mutex_);
 };
 
 LRUCache::LRUCache() : usage_(0) {
@@ -393,8 +399,451 @@ class ShardedLRUCache : public Cache {
   }
 };
 
+// CLOCK cache with TinyLFU admission
+//
+// Lookups only take the lock of a shard in shared mode: they pin the entry
+// with its atomic reference count and set its referenced bit, instead of
+// moving it in a list.  Inserts take the lock exclusively and sweep a clock
+// hand over the ring of entries of the shard, clearing the referenced bits
+// it passes and evicting the first entry that is neither referenced since
+// the last sweep nor pinned by a client.
+//
+// Once a shard is full, a new entry is only admitted if its key was looked
+// up at least as often as that of the entry it would evict, according to a
+// sketch of the recent lookup frequencies.  The blocks that a large scan reads
+// once therefore do not evict the blocks point lookups keep coming back to.
+
+// An entry is a variable length heap-allocated structure.  Entries in the
+// cache are kept in a circular doubly linked list in insertion order.
+struct ClockHandle {
+  void* value;
+  void (*deleter)(const Slice&, void* value);
+  ClockHandle* next_hash;
+  ClockHandle* next;
+  ClockHandle* prev;
+  size_t charge;
+  size_t key_length;
+  bool in_cache;                 // Whether entry is in the cache.
+  std::atomic<bool> referenced;  // Used since the clock hand last passed.
+  // References, including cache reference, if present.
+  std::atomic<uint32_t> refs;
+  uint32_t hash;     // Hash of key(); used for fast sharding and comparisons
+  char key_data[1];  // Beginning of key
+
+  Slice key() const { return Slice(key_data, key_length); }
+};
+
+// Count-min sketch of 4-bit counters estimating how often each key hash
+// was used recently, sized as in TinyLFU: sixteen counters per entry of
+// the cache, halved once ten uses per entry were counted so that past
+// popularity fades.
+// Updates are plain loads and stores rather than atomic read-modify-writes,
+// to keep them cheap on the lookup path; racing updates may lose some
+// increments, which only lowers the estimates a little.
+class FrequencySketch {
+ public:
+  // num_entries must be a power of two.
+  explicit FrequencySketch(size_t num_entries)
+      : table_(new std::atomic<uint64_t>[num_entries]),
+        word_mask_(num_entries - 1),
+        sample_size_(10 * num_entries),
+        additions_(0) {
+    for (size_t i = 0; i <= word_mask_; i++) {
+      table_[i].store(0, std::memory_order_relaxed);
+    }
+  }
+
+  ~FrequencySketch() { delete[] table_; }
+
+  void Increment(uint32_t hash) {
+    bool added = false;
+    for (int i = 0; i < kDepth; i++) {
+      std::atomic<uint64_t>* word;
+      int shift;
+      Locate(hash, i, &word, &shift);
+      const uint64_t w = word->load(std::memory_order_relaxed);
+      if (((w >> shift) & 0xf) != 0xf) {
+        word->store(w + (uint64_t{1} << shift), std::memory_order_relaxed);
+        added = true;
+      }
+    }
+    // Saturated keys, such as the hottest ones, cost no stores.
+    if (added) {
+      const uint64_t additions =
+          additions_.load(std::memory_order_relaxed) + 1;
+      if (additions >= sample_size_) {
+        Halve();
+      } else {
+        additions_.store(additions, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  int Estimate(uint32_t hash) const {
+    int result = 0xf;
+    for (int i = 0; i < kDepth; i++) {
+      std::atomic<uint64_t>* word;
+      int shift;
+      Locate(hash, i, &word, &shift);
+      const int count =
+          static_cast<int>((word->load(std::memory_order_relaxed) >> shift) &
+                           0xf);
+      if (count < result) result = count;
+    }
+    return result;
+  }
+
+ private:
+  static const int kDepth = 4;
+
+  // Position of the i-th counter of hash: the shift of its nibble in *word.
+  void Locate(uint32_t hash, int i, std::atomic<uint64_t>** word,
+              int* shift) const {
+    static const uint32_t kSeeds[kDepth] = {0x97cb3127, 0xc2b2ae35,
+                                            0x85ebca6b, 0x27d4eb2f};
+    uint32_t h = (hash ^ (hash >> 16)) * kSeeds[i];
+    h ^= h >> 15;
+    *word = &table_[h & word_mask_];
+    *shift = static_cast<int>(h >> 28) * 4;
+  }
+
+  void Halve() {
+    for (size_t i = 0; i <= word_mask_; i++) {
+      const uint64_t w = table_[i].load(std::memory_order_relaxed);
+      table_[i].store((w >> 1) & 0x7777777777777777ull,
+                      std::memory_order_relaxed);
+    }
+    additions_.store(sample_size_ / 2, std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t>* const table_;
+  const size_t word_mask_;
+  const uint64_t sample_size_;
+  std::atomic<uint64_t> additions_;
+
+  // No copying allowed
+  FrequencySketch(const FrequencySketch&);
+  void operator=(const FrequencySketch&);
+};
+
+// Reader-writer lock of a shard of the clock cache.
+class RWMutex {
+ public:
+  RWMutex() { pthread_rwlock_init(&rw_, nullptr); }
+  ~RWMutex() { pthread_rwlock_destroy(&rw_); }
+  void ReadLock() { pthread_rwlock_rdlock(&rw_); }
+  void WriteLock() { pthread_rwlock_wrlock(&rw_); }
+  void Unlock() { pthread_rwlock_unlock(&rw_); }
+
+ private:
+  pthread_rwlock_t rw_;
+
+  // No copying allowed
+  RWMutex(const RWMutex&);
+  void operator=(const RWMutex&);
+};
+
+class ReadLock {
+ public:
+  explicit ReadLock(RWMutex* mu) : mu_(mu) { mu_->ReadLock(); }
+  ~ReadLock() { mu_->Unlock(); }
+
+ private:
+  RWMutex* const mu_;
+};
+
+class WriteLock {
+ public:
+  explicit WriteLock(RWMutex* mu) : mu_(mu) { mu_->WriteLock(); }
+  ~WriteLock() { mu_->Unlock(); }
+
+ private:
+  RWMutex* const mu_;
+};
+
+// A single shard of sharded clock cache.
+class ClockCache {
+ public:
+  ClockCache();
+  ~ClockCache();
+
+  // Separate from constructor so caller can easily make an array of
+  // ClockCache.
+  void SetCapacity(size_t capacity);
+
+  // Like Cache methods, but with an extra "hash" parameter.
+  Cache::Handle* Insert(const Slice& key, uint32_t hash, void* value,
+                        size_t charge,
+                        void (*deleter)(const Slice& key, void* value));
+  Cache::Handle* Lookup(const Slice& key, uint32_t hash);
+  void Release(Cache::Handle* handle) {
+    Unref(reinterpret_cast<ClockHandle*>(handle));
+  }
+  void Erase(const Slice& key, uint32_t hash);
+  void Prune();
+  size_t TotalCharge() const {
+    ReadLock l(&mutex_);
+    return usage_;
+  }
+
+ private:
+  void Unref(ClockHandle* e);
+  // Advance the hand past the next entry that may be evicted, and return
+  // it.  Returns nullptr if every entry is pinned.
+  ClockHandle* NextVictim();
+  void RingAppend(ClockHandle* e);
+  void RingRemove(ClockHandle* e);
+  bool FinishErase(ClockHandle* e);
+
+  // Initialized before use.
+  size_t capacity_;
+  std::unique_ptr<FrequencySketch> sketch_;
+
+  // mutex_ protects the following state.  Lookups hold it shared.
+  mutable RWMutex mutex_;
+  size_t usage_;
+  size_t num_entries_;
+  // Next entry of the ring for the clock hand to look at, or nullptr if
+  // the ring is empty.  Entries have in_cache==true.
+  ClockHandle* hand_;
+  HandleTable<ClockHandle> table_;
+};
+
+ClockCache::ClockCache()
+    : capacity_(0), usage_(0), num_entries_(0), hand_(nullptr) {}
+
+ClockCache::~ClockCache() {
+  while (hand_ != nullptr) {
+    ClockHandle* e = hand_;
+    // Error if caller has an unreleased handle
+    assert(e->refs.load(std::memory_order_relaxed) == 1);
+    bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+    if (!erased) {  // to avoid unused variable when compiled NDEBUG
+      assert(erased);
+    }
+  }
+}
+
+void ClockCache::SetCapacity(size_t capacity) {
+  capacity_ = capacity;
+  // Most entries of a block cache are about the size of a default block.
+  size_t num_entries = 64;
+  while (num_entries < capacity / 4096 && num_entries < (1 << 22)) {
+    num_entries *= 2;
+  }
+  sketch_.reset(new FrequencySketch(num_entries));
+}
+
+void ClockCache::Unref(ClockHandle* e) {
+  if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {  // Deallocate.
+    assert(!e->in_cache);
+    (*e->deleter)(e->key(), e->value);
+    e->~ClockHandle();
+    free(e);
+  }
+}
+
+void ClockCache::RingAppend(ClockHandle* e) {
+  // Make "e" the last entry the hand gets to by inserting it just before
+  // the hand.
+  if (hand_ == nullptr) {
+    e->next = e;
+    e->prev = e;
+    hand_ = e;
+  } else {
+    e->next = hand_;
+    e->prev = hand_->prev;
+    e->prev->next = e;
+    e->next->prev = e;
+  }
+  num_entries_++;
+}
+
+void ClockCache::RingRemove(ClockHandle* e) {
+  if (e->next == e) {
+    hand_ = nullptr;
+  } else {
+    if (hand_ == e) hand_ = e->next;
+    e->next->prev = e->prev;
+    e->prev->next = e->next;
+  }
+  num_entries_--;
+}
+
+ClockHandle* ClockCache::NextVictim() {
+  // The first round clears every referenced bit, so two rounds find an
+  // entry unless they are all pinned.
+  for (size_t i = 0; i < 2 * num_entries_; i++) {
+    ClockHandle* e = hand_;
+    hand_ = hand_->next;
+    // Lookups cannot pin an entry while the lock is held exclusively, and
+    // releases only unpin.
+    if (e->refs.load(std::memory_order_acquire) > 1) continue;
+    if (e->referenced.load(std::memory_order_relaxed)) {
+      e->referenced.store(false, std::memory_order_relaxed);
+      continue;
+    }
+    return e;
+  }
+  return nullptr;
+}
+
+Cache::Handle* ClockCache::Lookup(const Slice& key, uint32_t hash) {
+  sketch_->Increment(hash);
+  ReadLock l(&mutex_);
+  ClockHandle* e = table_.Lookup(key, hash);
+  if (e != nullptr) {
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    // Avoid dirtying the cache line of an entry that is already marked.
+    if (!e->referenced.load(std::memory_order_relaxed)) {
+      e->referenced.store(true, std::memory_order_relaxed);
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+Cache::Handle* ClockCache::Insert(const Slice& key, uint32_t hash, void* value,
+                                  size_t charge,
+                                  void (*deleter)(const Slice& key,
+                                                  void* value)) {
+  ClockHandle* e = new (malloc(sizeof(ClockHandle) - 1 + key.size()))
+      ClockHandle;
+  e->value = value;
+  e->deleter = deleter;
+  e->charge = charge;
+  e->key_length = key.size();
+  e->hash = hash;
+  e->in_cache = false;
+  e->referenced.store(false, std::memory_order_relaxed);
+  e->refs.store(1, std::memory_order_relaxed);  // for the returned handle.
+  memcpy(e->key_data, key.data(), key.size());
+
+  WriteLock l(&mutex_);
+  // capacity_==0 is supported and turns off caching.
+  bool admit = capacity_ > 0;
+  ClockHandle* victim = nullptr;
+  if (admit && usage_ + charge > capacity_ &&
+      table_.Lookup(key, hash) == nullptr) {
+    victim = NextVictim();
+    admit = victim == nullptr ||
+            sketch_->Estimate(hash) >= sketch_->Estimate(victim->hash);
+  }
+  if (admit) {
+    // for the cache's reference.
+    e->refs.fetch_add(1, std::memory_order_relaxed);
+    e->in_cache = true;
+    RingAppend(e);
+    usage_ += charge;
+    FinishErase(table_.Insert(e));
+    while (usage_ > capacity_) {
+      if (victim == nullptr) victim = NextVictim();
+      if (victim == nullptr) break;
+      bool erased = FinishErase(table_.Remove(victim->key(), victim->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+      victim = nullptr;
+    }
+  }
+  return reinterpret_cast<Cache::Handle*>(e);
+}
+
+// If e != nullptr, finish removing *e from the cache; it has already been
+// removed from the hash table.  Return whether e != nullptr.
+bool ClockCache::FinishErase(ClockHandle* e) {
+  if (e != nullptr) {
+    assert(e->in_cache);
+    RingRemove(e);
+    e->in_cache = false;
+    usage_ -= e->charge;
+    Unref(e);
+  }
+  return e != nullptr;
+}
+
+void ClockCache::Erase(const Slice& key, uint32_t hash) {
+  WriteLock l(&mutex_);
+  FinishErase(table_.Remove(key, hash));
+}
+
+void ClockCache::Prune() {
+  WriteLock l(&mutex_);
+  for (size_t n = num_entries_; n > 0 && hand_ != nullptr; n--) {
+    ClockHandle* e = hand_;
+    hand_ = hand_->next;
+    if (e->refs.load(std::memory_order_acquire) == 1) {
+      bool erased = FinishErase(table_.Remove(e->key(), e->hash));
+      if (!erased) {  // to avoid unused variable when compiled NDEBUG
+        assert(erased);
+      }
+    }
+  }
+}
+
+class ShardedClockCache : public Cache {
+ private:
+  ClockCache shard_[kNumShards];
+  port::Mutex id_mutex_;
+  uint64_t last_id_;
+
+  static inline uint32_t HashSlice(const Slice& s) {
+    return Hash(s.data(), s.size(), 0);
+  }
+
+  static uint32_t Shard(uint32_t hash) { return hash >> (32 - kNumShardBits); }
+
+ public:
+  explicit ShardedClockCache(size_t capacity) : last_id_(0) {
+    const size_t per_shard = (capacity + (kNumShards - 1)) / kNumShards;
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].SetCapacity(per_shard);
+    }
+  }
+  virtual ~ShardedClockCache() {}
+  virtual Handle* Insert(const Slice& key, void* value, size_t charge,
+                         void (*deleter)(const Slice& key, void* value)) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Insert(key, hash, value, charge, deleter);
+  }
+  virtual Handle* Lookup(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    return shard_[Shard(hash)].Lookup(key, hash);
+  }
+  virtual void Release(Handle* handle) {
+    ClockHandle* h = reinterpret_cast<ClockHandle*>(handle);
+    shard_[Shard(h->hash)].Release(handle);
+  }
+  virtual void Erase(const Slice& key) {
+    const uint32_t hash = HashSlice(key);
+    shard_[Shard(hash)].Erase(key, hash);
+  }
+  virtual void* Value(Handle* handle) {
+    return reinterpret_cast<ClockHandle*>(handle)->value;
+  }
+  virtual uint64_t NewId() {
+    MutexLock l(&id_mutex_);
+    return ++(last_id_);
+  }
+  virtual void Prune() {
+    for (int s = 0; s < kNumShards; s++) {
+      shard_[s].Prune();
+    }
+  }
+  virtual size_t TotalCharge() const {
+    size_t total = 0;
+    for (int s = 0; s < kNumShards; s++) {
+      total += shard_[s].TotalCharge();
+    }
+    return total;
+  }
+};
+
 }  // end anonymous namespace
 
 Cache* NewLRUCache(size_t capacity) { return new ShardedLRUCache(capacity); }
 
+Cache* NewClockCache(size_t capacity) {
+  return new ShardedClockCache(capacity);
+}
+
 }  // namespace leveldb
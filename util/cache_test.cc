@@ -4,6 +4,8 @@
 
 #include "leveldb/cache.h"
 
+#include <atomic>
+#include <thread>
 #include <vector>
 #include "util/coding.h"
 #include "util/testharness.h"
@@ -221,6 +223,144 @@ TEST(CacheTest, ZeroSizeCache) {
   ASSERT_EQ(-1, Lookup(1));
 }
 
+class ClockCacheTest : public CacheTest {
+ public:
+  ClockCacheTest() {
+    delete cache_;
+    cache_ = NewClockCache(kCacheSize);
+  }
+};
+
+TEST(ClockCacheTest, ClockEntriesArePinned) {
+  Insert(100, 101);
+  Cache::Handle* h1 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(101, DecodeValue(cache_->Value(h1)));
+
+  Insert(100, 102);
+  Cache::Handle* h2 = cache_->Lookup(EncodeKey(100));
+  ASSERT_EQ(102, DecodeValue(cache_->Value(h2)));
+  ASSERT_EQ(0, deleted_keys_.size());
+
+  cache_->Release(h1);
+  ASSERT_EQ(1, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[0]);
+  ASSERT_EQ(101, deleted_values_[0]);
+
+  Erase(100);
+  ASSERT_EQ(-1, Lookup(100));
+  ASSERT_EQ(1, deleted_keys_.size());
+
+  cache_->Release(h2);
+  ASSERT_EQ(2, deleted_keys_.size());
+  ASSERT_EQ(100, deleted_keys_[1]);
+  ASSERT_EQ(102, deleted_values_[1]);
+}
+
+TEST(ClockCacheTest, ClockUseExceedsCacheSize) {
+  std::vector<Cache::Handle*> h;
+  for (int i = 0; i < kCacheSize + 100; i++) {
+    h.push_back(InsertAndReturnHandle(1000 + i, 2000 + i));
+  }
+  for (int i = 0; i < h.size(); i++) {
+    ASSERT_EQ(2000 + i, Lookup(1000 + i));
+  }
+  for (int i = 0; i < h.size(); i++) {
+    cache_->Release(h[i]);
+  }
+}
+
+TEST(ClockCacheTest, ClockHeavyEntries) {
+  const int kLight = 1;
+  const int kHeavy = 10;
+  int added = 0;
+  int index = 0;
+  while (added < 2 * kCacheSize) {
+    const int weight = (index & 1) ? kLight : kHeavy;
+    Insert(index, 1000 + index, weight);
+    added += weight;
+    index++;
+  }
+
+  int cached_weight = 0;
+  for (int i = 0; i < index; i++) {
+    const int weight = (i & 1 ? kLight : kHeavy);
+    int r = Lookup(i);
+    if (r >= 0) {
+      cached_weight += weight;
+      ASSERT_EQ(1000 + i, r);
+    }
+  }
+  ASSERT_LE(cached_weight, kCacheSize + kCacheSize / 10);
+}
+
+TEST(ClockCacheTest, ClockScanResistance) {
+  // Entries looked up over and over, as by point lookups.
+  for (int i = 0; i < 100; i++) {
+    Insert(i, 1000 + i);
+  }
+  for (int round = 0; round < 10; round++) {
+    for (int i = 0; i < 100; i++) {
+      ASSERT_EQ(1000 + i, Lookup(i));
+    }
+  }
+
+  // A scan reading many more entries once each.
+  for (int i = 0; i < 4 * kCacheSize; i++) {
+    ASSERT_EQ(-1, Lookup(10000 + i));
+    Insert(10000 + i, 20000 + i);
+  }
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(1000 + i, Lookup(i));
+  }
+  ASSERT_LE(cache_->TotalCharge(), kCacheSize + kCacheSize / 10);
+}
+
+TEST(ClockCacheTest, ClockPrune) {
+  Insert(1, 100);
+  Insert(2, 200);
+
+  Cache::Handle* handle = cache_->Lookup(EncodeKey(1));
+  ASSERT_TRUE(handle);
+  cache_->Prune();
+  cache_->Release(handle);
+
+  ASSERT_EQ(100, Lookup(1));
+  ASSERT_EQ(-1, Lookup(2));
+}
+
+TEST(ClockCacheTest, ClockZeroSizeCache) {
+  delete cache_;
+  cache_ = NewClockCache(0);
+
+  Insert(1, 100);
+  ASSERT_EQ(-1, Lookup(1));
+}
+
+TEST(ClockCacheTest, ClockConcurrentLookups) {
+  for (int i = 0; i < kCacheSize / 2; i++) {
+    Insert(i, 1000 + i);
+  }
+  std::atomic<int> misses(0);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; t++) {
+    threads.emplace_back([this, t, &misses]() {
+      for (int n = 0; n < 20000; n++) {
+        const int key = (n * 7 + t) % (kCacheSize / 2);
+        Cache::Handle* h = cache_->Lookup(EncodeKey(key));
+        if (h == nullptr) {
+          misses++;
+        } else if (DecodeValue(cache_->Value(h)) != 1000 + key) {
+          misses += 1000000;
+        }
+        if (h != nullptr) cache_->Release(h);
+      }
+    });
+  }
+  for (std::thread& thread : threads) thread.join();
+  ASSERT_EQ(0, misses.load());
+  ASSERT_EQ(0, deleted_keys_.size());
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }
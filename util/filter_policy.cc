@@ -8,5 +8,9 @@ namespace leveldb {
 
 FilterPolicy::~FilterPolicy() {}
 
+const FilterPolicy* FilterPolicy::NewWithBitsPerKey(int bits_per_key) const {
+  return nullptr;
+}
+
 DynamicFilter::~DynamicFilter() {}
 }  // namespace leveldb
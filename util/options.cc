@@ -45,6 +45,20 @@ Options::Options()
       maximum_segments_storage_size(0),
       segments_storage_size_gc_threshold(0.9),
       use_memtable_dynamic_filter(false),
-      memtable_dynamic_filter_fp_rate(0.1) {}
+      memtable_dynamic_filter_fp_rate(0.1),
+      segment_open_threads(4),
+      nvmemtable_recovery_threads(4),
+      leaf_read_sample_rate(1),
+      event_trace_file(nullptr),
+      op_trace_file(nullptr),
+      op_trace_sample_rate(1),
+      adaptive_filter_bits_per_key(0),
+      leaf_filter_bits_per_key(0),
+      cold_leaf_read_hotness(0),
+      metadata_cache_size(8 << 20),
+      index_block_restart_interval(16),
+      row_cache_size(0),
+      secondary_cache_file(nullptr),
+      secondary_cache_size(1024ul * 1024ul * 1024ul) {}
 
 }  // namespace leveldb
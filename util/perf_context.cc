@@ -0,0 +1,46 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "leveldb/perf_context.h"
+
+namespace leveldb {
+
+void PerfContext::Reset() {
+  memtable_nanos = 0;
+  leaf_index_seek_nanos = 0;
+  filter_nanos = 0;
+  block_read_nanos = 0;
+  decode_nanos = 0;
+  runs_searched = 0;
+  filter_rejects = 0;
+  leaf_filter_rejects = 0;
+  write_wait_nanos = 0;
+  write_memtable_nanos = 0;
+}
+
+static void AppendField(std::string* result, const char* name,
+                        uint64_t value) {
+  if (value == 0) return;
+  if (!result->empty()) result->append(", ");
+  result->append(name);
+  result->append(" = ");
+  result->append(std::to_string(value));
+}
+
+std::string PerfContext::ToString() const {
+  std::string result;
+  AppendField(&result, "memtable_nanos", memtable_nanos);
+  AppendField(&result, "leaf_index_seek_nanos", leaf_index_seek_nanos);
+  AppendField(&result, "filter_nanos", filter_nanos);
+  AppendField(&result, "block_read_nanos", block_read_nanos);
+  AppendField(&result, "decode_nanos", decode_nanos);
+  AppendField(&result, "runs_searched", runs_searched);
+  AppendField(&result, "filter_rejects", filter_rejects);
+  AppendField(&result, "leaf_filter_rejects", leaf_filter_rejects);
+  AppendField(&result, "write_wait_nanos", write_wait_nanos);
+  AppendField(&result, "write_memtable_nanos", write_memtable_nanos);
+  return result;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,163 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/ycsb.h"
+
+#include <math.h>
+
+#include "util/mutexlock.h"
+
+namespace leveldb {
+namespace ycsb {
+
+const char* OpTypeName(OpType type) {
+  switch (type) {
+    case kRead:
+      return "read";
+    case kUpdate:
+      return "update";
+    case kInsert:
+      return "insert";
+    case kScan:
+      return "scan";
+    case kReadModifyWrite:
+      return "read-modify-write";
+    case kNumOpTypes:
+      break;
+  }
+  return "unknown";
+}
+
+bool GetWorkload(char name, Workload* workload) {
+  Workload w = {name, 0, 0, 0, 0, 0, kScrambledZipfian, 100};
+  switch (name) {
+    case 'a':  // Update heavy
+      w.read_proportion = 0.5;
+      w.update_proportion = 0.5;
+      break;
+    case 'b':  // Read mostly
+      w.read_proportion = 0.95;
+      w.update_proportion = 0.05;
+      break;
+    case 'c':  // Read only
+      w.read_proportion = 1;
+      break;
+    case 'd':  // Read latest
+      w.read_proportion = 0.95;
+      w.insert_proportion = 0.05;
+      w.distribution = kLatest;
+      break;
+    case 'e':  // Short ranges
+      w.scan_proportion = 0.95;
+      w.insert_proportion = 0.05;
+      break;
+    case 'f':  // Read-modify-write
+      w.read_proportion = 0.5;
+      w.read_modify_write_proportion = 0.5;
+      break;
+    default:
+      return false;
+  }
+  *workload = w;
+  return true;
+}
+
+double NextDouble(Random* rnd) {
+  // Next() returns values in [1, 2^31 - 2].
+  return (rnd->Next() - 1) / 2147483646.0;
+}
+
+double ZipfianGenerator::Zeta(uint64_t n, double theta) {
+  static const uint64_t kExactTerms = 1000000;
+  double sum = 0;
+  uint64_t exact = n < kExactTerms ? n : kExactTerms;
+  for (uint64_t i = 1; i <= exact; ++i) {
+    sum += 1 / pow(static_cast<double>(i), theta);
+  }
+  if (n > exact) {
+    // Midpoint rule: sum_{i=a+1}^{b} f(i) ~= integral of f over [a+.5, b+.5]
+    double a = exact + 0.5, b = n + 0.5;
+    sum += (pow(b, 1 - theta) - pow(a, 1 - theta)) / (1 - theta);
+  }
+  return sum;
+}
+
+ZipfianGenerator::ZipfianGenerator(uint64_t num_items, double theta)
+    : num_items_(num_items < 1 ? 1 : num_items), theta_(theta) {
+  alpha_ = 1 / (1 - theta_);
+  zetan_ = Zeta(num_items_, theta_);
+  double zeta2 = Zeta(2, theta_);
+  eta_ = (1 - pow(2.0 / num_items_, 1 - theta_)) / (1 - zeta2 / zetan_);
+}
+
+uint64_t ZipfianGenerator::Next(double u) const {
+  double uz = u * zetan_;
+  if (uz < 1) return 0;
+  if (uz < 1 + pow(0.5, theta_)) return num_items_ > 1 ? 1 : 0;
+  uint64_t v = static_cast<uint64_t>(num_items_ *
+                                     pow(eta_ * u - eta_ + 1, alpha_));
+  return v < num_items_ ? v : num_items_ - 1;
+}
+
+static uint64_t FNVHash64(uint64_t v) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int i = 0; i < 8; ++i) {
+    hash ^= v & 0xff;
+    hash *= 0x100000001B3ull;
+    v >>= 8;
+  }
+  return hash;
+}
+
+KeyChooser::KeyChooser(Distribution distribution, uint64_t record_count,
+                       double zipf_theta)
+    : distribution_(distribution),
+      record_count_(record_count < 1 ? 1 : record_count),
+      zipfian_(record_count_, zipf_theta) {}
+
+uint64_t KeyChooser::Next(Random* rnd, uint64_t key_count) const {
+  if (key_count == 0) return 0;
+  switch (distribution_) {
+    case kUniform:
+      return static_cast<uint64_t>(NextDouble(rnd) * key_count);
+    case kScrambledZipfian:
+      // Inserted keys beyond record_count_ are not picked, as in YCSB.
+      return FNVHash64(zipfian_.Next(NextDouble(rnd))) %
+             (key_count < record_count_ ? key_count : record_count_);
+    case kLatest:
+      return key_count - 1 - zipfian_.Next(NextDouble(rnd)) % key_count;
+  }
+  return 0;
+}
+
+void InsertCounter::Reset(uint64_t key_count) {
+  next_ = key_count;
+  key_count_ = key_count;
+  MutexLock l(&mutex_);
+  acknowledged_.clear();
+}
+
+void InsertCounter::Acknowledge(uint64_t key) {
+  MutexLock l(&mutex_);
+  acknowledged_.insert(key);
+  uint64_t count = key_count_.load();
+  while (!acknowledged_.empty() && *acknowledged_.begin() == count) {
+    acknowledged_.erase(acknowledged_.begin());
+    ++count;
+  }
+  key_count_.store(count);
+}
+
+OpType NextOp(const Workload& workload, Random* rnd) {
+  double u = NextDouble(rnd);
+  if ((u -= workload.read_proportion) < 0) return kRead;
+  if ((u -= workload.update_proportion) < 0) return kUpdate;
+  if ((u -= workload.insert_proportion) < 0) return kInsert;
+  if ((u -= workload.scan_proportion) < 0) return kScan;
+  if (workload.read_modify_write_proportion > 0) return kReadModifyWrite;
+  return kRead;
+}
+
+}  // namespace ycsb
+}  // namespace leveldb
@@ -0,0 +1,141 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// The YCSB core workloads A-F and their key generators, shared by the
+// benchmarks.
+
+#ifndef STORAGE_LEVELDB_UTIL_YCSB_H_
+#define STORAGE_LEVELDB_UTIL_YCSB_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <set>
+
+#include "port/port.h"
+#include "port/thread_annotations.h"
+#include "util/random.h"
+
+namespace leveldb {
+namespace ycsb {
+
+enum OpType {
+  kRead,
+  kUpdate,
+  kInsert,
+  kScan,
+  kReadModifyWrite,
+  kNumOpTypes,
+};
+
+const char* OpTypeName(OpType type);
+
+enum Distribution {
+  kUniform,
+  // Popular keys are scattered over the key space.
+  kScrambledZipfian,
+  // Recently inserted keys are the most popular.
+  kLatest,
+};
+
+struct Workload {
+  char name;
+  // Proportions of the operations, summing up to 1.
+  double read_proportion;
+  double update_proportion;
+  double insert_proportion;
+  double scan_proportion;
+  double read_modify_write_proportion;
+  Distribution distribution;
+  // Scans read a uniformly distributed number of entries in
+  // [1, max_scan_length].
+  int max_scan_length;
+};
+
+// Store the core workload name ('a' to 'f') in *workload. Returns false if
+// there is no such workload.
+bool GetWorkload(char name, Workload* workload);
+
+// A uniformly distributed double in [0, 1).
+double NextDouble(Random* rnd);
+
+// Zipfian distributed values in [0, num_items), 0 being the most popular,
+// following "Quickly Generating Billion-Record Synthetic Databases" by
+// Gray et al. theta is the zipfian constant and must lie in (0, 1).
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t num_items, double theta);
+
+  // Map a uniform u in [0, 1) to the next value.
+  uint64_t Next(double u) const;
+
+ private:
+  // Sum of 1 / i^theta for i in [1, n]. Large n are approximated by an
+  // integral beyond the first million terms.
+  static double Zeta(uint64_t n, double theta);
+
+  const uint64_t num_items_;
+  const double theta_;
+  double alpha_;
+  double zetan_;
+  double eta_;
+};
+
+// Picks the key of each operation of a workload over record_count keys.
+// Thread-safe.
+class KeyChooser {
+ public:
+  KeyChooser(Distribution distribution, uint64_t record_count,
+             double zipf_theta);
+
+  // Choose a key in [0, key_count), key_count - 1 being the latest insert.
+  uint64_t Next(Random* rnd, uint64_t key_count) const;
+
+ private:
+  const Distribution distribution_;
+  const uint64_t record_count_;
+  const ZipfianGenerator zipfian_;
+};
+
+// Numbers the keys inserted by a workload and tracks which keys exist.
+// An insert takes a number from Next() and reports it with Acknowledge()
+// once the key is written.  key_count() only grows past keys whose insert
+// and those of all lower numbers were acknowledged, so that readers never
+// pick a key still being inserted.
+// Thread-safe.
+class InsertCounter {
+ public:
+  // Keys [0, key_count) exist already.
+  explicit InsertCounter(uint64_t key_count) { Reset(key_count); }
+
+  InsertCounter(const InsertCounter&) = delete;
+  InsertCounter& operator=(const InsertCounter&) = delete;
+
+  // Forget every insert in progress. Not thread-safe.
+  void Reset(uint64_t key_count);
+
+  // Number of the next key to insert.
+  uint64_t Next() { return next_.fetch_add(1); }
+
+  // The key numbered key, returned by Next(), has been inserted.
+  void Acknowledge(uint64_t key);
+
+  // Keys [0, key_count()) have been inserted.
+  uint64_t key_count() const { return key_count_.load(); }
+
+ private:
+  std::atomic<uint64_t> next_;
+  std::atomic<uint64_t> key_count_;
+  port::Mutex mutex_;
+  // Acknowledged keys beyond key_count_.
+  std::set<uint64_t> acknowledged_ GUARDED_BY(mutex_);
+};
+
+// Choose the type of the next operation of workload.
+OpType NextOp(const Workload& workload, Random* rnd);
+
+}  // namespace ycsb
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_YCSB_H_
@@ -0,0 +1,193 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/ycsb.h"
+
+#include <math.h>
+
+#include <thread>
+#include <vector>
+
+#include "util/testharness.h"
+
+namespace leveldb {
+namespace ycsb {
+
+class YCSBTest {
+ public:
+  static const int kSamples = 200000;
+
+  // Counts of the values of kSamples draws of chooser over key_count keys.
+  static std::vector<int> Histogram(const KeyChooser& chooser,
+                                    uint64_t key_count, uint64_t range) {
+    Random rnd(301);
+    std::vector<int> counts(range, 0);
+    for (int i = 0; i < kSamples; i++) {
+      uint64_t k = chooser.Next(&rnd, key_count);
+      ASSERT_LT(k, range);
+      counts[k]++;
+    }
+    return counts;
+  }
+
+  // Probability of the most popular of n zipfian items.
+  static double TopProbability(uint64_t n, double theta) {
+    double zeta = 0;
+    for (uint64_t i = 1; i <= n; i++) zeta += 1 / pow(i, theta);
+    return 1 / zeta;
+  }
+};
+
+TEST(YCSBTest, NextDoubleRange) {
+  Random rnd(301);
+  for (int i = 0; i < 100000; i++) {
+    double u = NextDouble(&rnd);
+    ASSERT_GE(u, 0);
+    ASSERT_LT(u, 1);
+  }
+}
+
+TEST(YCSBTest, ZipfianRange) {
+  const uint64_t kItemCounts[] = {1, 2, 3, 1000, 1ull << 40};
+  for (uint64_t n : kItemCounts) {
+    ZipfianGenerator zipfian(n, 0.99);
+    for (int i = 0; i <= 1000; i++) {
+      ASSERT_LT(zipfian.Next(i / 1000.0 * 0.999999), n);
+    }
+    ASSERT_EQ(0, zipfian.Next(0));
+  }
+}
+
+TEST(YCSBTest, ZipfianDistribution) {
+  const uint64_t kItems = 1000;
+  const double kTheta = 0.99;
+  ZipfianGenerator zipfian(kItems, kTheta);
+  Random rnd(301);
+  std::vector<int> counts(kItems, 0);
+  for (int i = 0; i < kSamples; i++) {
+    counts[zipfian.Next(NextDouble(&rnd))]++;
+  }
+  double top = TopProbability(kItems, kTheta);
+  ASSERT_GT(counts[0], kSamples * top * 0.95);
+  ASSERT_LT(counts[0], kSamples * top * 1.05);
+  // Item i + 1 is drawn about (i + 1)^theta times as often as the first.
+  ASSERT_GT(counts[1], kSamples * top / 2 * 0.9);
+  ASSERT_LT(counts[1], kSamples * top / 2 * 1.1);
+  // The popularity falls with the rank.
+  int head = 0, tail = 0;
+  for (int i = 0; i < 10; i++) head += counts[i];
+  for (int i = kItems - 10; i < kItems; i++) tail += counts[i];
+  ASSERT_GT(head, 50 * tail);
+}
+
+TEST(YCSBTest, UniformKeys) {
+  KeyChooser chooser(kUniform, 100, 0.99);
+  std::vector<int> counts = Histogram(chooser, 100, 100);
+  for (int c : counts) {
+    ASSERT_GT(c, kSamples / 100 * 0.8);
+    ASSERT_LT(c, kSamples / 100 * 1.2);
+  }
+}
+
+TEST(YCSBTest, ScrambledZipfianKeys) {
+  const uint64_t kRecords = 1000;
+  KeyChooser chooser(kScrambledZipfian, kRecords, 0.99);
+  // Keys inserted beyond the records of the load phase are never picked.
+  std::vector<int> counts = Histogram(chooser, 2 * kRecords, kRecords);
+  // The popular keys are scattered, not the first ones.
+  uint64_t hottest = 0;
+  for (uint64_t k = 0; k < kRecords; k++) {
+    if (counts[k] > counts[hottest]) hottest = k;
+  }
+  ASSERT_NE(0, hottest);
+  double top = TopProbability(kRecords, 0.99);
+  ASSERT_GT(counts[hottest], kSamples * top * 0.95);
+  int head = 0;
+  for (int i = 0; i < 10; i++) head += counts[i];
+  ASSERT_LT(head, kSamples * top);
+
+  // Fewer keys than records: stays in range.
+  Histogram(chooser, 10, 10);
+}
+
+TEST(YCSBTest, LatestKeys) {
+  const uint64_t kRecords = 1000;
+  KeyChooser chooser(kLatest, kRecords, 0.99);
+  const uint64_t kKeys = 1500;
+  std::vector<int> counts = Histogram(chooser, kKeys, kKeys);
+  // The latest insert is the most popular key, then the ones before it.
+  double top = TopProbability(kRecords, 0.99);
+  ASSERT_GT(counts[kKeys - 1], kSamples * top * 0.95);
+  ASSERT_LT(counts[kKeys - 1], kSamples * top * 1.05);
+  ASSERT_GT(counts[kKeys - 1], counts[kKeys - 2]);
+  ASSERT_GT(counts[kKeys - 2], counts[kKeys - 100]);
+  int oldest = 0;
+  for (int i = 0; i < 100; i++) oldest += counts[i];
+  ASSERT_LT(oldest, counts[kKeys - 1]);
+
+  // Fewer keys than records: stays in range.
+  Histogram(chooser, 10, 10);
+  ASSERT_EQ(0, chooser.Next(nullptr, 0));
+}
+
+TEST(YCSBTest, NextOpProportions) {
+  Workload workload;
+  ASSERT_TRUE(GetWorkload('a', &workload));
+  ASSERT_TRUE(!GetWorkload('g', &workload));
+  ASSERT_TRUE(GetWorkload('f', &workload));
+  Random rnd(301);
+  int counts[kNumOpTypes] = {};
+  for (int i = 0; i < kSamples; i++) counts[NextOp(workload, &rnd)]++;
+  ASSERT_GT(counts[kRead], kSamples * 0.48);
+  ASSERT_GT(counts[kReadModifyWrite], kSamples * 0.48);
+  ASSERT_EQ(kSamples, counts[kRead] + counts[kReadModifyWrite]);
+}
+
+TEST(YCSBTest, InsertCounterWaitsForEarlierInserts) {
+  InsertCounter inserts(10);
+  ASSERT_EQ(10, inserts.key_count());
+  uint64_t a = inserts.Next();
+  uint64_t b = inserts.Next();
+  uint64_t c = inserts.Next();
+  ASSERT_EQ(10, a);
+  ASSERT_EQ(12, c);
+  inserts.Acknowledge(b);
+  inserts.Acknowledge(c);
+  ASSERT_EQ(10, inserts.key_count());
+  inserts.Acknowledge(a);
+  ASSERT_EQ(13, inserts.key_count());
+
+  // An insert that is never acknowledged holds back the later ones.
+  uint64_t failed = inserts.Next();
+  inserts.Acknowledge(inserts.Next());
+  ASSERT_EQ(failed, inserts.key_count());
+
+  inserts.Reset(5);
+  ASSERT_EQ(5, inserts.key_count());
+  ASSERT_EQ(5, inserts.Next());
+}
+
+TEST(YCSBTest, InsertCounterConcurrentInserts) {
+  InsertCounter inserts(0);
+  const int kThreads = 4;
+  const int kInsertsPerThread = 10000;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&inserts]() {
+      for (int i = 0; i < kInsertsPerThread; i++) {
+        uint64_t k = inserts.Next();
+        // The count never covers a key that is not acknowledged yet.
+        ASSERT_LE(inserts.key_count(), k);
+        inserts.Acknowledge(k);
+      }
+    });
+  }
+  for (auto& thread : threads) thread.join();
+  ASSERT_EQ(kThreads * kInsertsPerThread, inserts.key_count());
+}
+
+}  // namespace ycsb
+}  // namespace leveldb
+
+int main(int argc, char** argv) { return leveldb::test::RunAllTests(); }